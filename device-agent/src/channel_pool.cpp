@@ -0,0 +1,9 @@
+#include "channel_pool.h"
+
+std::shared_ptr<grpc::Channel> ChannelPool::get(const std::string& address) {
+    auto& channel = channels_[address];
+    if (!channel) {
+        channel = grpc::CreateChannel(address, grpc::InsecureChannelCredentials());
+    }
+    return channel;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <grpcpp/grpcpp.h>
+
+// One gRPC channel per server endpoint, shared by the modules that talk to
+// it: modules pointed at the same address use a single TCP connection.
+class ChannelPool {
+public:
+    std::shared_ptr<grpc::Channel> get(const std::string& address);
+
+    size_t size() const { return channels_.size(); }
+
+private:
+    std::map<std::string, std::shared_ptr<grpc::Channel>> channels_;
+};
@@ -0,0 +1,49 @@
+#include "provisioning_module.h"
+#include <iostream>
+#include <sys/utsname.h>
+#include <unistd.h>
+#include "ConfigManager.h"
+
+ProvisioningModule::ProvisioningModule(std::shared_ptr<grpc::Channel> channel, const Options& options)
+    : options_(options),
+      client_(std::move(channel)) {
+    ConfigManager::setConfigPath(options_.config_path);
+}
+
+bool ProvisioningModule::ensureIdentity() {
+    if (ConfigManager::loadDeviceInfo(hostname_, device_id_) && !device_id_.empty()) {
+        std::cout << "Device identity: " << hostname_ << " (ID: " << device_id_ << ")" << std::endl;
+        if (!options_.password.empty() && !client_.Authenticate(hostname_, options_.password, jwt_token_)) {
+            // The identity stays usable, monitoring and OTA do not need the token
+            std::cerr << "Provisioning authentication failed for " << hostname_ << std::endl;
+        }
+        return true;
+    }
+
+    if (options_.password.empty()) {
+        std::cerr << "No device identity in " << options_.config_path
+                  << ", pass --password to register this device" << std::endl;
+        return false;
+    }
+    return registerDevice();
+}
+
+bool ProvisioningModule::registerDevice() {
+    char host[256] = {};
+    if (::gethostname(host, sizeof(host) - 1) != 0) {
+        std::cerr << "Unable to read the hostname" << std::endl;
+        return false;
+    }
+    struct utsname system{};
+    ::uname(&system);
+
+    int device_id = -1;
+    if (!client_.AddDevice(host, options_.password, options_.user, options_.location,
+                           system.machine, system.sysname, device_id, jwt_token_)) {
+        return false;
+    }
+    // AddDevice saved them through ConfigManager as well
+    hostname_ = host;
+    device_id_ = std::to_string(device_id);
+    return true;
+}
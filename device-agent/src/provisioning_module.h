@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <grpcpp/grpcpp.h>
+#include "ProvisionClientImpl.h"
+
+// Device identity shared by the other modules: hostname and device_id saved
+// by ConfigManager. A device without one registers itself first
+// (AddDevice, with the local hostname, machine and OS) when a password is
+// given; with an identity the password is used to authenticate.
+class ProvisioningModule {
+public:
+    struct Options {
+        std::string config_path = "../config/config.txt";
+        std::string password;               // empty: only use the saved identity
+        std::string user;
+        std::string location;
+    };
+
+    ProvisioningModule(std::shared_ptr<grpc::Channel> channel, const Options& options);
+
+    // Loads the saved identity, registering the device if there is none
+    bool ensureIdentity();
+
+    const std::string& hostname() const { return hostname_; }
+    const std::string& deviceId() const { return device_id_; }
+
+private:
+    Options options_;
+    ProvisioningClient client_;
+    std::string hostname_;
+    std::string device_id_;
+    std::string jwt_token_;
+
+    bool registerDevice();
+};
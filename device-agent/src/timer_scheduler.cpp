@@ -0,0 +1,35 @@
+#include "timer_scheduler.h"
+#include <algorithm>
+#include <iostream>
+
+void TimerScheduler::add(const std::string& name, Clock::time_point first_run, Task task) {
+    entries_.push_back({name, first_run, std::move(task)});
+}
+
+int TimerScheduler::run(const sigset_t& stop_signals) {
+    while (true) {
+        auto next = std::min_element(entries_.begin(), entries_.end(),
+                                     [](const Entry& a, const Entry& b) { return a.next_run < b.next_run; });
+        auto now = Clock::now();
+        if (next != entries_.end() && next->next_run <= now) {
+            try {
+                next->next_run = next->task();
+            } catch (const std::exception& e) {
+                std::cerr << "Error in " << next->name << ": " << e.what() << std::endl;
+                next->next_run = now + kRetryDelay;
+            }
+            // Pending stop signals are not left waiting behind a busy schedule
+            struct timespec poll{0, 0};
+            int signal = ::sigtimedwait(&stop_signals, nullptr, &poll);
+            if (signal > 0) return signal;
+            continue;
+        }
+
+        auto wait = next != entries_.end() ? next->next_run - now : std::chrono::hours(1);
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+        struct timespec timeout{static_cast<time_t>(nanos / 1000000000), static_cast<long>(nanos % 1000000000)};
+        int signal = ::sigtimedwait(&stop_signals, nullptr, &timeout);
+        if (signal > 0) return signal;
+        // EAGAIN: the earliest task is due; EINTR: another signal, wait again
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <csignal>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Periodic work of every agent module, run on one thread.
+//
+// Each task returns when it wants to run next. run() sleeps in sigtimedwait()
+// until the earliest task is due, so the stop signals are taken on the same
+// thread and no extra thread waits for them. Tasks run one at a time: a long
+// task (an OTA download) delays the others until it returns.
+class TimerScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Task = std::function<Clock::time_point()>;
+
+    void add(const std::string& name, Clock::time_point first_run, Task task);
+
+    // Runs the tasks on the calling thread until one of stop_signals arrives
+    // and returns that signal. The signals must be blocked in every thread.
+    int run(const sigset_t& stop_signals);
+
+private:
+    struct Entry {
+        std::string name;
+        Clock::time_point next_run;
+        Task task;
+    };
+
+    std::vector<Entry> entries_;
+
+    // Retry delay of a task that threw
+    static constexpr std::chrono::seconds kRetryDelay{60};
+};
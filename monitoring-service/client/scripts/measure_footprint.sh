@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# Footprint of an agent binary: stripped size, then resident memory after it
+# has run for a while. Used for the monitoring_test / monitoring_lite table
+# in the README.
+#
+#   ./measure_footprint.sh [--settle SECONDS] BINARY [ARGS...]
+#
+# Run it from the directory the agent normally starts in (client/build).
+
+SETTLE=60
+if [ "$1" = "--settle" ]; then
+    SETTLE="$2"
+    shift 2
+fi
+BINARY="$1"
+shift
+if [ ! -x "$BINARY" ]; then
+    echo "usage: $0 [--settle SECONDS] BINARY [ARGS...]" >&2
+    exit 1
+fi
+
+STRIPPED=$(mktemp)
+strip -o "$STRIPPED" "$BINARY"
+echo "binary:   $(stat -c %s "$BINARY") bytes, $(stat -c %s "$STRIPPED") stripped"
+rm -f "$STRIPPED"
+
+"$BINARY" "$@" > /dev/null 2>&1 &
+PID=$!
+sleep "$SETTLE"
+if ! kill -0 "$PID" 2> /dev/null; then
+    echo "$BINARY exited before the measurement" >&2
+    exit 1
+fi
+
+# RSS counts shared library pages in full, PSS splits them between their users
+awk '/^(VmRSS|VmHWM|Threads):/ {printf "%-9s %s %s\n", $1, $2, $3}' "/proc/$PID/status"
+awk '/^(Pss|Private_Dirty):/ {printf "%-9s %s %s\n", $1, $2, $3}' "/proc/$PID/smaps_rollup"
+
+kill -TERM "$PID"
+wait "$PID" 2> /dev/null
@@ -0,0 +1,255 @@
+#include "command_executor.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Read after the command exited: what it left in the pipe (64 KiB on Linux)
+constexpr size_t kExitDrainBytes = 64 * 1024;
+
+// Frees the spawn attributes however run() returns
+struct SpawnSetup {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+
+    SpawnSetup() {
+        posix_spawn_file_actions_init(&actions);
+        posix_spawnattr_init(&attr);
+    }
+    ~SpawnSetup() {
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attr);
+    }
+};
+
+} // namespace
+
+CommandExecutor::CommandExecutor() : CommandExecutor(Options{}) {
+}
+
+CommandExecutor::CommandExecutor(const Options& options) : options_(options) {
+    for (size_t i = 0; i < std::max<size_t>(options_.workers, 1); ++i) {
+        workers_.emplace_back(&CommandExecutor::work, this);
+    }
+}
+
+CommandExecutor::~CommandExecutor() {
+    stop();
+}
+
+bool CommandExecutor::submit(std::vector<std::string> commands, ResultHandler on_result) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || jobs_.size() >= options_.max_pending) {
+            return false;
+        }
+        jobs_.push_back(Job{std::move(commands), std::move(on_result), Clock::now()});
+    }
+    wakeup_.notify_one();
+    return true;
+}
+
+void CommandExecutor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_.exchange(true)) return;
+        jobs_.clear();
+    }
+    wakeup_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+std::vector<std::string> CommandExecutor::splitArguments(const std::string& command) {
+    std::vector<std::string> args;
+    std::string current;
+    bool in_word = false;
+    char quote = 0;
+    for (char c : command) {
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            } else {
+                current += c;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            in_word = true;
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            if (in_word) {
+                args.push_back(std::move(current));
+                current.clear();
+                in_word = false;
+            }
+        } else {
+            current += c;
+            in_word = true;
+        }
+    }
+    if (in_word) {
+        args.push_back(std::move(current));
+    }
+    return args;
+}
+
+void CommandExecutor::work() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wakeup_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+            if (stopping_) return;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        for (const auto& command : job.commands) {
+            if (stopping_) return;
+            Result result = run(command);
+            result.latency = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - job.submitted);
+            if (job.on_result) {
+                job.on_result(result);
+            }
+        }
+    }
+}
+
+CommandExecutor::Result CommandExecutor::run(const std::string& command) {
+    Result result;
+    result.command = command;
+
+    std::vector<std::string> args = splitArguments(command);
+    if (args.empty()) {
+        result.error = "empty command";
+        return result;
+    }
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        result.error = std::string("pipe: ") + std::strerror(errno);
+        return result;
+    }
+
+    // stdin from /dev/null, stdout and stderr into the pipe; own process
+    // group so a timeout kills whatever the command started too
+    SpawnSetup setup;
+    posix_spawn_file_actions_addopen(&setup.actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&setup.actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&setup.actions, fds[1], STDERR_FILENO);
+    sigset_t no_signals;
+    sigemptyset(&no_signals);
+    sigset_t default_signals;
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals, SIGPIPE);
+    sigaddset(&default_signals, SIGINT);
+    sigaddset(&default_signals, SIGTERM);
+    posix_spawnattr_setflags(&setup.attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&setup.attr, 0);
+    posix_spawnattr_setsigmask(&setup.attr, &no_signals);
+    posix_spawnattr_setsigdefault(&setup.attr, &default_signals);
+
+    auto start = Clock::now();
+    pid_t pid = 0;
+    int rc = posix_spawnp(&pid, argv[0], &setup.actions, &setup.attr, argv.data(), environ);
+    close(fds[1]);
+    if (rc != 0) {
+        close(fds[0]);
+        result.error = args[0] + ": " + std::strerror(rc);
+        return result;
+    }
+
+    if (options_.cpu_limit.count() > 0) {
+        // SIGXCPU at the soft limit, SIGKILL a second later
+        rlimit limit;
+        limit.rlim_cur = static_cast<rlim_t>(options_.cpu_limit.count());
+        limit.rlim_max = limit.rlim_cur + 1;
+        prlimit(pid, RLIMIT_CPU, &limit, nullptr);
+    }
+
+    supervise(pid, fds[0], result);
+    close(fds[0]);
+    result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+    return result;
+}
+
+void CommandExecutor::supervise(pid_t pid, int output_fd, Result& result) {
+    auto deadline = Clock::now() + options_.timeout;
+    char buffer[4096];
+    pollfd output{output_fd, POLLIN, 0};
+    bool output_open = true;
+    bool killed = false;
+    bool exited = false;
+    int status = 0;
+    size_t read_total = 0;
+
+    // Keeps the pipe drained past the cap so the command never blocks on it
+    auto readOutput = [&](int wait_ms) {
+        if (poll(&output, 1, wait_ms) <= 0) return false;
+        ssize_t got = read(output_fd, buffer, sizeof(buffer));
+        if (got < 0 && errno == EINTR) return true;
+        if (got <= 0) {
+            output_open = false;
+            return false;
+        }
+        read_total += static_cast<size_t>(got);
+        size_t room = options_.max_output - std::min(options_.max_output, result.output.size());
+        result.output.append(buffer, std::min(room, static_cast<size_t>(got)));
+        if (static_cast<size_t>(got) > room) {
+            result.output_truncated = true;
+        }
+        return true;
+    };
+
+    while (!exited) {
+        auto now = Clock::now();
+        if (!killed && (stopping_ || now >= deadline)) {
+            result.timed_out = !stopping_;
+            kill(-pid, SIGKILL);
+            killed = true;
+        }
+        if (output_open) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+            readOutput(killed ? 100 : static_cast<int>(std::clamp<int64_t>(remaining, 0, 100)));
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        pid_t reaped = waitpid(pid, &status, WNOHANG);
+        if (reaped == pid) {
+            exited = true;
+        } else if (reaped < 0 && errno != EINTR) {
+            result.error = std::string("waitpid: ") + std::strerror(errno);
+            return;
+        }
+    }
+    // What was written before the exit. A background child may hold the pipe
+    // open and keep writing, so stop at the output cap or one pipe's worth
+    size_t drain_limit = read_total + kExitDrainBytes;
+    while (output_open && !result.output_truncated && read_total < drain_limit && readOutput(0)) {
+    }
+
+    if (WIFEXITED(status)) {
+        result.exit_code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        result.signal = WTERMSIG(status);
+    }
+}
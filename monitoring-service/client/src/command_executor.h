@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+// Corrective command runner.
+//
+// Commands are split into arguments and started with posix_spawnp, without a
+// shell, on a small pool of worker threads so a slow command no longer holds up
+// the alerts behind it. Each command gets a wall-clock timeout (its process
+// group is killed), a CPU time limit (RLIMIT_CPU) and its stdout/stderr kept up
+// to a size cap.
+class CommandExecutor {
+public:
+    struct Options {
+        size_t workers = 2;
+        size_t max_pending = 32;                   // queued jobs, submit() fails beyond
+        std::chrono::milliseconds timeout{30000};  // wall clock, per command
+        std::chrono::seconds cpu_limit{10};        // per command, 0 = none
+        size_t max_output = 4096;                  // bytes of stdout+stderr kept
+    };
+
+    struct Result {
+        std::string command;
+        int exit_code = -1;                        // -1 unless the process exited
+        int signal = 0;                            // terminating signal, if any
+        bool timed_out = false;
+        std::chrono::milliseconds duration{0};     // spawn to exit
+        std::chrono::milliseconds latency{0};      // submit to exit, queueing included
+        std::string output;
+        bool output_truncated = false;
+        std::string error;                         // spawn failure
+    };
+
+    // Called on a worker thread after each command
+    using ResultHandler = std::function<void(const Result&)>;
+
+    CommandExecutor();
+    explicit CommandExecutor(const Options& options);
+    ~CommandExecutor();
+
+    CommandExecutor(const CommandExecutor&) = delete;
+    CommandExecutor& operator=(const CommandExecutor&) = delete;
+
+    // Run the commands one after the other on the same worker (later ones
+    // may depend on earlier ones); jobs run concurrently with each other.
+    // False when the queue is full or the executor is stopped.
+    bool submit(std::vector<std::string> commands, ResultHandler on_result);
+
+    // Kill running commands, drop queued ones and join the workers
+    void stop();
+
+    // Whitespace-separated arguments, single or double quotes group words
+    static std::vector<std::string> splitArguments(const std::string& command);
+
+private:
+    struct Job {
+        std::vector<std::string> commands;
+        ResultHandler on_result;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    Options options_;
+    std::vector<std::thread> workers_;
+    std::deque<Job> jobs_;
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::atomic<bool> stopping_{false};
+
+    void work();
+    Result run(const std::string& command);
+    // Read the output and reap the child, killing it at the deadline
+    void supervise(pid_t pid, int output_fd, Result& result);
+};
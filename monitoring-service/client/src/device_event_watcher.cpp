@@ -0,0 +1,336 @@
+#include "device_event_watcher.h"
+#include <chrono>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "proc_stats.h"
+
+namespace {
+
+// Lines requested by the agent itself show up in the line info changes too
+constexpr const char* kConsumer = "shadow_agent";
+
+int64_t nowMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// "Bus 001 Device 005: ID 0781:5567" from the uevent alone, once sysfs is gone
+std::string describeFromUevent(const std::map<std::string, std::string>& env) {
+    auto value = [&env](const char* key) {
+        auto it = env.find(key);
+        return it == env.end() ? std::string() : it->second;
+    };
+    // PRODUCT=vendor/product/bcdDevice, hex without leading zeros
+    std::string product = value("PRODUCT");
+    unsigned long vendor_id = std::strtoul(product.c_str(), nullptr, 16);
+    size_t slash = product.find('/');
+    unsigned long product_id = slash == std::string::npos ? 0 : std::strtoul(product.c_str() + slash + 1, nullptr, 16);
+
+    char line[64];
+    std::snprintf(line, sizeof(line), "Bus %03d Device %03d: ID %04lx:%04lx", std::atoi(value("BUSNUM").c_str()),
+                  std::atoi(value("DEVNUM").c_str()), vendor_id, product_id);
+    return line;
+}
+
+} // namespace
+
+DeviceEventWatcher::DeviceEventWatcher() : DeviceEventWatcher(Options{}) {
+}
+
+DeviceEventWatcher::DeviceEventWatcher(const Options& options) : options_(options) {
+}
+
+DeviceEventWatcher::~DeviceEventWatcher() {
+    stop();
+}
+
+bool DeviceEventWatcher::start(Handler handler) {
+    if (running_) return true;
+    handler_ = std::move(handler);
+
+    stop_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (stop_fd_ < 0) {
+        std::cerr << "Device events: eventfd failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    // Edge requests first, so the line info watches do not report them
+    openGpioChips();
+    if (!openUevents()) {
+        std::cerr << "Device events: no uevent socket (" << std::strerror(errno)
+                  << "), USB changes are only seen in samples" << std::endl;
+    }
+    if (uevent_fd_ < 0 && gpio_sources_.empty()) {
+        closeAll();
+        return false;
+    }
+
+    running_ = true;
+    thread_ = std::thread(&DeviceEventWatcher::run, this);
+    return true;
+}
+
+void DeviceEventWatcher::stop() {
+    if (!running_.exchange(false)) return;
+    uint64_t one = 1;
+    if (::write(stop_fd_, &one, sizeof(one)) < 0) {
+        // The counter cannot overflow with a single write, nothing to handle
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    closeAll();
+}
+
+const char* DeviceEventWatcher::kindName(Event::Kind kind) {
+    switch (kind) {
+        case Event::Kind::UsbAdded: return "usb_added";
+        case Event::Kind::UsbRemoved: return "usb_removed";
+        case Event::Kind::GpioChanged: return "gpio_changed";
+    }
+    return "unknown";
+}
+
+bool DeviceEventWatcher::openUevents() {
+    uevent_fd_ = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (uevent_fd_ < 0) return false;
+
+    // A hub with several devices behind it sends a burst of uevents
+    int buffer = 256 * 1024;
+    ::setsockopt(uevent_fd_, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+
+    struct sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;     // kernel uevents (udev rebroadcasts on group 2)
+    if (::bind(uevent_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(uevent_fd_);
+        uevent_fd_ = -1;
+        return false;
+    }
+
+    // Devices already plugged in, so their removal is reported with their name
+    std::string usb_root = options_.sysfs_root + "/bus/usb/devices";
+    if (DIR* dir = ::opendir(usb_root.c_str())) {
+        char resolved[PATH_MAX];
+        while (struct dirent* entry = ::readdir(dir)) {
+            if (entry->d_name[0] == '.' || std::strchr(entry->d_name, ':')) continue;
+            std::string link = usb_root + "/" + entry->d_name;
+            std::string line = proc_stats::describeUsbDevice(link);
+            if (line.empty() || !::realpath(link.c_str(), resolved)) continue;
+            // DEVPATH is relative to the sysfs mount
+            usb_devices_[std::string(resolved).substr(options_.sysfs_root.size())] = line;
+        }
+        ::closedir(dir);
+    }
+    return true;
+}
+
+void DeviceEventWatcher::openGpioChips() {
+    for (const auto& requested : options_.gpio_edge_lines) {
+        std::string path = options_.dev_dir + "/" + requested.chip;
+        int chip_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (chip_fd < 0) {
+            std::cerr << "Device events: cannot open " << path << ": " << std::strerror(errno) << std::endl;
+            continue;
+        }
+        struct gpio_v2_line_request request{};
+        request.offsets[0] = requested.line;
+        request.num_lines = 1;
+        std::strncpy(request.consumer, kConsumer, sizeof(request.consumer) - 1);
+        request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+        if (::ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request) != 0) {
+            std::cerr << "Device events: cannot request " << requested.chip << " line " << requested.line
+                      << " for edge events: " << std::strerror(errno) << std::endl;
+        } else {
+            ::fcntl(request.fd, F_SETFL, ::fcntl(request.fd, F_GETFL) | O_NONBLOCK);
+            gpio_sources_.push_back({request.fd, requested.chip, true});
+        }
+        ::close(chip_fd);
+    }
+
+    DIR* dir = ::opendir(options_.dev_dir.c_str());
+    if (!dir) return;
+    while (struct dirent* entry = ::readdir(dir)) {
+        if (std::strncmp(entry->d_name, "gpiochip", 8) != 0) continue;
+        std::string path = options_.dev_dir + "/" + entry->d_name;
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+        if (fd < 0) continue;
+
+        struct gpiochip_info chip{};
+        if (::ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &chip) != 0) {
+            ::close(fd);
+            continue;
+        }
+        uint32_t watched = 0;
+        for (uint32_t line = 0; line < chip.lines; ++line) {
+            struct gpio_v2_line_info info{};
+            info.offset = line;
+            if (::ioctl(fd, GPIO_V2_GET_LINEINFO_WATCH_IOCTL, &info) != 0) break;   // kernel < 5.10
+            ++watched;
+        }
+        if (watched == 0) {
+            ::close(fd);
+            continue;
+        }
+        gpio_sources_.push_back({fd, entry->d_name, false});
+    }
+    ::closedir(dir);
+}
+
+void DeviceEventWatcher::run() {
+    std::vector<struct pollfd> fds;
+    fds.push_back({stop_fd_, POLLIN, 0});
+    if (uevent_fd_ >= 0) {
+        fds.push_back({uevent_fd_, POLLIN, 0});
+    }
+    for (const auto& source : gpio_sources_) {
+        fds.push_back({source.fd, POLLIN, 0});
+    }
+    size_t first_gpio = fds.size() - gpio_sources_.size();
+
+    while (running_) {
+        // No timeout: the thread only wakes up for an event or stop()
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Device events: poll failed: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        if (fds[0].revents) break;
+        if (uevent_fd_ >= 0 && fds[1].revents) {
+            readUevents();
+        }
+        for (size_t i = first_gpio; i < fds.size(); ++i) {
+            if (!fds[i].revents) continue;
+            const GpioSource& source = gpio_sources_[i - first_gpio];
+            if (source.edges) {
+                readEdges(source);
+            } else {
+                readLineInfo(source);
+            }
+        }
+    }
+}
+
+void DeviceEventWatcher::readUevents() {
+    char buf[8192];
+    while (true) {
+        struct sockaddr_nl sender{};
+        socklen_t sender_len = sizeof(sender);
+        ssize_t len = ::recvfrom(uevent_fd_, buf, sizeof(buf) - 1, 0,
+                                 reinterpret_cast<struct sockaddr*>(&sender), &sender_len);
+        if (len < 0) {
+            if (errno == ENOBUFS) {
+                // Overrun: some add/remove may be lost, the caller rescans
+                handler_(Event{}, true);
+                continue;
+            }
+            return;     // EAGAIN, nothing left
+        }
+        if (sender.nl_pid != 0) continue;   // only the kernel sends on this group
+        buf[len] = '\0';
+
+        // "action@devpath" then NUL-separated KEY=VALUE pairs
+        std::map<std::string, std::string> env;
+        for (char* field = buf + std::strlen(buf) + 1; field < buf + len; field += std::strlen(field) + 1) {
+            char* equals = std::strchr(field, '=');
+            if (equals) env.emplace(std::string(field, equals), equals + 1);
+        }
+        if (env["SUBSYSTEM"] != "usb" || env["DEVTYPE"] != "usb_device") continue;
+
+        const std::string& action = env["ACTION"];
+        const std::string& devpath = env["DEVPATH"];
+        Event event;
+        event.timestamp_ms = nowMillis();
+        if (action == "add") {
+            event.kind = Event::Kind::UsbAdded;
+            event.usb_device = proc_stats::describeUsbDevice(options_.sysfs_root + devpath);
+            if (event.usb_device.empty()) event.usb_device = describeFromUevent(env);
+            usb_devices_[devpath] = event.usb_device;
+        } else if (action == "remove") {
+            event.kind = Event::Kind::UsbRemoved;
+            auto known = usb_devices_.find(devpath);
+            if (known != usb_devices_.end()) {
+                event.usb_device = known->second;
+                usb_devices_.erase(known);
+            } else {
+                event.usb_device = describeFromUevent(env);
+            }
+        } else {
+            continue;   // bind, unbind, change: the device list is the same
+        }
+        handler_(event, false);
+    }
+}
+
+void DeviceEventWatcher::readLineInfo(const GpioSource& source) {
+    struct gpio_v2_line_info_changed changes[16];
+    while (true) {
+        ssize_t len = ::read(source.fd, changes, sizeof(changes));
+        if (len <= 0) return;
+        for (size_t i = 0; i < static_cast<size_t>(len) / sizeof(changes[0]); ++i) {
+            const auto& change = changes[i];
+            if (std::strncmp(change.info.consumer, kConsumer, sizeof(change.info.consumer)) == 0) continue;
+
+            Event event;
+            event.kind = Event::Kind::GpioChanged;
+            event.timestamp_ms = nowMillis();
+            event.gpio_chip = source.chip;
+            event.gpio_line = change.info.offset;
+            switch (change.event_type) {
+                case GPIO_V2_LINE_CHANGED_REQUESTED: event.gpio_change = "requested"; break;
+                case GPIO_V2_LINE_CHANGED_RELEASED: event.gpio_change = "released"; break;
+                default: event.gpio_change = "reconfigured"; break;
+            }
+            handler_(event, false);
+        }
+    }
+}
+
+void DeviceEventWatcher::readEdges(const GpioSource& source) {
+    // A bouncing input queues many edges, only the last one is reported
+    struct gpio_v2_line_event edges[16];
+    struct gpio_v2_line_event last{};
+    bool seen = false;
+    ssize_t len;
+    while ((len = ::read(source.fd, edges, sizeof(edges))) >= static_cast<ssize_t>(sizeof(edges[0]))) {
+        last = edges[static_cast<size_t>(len) / sizeof(edges[0]) - 1];
+        seen = true;
+    }
+    if (!seen) return;
+
+    Event event;
+    event.kind = Event::Kind::GpioChanged;
+    event.timestamp_ms = nowMillis();
+    event.gpio_chip = source.chip;
+    event.gpio_line = last.offset;
+    event.gpio_change = last.id == GPIO_V2_LINE_EVENT_RISING_EDGE ? "rising" : "falling";
+    handler_(event, false);
+}
+
+void DeviceEventWatcher::closeAll() {
+    for (auto& source : gpio_sources_) {
+        ::close(source.fd);
+    }
+    gpio_sources_.clear();
+    if (uevent_fd_ >= 0) {
+        ::close(uevent_fd_);
+        uevent_fd_ = -1;
+    }
+    if (stop_fd_ >= 0) {
+        ::close(stop_fd_);
+        stop_fd_ = -1;
+    }
+    usb_devices_.clear();
+}
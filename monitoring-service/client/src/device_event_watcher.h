@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// USB hotplug and GPIO changes as they happen.
+//
+// One thread blocks in poll() on a NETLINK_KOBJECT_UEVENT socket (USB devices
+// added or removed) and on the gpiochip character devices: line info changes
+// (a line requested, released or reconfigured, e.g. exported through sysfs)
+// for every line of every chip, and edge events for the lines listed in
+// Options::gpio_edge_lines, requested as inputs. Nothing is polled on a timer,
+// an idle device costs no CPU.
+class DeviceEventWatcher {
+public:
+    struct GpioLine {
+        std::string chip;                       // "gpiochip0"
+        uint32_t line = 0;
+    };
+
+    struct Options {
+        std::vector<GpioLine> gpio_edge_lines;  // requested by the agent, rising and falling edges
+        std::string dev_dir = "/dev";
+        std::string sysfs_root = "/sys";
+    };
+
+    struct Event {
+        enum class Kind { UsbAdded, UsbRemoved, GpioChanged };
+        Kind kind = Kind::UsbAdded;
+        int64_t timestamp_ms = 0;               // wall clock
+        std::string usb_device;                 // lsusb-style line
+        std::string gpio_chip;
+        uint32_t gpio_line = 0;
+        std::string gpio_change;                // rising, falling, requested, released, reconfigured
+    };
+
+    // Called on the watcher thread. resync is set instead of an event when
+    // uevents were lost (socket buffer overrun): rescan the USB devices.
+    using Handler = std::function<void(const Event& event, bool resync)>;
+
+    DeviceEventWatcher();
+    explicit DeviceEventWatcher(const Options& options);
+    ~DeviceEventWatcher();
+
+    DeviceEventWatcher(const DeviceEventWatcher&) = delete;
+    DeviceEventWatcher& operator=(const DeviceEventWatcher&) = delete;
+
+    // False when neither the uevent socket nor any gpiochip could be opened
+    bool start(Handler handler);
+    void stop();
+
+    bool watchesUsb() const { return uevent_fd_ >= 0; }
+
+    static const char* kindName(Event::Kind kind);
+
+private:
+    // A gpiochip fd (line info changes) or a line request fd (edge events)
+    struct GpioSource {
+        int fd = -1;
+        std::string chip;
+        bool edges = false;
+    };
+
+    Options options_;
+    Handler handler_;
+    int uevent_fd_ = -1;
+    int stop_fd_ = -1;                          // eventfd, wakes the thread up on stop()
+    std::vector<GpioSource> gpio_sources_;
+    std::map<std::string, std::string> usb_devices_;   // DEVPATH -> line, for removals
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+
+    bool openUevents();
+    void openGpioChips();
+    void run();
+    void readUevents();
+    void readLineInfo(const GpioSource& source);
+    void readEdges(const GpioSource& source);
+    void closeAll();
+};
@@ -0,0 +1,67 @@
+#include "inventory_tracker.h"
+
+namespace {
+
+// Entries of current that are new or differ from previous, and keys of
+// previous missing from current
+void diffMaps(const std::map<std::string, std::string>& previous,
+              const std::map<std::string, std::string>& current,
+              std::vector<std::pair<std::string, std::string>>& changed,
+              std::vector<std::string>& removed) {
+    auto prev = previous.begin();
+    auto curr = current.begin();
+    while (prev != previous.end() || curr != current.end()) {
+        if (curr == current.end() || (prev != previous.end() && prev->first < curr->first)) {
+            removed.push_back(prev->first);
+            ++prev;
+        } else if (prev == previous.end() || curr->first < prev->first) {
+            changed.emplace_back(curr->first, curr->second);
+            ++curr;
+        } else {
+            if (prev->second != curr->second) {
+                changed.emplace_back(curr->first, curr->second);
+            }
+            ++prev;
+            ++curr;
+        }
+    }
+}
+
+} // namespace
+
+InventoryTracker::InventoryTracker(std::chrono::seconds snapshot_interval)
+    : snapshot_interval_(snapshot_interval), snapshot_requested_(true), sequence_(0) {
+}
+
+InventoryTracker::Update InventoryTracker::next(const std::map<std::string, std::string>& services,
+                                                const std::vector<std::pair<std::string, std::string>>& applications) {
+    std::map<std::string, std::string> current_apps(applications.begin(), applications.end());
+    auto now = std::chrono::steady_clock::now();
+
+    Update update;
+    update.sequence = ++sequence_;
+    update.snapshot = snapshot_requested_.exchange(false) || now - last_snapshot_ >= snapshot_interval_;
+
+    if (update.snapshot) {
+        update.services = services;
+        update.applications = applications;
+        last_snapshot_ = now;
+    } else {
+        std::vector<std::pair<std::string, std::string>> changed_services;
+        diffMaps(services_, services, changed_services, update.removed_services);
+        update.services.insert(changed_services.begin(), changed_services.end());
+        diffMaps(applications_, current_apps, update.applications, update.removed_applications);
+    }
+
+    services_ = services;
+    applications_ = std::move(current_apps);
+    return update;
+}
+
+void InventoryTracker::requestSnapshot() {
+    snapshot_requested_ = true;
+}
+
+void InventoryTracker::setSnapshotInterval(std::chrono::seconds interval) {
+    snapshot_interval_ = interval;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Delta encoding of the software inventory (services and applications).
+//
+// Every software sample gets the next inventory sequence number. A full
+// snapshot is sent on the first sample, periodically, and whenever the server
+// asks for one; in between only the entries added, changed or removed since
+// the previous sample are sent. The server applies a delta only on top of the
+// sequence number right before it, and requests a snapshot on a gap.
+class InventoryTracker {
+public:
+    struct Update {
+        bool snapshot = true;
+        uint64_t sequence = 0;
+        // Full inventory for a snapshot, added or changed entries for a delta
+        std::map<std::string, std::string> services;
+        std::vector<std::pair<std::string, std::string>> applications;
+        std::vector<std::string> removed_services;
+        std::vector<std::string> removed_applications;
+    };
+
+    explicit InventoryTracker(std::chrono::seconds snapshot_interval = std::chrono::hours(1));
+
+    // Encode the inventory of the next sample
+    Update next(const std::map<std::string, std::string>& services,
+                const std::vector<std::pair<std::string, std::string>>& applications);
+
+    // Send a full snapshot with the next sample (safe to call from any thread)
+    void requestSnapshot();
+
+    void setSnapshotInterval(std::chrono::seconds interval);
+
+private:
+    std::chrono::seconds snapshot_interval_;
+    std::chrono::steady_clock::time_point last_snapshot_;
+    std::atomic<bool> snapshot_requested_;
+    uint64_t sequence_;
+
+    // Inventory as of the last sample
+    std::map<std::string, std::string> services_;
+    std::map<std::string, std::string> applications_;   // name -> version
+};
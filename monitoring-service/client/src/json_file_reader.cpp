@@ -0,0 +1,217 @@
+#include "json_file_reader.h"
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open JSON file: " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Failed to stat JSON file: " + path);
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size >= kMapThreshold) {
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Failed to map JSON file: " + path);
+        }
+        data_ = static_cast<const char*>(mapping);
+        size_ = size;
+        mapped_ = true;
+    } else if (size > 0) {
+        buffer_.resize(size);
+        ssize_t got = pread(fd, &buffer_[0], size, 0);
+        if (got < 0) {
+            close(fd);
+            throw std::runtime_error("Failed to read JSON file: " + path);
+        }
+        buffer_.resize(static_cast<size_t>(got));
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+    }
+    // A mapping stays valid without the descriptor
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (mapped_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+JsonCursor::JsonCursor(std::string_view input)
+    : begin_(input.data()), pos_(input.data()), end_(input.data() + input.size()) {
+}
+
+JsonCursor::Type JsonCursor::peek() {
+    skipWhitespace();
+    if (pos_ == end_) fail("unexpected end");
+    switch (*pos_) {
+        case '{': return Type::Object;
+        case '[': return Type::Array;
+        case '"': return Type::String;
+        case 't':
+        case 'f': return Type::Bool;
+        case 'n': return Type::Null;
+        default:
+            if (*pos_ == '-' || (*pos_ >= '0' && *pos_ <= '9')) return Type::Number;
+            fail("unexpected character");
+    }
+}
+
+void JsonCursor::readString(std::string& out) {
+    expect('"');
+    out.clear();
+    while (true) {
+        const char* run = pos_;
+        while (pos_ < end_ && *pos_ != '"' && *pos_ != '\\') ++pos_;
+        out.append(run, pos_ - run);
+        if (pos_ == end_) fail("unterminated string");
+        if (*pos_++ == '"') return;
+
+        if (pos_ == end_) fail("unterminated escape");
+        char escaped = *pos_++;
+        switch (escaped) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                auto hex4 = [this]() {
+                    if (end_ - pos_ < 4) fail("short \\u escape");
+                    uint32_t value = 0;
+                    auto result = std::from_chars(pos_, pos_ + 4, value, 16);
+                    if (result.ptr != pos_ + 4) fail("bad \\u escape");
+                    pos_ += 4;
+                    return value;
+                };
+                uint32_t code = hex4();
+                if (code >= 0xD800 && code < 0xDC00 && end_ - pos_ >= 6 && pos_[0] == '\\' && pos_[1] == 'u') {
+                    pos_ += 2;
+                    uint32_t low = hex4();
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                // UTF-8
+                if (code < 0x80) {
+                    out += static_cast<char>(code);
+                } else if (code < 0x800) {
+                    out += static_cast<char>(0xC0 | (code >> 6));
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                } else if (code < 0x10000) {
+                    out += static_cast<char>(0xE0 | (code >> 12));
+                    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                } else {
+                    out += static_cast<char>(0xF0 | (code >> 18));
+                    out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                fail("bad escape");
+        }
+    }
+}
+
+int64_t JsonCursor::readInt() {
+    skipWhitespace();
+    bool quoted = consume('"');
+    int64_t value = 0;
+    auto result = std::from_chars(pos_, end_, value);
+    if (result.ec != std::errc()) fail("expected an integer");
+    pos_ = result.ptr;
+    // Fraction or exponent: truncated
+    while (pos_ < end_ && std::strchr("0123456789.eE+-", *pos_) && *pos_ != '\0') ++pos_;
+    if (quoted) expect('"');
+    return value;
+}
+
+void JsonCursor::skipValue() {
+    switch (peek()) {
+        case Type::Object:
+            forEachMember([](std::string_view) {});
+            break;
+        case Type::Array:
+            forEachElement([]() {});
+            break;
+        case Type::String:
+            skipString();
+            break;
+        case Type::Bool:
+        case Type::Null: {
+            size_t length = *pos_ == 'f' ? 5 : 4;
+            const char* literal = *pos_ == 't' ? "true" : *pos_ == 'f' ? "false" : "null";
+            if (static_cast<size_t>(end_ - pos_) < length || std::memcmp(pos_, literal, length) != 0) {
+                fail("bad literal");
+            }
+            pos_ += length;
+            break;
+        }
+        case Type::Number:
+            ++pos_;
+            while (pos_ < end_ && std::strchr("0123456789.eE+-", *pos_) && *pos_ != '\0') ++pos_;
+            break;
+    }
+}
+
+void JsonCursor::expectEnd() {
+    skipWhitespace();
+    if (pos_ != end_) fail("trailing characters");
+}
+
+void JsonCursor::skipWhitespace() {
+    while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t')) ++pos_;
+}
+
+void JsonCursor::expect(char c) {
+    if (!consume(c)) {
+        char what[] = "expected ' '";
+        what[10] = c;
+        fail(what);
+    }
+}
+
+bool JsonCursor::consume(char c) {
+    skipWhitespace();
+    if (pos_ < end_ && *pos_ == c) {
+        ++pos_;
+        return true;
+    }
+    return false;
+}
+
+std::string_view JsonCursor::rawKey() {
+    skipWhitespace();
+    const char* start = pos_ + 1;
+    skipString();
+    return std::string_view(start, pos_ - 1 - start);
+}
+
+void JsonCursor::skipString() {
+    expect('"');
+    while (pos_ < end_ && *pos_ != '"') {
+        pos_ += *pos_ == '\\' ? 2 : 1;
+    }
+    if (pos_ >= end_) fail("unterminated string");
+    ++pos_;
+}
+
+void JsonCursor::fail(const char* what) const {
+    throw std::runtime_error(std::string("Failed to parse JSON: ") + what + " at offset " +
+                             std::to_string(pos_ - begin_));
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole file; throws std::runtime_error if it cannot be opened.
+// Files from kMapThreshold up are mmapped. Smaller ones (the script's files are a
+// few hundred bytes) are read with one pread, which is cheaper than the
+// mmap/munmap and page fault.
+class MappedFile {
+public:
+    static constexpr size_t kMapThreshold = 64 * 1024;
+
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view data() const { return {data_, size_}; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::string buffer_;   // small files
+};
+
+// On-demand JSON reader for the collect_metrics.sh files.
+//
+// Walks the text once without building a DOM: the caller visits the members
+// it knows and everything else is skipped. Keys are views into the input, and
+// strings are only copied into the caller's std::string, escapes decoded on
+// the way. Raw control characters inside strings are accepted, because the
+// script writes values such as a hostname with a trailing newline verbatim.
+// Malformed input throws std::runtime_error.
+class JsonCursor {
+public:
+    enum class Type { Object, Array, String, Number, Bool, Null };
+
+    explicit JsonCursor(std::string_view input);
+
+    Type peek();
+
+    // Visit each member of the object at the cursor. The callback gets the
+    // raw key with the cursor on the value; a value it does not read is skipped.
+    template <typename Visitor>
+    void forEachMember(Visitor&& visit);
+
+    // Same for the elements of an array
+    template <typename Visitor>
+    void forEachElement(Visitor&& visit);
+
+    void readString(std::string& out);
+    int64_t readInt();          // also accepts a quoted integer
+    void skipValue();
+
+    // Nothing but whitespace left
+    void expectEnd();
+
+private:
+    const char* begin_;
+    const char* pos_;
+    const char* end_;
+
+    void skipWhitespace();
+    void expect(char c);
+    bool consume(char c);
+    std::string_view rawKey();
+    void skipString();
+    [[noreturn]] void fail(const char* what) const;
+};
+
+template <typename Visitor>
+void JsonCursor::forEachMember(Visitor&& visit) {
+    expect('{');
+    if (consume('}')) return;
+    do {
+        std::string_view key = rawKey();
+        expect(':');
+        skipWhitespace();
+        const char* value_start = pos_;
+        visit(key);
+        if (pos_ == value_start) {
+            skipValue();
+        }
+    } while (consume(','));
+    expect('}');
+}
+
+template <typename Visitor>
+void JsonCursor::forEachElement(Visitor&& visit) {
+    expect('[');
+    if (consume(']')) return;
+    do {
+        skipWhitespace();
+        const char* value_start = pos_;
+        visit();
+        if (pos_ == value_start) {
+            skipValue();
+        }
+    } while (consume(','));
+    expect(']');
+}
@@ -0,0 +1,170 @@
+#include "lite_agent.h"
+#include "proc_stats.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+volatile std::sig_atomic_t g_stop = 0;
+
+// Static, like everything the agent holds on to
+SampleRing g_ring;
+LiteSample g_sample;
+uint8_t g_scratch[sizeof(EncodedSample::data)];
+char g_device_id[64];
+
+void onSignal(int) {
+    g_stop = 1;
+}
+
+// VmRSS from /proc/self/status, 0 if unknown
+uint32_t residentKb() {
+    char buf[2048];
+    if (proc_stats::readFile("/proc/self/status", buf, sizeof(buf)) <= 0) return 0;
+    const char* line = std::strstr(buf, "VmRSS:");
+    return line ? static_cast<uint32_t>(std::strtoul(line + 6, nullptr, 10)) : 0;
+}
+
+// First line of the same config file the full agent reads
+void loadDeviceId(const char* path) {
+    char buf[sizeof(g_device_id)];
+    g_device_id[0] = '\0';
+    if (proc_stats::readFile(path, buf, sizeof(buf)) <= 0) return;
+    buf[std::strcspn(buf, "\r\n")] = '\0';
+    std::snprintf(g_device_id, sizeof(g_device_id), "%s", buf);
+}
+
+} // namespace
+
+EncodedSample& SampleRing::push() {
+    if (count_ == LITE_SAMPLE_SLOTS) {
+        pop();
+        ++dropped_;
+    }
+    EncodedSample& slot = slots_[(head_ + count_) % LITE_SAMPLE_SLOTS];
+    ++count_;
+    slot.tag = 0;
+    slot.size = 0;
+    return slot;
+}
+
+void SampleRing::pop() {
+    if (count_ == 0) return;
+    head_ = (head_ + 1) % LITE_SAMPLE_SLOTS;
+    --count_;
+}
+
+void SampleRing::resetTags() {
+    for (size_t i = 0; i < count_; ++i) {
+        at(i).tag = 0;
+    }
+}
+
+void liteLog(const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    std::fprintf(stderr, "%s\n", line);
+}
+
+int main(int argc, char** argv) {
+    LiteConfig config;
+    loadDeviceId("../../client/config/config.txt");
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value) {
+            liteLog("Missing value for %s", arg);
+            return 1;
+        }
+        if (std::strcmp(arg, "--device-id") == 0) {
+            std::snprintf(g_device_id, sizeof(g_device_id), "%s", value);
+        } else if (std::strcmp(arg, "--interval") == 0) {
+            // Seconds between samples; the server closes sessions idle for 180 s
+            config.interval_seconds = std::clamp<uint32_t>(std::strtoul(value, nullptr, 10), 1, 120);
+        } else if (std::strcmp(arg, "--rss-budget") == 0) {
+            config.rss_budget_kb = std::strtoul(value, nullptr, 10);
+        } else if (std::strcmp(arg, "--server") == 0) {
+            config.server_address = value;
+        } else if (std::strcmp(arg, "--amqp-host") == 0) {
+            config.amqp_host = value;
+        } else if (std::strcmp(arg, "--amqp-port") == 0) {
+            config.amqp_port = std::atoi(value);
+        } else {
+            liteLog("Unknown option: %s", arg);
+            return 1;
+        }
+        ++i;
+    }
+    if (g_device_id[0] == '\0') {
+        liteLog("No device ID: pass --device-id or fill client/config/config.txt");
+        return 1;
+    }
+    config.device_id = g_device_id;
+
+#ifdef __GLIBC__
+    // Threads started by the transport libraries would each get a malloc arena
+    mallopt(M_ARENA_MAX, 1);
+#endif
+
+    struct sigaction action{};
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    lite_sampler::init(config.device_id);
+    lite_transport::init(config);
+    liteLog("monitoring_lite %s for device %s, sample every %u s, RSS budget %u kB", lite_transport::name(),
+            config.device_id, config.interval_seconds, config.rss_budget_kb);
+
+    const auto interval = std::chrono::seconds(config.interval_seconds);
+    auto next_sample = Clock::now();
+    int exit_code = 0;
+    while (!g_stop) {
+        auto now = Clock::now();
+        if (now >= next_sample) {
+            lite_sampler::sample(g_sample);
+            size_t size = lite_sampler::encode(g_sample, g_scratch, sizeof(g_scratch));
+            if (size > 0) {
+                EncodedSample& slot = g_ring.push();
+                std::memcpy(slot.data, g_scratch, size);
+                slot.size = static_cast<uint16_t>(size);
+            }
+            // Skip the samples missed while suspended instead of bursting them
+            next_sample += interval;
+            if (next_sample <= now) {
+                next_sample = now + interval;
+            }
+
+            uint32_t rss = residentKb();
+            liteLog("Sample %s: cpu %s, memory %s, disk %s; %zu queued, %llu dropped, RSS %u kB",
+                    g_sample.readable_date, g_sample.cpu_usage, g_sample.memory_usage, g_sample.disk_usage_root,
+                    g_ring.size(), static_cast<unsigned long long>(g_ring.dropped()), rss);
+            if (config.rss_budget_kb > 0 && rss > config.rss_budget_kb) {
+                liteLog("RSS %u kB over the %u kB budget, exiting", rss, config.rss_budget_kb);
+                exit_code = 2;
+                break;
+            }
+        }
+
+        // Wake at least once a second to notice a stop signal
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_sample - Clock::now()).count();
+        lite_transport::run(g_ring, static_cast<int>(std::clamp<int64_t>(wait, 0, 1000)));
+    }
+
+    lite_transport::shutdown();
+    return exit_code;
+}
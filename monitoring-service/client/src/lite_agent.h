@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Minimal-footprint agent (monitoring_lite) for devices with little RAM.
+//
+// Hardware samples only, taken into preallocated static buffers and kept
+// protobuf-encoded in a fixed ring until the transport delivers them. One
+// event thread samples and drives the transport; no iostreams, and no heap
+// allocation on the sampling path. The transport is chosen at build time
+// (LITE_TRANSPORT in CMake), only its source file is compiled in.
+
+// Samples kept while the server is unreachable, the oldest is dropped beyond
+#ifndef LITE_SAMPLE_SLOTS
+#define LITE_SAMPLE_SLOTS 64
+#endif
+
+// The agent exits (for its supervisor to restart it) above this resident
+// size; CMake sets it per transport
+#ifndef LITE_RSS_BUDGET_KB
+#define LITE_RSS_BUDGET_KB 8192
+#endif
+
+struct LiteConfig {
+    const char* device_id = "";
+    const char* amqp_host = "localhost";
+    int amqp_port = 5672;
+    const char* amqp_user = "guest";
+    const char* amqp_password = "guest";
+    const char* hardware_queue = "hardware_metrics";
+    const char* server_address = "localhost:50051";
+    uint32_t interval_seconds = 60;
+    uint32_t rss_budget_kb = LITE_RSS_BUDGET_KB;
+};
+
+// One hardware sample, fields truncated to their buffers
+struct LiteSample {
+    char readable_date[24];
+    char cpu_usage[12];
+    char memory_usage[12];
+    char disk_usage_root[8];
+    char usb_devices[192];
+    int32_t gpio_state;
+};
+
+// Encoded monitoring.HardwareMetrics waiting for delivery
+struct EncodedSample {
+    uint64_t tag;           // transport delivery tag, 0 = not sent on the current connection
+    uint16_t size;
+    uint8_t data[512];
+};
+
+class SampleRing {
+public:
+    // Slot for a new sample, overwriting the oldest when full
+    EncodedSample& push();
+    void pop();             // drop the oldest
+
+    size_t size() const { return count_; }
+    EncodedSample& at(size_t index) { return slots_[(head_ + index) % LITE_SAMPLE_SLOTS]; }
+    uint64_t dropped() const { return dropped_; }
+
+    // Connection lost: everything unacknowledged is sent again
+    void resetTags();
+
+private:
+    EncodedSample slots_[LITE_SAMPLE_SLOTS];
+    size_t head_ = 0;
+    size_t count_ = 0;
+    uint64_t dropped_ = 0;
+};
+
+// printf-style line on stderr
+void liteLog(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+namespace lite_sampler {
+
+// Kernel version and board model, read once
+void init(const char* device_id);
+
+void sample(LiteSample& out);
+
+// monitoring.HardwareMetrics wire format, 0 if it does not fit
+size_t encode(const LiteSample& sample, uint8_t* out, size_t capacity);
+
+} // namespace lite_sampler
+
+// Implemented by lite_transport_amqp.cpp or lite_transport_grpc.cpp
+namespace lite_transport {
+
+const char* name();
+
+void init(const LiteConfig& config);
+
+// Send what the ring holds and wait up to timeout_ms for the connection
+// (acks, server messages); samples leave the ring once delivered.
+// Reconnects with backoff when the connection is down.
+void run(SampleRing& ring, int timeout_ms);
+
+void shutdown();
+
+} // namespace lite_transport
@@ -0,0 +1,211 @@
+#include "lite_agent.h"
+#include "proc_stats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <sys/utsname.h>
+
+namespace lite_sampler {
+
+namespace {
+
+char device_id_[64];
+char kernel_version_[65];  // utsname release
+char hardware_model_[64];
+proc_stats::CpuTicks last_cpu_ticks_;
+
+void copyTrimmed(char* out, size_t size, const char* in) {
+    while (*in == ' ' || *in == '\t') ++in;
+    std::snprintf(out, size, "%s", in);
+    size_t len = std::strlen(out);
+    while (len > 0 && (out[len - 1] == '\n' || out[len - 1] == ' ')) {
+        out[--len] = '\0';
+    }
+}
+
+// Sysfs attribute without its newline, empty if missing
+void readAttribute(const char* dir, const char* name, char* out, size_t size) {
+    char path[320];
+    std::snprintf(path, sizeof(path), "%s/%s", dir, name);
+    char buf[64];
+    if (proc_stats::readFile(path, buf, sizeof(buf)) <= 0) {
+        out[0] = '\0';
+        return;
+    }
+    copyTrimmed(out, size, buf);
+}
+
+// "Bus 001 Device 002: ID 0781:5567 | ..." as in the full agent, without
+// the manufacturer and product strings; "none" without devices
+void readUsbDevices(char* out, size_t size) {
+    size_t used = 0;
+    out[0] = '\0';
+    if (DIR* dir = ::opendir("/sys/bus/usb/devices")) {
+        while (struct dirent* entry = ::readdir(dir)) {
+            if (entry->d_name[0] == '.' || std::strchr(entry->d_name, ':')) continue;
+
+            char device_dir[288];
+            std::snprintf(device_dir, sizeof(device_dir), "/sys/bus/usb/devices/%s", entry->d_name);
+            char vendor[8], product[8], bus[8], dev[8];
+            readAttribute(device_dir, "idVendor", vendor, sizeof(vendor));
+            if (vendor[0] == '\0') continue;
+            readAttribute(device_dir, "idProduct", product, sizeof(product));
+            readAttribute(device_dir, "busnum", bus, sizeof(bus));
+            readAttribute(device_dir, "devnum", dev, sizeof(dev));
+
+            int written = std::snprintf(out + used, size - used, "%sBus %03d Device %03d: ID %s:%s",
+                                        used ? " | " : "", std::atoi(bus), std::atoi(dev), vendor, product);
+            if (written < 0 || static_cast<size_t>(written) >= size - used) {
+                out[used] = '\0';   // keep whole entries only
+                break;
+            }
+            used += static_cast<size_t>(written);
+        }
+        ::closedir(dir);
+    }
+    if (used == 0) {
+        std::snprintf(out, size, "none");
+    }
+}
+
+// Exported GPIO lines driven high, like the full agent
+int32_t readGpioState() {
+    int32_t active = 0;
+    DIR* dir = ::opendir("/sys/class/gpio");
+    if (!dir) return 0;
+    while (struct dirent* entry = ::readdir(dir)) {
+        if (std::strncmp(entry->d_name, "gpio", 4) != 0 || std::strncmp(entry->d_name, "gpiochip", 8) == 0) continue;
+        char path[288];
+        std::snprintf(path, sizeof(path), "/sys/class/gpio/%s/value", entry->d_name);
+        char buf[8];
+        if (proc_stats::readFile(path, buf, sizeof(buf)) > 0 && buf[0] == '1') {
+            ++active;
+        }
+    }
+    ::closedir(dir);
+    return active;
+}
+
+// Protobuf wire format, writing nothing once the buffer is full
+struct Writer {
+    uint8_t* out;
+    size_t capacity;
+    size_t used = 0;
+    bool overflow = false;
+
+    void byte(uint8_t value) {
+        if (used < capacity) {
+            out[used++] = value;
+        } else {
+            overflow = true;
+        }
+    }
+
+    void varint(uint64_t value) {
+        while (value >= 0x80) {
+            byte(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        byte(static_cast<uint8_t>(value));
+    }
+
+    void string(uint32_t field, const char* value) {
+        size_t len = std::strlen(value);
+        if (len == 0) return;
+        varint((field << 3) | 2);
+        varint(len);
+        if (len > capacity - std::min(capacity, used)) {
+            overflow = true;
+            return;
+        }
+        std::memcpy(out + used, value, len);
+        used += len;
+    }
+
+    void int32(uint32_t field, int32_t value) {
+        if (value == 0) return;
+        varint(field << 3);
+        varint(static_cast<uint64_t>(static_cast<int64_t>(value)));
+    }
+};
+
+} // namespace
+
+void init(const char* device_id) {
+    std::snprintf(device_id_, sizeof(device_id_), "%s", device_id);
+
+    struct utsname uts;
+    std::snprintf(kernel_version_, sizeof(kernel_version_), "%s", ::uname(&uts) == 0 ? uts.release : "unknown");
+
+    // RPi exposes "Model" in /proc/cpuinfo, other boards in the device tree
+    hardware_model_[0] = '\0';
+    static char cpuinfo[8192];
+    if (proc_stats::readFile("/proc/cpuinfo", cpuinfo, sizeof(cpuinfo)) > 0) {
+        char* line = std::strncmp(cpuinfo, "Model", 5) == 0 ? cpuinfo : std::strstr(cpuinfo, "\nModel");
+        char* colon = line ? std::strchr(line + 1, ':') : nullptr;
+        if (colon) {
+            if (char* end = std::strchr(colon, '\n')) *end = '\0';
+            copyTrimmed(hardware_model_, sizeof(hardware_model_), colon + 1);
+        }
+    }
+    if (hardware_model_[0] == '\0') {
+        char buf[64];
+        if (proc_stats::readFile("/proc/device-tree/model", buf, sizeof(buf)) > 0) {
+            copyTrimmed(hardware_model_, sizeof(hardware_model_), buf);
+        }
+    }
+}
+
+void sample(LiteSample& out) {
+    std::time_t now = std::time(nullptr);
+    std::tm tm_now{};
+    localtime_r(&now, &tm_now);
+    std::strftime(out.readable_date, sizeof(out.readable_date), "%Y-%m-%d_%H-%M-%S", &tm_now);
+
+    proc_stats::CpuTicks ticks;
+    out.cpu_usage[0] = '\0';
+    if (proc_stats::readCpuTicks(ticks)) {
+        // The first sample has no baseline, it gets the average since boot
+        double usage = last_cpu_ticks_.total > 0 ? proc_stats::cpuUsagePercent(last_cpu_ticks_, ticks)
+                                                 : static_cast<double>(ticks.busy) * 100.0 / static_cast<double>(ticks.total);
+        std::snprintf(out.cpu_usage, sizeof(out.cpu_usage), "%.1f%%", usage);
+        last_cpu_ticks_ = ticks;
+    }
+
+    proc_stats::MemInfo mem;
+    out.memory_usage[0] = '\0';
+    if (proc_stats::readMemInfo(mem)) {
+        std::snprintf(out.memory_usage, sizeof(out.memory_usage), "%.2f%%", proc_stats::memoryUsagePercent(mem));
+    }
+
+    // df rounds the percentage up
+    double disk = 0.0;
+    out.disk_usage_root[0] = '\0';
+    if (proc_stats::readDiskUsagePercent("/", disk)) {
+        std::snprintf(out.disk_usage_root, sizeof(out.disk_usage_root), "%d%%", static_cast<int>(std::ceil(disk)));
+    }
+
+    readUsbDevices(out.usb_devices, sizeof(out.usb_devices));
+    out.gpio_state = readGpioState();
+}
+
+size_t encode(const LiteSample& sample, uint8_t* out, size_t capacity) {
+    Writer writer{out, capacity};
+    writer.string(1, device_id_);
+    writer.string(2, sample.readable_date);
+    writer.string(3, sample.cpu_usage);
+    writer.string(4, sample.memory_usage);
+    writer.string(5, sample.disk_usage_root);
+    writer.string(7, sample.usb_devices);
+    writer.int32(8, sample.gpio_state);
+    writer.string(9, kernel_version_);
+    writer.string(10, hardware_model_);
+    writer.string(11, "unknown");   // firmware_version, as the native full agent
+    return writer.overflow ? 0 : writer.used;
+}
+
+} // namespace lite_sampler
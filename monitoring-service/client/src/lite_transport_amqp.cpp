@@ -0,0 +1,209 @@
+#include "lite_agent.h"
+#include <algorithm>
+#include <chrono>
+#include <poll.h>
+#include <amqp.h>
+#include <amqp_tcp_socket.h>
+
+// AMQP-only transport: samples go to the hardware queue as protobuf with
+// publisher confirms, over librabbitmq with the smallest frame size.
+// No server messages come back on this transport, so alerts are only seen
+// on the server side.
+namespace lite_transport {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr amqp_channel_t kChannel = 1;
+constexpr uint64_t kDelivered = UINT64_MAX;   // confirmed, popped off the front of the ring
+constexpr std::chrono::seconds kMaxBackoff{60};
+
+const LiteConfig* config_ = nullptr;
+amqp_connection_state_t conn_ = nullptr;
+uint64_t next_delivery_tag_ = 1;
+Clock::time_point next_attempt_;
+std::chrono::seconds backoff_{1};
+
+void disconnect(SampleRing& ring) {
+    if (conn_) {
+        amqp_connection_close(conn_, AMQP_REPLY_SUCCESS);
+        amqp_destroy_connection(conn_);
+        conn_ = nullptr;
+    }
+    ring.resetTags();
+}
+
+bool rpcOk(const char* context) {
+    amqp_rpc_reply_t reply = amqp_get_rpc_reply(conn_);
+    if (reply.reply_type == AMQP_RESPONSE_NORMAL) return true;
+    liteLog("AMQP: %s failed (reply type %d)", context, static_cast<int>(reply.reply_type));
+    return false;
+}
+
+bool connect(SampleRing& ring) {
+    conn_ = amqp_new_connection();
+    amqp_socket_t* socket = conn_ ? amqp_tcp_socket_new(conn_) : nullptr;
+    if (!socket) {
+        liteLog("AMQP: cannot create socket");
+        disconnect(ring);
+        return false;
+    }
+    struct timeval timeout{5, 0};
+    int status = amqp_socket_open_noblock(socket, config_->amqp_host, config_->amqp_port, &timeout);
+    if (status != AMQP_STATUS_OK) {
+        liteLog("AMQP: cannot reach %s:%d: %s", config_->amqp_host, config_->amqp_port, amqp_error_string2(status));
+        disconnect(ring);
+        return false;
+    }
+
+    // One channel, 4 KiB frames (the protocol minimum, a sample is a few
+    // hundred bytes) and no heartbeats: librabbitmq sizes its buffers on the frame
+    amqp_rpc_reply_t reply = amqp_login(conn_, "/", 1, 4096, 0, AMQP_SASL_METHOD_PLAIN,
+                                        config_->amqp_user, config_->amqp_password);
+    if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
+        liteLog("AMQP: login failed");
+        disconnect(ring);
+        return false;
+    }
+    amqp_channel_open(conn_, kChannel);
+    if (!rpcOk("opening channel")) {
+        disconnect(ring);
+        return false;
+    }
+    amqp_confirm_select(conn_, kChannel);
+    if (!rpcOk("enabling publisher confirms")) {
+        disconnect(ring);
+        return false;
+    }
+    amqp_queue_declare(conn_, kChannel, amqp_cstring_bytes(config_->hardware_queue), 0, 1, 0, 0, amqp_empty_table);
+    if (!rpcOk("declaring queue")) {
+        disconnect(ring);
+        return false;
+    }
+
+    // Delivery tags restart at 1 on every new channel
+    next_delivery_tag_ = 1;
+    ring.resetTags();
+    liteLog("AMQP: connected to %s:%d", config_->amqp_host, config_->amqp_port);
+    return true;
+}
+
+bool publishPending(SampleRing& ring) {
+    amqp_basic_properties_t props;
+    props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG | AMQP_BASIC_DELIVERY_MODE_FLAG;
+    props.content_type = amqp_cstring_bytes("application/x-protobuf");
+    props.delivery_mode = 2;
+
+    for (size_t i = 0; i < ring.size(); ++i) {
+        EncodedSample& sample = ring.at(i);
+        if (sample.tag != 0) continue;
+
+        amqp_bytes_t body;
+        body.len = sample.size;
+        body.bytes = sample.data;
+        int status = amqp_basic_publish(conn_, kChannel, amqp_cstring_bytes(""),
+                                        amqp_cstring_bytes(config_->hardware_queue), 0, 0, &props, body);
+        if (status != AMQP_STATUS_OK) {
+            liteLog("AMQP: publish failed: %s", amqp_error_string2(status));
+            return false;
+        }
+        sample.tag = next_delivery_tag_++;
+    }
+    return true;
+}
+
+// Mark the samples an ack or nack covers; nacked ones are published again
+void settle(SampleRing& ring, uint64_t delivery_tag, bool multiple, bool acked) {
+    for (size_t i = 0; i < ring.size(); ++i) {
+        EncodedSample& sample = ring.at(i);
+        if (sample.tag == 0 || sample.tag == kDelivered) continue;
+        if (multiple ? sample.tag <= delivery_tag : sample.tag == delivery_tag) {
+            sample.tag = acked ? kDelivered : 0;
+        }
+    }
+    while (ring.size() > 0 && ring.at(0).tag == kDelivered) {
+        ring.pop();
+    }
+}
+
+// Confirms until the timeout; false when the connection is gone
+bool readConfirms(SampleRing& ring, int timeout_ms) {
+    struct timeval timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+    while (true) {
+        amqp_frame_t frame;
+        int status = amqp_simple_wait_frame_noblock(conn_, &frame, &timeout);
+        if (status == AMQP_STATUS_TIMEOUT) break;
+        if (status != AMQP_STATUS_OK) {
+            liteLog("AMQP: connection lost: %s", amqp_error_string2(status));
+            return false;
+        }
+        if (frame.frame_type == AMQP_FRAME_METHOD) {
+            switch (frame.payload.method.id) {
+                case AMQP_BASIC_ACK_METHOD: {
+                    auto* ack = static_cast<amqp_basic_ack_t*>(frame.payload.method.decoded);
+                    settle(ring, ack->delivery_tag, ack->multiple, true);
+                    break;
+                }
+                case AMQP_BASIC_NACK_METHOD: {
+                    auto* nack = static_cast<amqp_basic_nack_t*>(frame.payload.method.decoded);
+                    settle(ring, nack->delivery_tag, nack->multiple, false);
+                    break;
+                }
+                case AMQP_CHANNEL_CLOSE_METHOD:
+                case AMQP_CONNECTION_CLOSE_METHOD:
+                    liteLog("AMQP: broker closed the channel");
+                    return false;
+                default:
+                    break;
+            }
+        }
+        // Whatever else arrived is already buffered, do not wait for more
+        timeout = {0, 0};
+    }
+    amqp_maybe_release_buffers(conn_);
+    return true;
+}
+
+} // namespace
+
+const char* name() {
+    return "amqp";
+}
+
+void init(const LiteConfig& config) {
+    config_ = &config;
+    next_attempt_ = Clock::now();
+}
+
+void run(SampleRing& ring, int timeout_ms) {
+    if (!conn_) {
+        if (Clock::now() >= next_attempt_) {
+            if (connect(ring)) {
+                backoff_ = std::chrono::seconds(1);
+            } else {
+                next_attempt_ = Clock::now() + backoff_;
+                backoff_ = std::min(backoff_ * 2, kMaxBackoff);
+            }
+        }
+        if (!conn_) {
+            ::poll(nullptr, 0, timeout_ms);
+            return;
+        }
+    }
+
+    if (!publishPending(ring) || !readConfirms(ring, timeout_ms)) {
+        disconnect(ring);
+        next_attempt_ = Clock::now() + backoff_;
+    }
+}
+
+void shutdown() {
+    if (conn_) {
+        amqp_connection_close(conn_, AMQP_REPLY_SUCCESS);
+        amqp_destroy_connection(conn_);
+        conn_ = nullptr;
+    }
+}
+
+} // namespace lite_transport
@@ -0,0 +1,257 @@
+#include "lite_agent.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <grpcpp/alarm.h>
+#include <grpcpp/grpcpp.h>
+#include "monitoring.grpc.pb.h"
+
+// gRPC-only transport: samples travel as DeviceMessage.metrics on the device
+// Session and the server's alerts come back on it. The completion queue is
+// driven from run() on the agent's event thread, not from a thread of its own.
+// Alerts are logged and acknowledged; the lite agent runs no corrective commands.
+namespace lite_transport {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using monitoring::DeviceMessage;
+using monitoring::ServerMessage;
+
+constexpr uint64_t kWriting = 1;               // ring tag of the sample being written
+constexpr std::chrono::seconds kMaxBackoff{60};
+constexpr std::chrono::seconds kStableAfter{30};
+constexpr std::chrono::seconds kHeartbeatAfter{60};
+constexpr size_t kMaxPendingAcks = 16;
+
+enum class TagKind { Start, Read, Write, Finish, Reconnect };
+
+struct Call;
+struct Tag {
+    TagKind kind;
+    Call* call;
+};
+
+// One Session stream, freed once every operation on it completed
+struct Call {
+    grpc::ClientContext context;
+    std::unique_ptr<grpc::ClientAsyncReaderWriter<DeviceMessage, ServerMessage>> stream;
+    ServerMessage incoming;
+    grpc::Status status;
+    Tag start_tag{TagKind::Start, this};
+    Tag read_tag{TagKind::Read, this};
+    Tag write_tag{TagKind::Write, this};
+    Tag finish_tag{TagKind::Finish, this};
+    int pending = 0;
+    bool connected = false;
+    bool finishing = false;
+    bool finished = false;
+    bool hello_sent = false;
+    Clock::time_point connected_at;
+};
+
+const LiteConfig* config_ = nullptr;
+std::unique_ptr<monitoring::MonitoringService::Stub> stub_;
+std::unique_ptr<grpc::CompletionQueue> cq_;
+std::unique_ptr<grpc::Alarm> reconnect_alarm_;
+Tag reconnect_tag_{TagKind::Reconnect, nullptr};
+bool reconnect_armed_ = false;
+Call* call_ = nullptr;
+DeviceMessage outgoing_;                       // write in progress
+bool writing_ = false;
+bool writing_sample_ = false;
+uint64_t pending_acks_[kMaxPendingAcks];
+size_t ack_count_ = 0;
+Clock::time_point last_write_;
+std::chrono::seconds backoff_{1};
+
+void connect() {
+    call_ = new Call();
+    call_->stream = stub_->PrepareAsyncSession(&call_->context, cq_.get());
+    call_->stream->StartCall(&call_->start_tag);
+    call_->pending = 1;
+}
+
+void finish(Call* call) {
+    if (call->finishing) return;
+    call->finishing = true;
+    call->stream->Finish(&call->status, &call->finish_tag);
+    call->pending++;
+}
+
+void queueAck(uint64_t alert_id) {
+    // The server replays the alerts still unacked when a session ends, so a
+    // dropped ack only means the oldest alert arrives twice
+    if (ack_count_ == kMaxPendingAcks) {
+        std::copy(pending_acks_ + 1, pending_acks_ + kMaxPendingAcks, pending_acks_);
+        --ack_count_;
+    }
+    pending_acks_[ack_count_++] = alert_id;
+}
+
+void handleMessage(const ServerMessage& message) {
+    if (!message.has_alert()) return;
+    const monitoring::Alert& alert = message.alert();
+    if (alert.alert_type() != "RULES_UPDATE" && alert.alert_type() != "INVENTORY_RESYNC") {
+        liteLog("ALERT %s %s: %s", monitoring::Alert::Severity_Name(alert.severity()).c_str(),
+                alert.alert_type().c_str(), alert.description().c_str());
+    }
+    if (alert.alert_id() != 0) {
+        queueAck(alert.alert_id());
+    }
+}
+
+// Hello first, then acks, then the oldest sample; a heartbeat when idle
+void startWrite(SampleRing& ring) {
+    if (!call_ || !call_->connected || call_->finishing || writing_) return;
+
+    outgoing_.Clear();
+    outgoing_.set_device_id(config_->device_id);
+    writing_sample_ = false;
+    if (!call_->hello_sent) {
+        outgoing_.mutable_hello()->set_device_id(config_->device_id);
+        call_->hello_sent = true;
+    } else if (ack_count_ > 0) {
+        outgoing_.mutable_ack()->set_alert_id(pending_acks_[0]);
+        std::copy(pending_acks_ + 1, pending_acks_ + ack_count_, pending_acks_);
+        --ack_count_;
+    } else if (ring.size() > 0 && ring.at(0).tag == 0) {
+        EncodedSample& sample = ring.at(0);
+        outgoing_.mutable_metrics()->ParseFromArray(sample.data, sample.size);
+        sample.tag = kWriting;
+        writing_sample_ = true;
+    } else if (Clock::now() - last_write_ >= kHeartbeatAfter) {
+        outgoing_.mutable_heartbeat()->set_status("running");
+    } else {
+        return;
+    }
+    call_->stream->Write(outgoing_, &call_->write_tag);
+    call_->pending++;
+    writing_ = true;
+    last_write_ = Clock::now();
+}
+
+void scheduleReconnect() {
+    auto jitter = std::chrono::milliseconds(std::rand() % 500);
+    reconnect_alarm_->Set(cq_.get(), std::chrono::system_clock::now() + backoff_ + jitter, &reconnect_tag_);
+    reconnect_armed_ = true;
+    liteLog("gRPC: session closed, retry in %lld s", static_cast<long long>(backoff_.count()));
+    backoff_ = std::min(backoff_ * 2, kMaxBackoff);
+}
+
+void handleEvent(Tag* tag, bool ok, SampleRing& ring) {
+    if (tag->kind == TagKind::Reconnect) {
+        reconnect_armed_ = false;
+        if (ok) connect();
+        return;
+    }
+
+    Call* call = tag->call;
+    call->pending--;
+    switch (tag->kind) {
+        case TagKind::Start:
+            if (!ok) {
+                finish(call);
+                break;
+            }
+            call->connected = true;
+            call->connected_at = Clock::now();
+            liteLog("gRPC: session open to %s", config_->server_address);
+            call->stream->Read(&call->incoming, &call->read_tag);
+            call->pending++;
+            break;
+        case TagKind::Read:
+            if (!ok) {
+                finish(call);
+                break;
+            }
+            handleMessage(call->incoming);
+            call->stream->Read(&call->incoming, &call->read_tag);
+            call->pending++;
+            break;
+        case TagKind::Write:
+            if (call != call_) break;   // completed after its stream was given up
+            writing_ = false;
+            // A full ring may have dropped the sample in the meantime
+            if (ok && writing_sample_ && ring.size() > 0 && ring.at(0).tag == kWriting) {
+                ring.pop();
+            }
+            if (!ok) finish(call);
+            break;
+        case TagKind::Finish:
+            call->finished = true;
+            if (call == call_) {
+                if (call->connected && Clock::now() - call->connected_at >= kStableAfter) {
+                    backoff_ = std::chrono::seconds(1);
+                }
+                if (!call->status.ok()) {
+                    liteLog("gRPC: session ended: %s", call->status.error_message().c_str());
+                }
+                call_ = nullptr;
+                writing_ = false;
+                ring.resetTags();
+                scheduleReconnect();
+            }
+            break;
+        default:
+            break;
+    }
+    if (call->finished && call->pending == 0) {
+        delete call;
+    }
+}
+
+} // namespace
+
+const char* name() {
+    return "grpc";
+}
+
+void init(const LiteConfig& config) {
+    config_ = &config;
+    // Small messages only: no window growth probing, a low receive limit
+    grpc::ChannelArguments args;
+    args.SetInt(GRPC_ARG_HTTP2_BDP_PROBE, 0);
+    args.SetMaxReceiveMessageSize(64 * 1024);
+    stub_ = monitoring::MonitoringService::NewStub(
+        grpc::CreateCustomChannel(config.server_address, grpc::InsecureChannelCredentials(), args));
+    cq_ = std::make_unique<grpc::CompletionQueue>();
+    reconnect_alarm_ = std::make_unique<grpc::Alarm>();
+    last_write_ = Clock::now();
+}
+
+void run(SampleRing& ring, int timeout_ms) {
+    if (!call_ && !reconnect_armed_) {
+        connect();
+    }
+    startWrite(ring);
+
+    auto deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(timeout_ms);
+    void* tag = nullptr;
+    bool ok = false;
+    while (cq_->AsyncNext(&tag, &ok, deadline) == grpc::CompletionQueue::GOT_EVENT) {
+        handleEvent(static_cast<Tag*>(tag), ok, ring);
+        startWrite(ring);
+    }
+}
+
+void shutdown() {
+    if (reconnect_armed_) {
+        reconnect_alarm_->Cancel();
+    }
+    if (call_) {
+        call_->context.TryCancel();
+        finish(call_);
+    }
+    cq_->Shutdown();
+    void* tag = nullptr;
+    bool ok = false;
+    while (cq_->Next(&tag, &ok)) {
+        auto* event = static_cast<Tag*>(tag);
+        if (event->kind != TagKind::Reconnect && --event->call->pending == 0) {
+            delete event->call;
+        }
+    }
+}
+
+} // namespace lite_transport
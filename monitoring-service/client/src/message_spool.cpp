@@ -0,0 +1,305 @@
+#include "message_spool.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kSpoolMagic[4] = {'M', 'S', 'P', 'L'};
+constexpr uint32_t kSpoolVersion = 1;
+constexpr uint32_t kWrapMarker = 0xFFFFFFFFu;
+
+// length, checksum, queue name length, content type length
+constexpr uint64_t kRecordHeaderSize = 12;
+
+uint32_t checksum(const uint8_t* data, size_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+} // namespace
+
+MessageSpool::MessageSpool(const Options& options)
+    : options_(options), mapping_(nullptr), mapping_size_(0), header_(nullptr), data_(nullptr),
+      drain_tokens_(static_cast<double>(options.drain_burst)),
+      last_drain_(std::chrono::steady_clock::now()) {
+    std::error_code ec;
+    fs::create_directories(fs::path(options_.path).parent_path(), ec);
+
+    int fd = ::open(options_.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open spool " + options_.path + ": " + std::strerror(errno));
+    }
+
+    // An existing spool keeps its own capacity
+    off_t existing = ::lseek(fd, 0, SEEK_END);
+    if (existing > static_cast<off_t>(sizeof(Header))) {
+        mapping_size_ = static_cast<size_t>(existing);
+    } else {
+        mapping_size_ = sizeof(Header) + options_.capacity_bytes;
+        if (::ftruncate(fd, static_cast<off_t>(mapping_size_)) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to size spool " + options_.path + ": " + std::strerror(errno));
+        }
+    }
+
+    void* mapping = ::mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map spool " + options_.path + ": " + std::strerror(errno));
+    }
+
+    mapping_ = static_cast<uint8_t*>(mapping);
+    header_ = reinterpret_cast<Header*>(mapping_);
+    data_ = mapping_ + sizeof(Header);
+    recover();
+
+    stats_.depth_messages = header_->count;
+    stats_.depth_bytes = header_->used;
+    stats_.dropped_total = header_->dropped_total;
+    if (header_->count > 0) {
+        std::cout << "Spool " << options_.path << " holds " << header_->count
+                  << " undelivered message(s)" << std::endl;
+    }
+}
+
+MessageSpool::~MessageSpool() {
+    if (mapping_) {
+        ::msync(mapping_, mapping_size_, MS_SYNC);
+        ::munmap(mapping_, mapping_size_);
+    }
+}
+
+bool MessageSpool::push(const Message& message) {
+    uint64_t payload_size = message.queue_name.size() + message.content_type.size() + message.body.size();
+    uint64_t record_size = kRecordHeaderSize + payload_size;
+    if (message.queue_name.size() > 0xFFFF || message.content_type.size() > 0xFFFF ||
+        record_size > header_->capacity) {
+        std::cerr << "Message of " << record_size << " bytes does not fit in the spool" << std::endl;
+        return false;
+    }
+
+    if (!reserve(record_size)) {
+        return false;
+    }
+
+    uint8_t* record = data_ + header_->tail;
+    uint8_t* payload = record + kRecordHeaderSize;
+    std::memcpy(payload, message.queue_name.data(), message.queue_name.size());
+    std::memcpy(payload + message.queue_name.size(), message.content_type.data(), message.content_type.size());
+    std::memcpy(payload + message.queue_name.size() + message.content_type.size(),
+                message.body.data(), message.body.size());
+
+    uint32_t length = static_cast<uint32_t>(record_size);
+    uint32_t sum = checksum(payload, payload_size);
+    uint16_t queue_len = static_cast<uint16_t>(message.queue_name.size());
+    uint16_t type_len = static_cast<uint16_t>(message.content_type.size());
+    std::memcpy(record, &length, sizeof(length));
+    std::memcpy(record + 4, &sum, sizeof(sum));
+    std::memcpy(record + 8, &queue_len, sizeof(queue_len));
+    std::memcpy(record + 10, &type_len, sizeof(type_len));
+
+    // Record first, then the header that publishes it
+    syncRange(record, record_size);
+    header_->tail = (header_->tail + record_size) % header_->capacity;
+    header_->used += record_size;
+    header_->count++;
+    syncRange(header_, sizeof(Header));
+
+    stats_.spooled_total++;
+    stats_.depth_messages = header_->count;
+    stats_.depth_bytes = header_->used;
+    return true;
+}
+
+size_t MessageSpool::drain(const std::function<bool(const Message&)>& publish) {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last_drain_).count();
+    last_drain_ = now;
+
+    // Token bucket: drain_rate messages per second, at most drain_burst at once
+    drain_tokens_ = std::min(static_cast<double>(options_.drain_burst),
+                             drain_tokens_ + elapsed * options_.drain_rate);
+
+    size_t drained = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (header_->count > 0 && drain_tokens_ >= 1.0) {
+        Message message;
+        uint64_t record_size = 0;
+        if (!readRecord(header_->head, &message, record_size)) {
+            // Wrap padding at the head, skip to the start of the data area
+            header_->used -= header_->capacity - header_->head;
+            header_->head = 0;
+            continue;
+        }
+        if (!publish(message)) {
+            break;
+        }
+        popOldest();
+        drain_tokens_ -= 1.0;
+        drained++;
+    }
+
+    if (drained > 0) {
+        syncRange(header_, sizeof(Header));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats_.drained_total += drained;
+        stats_.drain_throughput = seconds > 0.0 ? drained / seconds : static_cast<double>(drained);
+    }
+    stats_.depth_messages = header_->count;
+    stats_.depth_bytes = header_->used;
+    return drained;
+}
+
+bool MessageSpool::empty() const {
+    return header_->count == 0;
+}
+
+MessageSpool::Stats MessageSpool::getStats() const {
+    return stats_;
+}
+
+bool MessageSpool::reserve(uint64_t size) {
+    const uint64_t capacity = header_->capacity;
+
+    while (true) {
+        if (header_->count == 0) {
+            header_->head = header_->tail = header_->used = 0;
+        }
+        uint64_t head = header_->head;
+        uint64_t tail = header_->tail;
+
+        if (header_->count == 0 || tail > head) {
+            if (capacity - tail >= size) return true;
+            if (head >= size || header_->count == 0) {
+                // Not enough room before the end: pad and continue at offset 0
+                if (capacity - tail >= sizeof(kWrapMarker)) {
+                    std::memcpy(data_ + tail, &kWrapMarker, sizeof(kWrapMarker));
+                }
+                header_->used += capacity - tail;
+                header_->tail = 0;
+                continue;
+            }
+        } else if (tail < head) {
+            if (head - tail >= size) return true;
+        }
+
+        // Full: oldest-first drop policy
+        popOldest();
+        header_->dropped_total++;
+        stats_.dropped_total = header_->dropped_total;
+    }
+}
+
+bool MessageSpool::readRecord(uint64_t offset, Message* message, uint64_t& record_size) const {
+    const uint64_t capacity = header_->capacity;
+    if (capacity - offset < kRecordHeaderSize) return false;
+
+    const uint8_t* record = data_ + offset;
+    uint32_t length = 0;
+    uint32_t sum = 0;
+    uint16_t queue_len = 0;
+    uint16_t type_len = 0;
+    std::memcpy(&length, record, sizeof(length));
+    if (length == kWrapMarker) return false;
+    std::memcpy(&sum, record + 4, sizeof(sum));
+    std::memcpy(&queue_len, record + 8, sizeof(queue_len));
+    std::memcpy(&type_len, record + 10, sizeof(type_len));
+
+    if (length < kRecordHeaderSize + queue_len + type_len || length > capacity - offset) {
+        throw std::runtime_error("Corrupted spool record at offset " + std::to_string(offset));
+    }
+
+    record_size = length;
+    if (message) {
+        const char* payload = reinterpret_cast<const char*>(record + kRecordHeaderSize);
+        message->queue_name.assign(payload, queue_len);
+        message->content_type.assign(payload + queue_len, type_len);
+        message->body.assign(payload + queue_len + type_len, length - kRecordHeaderSize - queue_len - type_len);
+    }
+    return true;
+}
+
+void MessageSpool::popOldest() {
+    uint64_t record_size = 0;
+    while (!readRecord(header_->head, nullptr, record_size)) {
+        header_->used -= header_->capacity - header_->head;
+        header_->head = 0;
+    }
+    header_->head = (header_->head + record_size) % header_->capacity;
+    header_->used -= record_size;
+    header_->count--;
+    if (header_->count == 0) {
+        header_->head = header_->tail = header_->used = 0;
+    }
+}
+
+void MessageSpool::recover() {
+    uint64_t capacity = mapping_size_ - sizeof(Header);
+    if (std::memcmp(header_->magic, kSpoolMagic, sizeof(kSpoolMagic)) != 0 ||
+        header_->version != kSpoolVersion || header_->capacity != capacity) {
+        std::memset(header_, 0, sizeof(Header));
+        std::memcpy(header_->magic, kSpoolMagic, sizeof(kSpoolMagic));
+        header_->version = kSpoolVersion;
+        header_->capacity = capacity;
+        syncRange(header_, sizeof(Header));
+        return;
+    }
+
+    // Walk the ring and keep the records up to the first torn one
+    uint64_t offset = header_->head;
+    uint64_t used = 0;
+    uint64_t valid = 0;
+    try {
+        while (valid < header_->count) {
+            if (offset >= capacity) break;
+            uint64_t record_size = 0;
+            if (!readRecord(offset, nullptr, record_size)) {
+                used += capacity - offset;
+                offset = 0;
+                continue;
+            }
+            const uint8_t* record = data_ + offset;
+            uint32_t sum = 0;
+            std::memcpy(&sum, record + 4, sizeof(sum));
+            if (checksum(record + kRecordHeaderSize, record_size - kRecordHeaderSize) != sum) break;
+            offset = (offset + record_size) % capacity;
+            used += record_size;
+            valid++;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Spool recovery: " << e.what() << std::endl;
+    }
+
+    if (valid != header_->count) {
+        std::cerr << "Spool recovery dropped " << (header_->count - valid) << " torn record(s)" << std::endl;
+    }
+    header_->count = valid;
+    header_->tail = offset;
+    header_->used = used;
+    if (valid == 0) {
+        header_->head = header_->tail = header_->used = 0;
+    }
+    syncRange(header_, sizeof(Header));
+}
+
+void MessageSpool::syncRange(const void* address, size_t length) {
+    // msync needs a page-aligned start
+    static const uintptr_t page = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+    uintptr_t start = reinterpret_cast<uintptr_t>(address) & ~(page - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(address) + length;
+    ::msync(reinterpret_cast<void*>(start), end - start, MS_SYNC);
+}
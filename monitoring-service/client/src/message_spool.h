@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Crash-safe store-and-forward spool for messages that could not be published.
+//
+// The spool is a single preallocated file mapped with mmap and used as a ring
+// buffer of variable-length records. Records are written (and synced) before
+// the header that makes them visible, and each record carries a checksum, so
+// a crash can at worst lose the record being written. When the spool is full
+// the oldest records are dropped first.
+class MessageSpool {
+public:
+    struct Options {
+        std::string path;
+        uint64_t capacity_bytes = 16 * 1024 * 1024;
+        double drain_rate = 20.0;       // messages per second once the broker is back
+        size_t drain_burst = 100;       // max messages per drain call
+    };
+
+    struct Message {
+        std::string queue_name;
+        std::string content_type;
+        std::string body;
+    };
+
+    struct Stats {
+        uint64_t depth_messages = 0;    // gauge
+        uint64_t depth_bytes = 0;       // gauge
+        uint64_t spooled_total = 0;
+        uint64_t drained_total = 0;
+        uint64_t dropped_total = 0;     // oldest-first drops on overflow
+        double drain_throughput = 0.0;  // gauge, messages per second over the last drain
+    };
+
+    explicit MessageSpool(const Options& options);
+    ~MessageSpool();
+
+    MessageSpool(const MessageSpool&) = delete;
+    MessageSpool& operator=(const MessageSpool&) = delete;
+
+    // Append a message, dropping the oldest ones if needed; false if it can never fit
+    bool push(const Message& message);
+
+    // Hand messages to publish() in order, at most what the rate limit allows.
+    // A message is removed only when publish() returns true; draining stops at
+    // the first false. Returns the number of messages drained.
+    size_t drain(const std::function<bool(const Message&)>& publish);
+
+    bool empty() const;
+    Stats getStats() const;
+
+private:
+    struct Header {
+        char magic[4];                  // "MSPL"
+        uint32_t version;
+        uint64_t capacity;              // size of the data area
+        uint64_t head;                  // offset of the oldest record
+        uint64_t tail;                  // offset where the next record goes
+        uint64_t used;                  // bytes in use, including wrap padding
+        uint64_t count;                 // records in the spool
+        uint64_t dropped_total;
+        uint64_t reserved;
+    };
+    static_assert(sizeof(Header) == 64, "MessageSpool::Header must stay 64 bytes");
+
+    Options options_;
+    uint8_t* mapping_;
+    size_t mapping_size_;
+    Header* header_;
+    uint8_t* data_;
+
+    Stats stats_;
+    double drain_tokens_;
+    std::chrono::steady_clock::time_point last_drain_;
+
+    bool reserve(uint64_t size);
+    bool readRecord(uint64_t offset, Message* message, uint64_t& record_size) const;
+    void popOldest();
+    void recover();
+    void syncRange(const void* address, size_t length);
+};
@@ -0,0 +1,295 @@
+#include "metric_store.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kSegmentMagic[4] = {'M', 'S', 'E', 'G'};
+constexpr uint32_t kSegmentVersion = 1;
+
+std::string segmentName(uint64_t first_sequence) {
+    char name[48];
+    std::snprintf(name, sizeof(name), "segment_%020llu.seg",
+                  static_cast<unsigned long long>(first_sequence));
+    return name;
+}
+
+} // namespace
+
+MetricStore::MetricStore(const Options& options)
+    : options_(options) {
+    if (options_.records_per_segment == 0) {
+        options_.records_per_segment = 1;
+    }
+
+    std::error_code ec;
+    fs::create_directories(options_.directory, ec);
+    if (ec) {
+        throw std::runtime_error("Failed to create metric store directory " +
+                                 options_.directory + ": " + ec.message());
+    }
+
+    std::string cursor_path = (fs::path(options_.directory) / "cursor").string();
+    cursor_fd_ = ::open(cursor_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (cursor_fd_ < 0) {
+        throw std::runtime_error("Failed to open metric store cursor " + cursor_path +
+                                 ": " + std::strerror(errno));
+    }
+    uint64_t cursor = 0;
+    if (::pread(cursor_fd_, &cursor, sizeof(cursor), 0) == sizeof(cursor)) {
+        cursor_ = cursor;
+    }
+
+    openExisting();
+    if (segments_.empty()) {
+        rotate(last_sequence_ + 1);
+    }
+
+    std::cout << "Metric store opened in " << options_.directory << ": "
+              << segments_.size() << " segment(s), last sequence " << last_sequence_ << std::endl;
+}
+
+MetricStore::~MetricStore() {
+    for (auto& segment : segments_) {
+        unmapSegment(segment);
+    }
+    if (cursor_fd_ >= 0) {
+        ::close(cursor_fd_);
+    }
+}
+
+uint64_t MetricStore::append(Record record) {
+    Segment* active = &segments_.back();
+    if (active->count >= active->capacity) {
+        rotate(last_sequence_ + 1);
+        active = &segments_.back();
+    }
+
+    record.sequence = last_sequence_ + 1;
+    std::memset(record.reserved, 0, sizeof(record.reserved));
+    record.checksum = computeChecksum(record);
+
+    uint8_t* slot = active->mapping + sizeof(SegmentHeader) + active->count * sizeof(Record);
+    std::memcpy(slot, &record, sizeof(Record));
+    // The page cache owns the data from here; writeback is left to the kernel
+    ::msync(active->mapping, active->mapping_size, MS_ASYNC);
+
+    active->count++;
+    active->last_timestamp = record.timestamp;
+    last_sequence_ = record.sequence;
+    return record.sequence;
+}
+
+bool MetricStore::latest(Record& out) const {
+    for (auto it = segments_.rbegin(); it != segments_.rend(); ++it) {
+        if (it->count > 0) {
+            out = *recordAt(*it, it->count - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<MetricStore::Record> MetricStore::readSince(uint64_t after_sequence, size_t max_records) const {
+    std::vector<Record> records;
+
+    for (const auto& segment : segments_) {
+        if (records.size() >= max_records) break;
+        if (segment.count == 0) continue;
+        uint64_t segment_last = segment.first_sequence + segment.count - 1;
+        if (segment_last <= after_sequence) continue;
+
+        uint32_t start = 0;
+        if (after_sequence >= segment.first_sequence) {
+            start = static_cast<uint32_t>(after_sequence - segment.first_sequence + 1);
+        }
+        for (uint32_t i = start; i < segment.count && records.size() < max_records; ++i) {
+            records.push_back(*recordAt(segment, i));
+        }
+    }
+    return records;
+}
+
+uint64_t MetricStore::lastSequence() const {
+    return last_sequence_;
+}
+
+uint64_t MetricStore::readCursor() const {
+    return cursor_;
+}
+
+void MetricStore::commitCursor(uint64_t sequence) {
+    if (sequence <= cursor_) return;
+    cursor_ = sequence;
+    if (::pwrite(cursor_fd_, &cursor_, sizeof(cursor_), 0) != sizeof(cursor_)) {
+        std::cerr << "Failed to persist metric store cursor: " << std::strerror(errno) << std::endl;
+    }
+}
+
+void MetricStore::openExisting() {
+    std::vector<std::string> paths;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(options_.directory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("segment_", 0) == 0 && entry.path().extension() == ".seg") {
+            paths.push_back(entry.path().string());
+        }
+    }
+    // Zero-padded names sort in sequence order
+    std::sort(paths.begin(), paths.end());
+
+    for (const auto& path : paths) {
+        Segment segment;
+        segment.path = path;
+        if (!mapSegment(segment, false)) {
+            std::cerr << "Skipping unreadable metric segment " << path << std::endl;
+            continue;
+        }
+
+        // Valid records are contiguous; stop at the first empty or torn slot
+        while (segment.count < segment.capacity) {
+            const Record* record = recordAt(segment, segment.count);
+            if (record->sequence != segment.first_sequence + segment.count ||
+                record->checksum != computeChecksum(*record)) {
+                break;
+            }
+            segment.last_timestamp = record->timestamp;
+            segment.count++;
+        }
+
+        if (segment.count > 0) {
+            last_sequence_ = segment.first_sequence + segment.count - 1;
+        } else if (segment.first_sequence > 0) {
+            last_sequence_ = std::max(last_sequence_, segment.first_sequence - 1);
+        }
+        segments_.push_back(segment);
+    }
+}
+
+bool MetricStore::mapSegment(Segment& segment, bool create) {
+    int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0);
+    int fd = ::open(segment.path.c_str(), flags, 0644);
+    if (fd < 0) return false;
+
+    size_t size = create ? segmentFileSize(segment.capacity) : 0;
+    if (create) {
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            ::close(fd);
+            return false;
+        }
+    } else {
+        off_t end = ::lseek(fd, 0, SEEK_END);
+        if (end < static_cast<off_t>(sizeof(SegmentHeader))) {
+            ::close(fd);
+            return false;
+        }
+        size = static_cast<size_t>(end);
+    }
+
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    segment.mapping = static_cast<uint8_t*>(mapping);
+    segment.mapping_size = size;
+
+    auto* header = reinterpret_cast<SegmentHeader*>(segment.mapping);
+    if (create) {
+        std::memcpy(header->magic, kSegmentMagic, sizeof(kSegmentMagic));
+        header->version = kSegmentVersion;
+        header->record_size = sizeof(Record);
+        header->capacity = segment.capacity;
+        header->first_sequence = segment.first_sequence;
+        header->created_at = static_cast<int64_t>(std::time(nullptr));
+        return true;
+    }
+
+    if (std::memcmp(header->magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0 ||
+        header->version != kSegmentVersion || header->record_size != sizeof(Record) ||
+        segmentFileSize(header->capacity) > size) {
+        unmapSegment(segment);
+        return false;
+    }
+    segment.capacity = header->capacity;
+    segment.first_sequence = header->first_sequence;
+    segment.last_timestamp = header->created_at;
+    return true;
+}
+
+void MetricStore::unmapSegment(Segment& segment) {
+    if (segment.mapping) {
+        ::munmap(segment.mapping, segment.mapping_size);
+        segment.mapping = nullptr;
+        segment.mapping_size = 0;
+    }
+}
+
+void MetricStore::rotate(uint64_t first_sequence) {
+    Segment segment;
+    segment.first_sequence = first_sequence;
+    segment.capacity = options_.records_per_segment;
+    segment.last_timestamp = static_cast<int64_t>(std::time(nullptr));
+    segment.path = (fs::path(options_.directory) / segmentName(first_sequence)).string();
+
+    if (!mapSegment(segment, true)) {
+        throw std::runtime_error("Failed to create metric segment " + segment.path +
+                                 ": " + std::strerror(errno));
+    }
+    segments_.push_back(segment);
+    applyRetention();
+}
+
+void MetricStore::applyRetention() {
+    int64_t oldest_allowed = static_cast<int64_t>(std::time(nullptr)) -
+        std::chrono::duration_cast<std::chrono::seconds>(options_.max_age).count();
+
+    uint64_t total_bytes = 0;
+    for (const auto& segment : segments_) {
+        total_bytes += segment.mapping_size;
+    }
+
+    // The active segment is never dropped
+    while (segments_.size() > 1) {
+        Segment& oldest = segments_.front();
+        if (total_bytes <= options_.max_total_bytes && oldest.last_timestamp >= oldest_allowed) {
+            break;
+        }
+        total_bytes -= oldest.mapping_size;
+        unmapSegment(oldest);
+        std::error_code ec;
+        fs::remove(oldest.path, ec);
+        std::cout << "Metric store retention removed " << oldest.path << std::endl;
+        segments_.erase(segments_.begin());
+    }
+}
+
+const MetricStore::Record* MetricStore::recordAt(const Segment& segment, uint32_t index) const {
+    return reinterpret_cast<const Record*>(segment.mapping + sizeof(SegmentHeader) + index * sizeof(Record));
+}
+
+uint32_t MetricStore::computeChecksum(const Record& record) {
+    // FNV-1a over everything but the checksum itself
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&record);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(Record, checksum); ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+size_t MetricStore::segmentFileSize(uint32_t capacity) {
+    return sizeof(SegmentHeader) + static_cast<size_t>(capacity) * sizeof(Record);
+}
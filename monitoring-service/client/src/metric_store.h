@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Append-only, segmented local store for the numeric hardware metrics.
+//
+// Each segment is a preallocated file of fixed-size records that is written
+// through a shared mmap, so appending a sample never creates a file and reads
+// are plain memory accesses. Segments rotate when full and whole segments are
+// dropped by the size/age retention policy.
+class MetricStore {
+public:
+    // Fixed-size (64 bytes) on-disk record
+    struct Record {
+        uint64_t sequence;          // 1-based, 0 marks an unused slot
+        int64_t timestamp;          // Unix time, seconds
+        float cpu_usage;            // percent
+        float memory_usage;         // percent
+        float disk_usage;           // percent
+        int32_t gpio_state;
+        uint32_t usb_device_count;
+        uint32_t uptime_seconds;
+        uint16_t sample_interval[3];  // seconds, cpu/memory/disk, 0 when not scheduled
+        uint8_t sample_reason[3];     // SamplingScheduler::Reason per class
+        uint8_t sample_stretch[3];    // budget multiplier per class, 0 in older records
+        uint8_t reserved[8];
+        uint32_t checksum;          // detects torn writes after a crash
+    };
+    static_assert(sizeof(Record) == 64, "MetricStore::Record must stay 64 bytes");
+
+    struct Options {
+        std::string directory;
+        uint32_t records_per_segment = 1440;              // one day at one sample per minute
+        uint64_t max_total_bytes = 8 * 1024 * 1024;       // retention by size
+        std::chrono::hours max_age = std::chrono::hours(24 * 7); // retention by age
+    };
+
+    explicit MetricStore(const Options& options);
+    ~MetricStore();
+
+    MetricStore(const MetricStore&) = delete;
+    MetricStore& operator=(const MetricStore&) = delete;
+
+    // Append a record, the sequence number is assigned by the store
+    uint64_t append(Record record);
+
+    // Most recent record, false if the store is empty
+    bool latest(Record& out) const;
+
+    // Records with sequence > after_sequence in order, at most max_records
+    std::vector<Record> readSince(uint64_t after_sequence, size_t max_records) const;
+
+    uint64_t lastSequence() const;
+
+    // Persistent consumer position (last sequence handed to the publisher)
+    uint64_t readCursor() const;
+    void commitCursor(uint64_t sequence);
+
+private:
+    struct SegmentHeader {
+        char magic[4];              // "MSEG"
+        uint32_t version;
+        uint32_t record_size;
+        uint32_t capacity;
+        uint64_t first_sequence;
+        int64_t created_at;
+    };
+    static_assert(sizeof(SegmentHeader) == 32, "SegmentHeader must stay 32 bytes");
+
+    struct Segment {
+        std::string path;
+        uint64_t first_sequence = 0;
+        uint32_t capacity = 0;
+        uint32_t count = 0;
+        int64_t last_timestamp = 0;
+        uint8_t* mapping = nullptr;
+        size_t mapping_size = 0;
+    };
+
+    Options options_;
+    std::vector<Segment> segments_;   // ordered by first_sequence, last one is active
+    uint64_t last_sequence_ = 0;
+    uint64_t cursor_ = 0;
+    int cursor_fd_ = -1;
+
+    void openExisting();
+    bool mapSegment(Segment& segment, bool create);
+    void unmapSegment(Segment& segment);
+    void rotate(uint64_t first_sequence);
+    void applyRetention();
+    const Record* recordAt(const Segment& segment, uint32_t index) const;
+
+    static uint32_t computeChecksum(const Record& record);
+    static size_t segmentFileSize(uint32_t capacity);
+};
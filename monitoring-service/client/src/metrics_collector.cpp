@@ -1,127 +1,719 @@
 #include "metrics_collector.h"
+#include "json_file_reader.h"
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
+#include <algorithm>
 #include <array>
 #include <filesystem>
 #include <cstdio>
+#include <cerrno>
+#include <cmath>
 #include <chrono>
 #include <regex>
+#include <ctime>
+#include <cstring>
+#include <cctype>
+#include <tuple>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
-MetricsCollector::MetricsCollector(const std::string& log_dir) 
-    : log_dir_(log_dir) {
+namespace {
+
+// Same format as READABLE_DATE in collect_metrics.sh
+std::string currentReadableDate() {
+    std::time_t now = std::time(nullptr);
+    std::tm tm_now{};
+    localtime_r(&now, &tm_now);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d_%H-%M-%S", &tm_now);
+    return buf;
+}
+
+std::string formatPercent(double value, int precision) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.*f%%", precision, value);
+    return buf;
+}
+
+// Same wording as "uptime -p"
+std::string formatUptime(double seconds) {
+    long minutes_total = static_cast<long>(seconds) / 60;
+    long weeks = minutes_total / (60 * 24 * 7);
+    long days = (minutes_total / (60 * 24)) % 7;
+    long hours = (minutes_total / 60) % 24;
+    long minutes = minutes_total % 60;
+
+    std::string result = "up";
+    bool first = true;
+    auto append = [&](long value, const char* unit) {
+        if (value == 0) return;
+        result += first ? " " : ", ";
+        result += std::to_string(value) + " " + unit + (value > 1 ? "s" : "");
+        first = false;
+    };
+    append(weeks, "week");
+    append(days, "day");
+    append(hours, "hour");
+    append(minutes, "minute");
+    if (first) result += " 0 minutes";
+    return result;
+}
+
+std::string trim(const std::string& value) {
+    size_t begin = value.find_first_not_of(" \t\n\"");
+    if (begin == std::string::npos) return "";
+    size_t end = value.find_last_not_of(" \t\n\"");
+    return value.substr(begin, end - begin + 1);
+}
+
+// collect_metrics.sh writes each file through a redirection, so a file can
+// be read while the script is still writing it: only a file whose JSON
+// object is closed counts
+bool isFullyWritten(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    std::streamoff size = file ? static_cast<std::streamoff>(file.tellg()) : 0;
+    if (size <= 0) return false;
+    char tail[64];
+    std::streamoff length = std::min<std::streamoff>(size, sizeof(tail));
+    file.seekg(size - length);
+    if (!file.read(tail, length)) return false;
+    for (std::streamoff i = length - 1; i >= 0; --i) {
+        if (!std::isspace(static_cast<unsigned char>(tail[i]))) return tail[i] == '}';
+    }
+    return false;
+}
+
+} // namespace
+
+MetricsCollector::MetricsCollector(const std::string& log_dir, CollectionMode mode) 
+    : log_dir_(log_dir), mode_(mode) {
     loadDeviceId();
+    if (mode_ == CollectionMode::Native) {
+        loadStaticInfo();
+        // Baseline for the first CPU delta
+        proc_stats::readCpuTicks(last_cpu_ticks_);
+
+        MetricStore::Options store_options;
+        store_options.directory = (fs::path(log_dir_).parent_path() / "store").string();
+        store_ = std::make_unique<MetricStore>(store_options);
+    } else {
+        initLogWatch();
+    }
+}
+
+MetricsCollector::~MetricsCollector() {
+    disableDeviceEvents();
+    if (window_sampler_) {
+        window_sampler_->stop();
+    }
+    if (inotify_fd_ >= 0) {
+        ::close(inotify_fd_);
+    }
 }
 
 std::pair<std::string, std::string> MetricsCollector::collectMetrics() {
+    if (inotify_fd_ < 0) {
+        std::tie(latest_hw_file_, latest_sw_file_) = scanLogDirectory();
+    } else {
+        // O(1): only the events queued since the last cycle are looked at
+        drainLogEvents();
+    }
+
+    if (latest_hw_file_.empty() || latest_sw_file_.empty()) {
+        std::string error = std::string("[Error] Not enough metric files. Found ") +
+                            (latest_hw_file_.empty() ? "0" : "1") + " hardware, " +
+                            (latest_sw_file_.empty() ? "0" : "1") + " software.";
+        std::cerr << error << std::endl;
+        throw std::runtime_error(error);
+    }
+
+    std::string hw_file_path = (fs::path(log_dir_) / latest_hw_file_).string();
+    std::string sw_file_path = (fs::path(log_dir_) / latest_sw_file_).string();
+    std::cout << "Selected files: " << hw_file_path << " and " << sw_file_path << std::endl;
+    return {hw_file_path, sw_file_path};
+}
+
+void MetricsCollector::initLogWatch() {
+    inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        std::cerr << "inotify unavailable, falling back to directory scans: "
+                  << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    // A file only becomes a candidate once the script has closed it
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM;
+    if (::inotify_add_watch(inotify_fd_, log_dir_.c_str(), mask) < 0) {
+        std::cerr << "Failed to watch " << log_dir_ << ": " << std::strerror(errno)
+                  << ", falling back to directory scans" << std::endl;
+        ::close(inotify_fd_);
+        inotify_fd_ = -1;
+        return;
+    }
+
+    // Seed the index from what is already on disk (one scan at startup);
+    // a type without a file yet fills as the script writes one
+    std::tie(latest_hw_file_, latest_sw_file_) = scanLogDirectory();
+}
+
+void MetricsCollector::drainLogEvents() {
+    alignas(struct inotify_event) char buf[4096];
+    bool rescan = false;
+
+    while (true) {
+        ssize_t len = ::read(inotify_fd_, buf, sizeof(buf));
+        if (len <= 0) break;
+
+        for (char* ptr = buf; ptr < buf + len;) {
+            auto* event = reinterpret_cast<struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                rescan = true;
+                continue;
+            }
+            if (event->len == 0) continue;
+
+            std::string filename(event->name);
+            std::string* latest = nullptr;
+            if (filename.find("hardware_metrics") != std::string::npos) {
+                latest = &latest_hw_file_;
+            } else if (filename.find("software_metrics") != std::string::npos) {
+                latest = &latest_sw_file_;
+            } else {
+                continue;
+            }
+
+            if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                // File names embed the date, so the greatest name is the newest
+                if (filename > *latest && isFullyWritten(fs::path(log_dir_) / filename)) *latest = filename;
+            } else if (filename == *latest) {
+                // The indexed file went away, find the next newest one
+                rescan = true;
+            }
+        }
+    }
+
+    if (rescan) {
+        std::tie(latest_hw_file_, latest_sw_file_) = scanLogDirectory();
+    }
+}
+
+std::pair<std::string, std::string> MetricsCollector::scanLogDirectory() {
     std::cout << "Searching for latest metrics files in: " << log_dir_ << std::endl;
 
-    std::vector<fs::directory_entry> hw_files;
-    std::vector<fs::directory_entry> sw_files;
+    std::vector<std::string> hw_files;
+    std::vector<std::string> sw_files;
 
     // Récupère tous les fichiers metrics
-    for (const auto& entry : fs::directory_iterator(log_dir_)) {
-        if (!fs::is_regular_file(entry)) continue;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(log_dir_, ec)) {
+        if (!entry.is_regular_file(ec)) continue;
         std::string filename = entry.path().filename().string();
 
         if (filename.find("hardware_metrics") != std::string::npos) {
-            hw_files.push_back(entry);
+            hw_files.push_back(filename);
         } else if (filename.find("software_metrics") != std::string::npos) {
-            sw_files.push_back(entry);
+            sw_files.push_back(filename);
         }
     }
 
-    // Trie les fichiers par date (extrait depuis le nom)
-    auto fileTimeComparator = [](const fs::directory_entry& a, const fs::directory_entry& b) {
-        return a.path().filename().string() > b.path().filename().string(); 
+    // Same rule as the inotify index: the newest fully written file of each type.
+    // File names embed the date, so the greatest name is the newest
+    auto newest = [this](std::vector<std::string>& files) {
+        std::sort(files.begin(), files.end(), std::greater<std::string>());
+        for (const auto& filename : files) {
+            if (isFullyWritten(fs::path(log_dir_) / filename)) return filename;
+        }
+        return std::string();
     };
+    return {newest(hw_files), newest(sw_files)};
+}
 
-    std::sort(hw_files.begin(), hw_files.end(), fileTimeComparator);
-    std::sort(sw_files.begin(), sw_files.end(), fileTimeComparator);
+MetricsCollector::HardwareMetrics MetricsCollector::parseHardwareMetrics(const std::string& file_path) {
+    MappedFile file(file_path);
+    JsonCursor json(file.data());
 
-    // Accept at least 1 file of each type
-    if (hw_files.empty() || sw_files.empty()) {
-        std::string error = "[Error] Not enough metric files. Found " + 
-                            std::to_string(hw_files.size()) + " hardware, " +
-                            std::to_string(sw_files.size()) + " software.";
-        std::cerr << error << std::endl;
-        throw std::runtime_error(error);
+    HardwareMetrics metrics;
+    metrics.device_id = device_id_;
+    metrics.usb_data = "none";
+    int required = 0;
+    json.forEachMember([&](std::string_view key) {
+        if (key == "readable_date") {
+            json.readString(metrics.readable_date);
+            required |= 1;
+        } else if (key == "cpu_usage") {
+            json.readString(metrics.cpu_usage);
+            required |= 2;
+        } else if (key == "memory_usage") {
+            json.readString(metrics.memory_usage);
+            required |= 4;
+        } else if (key == "disk_usage") {
+            json.readString(metrics.disk_usage_root);
+            required |= 8;
+        } else if (key == "gpio_state") {
+            metrics.gpio_state = static_cast<int>(json.readInt());
+            required |= 16;
+        } else if (key == "usb_state") {
+            json.readString(metrics.usb_data);
+        } else if (key == "kernel_version") {
+            json.readString(metrics.kernel_version);
+        } else if (key == "hardware_model") {
+            json.readString(metrics.hardware_model);
+        } else if (key == "firmware_version") {
+            json.readString(metrics.firmware_version);
+        }
+    });
+    json.expectEnd();
+    if (required != 31) {
+        throw std::runtime_error("Missing hardware metrics in " + file_path);
     }
+    return metrics;
+}
 
-    // Use the most recent file if only one exists, otherwise the second most recent
-    std::string hw_file_path = hw_files.size() > 1 ? hw_files[1].path().string() : hw_files[0].path().string();
-    std::string sw_file_path = sw_files.size() > 1 ? sw_files[1].path().string() : sw_files[0].path().string();
+MetricsCollector::SoftwareMetrics MetricsCollector::parseSoftwareMetrics(const std::string& file_path) {
+    MappedFile file(file_path);
+    JsonCursor json(file.data());
 
-    std::cout << "Selected files: " << hw_file_path << " and " << sw_file_path << std::endl;
-    return {hw_file_path, sw_file_path};
+    SoftwareMetrics metrics;
+    metrics.device_id = device_id_;
+    int required = 0;
+    std::string name, value;
+    json.forEachMember([&](std::string_view key) {
+        if (key == "readable_date") {
+            json.readString(metrics.readable_date);
+            required |= 1;
+        } else if (key == "ip_address") {
+            json.readString(metrics.ip_address);
+            required |= 2;
+        } else if (key == "uptime") {
+            json.readString(metrics.uptime);
+            required |= 4;
+        } else if (key == "network_status") {
+            json.readString(metrics.network_status);
+            required |= 8;
+        } else if (key == "os_version") {
+            json.readString(metrics.os_version);
+        } else if (key == "applications" && json.peek() == JsonCursor::Type::Array) {
+            // [{"name": ..., "version": ...}]; the script writes {} when there are none
+            json.forEachElement([&]() {
+                name.clear();
+                value.clear();
+                json.forEachMember([&](std::string_view field) {
+                    if (field == "name") json.readString(name);
+                    else if (field == "version") json.readString(value);
+                });
+                metrics.applications.emplace_back(name, value);
+            });
+        } else if (key == "services") {
+            json.forEachMember([&](std::string_view service) {
+                json.readString(value);
+                metrics.services[std::string(service)] = value;
+            });
+            required |= 16;
+        }
+    });
+    json.expectEnd();
+    if (required != 31) {
+        throw std::runtime_error("Missing software metrics in " + file_path);
+    }
+    return metrics;
 }
 
-
-MetricsCollector::HardwareMetrics MetricsCollector::parseHardwareMetrics(const std::string& file_path) {
-    nlohmann::json json = readJsonFile(file_path);
+MetricsCollector::HardwareMetrics MetricsCollector::sampleHardwareMetrics(
+    const std::vector<SamplingScheduler::Decision>& sampling) {
+    MetricStore::Record record{};
+    record.timestamp = static_cast<int64_t>(std::time(nullptr));
 
     HardwareMetrics metrics;
     metrics.device_id = device_id_;
-    metrics.readable_date = json["readable_date"];
-    metrics.cpu_usage = json["cpu_usage"];
-    metrics.memory_usage = json["memory_usage"];
-    metrics.disk_usage_root = json["disk_usage"];
-    metrics.usb_data = json.contains("usb_state") ? json["usb_state"].get<std::string>() : "none";
-    metrics.gpio_state = json["gpio_state"];
-    metrics.kernel_version = json.value("kernel_version", "");
-    metrics.hardware_model = json.value("hardware_model", "");
-    metrics.firmware_version = json.value("firmware_version", "");
+    metrics.readable_date = currentReadableDate();
+    metrics.sampling = sampling;
+    for (const auto& decision : sampling) {
+        size_t index = static_cast<size_t>(decision.metric_class);
+        if (index < 3) {
+            record.sample_interval[index] = static_cast<uint16_t>(std::min<uint32_t>(decision.interval_seconds, 0xffff));
+            record.sample_reason[index] = static_cast<uint8_t>(decision.reason);
+            record.sample_stretch[index] = static_cast<uint8_t>(std::min<uint32_t>(decision.stretch, 0xff));
+        }
+    }
+
+    proc_stats::CpuTicks ticks;
+    if (proc_stats::readCpuTicks(ticks)) {
+        double usage = 0.0;
+        if (ticks.total > last_cpu_ticks_.total) {
+            usage = proc_stats::cpuUsagePercent(last_cpu_ticks_, ticks);
+        } else if (ticks.total > 0) {
+            // No baseline yet, fall back to the average since boot
+            usage = static_cast<double>(ticks.busy) * 100.0 / static_cast<double>(ticks.total);
+        }
+        last_cpu_ticks_ = ticks;
+        record.cpu_usage = static_cast<float>(usage);
+        metrics.cpu_usage = formatPercent(usage, 1);
+    } else {
+        std::cerr << "Failed to read /proc/stat" << std::endl;
+        record.cpu_usage = std::nanf("");
+        metrics.cpu_usage = "";
+    }
+
+    proc_stats::MemInfo mem;
+    if (proc_stats::readMemInfo(mem)) {
+        double usage = proc_stats::memoryUsagePercent(mem);
+        record.memory_usage = static_cast<float>(usage);
+        metrics.memory_usage = formatPercent(usage, 2);
+    } else {
+        std::cerr << "Failed to read /proc/meminfo" << std::endl;
+        record.memory_usage = std::nanf("");
+        metrics.memory_usage = "";
+    }
+
+    double disk = 0.0;
+    if (proc_stats::readDiskUsagePercent("/", disk)) {
+        // df rounds the percentage up
+        record.disk_usage = static_cast<float>(std::ceil(disk));
+        metrics.disk_usage_root = std::to_string(static_cast<int>(std::ceil(disk))) + "%";
+    } else {
+        std::cerr << "Failed to stat root filesystem" << std::endl;
+        record.disk_usage = std::nanf("");
+        metrics.disk_usage_root = "";
+    }
+
+    double uptime_seconds = 0.0;
+    if (proc_stats::readUptimeSeconds(uptime_seconds)) {
+        record.uptime_seconds = static_cast<uint32_t>(uptime_seconds);
+    }
+
+    // With hotplug events the list only changes after one of them
+    if (!device_watcher_ || !device_watcher_->watchesUsb() || usb_changed_.exchange(false)) {
+        usb_devices_ = proc_stats::listUsbDevices();
+    }
+    record.usb_device_count = static_cast<uint32_t>(usb_devices_.size());
+    metrics.usb_data = formatUsbState(usb_devices_);
+    metrics.gpio_state = readGpioState();
+    record.gpio_state = metrics.gpio_state;
+    metrics.kernel_version = kernel_version_;
+    metrics.hardware_model = hardware_model_;
+    metrics.firmware_version = firmware_version_;
+    metrics.agent = agent_usage_;
+    if (window_sampler_) {
+        window_sampler_->takeWindow(metrics.cpu_window, metrics.memory_window);
+    }
+    if (process_sampler_ && !optional_deferred_) {
+        // Same values the scheduler reacts to: the window p95 when there is one
+        process_sampler_->sample(
+            metrics.cpu_window.samples > 0 ? metrics.cpu_window.p95 : record.cpu_usage,
+            metrics.memory_window.samples > 0 ? metrics.memory_window.p95 : record.memory_usage,
+            metrics.top_cpu, metrics.top_memory);
+    }
+
+    if (store_) {
+        metrics.sequence = store_->append(record);
+    }
+    last_hw_sample_ = metrics;
     return metrics;
 }
 
-MetricsCollector::SoftwareMetrics MetricsCollector::parseSoftwareMetrics(const std::string& file_path) {
-    nlohmann::json json = readJsonFile(file_path);
+void MetricsCollector::enableWindowSampling(const WindowSampler::Options& options) {
+    if (mode_ != CollectionMode::Native || window_sampler_) return;
+    window_sampler_ = std::make_unique<WindowSampler>(options);
+    window_sampler_->start();
+}
+
+void MetricsCollector::enableProcessSampling(const ProcessSampler::Options& options) {
+    if (mode_ != CollectionMode::Native || process_sampler_) return;
+    process_sampler_ = std::make_unique<ProcessSampler>(options);
+}
+
+void MetricsCollector::setAgentUsage(const SelfBudget::Usage& usage) {
+    agent_usage_ = usage;
+}
+
+void MetricsCollector::deferOptionalCollectors(bool defer) {
+    if (defer == optional_deferred_) return;
+    optional_deferred_ = defer;
+    if (window_sampler_) {
+        // Readings taken so far still summarize into the next sample
+        if (defer) {
+            window_sampler_->stop();
+        } else {
+            window_sampler_->start();
+        }
+    }
+}
+
+bool MetricsCollector::enableDeviceEvents(const DeviceEventWatcher::Options& options,
+                                          DeviceEventHandler handler) {
+    if (mode_ != CollectionMode::Native || device_watcher_) return false;
+    auto watcher = std::make_unique<DeviceEventWatcher>(options);
+    bool started = watcher->start([this, handler](const DeviceEventWatcher::Event& event, bool resync) {
+        if (resync || event.kind != DeviceEventWatcher::Event::Kind::GpioChanged) {
+            usb_changed_ = true;
+        }
+        if (!resync) {
+            handler(event, readGpioState());
+        }
+    });
+    if (!started) return false;
+    usb_changed_ = true;
+    device_watcher_ = std::move(watcher);
+    return true;
+}
 
+void MetricsCollector::disableDeviceEvents() {
+    if (device_watcher_) {
+        device_watcher_->stop();
+        device_watcher_.reset();
+    }
+}
+
+std::vector<MetricsCollector::HardwareMetrics> MetricsCollector::readHardwareBacklog(size_t max_samples,
+                                                                                    uint64_t after_sequence) {
+    std::vector<HardwareMetrics> backlog;
+    if (!store_) return backlog;
+
+    for (const auto& record : store_->readSince(std::max(store_->readCursor(), after_sequence), max_samples)) {
+        if (record.sequence == last_hw_sample_.sequence) {
+            // The newest sample is still in memory with its full string fields
+            backlog.push_back(last_hw_sample_);
+            continue;
+        }
+
+        // Older samples keep only the numeric fields. USB, kernel, model and
+        // firmware stay empty: the current ones may not have been true then
+        HardwareMetrics metrics;
+        metrics.device_id = device_id_;
+        metrics.sequence = record.sequence;
+        metrics.replayed = true;
+        std::time_t timestamp = static_cast<std::time_t>(record.timestamp);
+        std::tm tm_sample{};
+        localtime_r(&timestamp, &tm_sample);
+        char date[32];
+        std::strftime(date, sizeof(date), "%Y-%m-%d_%H-%M-%S", &tm_sample);
+        metrics.readable_date = date;
+        metrics.cpu_usage = std::isnan(record.cpu_usage) ? "" : formatPercent(record.cpu_usage, 1);
+        metrics.memory_usage = std::isnan(record.memory_usage) ? "" : formatPercent(record.memory_usage, 2);
+        metrics.disk_usage_root = std::isnan(record.disk_usage) ? ""
+            : std::to_string(static_cast<int>(record.disk_usage)) + "%";
+        metrics.gpio_state = record.gpio_state;
+        // Windows, process lists and agent usage are not stored, older samples only carry the point values
+        for (size_t index = 0; index < 3; ++index) {
+            if (record.sample_interval[index] == 0) continue;  // stored before scheduling
+            SamplingScheduler::Decision decision;
+            decision.metric_class = static_cast<SamplingScheduler::MetricClass>(index);
+            decision.interval_seconds = record.sample_interval[index];
+            decision.reason = static_cast<SamplingScheduler::Reason>(record.sample_reason[index]);
+            decision.stretch = std::max<uint32_t>(record.sample_stretch[index], 1);
+            metrics.sampling.push_back(decision);
+        }
+        backlog.push_back(metrics);
+    }
+    return backlog;
+}
+
+void MetricsCollector::commitHardware(uint64_t sequence) {
+    if (store_) {
+        store_->commitCursor(sequence);
+    }
+}
+
+MetricsCollector::SoftwareMetrics MetricsCollector::sampleSoftwareMetrics(
+    const std::vector<SamplingScheduler::Decision>& sampling) {
     SoftwareMetrics metrics;
     metrics.device_id = device_id_;
-    metrics.readable_date = json["readable_date"];
-    metrics.ip_address = json["ip_address"];
-    metrics.uptime = json["uptime"];
-    metrics.network_status = json["network_status"];
-    metrics.os_version = json.value("os_version", "");
-    // Parse applications array
-    if (json.contains("applications") && json["applications"].is_array()) {
-        for (const auto& app : json["applications"]) {
-            metrics.applications.push_back({
-                app["name"].get<std::string>(),
-                app["version"].get<std::string>()
-            });
+    metrics.readable_date = currentReadableDate();
+    metrics.sampling = sampling;
+    metrics.ip_address = readIpAddress();
+
+    double uptime_seconds = 0.0;
+    metrics.uptime = proc_stats::readUptimeSeconds(uptime_seconds) ? formatUptime(uptime_seconds) : "";
+
+    metrics.network_status = probeNetworkStatus();
+    metrics.os_version = os_version_;
+    metrics.applications = scanApplications();
+    for (const auto& service : monitored_services_) {
+        metrics.services[service] = readServiceStatus(service);
+    }
+    return metrics;
+}
+
+void MetricsCollector::loadStaticInfo() {
+    struct utsname uts;
+    kernel_version_ = (::uname(&uts) == 0) ? uts.release : "unknown";
+
+    // RPi exposes "Model" in /proc/cpuinfo, other boards in the device tree
+    hardware_model_.clear();
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.rfind("Model", 0) == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) hardware_model_ = trim(line.substr(colon + 1));
+            break;
         }
     }
-    // Parse services
-    for (auto& [service, status] : json["services"].items()) {
-        metrics.services[service] = status;
+    if (hardware_model_.empty()) {
+        char buf[256];
+        if (proc_stats::readFile("/proc/device-tree/model", buf, sizeof(buf)) > 0) {
+            hardware_model_ = trim(std::string(buf));
+        }
+    }
+
+    // vcgencmd would need a fork, the native mode does not report it
+    firmware_version_ = "unknown";
+
+    os_version_ = "unknown";
+    std::ifstream os_release("/etc/os-release");
+    while (std::getline(os_release, line)) {
+        if (line.rfind("PRETTY_NAME=", 0) == 0) {
+            os_version_ = trim(line.substr(std::strlen("PRETTY_NAME=")));
+            break;
+        }
     }
-    return metrics;
 }
 
-nlohmann::json MetricsCollector::readJsonFile(const std::string& file_path) {
-    std::ifstream file(file_path);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open JSON file: " + file_path);
+std::string MetricsCollector::formatUsbState(const std::vector<std::string>& devices) {
+    if (devices.empty()) return "none";
+
+    std::string state;
+    for (const auto& device : devices) {
+        if (!state.empty()) state += " | ";
+        state += device;
     }
-    
-    nlohmann::json json;
-    try {
-        file >> json;
-    } catch (const std::exception& e) {
-        throw std::runtime_error("Failed to parse JSON file: " + std::string(e.what()));
+    return state;
+}
+
+int MetricsCollector::readGpioState() {
+    // Count exported lines driven high, the sysfs equivalent of "gpio readall | grep -c ON"
+    int active = 0;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator("/sys/class/gpio", ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("gpio", 0) != 0 || name.rfind("gpiochip", 0) == 0) continue;
+
+        char buf[8];
+        std::string value_path = (entry.path() / "value").string();
+        if (proc_stats::readFile(value_path.c_str(), buf, sizeof(buf)) > 0 && buf[0] == '1') {
+            ++active;
+        }
+    }
+    return active;
+}
+
+std::string MetricsCollector::readIpAddress() {
+    // First non-loopback IPv4 address, like "hostname -I | awk '{print $1}'"
+    struct ifaddrs* addrs = nullptr;
+    if (::getifaddrs(&addrs) != 0) return "";
+
+    std::string ip;
+    for (struct ifaddrs* ifa = addrs; ifa; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET) continue;
+        auto* sin = reinterpret_cast<struct sockaddr_in*>(ifa->ifa_addr);
+        if (ntohl(sin->sin_addr.s_addr) >> 24 == 127) continue;
+
+        char buf[INET_ADDRSTRLEN];
+        if (::inet_ntop(AF_INET, &sin->sin_addr, buf, sizeof(buf))) {
+            ip = buf;
+            break;
+        }
     }
-    
-    return json;
+    ::freeifaddrs(addrs);
+    return ip;
+}
+
+std::string MetricsCollector::probeNetworkStatus() {
+    // Non-blocking TCP connect to the DNS port instead of forking ping
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return "unreachable";
+
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(53);
+    if (::inet_pton(AF_INET, ping_target_.c_str(), &addr.sin_addr) != 1) {
+        ::close(fd);
+        return "unreachable";
+    }
+
+    bool reachable = false;
+    int ret = ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    if (ret == 0) {
+        reachable = true;
+    } else if (errno == EINPROGRESS) {
+        struct pollfd pfd{fd, POLLOUT, 0};
+        if (::poll(&pfd, 1, 2000) == 1) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            reachable = (err == 0);
+        }
+    }
+    ::close(fd);
+    return reachable ? "reachable" : "unreachable";
+}
+
+std::string MetricsCollector::readServiceStatus(const std::string& service) {
+    // A systemd unit is running when its cgroup holds at least one process
+    const std::string candidates[] = {
+        "/sys/fs/cgroup/system.slice/" + service + ".service/cgroup.procs",
+        "/sys/fs/cgroup/systemd/system.slice/" + service + ".service/cgroup.procs",
+    };
+
+    for (const auto& path : candidates) {
+        char buf[64];
+        long n = proc_stats::readFile(path.c_str(), buf, sizeof(buf));
+        if (n < 0) continue;
+        return n > 0 ? "active" : "inactive";
+    }
+    return "inactive";
+}
+
+std::vector<std::pair<std::string, std::string>> MetricsCollector::scanApplications() {
+    // Same detection rules as collect_metrics.sh: /opt/<name>_<version>
+    static const std::regex versioned(R"(^(.+)_([0-9]+[a-zA-Z0-9._]*)$)");
+    std::map<std::string, std::string> apps;
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator("/opt", ec)) {
+        if (!entry.is_directory(ec)) continue;
+        std::string name = entry.path().filename().string();
+        if (name.find(".backup") != std::string::npos) continue;
+
+        std::smatch match;
+        if (std::regex_match(name, match, versioned)) {
+            std::string app = match[1];
+            std::string version = match[2];
+            auto it = apps.find(app);
+            if (it == apps.end() || it->second == "latest" || version > it->second) {
+                apps[app] = version;
+            }
+        } else if (name != "containerd" && name != "google" && name != "microsoft") {
+            apps.emplace(name, "latest");
+        }
+    }
+    return {apps.begin(), apps.end()};
 }
 
 std::string MetricsCollector::getDeviceId() const {
     return device_id_;
 }
 
+void MetricsCollector::setDeviceId(const std::string& device_id) {
+    device_id_ = device_id;
+}
+
+MetricsCollector::CollectionMode MetricsCollector::getMode() const {
+    return mode_;
+}
+
 void MetricsCollector::loadDeviceId() {
     // Change path to config.txt
     std::string config_file = (fs::path(log_dir_).parent_path() / "config" / "config.txt").string();
@@ -4,11 +4,30 @@
 #include <map>
 #include <vector>
 #include <memory>
-#include <nlohmann/json.hpp>
+#include <atomic>
+#include <functional>
+#include "proc_stats.h"
+#include "device_event_watcher.h"
+#include "metric_store.h"
+#include "process_sampler.h"
+#include "self_budget.h"
+#include "sampling_scheduler.h"
+#include "window_sampler.h"
 
 class MetricsCollector {
 public:
-    MetricsCollector(const std::string& log_dir_);
+    // Native reads /proc and sysfs in-process, Script parses the JSON files
+    // written by collect_metrics.sh (fallback mode)
+    enum class CollectionMode {
+        Native,
+        Script
+    };
+
+    MetricsCollector(const std::string& log_dir_, CollectionMode mode = CollectionMode::Native);
+    ~MetricsCollector();
+
+    MetricsCollector(const MetricsCollector&) = delete;
+    MetricsCollector& operator=(const MetricsCollector&) = delete;
 
     struct HardwareMetrics {
         std::string device_id;
@@ -21,6 +40,14 @@ public:
         std::string kernel_version;
         std::string hardware_model;
         std::string firmware_version;
+        uint64_t sequence = 0;      // MetricStore sequence, 0 when not stored
+        std::vector<SamplingScheduler::Decision> sampling;  // interval per class, empty when not scheduled
+        WindowSampler::Stats cpu_window;        // high-rate readings since the previous sample
+        WindowSampler::Stats memory_window;
+        std::vector<ProcessSampler::Process> top_cpu;      // only while the device is busy
+        std::vector<ProcessSampler::Process> top_memory;
+        SelfBudget::Usage agent;                        // the agent's own cost, window_seconds 0 when unknown
+        bool replayed = false;                          // read back from the store, not the sample just taken
     };
 
     struct SoftwareMetrics {
@@ -32,8 +59,10 @@ public:
         std::string os_version;
         std::vector<std::pair<std::string, std::string>> applications;
         std::map<std::string, std::string> services;
+        std::vector<SamplingScheduler::Decision> sampling;
     };
     //collect metrics from the latest log files 
+    // (served from an inotify index of the log directory, no directory scan per call)
     std::pair<std::string, std::string> collectMetrics();
 
     // Parse hardware metrics from JSON file
@@ -42,16 +71,102 @@ public:
     // Parse software metrics from JSON file
     SoftwareMetrics parseSoftwareMetrics(const std::string& file_path);
 
+    // Sample hardware metrics directly from /proc, sysfs and statvfs
+    // and append the numeric fields to the local metric store.
+    // sampling (cpu/memory/disk decisions) is stored with the sample.
+    HardwareMetrics sampleHardwareMetrics(const std::vector<SamplingScheduler::Decision>& sampling = {});
+
+    // Sample CPU and memory at a high rate between hardware samples and
+    // attach the window summaries to them (native mode only)
+    void enableWindowSampling(const WindowSampler::Options& options);
+
+    // Attach the busiest processes to hardware samples taken above the
+    // thresholds (native mode only)
+    void enableProcessSampling(const ProcessSampler::Options& options);
+
+    // Agent cost attached to the following hardware samples
+    void setAgentUsage(const SelfBudget::Usage& usage);
+
+    // Pause the window and process samplers while the agent is over its
+    // budget, resume them when it is back under
+    void deferOptionalCollectors(bool defer);
+
+    // Called on the watcher thread for each USB or GPIO change, with the
+    // active GPIO count read right after it
+    using DeviceEventHandler = std::function<void(const DeviceEventWatcher::Event& event, int gpio_state)>;
+
+    // Watch USB hotplug and gpiochip events (native mode only). While the
+    // uevent socket is open, samples reuse the USB device list until a
+    // change invalidates it. False when nothing could be watched.
+    bool enableDeviceEvents(const DeviceEventWatcher::Options& options, DeviceEventHandler handler);
+    void disableDeviceEvents();
+
+    // Stored samples not yet committed, oldest first (native mode only);
+    // those up to after_sequence are skipped, the publisher already holds them
+    std::vector<HardwareMetrics> readHardwareBacklog(size_t max_samples = 60, uint64_t after_sequence = 0);
+
+    // Mark every stored sample up to sequence as published
+    void commitHardware(uint64_t sequence);
+
+    // Sample software metrics without spawning any subprocess
+    SoftwareMetrics sampleSoftwareMetrics(const std::vector<SamplingScheduler::Decision>& sampling = {});
+
     // Gets the device ID (either from configuration or from system)
     std::string getDeviceId() const;
+    // Identity given by the caller instead (device agent, --device-id); call before sampling
+    void setDeviceId(const std::string& device_id);
+
+    CollectionMode getMode() const;
 
 private:
     std::string log_dir_;
     std::string device_id_;
+    CollectionMode mode_;
+
+    // Previous /proc/stat reading, CPU usage is computed from tick deltas
+    proc_stats::CpuTicks last_cpu_ticks_;
+
+    // Same defaults as collect_metrics.sh
+    std::vector<std::string> monitored_services_ = {"ssh", "cron", "mosquitto"};
+    std::string ping_target_ = "8.8.8.8";
+
+    // Local segment store replacing per-sample JSON files (native mode)
+    std::unique_ptr<MetricStore> store_;
+    HardwareMetrics last_hw_sample_{};
+    std::unique_ptr<WindowSampler> window_sampler_;
+    std::unique_ptr<ProcessSampler> process_sampler_;
+    std::unique_ptr<DeviceEventWatcher> device_watcher_;
+    std::atomic<bool> usb_changed_{true};           // set by the watcher, the next sample rescans
+    std::vector<std::string> usb_devices_;
+    SelfBudget::Usage agent_usage_;
+    bool optional_deferred_ = false;
+
+    // Values that do not change while the agent runs, read once
+    std::string kernel_version_;
+    std::string hardware_model_;
+    std::string firmware_version_;
+    std::string os_version_;
+
+    // inotify index of the newest fully written files in log_dir_, per type
+    int inotify_fd_ = -1;
+    std::string latest_hw_file_;
+    std::string latest_sw_file_;
+
+    void initLogWatch();
+    void drainLogEvents();
+
+    // Full directory scan, used to seed the index and when inotify is unavailable.
+    // Newest fully written hardware and software file names, empty when a type has none
+    std::pair<std::string, std::string> scanLogDirectory();
+
+    void loadStaticInfo();
+    std::string formatUsbState(const std::vector<std::string>& devices);
+    int readGpioState();
+    std::string readIpAddress();
+    std::string probeNetworkStatus();
+    std::string readServiceStatus(const std::string& service);
+    std::vector<std::pair<std::string, std::string>> scanApplications();
     
     // Load device ID from configuration file or environment
     void loadDeviceId();
-
-    // Parse JSON file
-    nlohmann::json readJsonFile(const std::string& file_path);
 };
\ No newline at end of file
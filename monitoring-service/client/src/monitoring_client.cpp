@@ -0,0 +1,480 @@
+#include "monitoring_client.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+ClientOptionResult ParseClientOption(int argc, char** argv, int& i, ClientOptions& options) {
+    std::string arg = argv[i];
+    if (arg == "--device-id" && i + 1 < argc) {
+        // Instead of the first line of client/config/config.txt
+        options.device_id = argv[++i];
+    } else if (arg == "--client-dir" && i + 1 < argc) {
+        options.client_dir = argv[++i];
+    } else if (arg == "--script") {
+        // Keep the legacy collect_metrics.sh + JSON files path
+        options.collection_mode = MetricsCollector::CollectionMode::Script;
+    } else if (arg == "--batch" && i + 1 < argc) {
+        // Publish up to N samples per message
+        options.batch_max_samples = std::stoul(argv[++i]);
+    } else if (arg == "--batch-age" && i + 1 < argc) {
+        options.batch_max_age = std::chrono::seconds(std::stol(argv[++i]));
+    } else if (arg == "--inventory-snapshot" && i + 1 < argc) {
+        // Seconds between full software inventory snapshots
+        options.inventory_snapshot_interval = std::chrono::seconds(std::stol(argv[++i]));
+    } else if (arg == "--compress") {
+        // zstd with the shipped dictionary, for metered uplinks
+        options.compress = true;
+    } else if (arg == "--dictionary" && i + 1 < argc) {
+        options.compress = true;
+        options.compression_dictionary = argv[++i];
+    } else if (arg == "--window-period" && i + 1 < argc) {
+        // Milliseconds between CPU/memory readings summarized per sample, 0 disables
+        options.window_period = std::chrono::milliseconds(std::stol(argv[++i]));
+    } else if (arg == "--top-processes" && i + 1 < argc) {
+        // Processes per list (CPU, RSS) attached to busy samples, 0 disables
+        options.processes.top_n = std::stoul(argv[++i]);
+    } else if (arg == "--top-cpu-threshold" && i + 1 < argc) {
+        options.processes.cpu_threshold = std::stod(argv[++i]);
+    } else if (arg == "--top-memory-threshold" && i + 1 < argc) {
+        options.processes.memory_threshold = std::stod(argv[++i]);
+    } else if (arg == "--no-device-events") {
+        // USB and GPIO changes only through the periodic samples
+        options.device_events = false;
+    } else if (arg == "--gpio-edge" && i + 1 < argc) {
+        // CHIP:LINE, e.g. gpiochip0:17, requested as an input for edge events (repeatable)
+        std::string spec = argv[++i];
+        size_t colon = spec.find(':');
+        if (colon == std::string::npos) {
+            std::cerr << "Expected CHIP:LINE for --gpio-edge: " << spec << std::endl;
+            return ClientOptionResult::Invalid;
+        }
+        options.device_event_options.gpio_edge_lines.push_back(
+            {spec.substr(0, colon), static_cast<uint32_t>(std::stoul(spec.substr(colon + 1)))});
+    } else if (arg == "--cpu-budget" && i + 1 < argc) {
+        // Percent of one CPU the agent may use on average, 0 disables the budget
+        options.budget.cpu_percent = std::stod(argv[++i]);
+    } else if (arg == "--io-budget" && i + 1 < argc) {
+        // Storage reads + writes in kB/s, 0 = no limit
+        options.budget.io_bytes_per_second = std::stoull(argv[++i]) * 1024;
+    } else if (arg == "--budget-window" && i + 1 < argc) {
+        options.budget.window = std::chrono::seconds(std::stol(argv[++i]));
+    } else if (arg == "--wire" && i + 1 < argc) {
+        // "protobuf" once the server understands it, older ones only take JSON
+        std::string format = argv[++i];
+        if (format == "json") {
+            options.wire_format = RabbitMQSender::WireFormat::Json;
+        } else if (format == "protobuf") {
+            options.wire_format = RabbitMQSender::WireFormat::Protobuf;
+        } else {
+            std::cerr << "Unknown wire format: " << format << std::endl;
+            return ClientOptionResult::Invalid;
+        }
+    } else {
+        return ClientOptionResult::Unknown;
+    }
+    return ClientOptionResult::Parsed;
+}
+
+MonitoringClient::MonitoringClient(std::shared_ptr<grpc::Channel> channel,
+                                   const std::string& amqp_uri,
+                                   const std::string& hardware_queue,
+                                   const std::string& software_queue,
+                                   const ClientOptions& options)
+    : channel_(std::move(channel)),
+      metrics_collector_(std::make_unique<MetricsCollector>(options.client_dir + "/logs", options.collection_mode)),
+      rabbitmq_sender_(std::make_unique<RabbitMQSender>(
+          "localhost", 5672, "guest", "guest", hardware_queue, software_queue)),
+      running_(false),
+      device_events_(options.device_events),
+      device_event_options_(options.device_event_options),
+      budget_(options.budget) {
+    if (!options.device_id.empty()) {
+        metrics_collector_->setDeviceId(options.device_id);
+    }
+    if (options.window_period.count() > 0) {
+        WindowSampler::Options window_options;
+        window_options.period = options.window_period;
+        metrics_collector_->enableWindowSampling(window_options);
+    }
+    if (options.processes.top_n > 0) {
+        metrics_collector_->enableProcessSampling(options.processes);
+    }
+    rabbitmq_sender_->setWireFormat(options.wire_format);
+    rabbitmq_sender_->setInventorySnapshotInterval(options.inventory_snapshot_interval);
+    if (options.compress && !rabbitmq_sender_->enableCompression(options.compression_dictionary)) {
+        std::cerr << "Payload compression unavailable, sending uncompressed" << std::endl;
+    }
+    rabbitmq_sender_->enableBatching(options.batch_max_samples, options.batch_max_age);
+
+    // Undeliverable messages survive broker outages and restarts on disk
+    MessageSpool::Options spool_options;
+    spool_options.path = options.client_dir + "/spool/spool.bin";
+    rabbitmq_sender_->enableSpool(spool_options);
+
+    // Connect to RabbitMQ; without a broker the client keeps sampling into the spool
+    if (!rabbitmq_sender_->connect()) {
+        std::cerr << "RabbitMQ unreachable, starting in store-and-forward mode" << std::endl;
+    }
+}
+
+std::string MonitoringClient::RegisterDevice() {
+    // The session connects in the background and reconnects on its own
+    monitoring::DeviceInfo hello;
+    hello.set_device_id(metrics_collector_->getDeviceId());
+    // Rules only run on native samples; the server alerts for script agents
+    hello.set_evaluates_rules(metrics_collector_->getMode() == MetricsCollector::CollectionMode::Native);
+    session_ = std::make_unique<SessionClient>(channel_, hello);
+    session_->start([this](const monitoring::ServerMessage& message) {
+        if (message.has_alert()) {
+            this->ProcessAlert(message.alert());
+        }
+    });
+
+    // Changes go up the session as they happen, ahead of the next sample
+    if (device_events_ && !metrics_collector_->enableDeviceEvents(device_event_options_,
+            [this](const DeviceEventWatcher::Event& event, int gpio_state) { SendDeviceEvent(event, gpio_state); })) {
+        std::cerr << "USB and GPIO changes are only seen in samples" << std::endl;
+    }
+
+    return metrics_collector_->getDeviceId();
+}
+
+void MonitoringClient::StartMonitoring() {
+    running_ = true;
+    metrics_thread_ = std::thread([this]() {
+        while (running_) {
+            std::this_thread::sleep_until(RunCycle());
+        }
+    });
+}
+
+SamplingScheduler::Clock::time_point MonitoringClient::RunCycle() {
+    using MetricClass = SamplingScheduler::MetricClass;
+    auto now = SamplingScheduler::Clock::now();
+    try {
+        // Collect and send hardware metrics
+        if (metrics_collector_->getMode() == MetricsCollector::CollectionMode::Native) {
+            ApplyRuleThresholds();
+
+            // One read covers cpu, memory and disk, taken when the most urgent class is due
+            auto due_classes = scheduler_.due({MetricClass::Cpu, MetricClass::Memory, MetricClass::Disk}, now);
+            if (!due_classes.empty()) {
+                auto hw_sample = metrics_collector_->sampleHardwareMetrics({
+                    scheduler_.current(MetricClass::Cpu), scheduler_.current(MetricClass::Memory),
+                    scheduler_.current(MetricClass::Disk)});
+                // Only the due classes are rescheduled, the others keep their
+                // interval. The window p95 also catches spikes between two samples
+                for (MetricClass metric_class : due_classes) {
+                    double value;
+                    if (metric_class == MetricClass::Cpu) {
+                        value = hw_sample.cpu_window.samples > 0
+                            ? hw_sample.cpu_window.p95 : SamplingScheduler::parsePercent(hw_sample.cpu_usage);
+                    } else if (metric_class == MetricClass::Memory) {
+                        value = hw_sample.memory_window.samples > 0
+                            ? hw_sample.memory_window.p95 : SamplingScheduler::parsePercent(hw_sample.memory_usage);
+                    } else {
+                        value = SamplingScheduler::parsePercent(hw_sample.disk_usage_root);
+                    }
+                    scheduler_.observe(metric_class, value, now);
+                }
+
+                // Act on local rules right away, the server only hears about it afterwards
+                for (const auto& alert : rule_engine_.evaluate(hw_sample)) {
+                    HandleLocalAlert(alert);
+                }
+
+                // Latest sample plus anything a previous cycle failed to publish,
+                // behind the samples already waiting in a batch
+                for (const auto& hw_metrics : metrics_collector_->readHardwareBacklog(
+                         60, rabbitmq_sender_->bufferedHardwareSequence())) {
+                    if (rabbitmq_sender_->sendHardwareMetrics(hw_metrics) == RabbitMQSender::SendResult::Failed) {
+                        break;
+                    }
+                }
+            }
+
+            if (scheduler_.due(MetricClass::Software, now)) {
+                auto sw_metrics = metrics_collector_->sampleSoftwareMetrics(
+                    {scheduler_.current(MetricClass::Software)});
+                bool changed = !have_sw_metrics_ || SoftwareChanged(last_sw_metrics_, sw_metrics);
+                scheduler_.observeChange(MetricClass::Software, changed, now);
+                rabbitmq_sender_->sendSoftwareMetrics(sw_metrics);
+                last_sw_metrics_ = std::move(sw_metrics);
+                have_sw_metrics_ = true;
+            }
+
+            LogSampling(scheduler_);
+        } else {
+            // Fallback: parse the files written by collect_metrics.sh
+            auto [hw_file, sw_file] = metrics_collector_->collectMetrics();
+            auto hw_metrics = metrics_collector_->parseHardwareMetrics(hw_file);
+            auto sw_metrics = metrics_collector_->parseSoftwareMetrics(sw_file);
+
+            rabbitmq_sender_->sendHardwareMetrics(hw_metrics);
+            rabbitmq_sender_->sendSoftwareMetrics(sw_metrics);
+        }
+
+        // Publish batches that reached their age limit
+        rabbitmq_sender_->flushBatches();
+        // Samples leave the store once published or spooled, not while batched
+        metrics_collector_->commitHardware(rabbitmq_sender_->durableHardwareSequence());
+
+        // Forward spooled messages, rate-limited so a backlog does not flood the broker
+        rabbitmq_sender_->drainSpool();
+        auto spool = rabbitmq_sender_->getSpoolStats();
+        std::cout << "Spool: " << spool.depth_messages << " message(s) / " << spool.depth_bytes
+                  << " bytes queued, " << spool.drain_throughput << " msg/s drain, "
+                  << spool.dropped_total << " dropped" << std::endl;
+
+        // Settle broker acks/nacks; nacked or timed-out messages are retried
+        rabbitmq_sender_->pollConfirms();
+        auto confirms = rabbitmq_sender_->getConfirmStats();
+        std::cout << "Publisher confirms: " << confirms.confirmed << " confirmed, "
+                  << confirms.in_flight << " in flight, " << confirms.retried << " retried, "
+                  << confirms.dropped << " dropped" << std::endl;
+        auto compression = rabbitmq_sender_->getCompressionStats();
+        if (compression.messages > 0) {
+            std::cout << "Compression: " << compression.raw_bytes << " -> " << compression.wire_bytes
+                      << " bytes (ratio " << compression.ratio() << ")" << std::endl;
+        }
+        auto batches = rabbitmq_sender_->getBatchStats();
+        if (batches.flushes > 0) {
+            std::cout << "Batches: " << batches.flushes << " flushed, " << batches.samples << " sample(s), "
+                      << static_cast<int>(batches.averageFillRatio() * 100) << " % full on average, flush latency avg "
+                      << batches.averageFlushLatencyMs() << " ms, max " << batches.flush_latency_ms_max << " ms"
+                      << std::endl;
+        }
+        
+        // Heartbeats carry this status whenever the session is otherwise idle
+        session_->setStatus("Metrics collected and sent");
+        LogSession(session_->getStats());
+        
+    } catch (const std::exception& e) {
+        std::cerr << "Error in metrics collection: " << e.what() << std::endl;
+    }
+    
+    if (metrics_collector_->getMode() == MetricsCollector::CollectionMode::Native &&
+        budget_.options().cpu_percent > 0) {
+        // Over its own budget the agent samples less and skips the optional collectors
+        auto usage = budget_.update(SamplingScheduler::Clock::now());
+        if (usage.stretch != scheduler_.stretch()) {
+            std::cout << "Agent " << (usage.stretch > scheduler_.stretch() ? "over" : "back under")
+                      << " its budget, sampling intervals x" << usage.stretch << std::endl;
+        }
+        scheduler_.setStretch(usage.stretch);
+        metrics_collector_->deferOptionalCollectors(usage.stretch > 1);
+        metrics_collector_->setAgentUsage(usage);
+        LogAgentUsage(usage);
+    }
+
+    if (metrics_collector_->getMode() == MetricsCollector::CollectionMode::Native) {
+        // Wake for the next due class, and at least once a minute for
+        // batches, spool, confirms and the status heartbeat
+        return std::min(scheduler_.nextDue(), now + kHousekeepingInterval);
+    }
+    // The script runs from cron once a minute
+    return now + std::chrono::seconds(60);
+}
+
+void MonitoringClient::StopMonitoring() {
+    running_ = false;
+    if (metrics_thread_.joinable()) {
+        metrics_thread_.join();
+    }
+    // Before the session its events go to
+    metrics_collector_->disableDeviceEvents();
+    // Kills commands still running; their results would have nowhere to go
+    command_executor_.stop();
+    if (session_) {
+        session_->stop();
+    }
+}
+
+void MonitoringClient::ApplyRuleThresholds() {
+    // The rules arrive on the session's thread, the scheduler is only used here
+    uint64_t version = rule_engine_.version();
+    if (version == scheduler_rules_version_) {
+        return;
+    }
+    scheduler_rules_version_ = version;
+
+    using MetricClass = SamplingScheduler::MetricClass;
+    for (auto metric_class : {MetricClass::Cpu, MetricClass::Memory, MetricClass::Disk}) {
+        const char* metric = SamplingScheduler::className(metric_class);
+        SamplingScheduler::Thresholds thresholds{rule_engine_.threshold(metric, monitoring::Alert::WARNING),
+                                                 rule_engine_.threshold(metric, monitoring::Alert::CRITICAL)};
+        if (std::isnan(thresholds.warning) || std::isnan(thresholds.critical)) {
+            continue;
+        }
+        scheduler_.setThresholds(metric_class, thresholds);
+        std::cout << "Sampling " << metric << " against the server's thresholds: warning "
+                  << thresholds.warning << "%, critical " << thresholds.critical << "%" << std::endl;
+    }
+}
+
+bool MonitoringClient::SoftwareChanged(const MetricsCollector::SoftwareMetrics& previous,
+                                       const MetricsCollector::SoftwareMetrics& current) {
+    return previous.ip_address != current.ip_address || previous.network_status != current.network_status ||
+           previous.services != current.services || previous.applications != current.applications;
+}
+
+void MonitoringClient::LogSampling(const SamplingScheduler& scheduler) {
+    std::cout << "Sampling intervals:";
+    for (size_t i = 0; i < SamplingScheduler::kClassCount; ++i) {
+        auto decision = scheduler.current(static_cast<SamplingScheduler::MetricClass>(i));
+        std::cout << " " << SamplingScheduler::className(decision.metric_class) << "="
+                  << decision.interval_seconds << "s (" << SamplingScheduler::reasonName(decision.reason);
+        if (decision.stretch > 1) {
+            std::cout << ", x" << decision.stretch;
+        }
+        std::cout << ")";
+    }
+    std::cout << std::endl;
+}
+
+void MonitoringClient::LogAgentUsage(const SelfBudget::Usage& usage) {
+    std::cout << "Agent usage: " << usage.cpu_percent << "% CPU (budget " << usage.cpu_budget_percent
+              << "%) over " << usage.window_seconds << " s, " << usage.io_bytes_per_second
+              << " B/s storage I/O, stretch x" << usage.stretch << std::endl;
+}
+
+void MonitoringClient::LogSession(const SessionClient::Stats& stats) {
+    std::cout << "Device session: " << SessionClient::stateName(stats.state) << ", "
+              << stats.sessions << " session(s), " << stats.disconnects << " disconnect(s), "
+              << stats.queued << " queued, " << stats.unacked << " unacked, "
+              << stats.dropped << " dropped";
+    if (stats.state == SessionClient::State::Backoff) {
+        std::cout << ", retry in " << stats.next_backoff.count() << " ms";
+    }
+    if (!stats.last_error.empty()) {
+        std::cout << ", last error: " << stats.last_error;
+    }
+    std::cout << std::endl;
+}
+
+void MonitoringClient::SendDeviceEvent(const DeviceEventWatcher::Event& event, int gpio_state) {
+    std::cout << "[INFO] Device event: " << DeviceEventWatcher::kindName(event.kind);
+    if (event.kind == DeviceEventWatcher::Event::Kind::GpioChanged) {
+        std::cout << " " << event.gpio_chip << " line " << event.gpio_line << " " << event.gpio_change
+                  << " (" << gpio_state << " active)";
+    } else {
+        std::cout << " " << event.usb_device;
+    }
+    std::cout << std::endl;
+
+    monitoring::DeviceMessage message;
+    auto* device_event = message.mutable_event();
+    switch (event.kind) {
+        case DeviceEventWatcher::Event::Kind::UsbAdded: device_event->set_kind(monitoring::DeviceEvent::USB_ADDED); break;
+        case DeviceEventWatcher::Event::Kind::UsbRemoved: device_event->set_kind(monitoring::DeviceEvent::USB_REMOVED); break;
+        case DeviceEventWatcher::Event::Kind::GpioChanged: device_event->set_kind(monitoring::DeviceEvent::GPIO_CHANGED); break;
+    }
+    device_event->set_timestamp_ms(event.timestamp_ms);
+    device_event->set_usb_device(event.usb_device);
+    device_event->set_gpio_chip(event.gpio_chip);
+    device_event->set_gpio_line(event.gpio_line);
+    device_event->set_gpio_change(event.gpio_change);
+    device_event->set_gpio_state(gpio_state);
+    if (!session_->send(std::move(message))) {
+        std::cerr << "Device session queue full, oldest message dropped" << std::endl;
+    }
+}
+
+void MonitoringClient::ExecuteCorrectiveCommand(const monitoring::Alert& alert) {
+    std::vector<std::string> commands;
+    std::istringstream iss(alert.corrective_command());
+    std::string cmd;
+    while (std::getline(iss, cmd, ';')) {
+        if (!cmd.empty()) {
+            commands.push_back(cmd);
+        }
+    }
+    if (commands.empty()) {
+        return;
+    }
+
+    uint64_t alert_id = alert.alert_id();
+    std::string rule_id = alert.rule_id();
+    bool queued = command_executor_.submit(commands, [this, alert_id, rule_id](const CommandExecutor::Result& r) {
+        std::cout << "[INFO] Corrective command: " << r.command << " - exit " << r.exit_code
+                  << " in " << r.duration.count() << " ms" << std::endl;
+        if (r.exit_code != 0) {
+            std::cerr << "[ERROR] Command failed: " << r.command;
+            if (r.timed_out) std::cerr << " (timed out)";
+            else if (r.signal != 0) std::cerr << " (signal " << r.signal << ")";
+            if (!r.error.empty()) std::cerr << " (" << r.error << ")";
+            std::cerr << std::endl;
+        }
+
+        monitoring::DeviceMessage result;
+        auto* command_result = result.mutable_command_result();
+        command_result->set_alert_id(alert_id);
+        command_result->set_rule_id(rule_id);
+        command_result->set_command(r.command);
+        command_result->set_exit_code(r.exit_code);
+        command_result->set_signal(r.signal);
+        command_result->set_timed_out(r.timed_out);
+        command_result->set_duration_ms(r.duration.count());
+        command_result->set_latency_ms(r.latency.count());
+        command_result->set_output(r.output);
+        command_result->set_output_truncated(r.output_truncated);
+        command_result->set_error(r.error);
+        session_->send(std::move(result));
+    });
+    if (!queued) {
+        std::cerr << "[ERROR] Too many corrective commands pending, skipped: " << alert.corrective_command() << std::endl;
+    }
+}
+
+void MonitoringClient::ProcessAlert(const monitoring::Alert& alert) {
+    // Not an alert: the server lost track of our inventory deltas
+    if (alert.alert_type() == "INVENTORY_RESYNC") {
+        std::cout << "Server requested an inventory resync, next software sample is a full snapshot" << std::endl;
+        rabbitmq_sender_->requestInventorySnapshot();
+        return;
+    }
+    // Not an alert either: thresholds to evaluate locally from now on
+    if (alert.alert_type() == "RULES_UPDATE") {
+        if (rule_engine_.update(alert.rules())) {
+            std::cout << "Loaded " << alert.rules().rules_size() << " local rule(s), version "
+                      << alert.rules().version() << std::endl;
+        }
+        return;
+    }
+
+    std::cout << "=== ALERT RECEIVED ===" << std::endl;
+    ActOnAlert(alert);
+}
+
+void MonitoringClient::HandleLocalAlert(const monitoring::Alert& alert) {
+    std::cout << "=== LOCAL ALERT (rule " << alert.rule_id() << ") ===" << std::endl;
+    ActOnAlert(alert);
+
+    monitoring::DeviceMessage message;
+    *message.mutable_alert() = alert;
+    if (!session_->send(std::move(message))) {
+        std::cerr << "Device session queue full, oldest message dropped" << std::endl;
+    }
+}
+
+void MonitoringClient::ActOnAlert(const monitoring::Alert& alert) {
+    std::cout << "Type: " << alert.alert_type() << std::endl;
+    std::cout << "Severity: " << monitoring::Alert::Severity_Name(alert.severity()) << std::endl;
+    std::cout << "Description: " << alert.description() << std::endl;
+    std::cout << "Recommended Action: " << alert.recommended_action() << std::endl;
+    std::cout << "Timestamp: " << alert.timestamp() << std::endl;
+    if (alert.processes_size() > 0) {
+        std::cout << "Top processes:" << std::endl;
+        for (const auto& process : alert.processes()) {
+            std::cout << "  " << process.pid() << " " << process.name() << " cpu " << process.cpu_percent()
+                      << "% rss " << process.rss_kb() << " kB" << std::endl;
+        }
+    }
+    if (!alert.corrective_command().empty()) {
+        std::cout << "Corrective Command(s): " << alert.corrective_command() << std::endl;
+        ExecuteCorrectiveCommand(alert);
+    }
+    std::cout << "=====================" << std::endl;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <grpcpp/grpcpp.h>
+#include "monitoring.grpc.pb.h"
+
+#include "command_executor.h"
+#include "metrics_collector.h"
+#include "rabbitmq_sender.h"
+#include "rule_engine.h"
+#include "sampling_scheduler.h"
+#include "session_client.h"
+
+// Runtime options, set from the command line (ParseClientOption)
+struct ClientOptions {
+    MetricsCollector::CollectionMode collection_mode = MetricsCollector::CollectionMode::Native;
+    size_t batch_max_samples = 1;                       // 1 = one message per sample
+    std::chrono::seconds batch_max_age{300};
+    RabbitMQSender::WireFormat wire_format = RabbitMQSender::WireFormat::Json;    // protobuf is opt-in
+    std::chrono::seconds inventory_snapshot_interval{3600};  // full inventory, deltas in between
+    bool compress = false;
+    std::string compression_dictionary = "../../dictionaries/metrics-v1.zdict";
+    std::chrono::milliseconds window_period{1000};          // high-rate CPU/memory readings, 0 = off
+    ProcessSampler::Options processes;                      // top_n 0 = off
+    bool device_events = true;                              // USB hotplug and gpiochip events
+    DeviceEventWatcher::Options device_event_options;
+    SelfBudget::Options budget;                             // cpu_percent 0 = no budget
+    std::string device_id;                                  // empty = first line of client/config/config.txt
+    std::string client_dir = "../../client";                // logs, config and spool, relative to client/build
+};
+
+enum class ClientOptionResult { Parsed, Unknown, Invalid };
+
+// Parses the monitoring option at argv[i], advancing i past its value.
+// Shared by monitoring_test and the device agent.
+ClientOptionResult ParseClientOption(int argc, char** argv, int& i, ClientOptions& options);
+
+class MonitoringClient {
+public:
+    MonitoringClient(std::shared_ptr<grpc::Channel> channel,
+                     const std::string& amqp_uri,
+                     const std::string& hardware_queue,
+                     const std::string& software_queue,
+                     const ClientOptions& options);
+
+    // Open the device session with the monitoring server
+    std::string RegisterDevice();
+
+    // Start monitoring and sending metrics on a thread of its own
+    void StartMonitoring();
+
+    // One collection cycle: samples whatever is due, publishes, and returns
+    // when the next cycle should run. The device agent calls it from its
+    // shared timer thread instead of StartMonitoring().
+    SamplingScheduler::Clock::time_point RunCycle();
+
+    void StopMonitoring();
+
+private:
+    static constexpr std::chrono::seconds kHousekeepingInterval{60};
+
+    // The server's thresholds, once its rules arrived, drive the sampling intervals
+    void ApplyRuleThresholds();
+    // Anything that would show up in an inventory delta or a network alert
+    static bool SoftwareChanged(const MetricsCollector::SoftwareMetrics& previous,
+                                const MetricsCollector::SoftwareMetrics& current);
+    static void LogSampling(const SamplingScheduler& scheduler);
+    static void LogAgentUsage(const SelfBudget::Usage& usage);
+    static void LogSession(const SessionClient::Stats& stats);
+
+    // Runs on the device event watcher's thread
+    void SendDeviceEvent(const DeviceEventWatcher::Event& event, int gpio_state);
+    // Runs on the executor's workers; each result goes up the session as soon as it is known
+    void ExecuteCorrectiveCommand(const monitoring::Alert& alert);
+    void ProcessAlert(const monitoring::Alert& alert);
+    void HandleLocalAlert(const monitoring::Alert& alert);
+    void ActOnAlert(const monitoring::Alert& alert);
+
+    std::shared_ptr<grpc::Channel> channel_;
+    std::unique_ptr<MetricsCollector> metrics_collector_;
+    std::unique_ptr<RabbitMQSender> rabbitmq_sender_;
+    RuleEngine rule_engine_;
+    std::atomic<bool> running_;
+    std::thread metrics_thread_;
+    bool device_events_;
+    DeviceEventWatcher::Options device_event_options_;
+    SamplingScheduler scheduler_;
+    uint64_t scheduler_rules_version_ = 0;      // RuleSet the scheduler's thresholds come from
+    SelfBudget budget_;
+    MetricsCollector::SoftwareMetrics last_sw_metrics_;
+    bool have_sw_metrics_ = false;
+
+    // Device session: one long-lived stream for alerts, acks, command results and heartbeats
+    std::unique_ptr<SessionClient> session_;
+
+    // Declared after the session it reports to, so it is torn down first
+    CommandExecutor command_executor_;
+};
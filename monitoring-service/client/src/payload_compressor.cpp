@@ -0,0 +1,83 @@
+#include "payload_compressor.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+PayloadCompressor::PayloadCompressor()
+    : cctx_(nullptr), cdict_(nullptr), dict_id_(0) {
+}
+
+PayloadCompressor::~PayloadCompressor() {
+#ifdef HAVE_ZSTD
+    ZSTD_freeCDict(static_cast<ZSTD_CDict*>(cdict_));
+    ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(cctx_));
+#endif
+}
+
+bool PayloadCompressor::load(const std::string& dictionary_path, int level) {
+#ifdef HAVE_ZSTD
+    std::ifstream file(dictionary_path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open compression dictionary " << dictionary_path << std::endl;
+        return false;
+    }
+    std::string dictionary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // Only trained dictionaries carry an id, raw content would be ambiguous for the consumer
+    unsigned dict_id = ZSTD_getDictID_fromDict(dictionary.data(), dictionary.size());
+    if (dict_id == 0) {
+        std::cerr << "Compression dictionary " << dictionary_path << " has no dictionary id" << std::endl;
+        return false;
+    }
+
+    ZSTD_CDict* cdict = ZSTD_createCDict(dictionary.data(), dictionary.size(), level);
+    ZSTD_CCtx* cctx = cctx_ ? static_cast<ZSTD_CCtx*>(cctx_) : ZSTD_createCCtx();
+    if (!cdict || !cctx) {
+        std::cerr << "Failed to load compression dictionary " << dictionary_path << std::endl;
+        ZSTD_freeCDict(cdict);
+        return false;
+    }
+
+    ZSTD_freeCDict(static_cast<ZSTD_CDict*>(cdict_));
+    cdict_ = cdict;
+    cctx_ = cctx;
+    dict_id_ = dict_id;
+    std::cout << "Payload compression enabled: zstd level " << level << ", dictionary "
+              << dict_id_ << " (" << dictionary.size() << " bytes)" << std::endl;
+    return true;
+#else
+    std::cerr << "Built without zstd, ignoring compression dictionary " << dictionary_path << std::endl;
+    return false;
+#endif
+}
+
+bool PayloadCompressor::enabled() const {
+    return cdict_ != nullptr;
+}
+
+uint32_t PayloadCompressor::dictionaryId() const {
+    return dict_id_;
+}
+
+bool PayloadCompressor::compress(const std::string& body, std::string& out) {
+#ifdef HAVE_ZSTD
+    if (!cdict_) return false;
+
+    out.resize(ZSTD_compressBound(body.size()));
+    size_t size = ZSTD_compress_usingCDict(static_cast<ZSTD_CCtx*>(cctx_), &out[0], out.size(),
+                                           body.data(), body.size(),
+                                           static_cast<const ZSTD_CDict*>(cdict_));
+    if (ZSTD_isError(size) || size >= body.size()) {
+        return false;
+    }
+    out.resize(size);
+    return true;
+#else
+    (void)body;
+    (void)out;
+    return false;
+#endif
+}
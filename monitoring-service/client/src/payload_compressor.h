@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Optional zstd compression of message bodies with a trained dictionary.
+//
+// Metric payloads are small and repetitive, so plain zstd gains little on a
+// single message; a dictionary trained on typical payloads (shipped in
+// dictionaries/, see tools/train_dictionary) primes the compressor with the
+// keys and common values. The dictionary id is sent with every message so the
+// consumer can pick the same dictionary. Without HAVE_ZSTD, load() fails and
+// messages go out uncompressed.
+class PayloadCompressor {
+public:
+    static constexpr const char* kAlgorithm = "zstd";
+
+    PayloadCompressor();
+    ~PayloadCompressor();
+
+    PayloadCompressor(const PayloadCompressor&) = delete;
+    PayloadCompressor& operator=(const PayloadCompressor&) = delete;
+
+    // Load a dictionary file; false (compression stays off) on error
+    bool load(const std::string& dictionary_path, int level = 3);
+
+    bool enabled() const;
+    uint32_t dictionaryId() const;
+
+    // Compress body into out; false when the result would not be smaller
+    bool compress(const std::string& body, std::string& out);
+
+private:
+    void* cctx_;        // ZSTD_CCtx*, zstd.h stays out of this header
+    void* cdict_;       // ZSTD_CDict*
+    uint32_t dict_id_;
+};
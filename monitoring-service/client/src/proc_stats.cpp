@@ -0,0 +1,177 @@
+#include "proc_stats.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+namespace proc_stats {
+
+long readFile(const char* path, char* buf, size_t size) {
+    if (size == 0) return -1;
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    size_t used = 0;
+    while (used < size - 1) {
+        ssize_t n = ::read(fd, buf + used, size - 1 - used);
+        if (n < 0) {
+            ::close(fd);
+            return -1;
+        }
+        if (n == 0) break;
+        used += static_cast<size_t>(n);
+    }
+    ::close(fd);
+
+    buf[used] = '\0';
+    return static_cast<long>(used);
+}
+
+bool readCpuTicks(CpuTicks& out) {
+    // Only the aggregate "cpu " line is needed, it is always first
+    char buf[512];
+    if (readFile("/proc/stat", buf, sizeof(buf)) <= 0) return false;
+    if (std::strncmp(buf, "cpu ", 4) != 0) return false;
+
+    // user nice system idle iowait irq softirq steal
+    uint64_t fields[8] = {0};
+    const char* p = buf + 4;
+    for (int i = 0; i < 8; ++i) {
+        char* end = nullptr;
+        fields[i] = std::strtoull(p, &end, 10);
+        if (end == p) break;
+        p = end;
+    }
+
+    uint64_t idle = fields[3] + fields[4];
+    uint64_t total = 0;
+    for (uint64_t f : fields) total += f;
+
+    out.total = total;
+    out.busy = total - idle;
+    return true;
+}
+
+double cpuUsagePercent(const CpuTicks& prev, const CpuTicks& curr) {
+    if (curr.total <= prev.total || curr.busy < prev.busy) return 0.0;
+    double busy = static_cast<double>(curr.busy - prev.busy);
+    double total = static_cast<double>(curr.total - prev.total);
+    return std::min(100.0, busy * 100.0 / total);
+}
+
+bool readMemInfo(MemInfo& out) {
+    char buf[4096];
+    if (readFile("/proc/meminfo", buf, sizeof(buf)) <= 0) return false;
+
+    struct Field {
+        const char* key;
+        uint64_t* value;
+    } fields[] = {
+        {"MemTotal:", &out.total_kb},
+        {"MemFree:", &out.free_kb},
+        {"MemAvailable:", &out.available_kb},
+        {"Buffers:", &out.buffers_kb},
+        {"Cached:", &out.cached_kb},
+    };
+
+    for (const auto& field : fields) {
+        const char* line = std::strstr(buf, field.key);
+        if (line) {
+            *field.value = std::strtoull(line + std::strlen(field.key), nullptr, 10);
+        }
+    }
+
+    // Kernels before 3.14 have no MemAvailable
+    if (out.available_kb == 0) {
+        out.available_kb = out.free_kb + out.buffers_kb + out.cached_kb;
+    }
+    return out.total_kb > 0;
+}
+
+double memoryUsagePercent(const MemInfo& info) {
+    if (info.total_kb == 0) return 0.0;
+    uint64_t available = std::min(info.available_kb, info.total_kb);
+    return static_cast<double>(info.total_kb - available) * 100.0 / static_cast<double>(info.total_kb);
+}
+
+bool readDiskUsagePercent(const char* path, double& percent) {
+    struct statvfs st;
+    if (::statvfs(path, &st) != 0) return false;
+
+    uint64_t used = static_cast<uint64_t>(st.f_blocks - st.f_bfree) * st.f_frsize;
+    uint64_t avail = static_cast<uint64_t>(st.f_bavail) * st.f_frsize;
+    if (used + avail == 0) {
+        percent = 0.0;
+        return true;
+    }
+    percent = static_cast<double>(used) * 100.0 / static_cast<double>(used + avail);
+    return true;
+}
+
+bool readUptimeSeconds(double& seconds) {
+    char buf[128];
+    if (readFile("/proc/uptime", buf, sizeof(buf)) <= 0) return false;
+    seconds = std::strtod(buf, nullptr);
+    return true;
+}
+
+namespace {
+
+std::string readSysfsAttribute(const std::string& dir, const char* name) {
+    char buf[256];
+    std::string path = dir + "/" + name;
+    if (readFile(path.c_str(), buf, sizeof(buf)) <= 0) return "";
+    std::string value(buf);
+    while (!value.empty() && (value.back() == '\n' || value.back() == ' ')) {
+        value.pop_back();
+    }
+    return value;
+}
+
+} // namespace
+
+std::string describeUsbDevice(const std::string& device_dir) {
+    std::string vendor = readSysfsAttribute(device_dir, "idVendor");
+    if (vendor.empty()) return "";
+
+    std::string product_id = readSysfsAttribute(device_dir, "idProduct");
+    std::string manufacturer = readSysfsAttribute(device_dir, "manufacturer");
+    std::string product = readSysfsAttribute(device_dir, "product");
+    int bus = std::atoi(readSysfsAttribute(device_dir, "busnum").c_str());
+    int dev = std::atoi(readSysfsAttribute(device_dir, "devnum").c_str());
+
+    char line[512];
+    std::snprintf(line, sizeof(line), "Bus %03d Device %03d: ID %s:%s %s%s%s",
+                  bus, dev, vendor.c_str(), product_id.c_str(), manufacturer.c_str(),
+                  (!manufacturer.empty() && !product.empty()) ? " " : "", product.c_str());
+    return line;
+}
+
+std::vector<std::string> listUsbDevices(const std::string& sysfs_root) {
+    std::vector<std::string> devices;
+
+    DIR* dir = ::opendir(sysfs_root.c_str());
+    if (!dir) return devices;
+
+    while (struct dirent* entry = ::readdir(dir)) {
+        // Interfaces look like "1-1:1.0", only device nodes carry idVendor
+        if (entry->d_name[0] == '.' || std::strchr(entry->d_name, ':')) continue;
+
+        std::string line = describeUsbDevice(sysfs_root + "/" + entry->d_name);
+        if (!line.empty()) {
+            devices.push_back(std::move(line));
+        }
+    }
+    ::closedir(dir);
+
+    // Same ordering as lsusb output
+    std::sort(devices.begin(), devices.end());
+    return devices;
+}
+
+} // namespace proc_stats
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Low-level readers for /proc, sysfs and statvfs used by the native sampler.
+// Everything here reads the kernel interfaces directly: no subprocesses,
+// no temporary files.
+namespace proc_stats {
+
+// Aggregate CPU tick counters from the first line of /proc/stat
+struct CpuTicks {
+    uint64_t busy = 0;
+    uint64_t total = 0;
+};
+
+// Subset of /proc/meminfo, values in kB
+struct MemInfo {
+    uint64_t total_kb = 0;
+    uint64_t free_kb = 0;
+    uint64_t available_kb = 0;
+    uint64_t buffers_kb = 0;
+    uint64_t cached_kb = 0;
+};
+
+// Read a small pseudo-file into buf (NUL terminated), returns bytes read or -1
+long readFile(const char* path, char* buf, size_t size);
+
+bool readCpuTicks(CpuTicks& out);
+
+// CPU usage between two readings, 0-100
+double cpuUsagePercent(const CpuTicks& prev, const CpuTicks& curr);
+
+bool readMemInfo(MemInfo& out);
+
+// Used memory as a percentage of MemTotal (MemTotal - MemAvailable)
+double memoryUsagePercent(const MemInfo& info);
+
+// Disk usage of the filesystem holding path, computed like df: used / (used + avail)
+bool readDiskUsagePercent(const char* path, double& percent);
+
+bool readUptimeSeconds(double& seconds);
+
+// lsusb-style line of one USB device directory in sysfs, empty when it is
+// not a device node (interface, hub port)
+std::string describeUsbDevice(const std::string& device_dir);
+
+// lsusb-style lines ("Bus 001 Device 001: ID 1d6b:0002 Linux Foundation 2.0 root hub")
+// built from /sys/bus/usb/devices
+std::vector<std::string> listUsbDevices(const std::string& sysfs_root = "/sys/bus/usb/devices");
+
+} // namespace proc_stats
@@ -0,0 +1,143 @@
+#include "process_sampler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+#include "proc_stats.h"
+
+ProcessSampler::ProcessSampler() : ProcessSampler(Options{}) {
+}
+
+ProcessSampler::ProcessSampler(const Options& options)
+    : options_(options),
+      clock_ticks_(std::max(1L, ::sysconf(_SC_CLK_TCK))),
+      page_kb_(std::max(1L, ::sysconf(_SC_PAGESIZE) / 1024)),
+      cpu_count_(std::max(1L, ::sysconf(_SC_NPROCESSORS_ONLN))) {
+}
+
+bool ProcessSampler::sample(double cpu_usage, double memory_usage,
+                            std::vector<Process>& top_cpu, std::vector<Process>& top_memory) {
+    top_cpu.clear();
+    top_memory.clear();
+    if (options_.top_n == 0) return false;
+
+    // NaN (unreadable usage) compares false, no scan either
+    if (!(cpu_usage >= options_.cpu_threshold) && !(memory_usage >= options_.memory_threshold)) {
+        if (!table_.empty()) {
+            std::unordered_map<int32_t, Entry>().swap(table_);
+            std::vector<Candidate>().swap(candidates_);
+            last_total_ticks_ = 0;
+        }
+        return false;
+    }
+    scan(top_cpu, top_memory);
+    return true;
+}
+
+void ProcessSampler::scan(std::vector<Process>& top_cpu, std::vector<Process>& top_memory) {
+    // Process ticks are compared with the ticks of all CPUs over the same
+    // interval, so 100% means every CPU busy, like cpu_usage
+    proc_stats::CpuTicks cpu;
+    uint64_t total = proc_stats::readCpuTicks(cpu) ? cpu.total : 0;
+    uint64_t elapsed = (last_total_ticks_ > 0 && total > last_total_ticks_) ? total - last_total_ticks_ : 0;
+    last_total_ticks_ = total;
+
+    double uptime = 0.0;
+    proc_stats::readUptimeSeconds(uptime);
+    uint64_t now_ticks = static_cast<uint64_t>(uptime * static_cast<double>(clock_ticks_));
+
+    DIR* dir = ::opendir("/proc");
+    if (!dir) return;
+
+    ++scan_;
+    candidates_.clear();
+    char path[32];
+    char buf[512];
+    while (struct dirent* entry = ::readdir(dir)) {
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+        char* end = nullptr;
+        long pid = std::strtol(entry->d_name, &end, 10);
+        if (*end != '\0') continue;
+
+        std::snprintf(path, sizeof(path), "/proc/%ld/stat", pid);
+        if (proc_stats::readFile(path, buf, sizeof(buf)) <= 0) continue;   // exited meanwhile
+
+        // "pid (comm) state ...", comm may itself hold spaces and parentheses
+        const char* open = std::strchr(buf, '(');
+        const char* close = std::strrchr(buf, ')');
+        if (!open || !close || close < open || close[1] == '\0') continue;
+
+        // Fields after comm, numbered as in proc(5): 14 utime, 15 stime,
+        // 22 starttime, 24 rss (pages, same value as statm's resident)
+        uint64_t utime = 0, stime = 0, start_time = 0, rss_pages = 0;
+        const char* p = close + 2;
+        for (int field = 3; field <= 24 && *p; ++field) {
+            char* next = nullptr;
+            if (field == 14 || field == 15 || field == 22 || field == 24) {
+                uint64_t value = std::strtoull(p, &next, 10);
+                if (field == 14) utime = value;
+                else if (field == 15) stime = value;
+                else if (field == 22) start_time = value;
+                else rss_pages = value;
+                p = next;
+            } else {
+                while (*p && *p != ' ') ++p;
+            }
+            while (*p == ' ') ++p;
+        }
+
+        Candidate candidate{};
+        candidate.pid = static_cast<int32_t>(pid);
+        candidate.rss_kb = rss_pages * static_cast<uint64_t>(page_kb_);
+        size_t name_len = std::min<size_t>(static_cast<size_t>(close - open - 1), sizeof(candidate.name) - 1);
+        std::memcpy(candidate.name, open + 1, name_len);
+        candidate.name[name_len] = '\0';
+
+        uint64_t ticks = utime + stime;
+        Entry& known = table_[candidate.pid];
+        if (known.scan != 0 && known.start_time == start_time && elapsed > 0 && ticks >= known.ticks) {
+            candidate.cpu_percent = static_cast<float>(
+                std::min(100.0, static_cast<double>(ticks - known.ticks) * 100.0 / static_cast<double>(elapsed)));
+        } else if (now_ticks > start_time) {
+            // New process or first scan: average since it started
+            candidate.cpu_percent = static_cast<float>(std::min(100.0,
+                static_cast<double>(ticks) * 100.0 /
+                (static_cast<double>(now_ticks - start_time) * static_cast<double>(cpu_count_))));
+        }
+        known.start_time = start_time;
+        known.ticks = ticks;
+        known.scan = scan_;
+        candidates_.push_back(candidate);
+    }
+    ::closedir(dir);
+
+    // Forget processes that exited since the previous scan
+    for (auto it = table_.begin(); it != table_.end();) {
+        if (it->second.scan != scan_) {
+            it = table_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    selectTop(true, top_cpu);
+    selectTop(false, top_memory);
+}
+
+void ProcessSampler::selectTop(bool by_cpu, std::vector<Process>& out) {
+    size_t count = std::min(options_.top_n, candidates_.size());
+    std::partial_sort(candidates_.begin(), candidates_.begin() + count, candidates_.end(),
+                      [by_cpu](const Candidate& a, const Candidate& b) {
+        if (by_cpu && a.cpu_percent != b.cpu_percent) return a.cpu_percent > b.cpu_percent;
+        return a.rss_kb > b.rss_kb;
+    });
+
+    out.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const Candidate& candidate = candidates_[i];
+        if (by_cpu ? candidate.cpu_percent <= 0.0f : candidate.rss_kb == 0) break;
+        out.push_back(Process{candidate.pid, candidate.name, candidate.cpu_percent, candidate.rss_kb});
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Top-N processes by CPU and by resident memory, attached to the hardware
+// sample while the device is busy.
+//
+// Each scan reads /proc/[pid]/stat once per process and keeps the CPU ticks
+// of every pid in a table, so the CPU of a process is its tick delta since
+// the previous scan. Below both thresholds nothing is scanned and the table
+// is dropped; the first scan after that falls back to the average since each
+// process started.
+class ProcessSampler {
+public:
+    struct Options {
+        size_t top_n = 5;                   // per list
+        double cpu_threshold = 75.0;        // percent, same default as the server's warning
+        double memory_threshold = 80.0;
+    };
+
+    struct Process {
+        int32_t pid = 0;
+        std::string name;
+        float cpu_percent = 0.0f;           // share of all CPUs
+        uint64_t rss_kb = 0;
+    };
+
+    ProcessSampler();
+    explicit ProcessSampler(const Options& options);
+
+    // Fills both lists when cpu_usage or memory_usage (percent) reaches its
+    // threshold, clears them otherwise. False when nothing was scanned.
+    bool sample(double cpu_usage, double memory_usage,
+                std::vector<Process>& top_cpu, std::vector<Process>& top_memory);
+
+private:
+    struct Entry {
+        uint64_t start_time = 0;            // ticks after boot, tells a reused pid apart
+        uint64_t ticks = 0;                 // utime + stime
+        uint32_t scan = 0;                  // last scan that saw it
+    };
+
+    struct Candidate {
+        int32_t pid;
+        float cpu_percent;
+        uint64_t rss_kb;
+        char name[16];
+    };
+
+    Options options_;
+    std::unordered_map<int32_t, Entry> table_;
+    std::vector<Candidate> candidates_;     // reused between scans
+    uint64_t last_total_ticks_ = 0;         // /proc/stat, all CPUs
+    uint32_t scan_ = 0;
+    long clock_ticks_;
+    long page_kb_;
+    long cpu_count_;
+
+    void scan(std::vector<Process>& top_cpu, std::vector<Process>& top_memory);
+    // Highest top_n candidates by CPU or by RSS, idle or kernel entries left out
+    void selectTop(bool by_cpu, std::vector<Process>& out);
+};
@@ -1,22 +1,127 @@
 #include "rabbitmq_sender.h"
 #include <iostream>
+#include <algorithm>
+#include <iterator>
 #include <amqp_framing.h>
 #include <nlohmann/json.hpp>
 #include <amqp_tcp_socket.h>
 
+namespace {
+
+// Base 128 varint, as used by the protobuf wire format
+void appendVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+// Same repeated SamplingInfo field on HardwareMetrics and SoftwareMetrics
+template <typename Message>
+void addSampling(const std::vector<SamplingScheduler::Decision>& sampling, Message& message) {
+    for (const auto& decision : sampling) {
+        auto* info = message.add_sampling();
+        info->set_metric_class(SamplingScheduler::className(decision.metric_class));
+        info->set_interval_seconds(decision.interval_seconds);
+        info->set_reason(SamplingScheduler::reasonName(decision.reason));
+        info->set_stretch(decision.stretch);
+    }
+}
+
+void setWindow(const WindowSampler::Stats& stats, monitoring::WindowStats& message) {
+    message.set_samples(stats.samples);
+    message.set_window_seconds(stats.window_seconds);
+    message.set_min(stats.min);
+    message.set_max(stats.max);
+    message.set_mean(stats.mean);
+    message.set_p95(stats.p95);
+}
+
+void addProcesses(const std::vector<ProcessSampler::Process>& processes,
+                  google::protobuf::RepeatedPtrField<monitoring::ProcessUsage>& out) {
+    for (const auto& process : processes) {
+        auto* usage = out.Add();
+        usage->set_pid(process.pid);
+        usage->set_name(process.name);
+        usage->set_cpu_percent(process.cpu_percent);
+        usage->set_rss_kb(process.rss_kb);
+    }
+}
+
+nlohmann::json processesToJson(const std::vector<ProcessSampler::Process>& processes) {
+    nlohmann::json entries = nlohmann::json::array();
+    for (const auto& process : processes) {
+        entries.push_back({{"pid", process.pid}, {"name", process.name},
+                           {"cpu_percent", process.cpu_percent}, {"rss_kb", process.rss_kb}});
+    }
+    return entries;
+}
+
+void setAgentUsage(const SelfBudget::Usage& usage, monitoring::AgentUsage& message) {
+    message.set_cpu_percent(static_cast<float>(usage.cpu_percent));
+    message.set_cpu_budget_percent(static_cast<float>(usage.cpu_budget_percent));
+    message.set_io_bytes_per_second(static_cast<float>(usage.io_bytes_per_second));
+    message.set_cpu_ms_total(usage.cpu_ms_total);
+    message.set_read_bytes_total(usage.read_bytes_total);
+    message.set_write_bytes_total(usage.write_bytes_total);
+    message.set_window_seconds(usage.window_seconds);
+    message.set_stretch(usage.stretch);
+    message.set_over_budget(usage.over_budget);
+}
+
+nlohmann::json agentUsageToJson(const SelfBudget::Usage& usage) {
+    return {{"cpu_percent", usage.cpu_percent}, {"cpu_budget_percent", usage.cpu_budget_percent},
+            {"io_bytes_per_second", usage.io_bytes_per_second}, {"cpu_ms_total", usage.cpu_ms_total},
+            {"read_bytes_total", usage.read_bytes_total}, {"write_bytes_total", usage.write_bytes_total},
+            {"window_seconds", usage.window_seconds}, {"stretch", usage.stretch}, {"over_budget", usage.over_budget}};
+}
+
+nlohmann::json windowToJson(const WindowSampler::Stats& stats) {
+    return {{"samples", stats.samples}, {"window_seconds", stats.window_seconds}, {"min", stats.min},
+            {"max", stats.max}, {"mean", stats.mean}, {"p95", stats.p95}};
+}
+
+nlohmann::json samplingToJson(const std::vector<SamplingScheduler::Decision>& sampling) {
+    nlohmann::json entries = nlohmann::json::array();
+    for (const auto& decision : sampling) {
+        entries.push_back({{"metric_class", SamplingScheduler::className(decision.metric_class)},
+                           {"interval_seconds", decision.interval_seconds},
+                           {"reason", SamplingScheduler::reasonName(decision.reason)},
+                           {"stretch", decision.stretch}});
+    }
+    return entries;
+}
+
+} // namespace
+
 RabbitMQSender::RabbitMQSender(const std::string& hostname, int port,
                              const std::string& username, const std::string& password,
                              const std::string& hw_queue_name, const std::string& sw_queue_name)
     : hostname_(hostname), port_(port), username_(username), password_(password),
       hw_queue_name_(hw_queue_name), sw_queue_name_(sw_queue_name),
-      conn_(nullptr), channel_(1), connected_(false) {
+      conn_(nullptr), channel_(1), connected_(false), wire_format_(WireFormat::Json),
+      batch_max_samples_(1), batch_max_age_(0), hw_durable_sequence_(0),
+      next_delivery_tag_(1), max_in_flight_(64),
+      confirm_timeout_(std::chrono::seconds(10)), max_publish_attempts_(5),
+      compression_min_size_(32), reconnect_interval_(std::chrono::seconds(30)) {
 }
 
 RabbitMQSender::~RabbitMQSender() {
+    if (connected_) {
+        flushBatches(true);
+        // Give the broker a chance to confirm what is still outstanding
+        waitForConfirms(confirm_timeout_, 0);
+    }
     disconnect();
 }
 
 bool RabbitMQSender::connect() {
+    // Drop what is left of a broken connection before opening a new one
+    if (conn_) {
+        disconnect();
+    }
+
     // Create connection
     conn_ = amqp_new_connection();
     if (!conn_) {
@@ -54,6 +159,15 @@ bool RabbitMQSender::connect() {
     if (!checkAMQPResponse(reply, "Opening channel")) {
         return false;
     }
+
+    // Publisher confirms: the broker acks or nacks every publish asynchronously
+    amqp_confirm_select(conn_, channel_);
+    reply = amqp_get_rpc_reply(conn_);
+    if (!checkAMQPResponse(reply, "Enabling publisher confirms")) {
+        return false;
+    }
+    // Delivery tags restart at 1 on every new channel
+    next_delivery_tag_ = 1;
     
     // Declare hardware queue
     amqp_queue_declare(conn_, channel_, amqp_cstring_bytes(hw_queue_name_.c_str()),
@@ -72,6 +186,18 @@ bool RabbitMQSender::connect() {
     }
     
     connected_ = true;
+
+    // Messages left unconfirmed by the previous connection are published again
+    if (!in_flight_.empty()) {
+        std::map<uint64_t, InFlightMessage> unconfirmed;
+        unconfirmed.swap(in_flight_);
+        std::cout << "Republishing " << unconfirmed.size() << " unconfirmed message(s)" << std::endl;
+        for (auto& [tag, message] : unconfirmed) {
+            if (!publish(std::move(message))) {
+                spoolMessage(message);
+            }
+        }
+    }
     return true;
 }
 
@@ -87,72 +213,550 @@ if (conn_) {
 }
 }
 
-bool RabbitMQSender::sendHardwareMetrics(const MetricsCollector::HardwareMetrics& metrics) {
-    if (!connected_) {
-        if (!connect()) {
-            std::cerr << "Reconnect failed" << std::endl;
+RabbitMQSender::SendResult RabbitMQSender::sendHardwareMetrics(const MetricsCollector::HardwareMetrics& metrics) {
+    std::string message = serializeHardwareMetrics(metrics);
+    if (batch_max_samples_ > 1) {
+        return enqueueSample(hw_batch_, hw_queue_name_, std::move(message), metrics.sequence);
+    }
+    if (!sendMessage(hw_queue_name_, message, sampleContentType())) {
+        return SendResult::Failed;
+    }
+    hw_durable_sequence_ = std::max(hw_durable_sequence_, metrics.sequence);
+    return SendResult::Sent;
+}
+
+RabbitMQSender::SendResult RabbitMQSender::sendSoftwareMetrics(const MetricsCollector::SoftwareMetrics& metrics) {
+    InventoryTracker::Update inventory = inventory_.next(metrics.services, metrics.applications);
+    std::string message = serializeSoftwareMetrics(metrics, inventory);
+    if (batch_max_samples_ > 1) {
+        return enqueueSample(sw_batch_, sw_queue_name_, std::move(message));
+    }
+    return sendMessage(sw_queue_name_, message, sampleContentType()) ? SendResult::Sent : SendResult::Failed;
+}
+
+uint64_t RabbitMQSender::bufferedHardwareSequence() const {
+    return std::max(hw_durable_sequence_, hw_batch_.last_sequence);
+}
+
+void RabbitMQSender::setInventorySnapshotInterval(std::chrono::seconds interval) {
+    inventory_.setSnapshotInterval(interval);
+}
+
+void RabbitMQSender::requestInventorySnapshot() {
+    inventory_.requestSnapshot();
+}
+
+bool RabbitMQSender::enableCompression(const std::string& dictionary_path, int level, size_t min_size) {
+    compression_min_size_ = min_size;
+    return compressor_.load(dictionary_path, level);
+}
+
+RabbitMQSender::CompressionStats RabbitMQSender::getCompressionStats() const {
+    return compression_stats_;
+}
+
+void RabbitMQSender::setWireFormat(WireFormat format) {
+    wire_format_ = format;
+}
+
+const char* RabbitMQSender::sampleContentType() const {
+    return wire_format_ == WireFormat::Protobuf ? kProtobufContentType : kJsonContentType;
+}
+
+void RabbitMQSender::enableBatching(size_t max_samples, std::chrono::milliseconds max_age) {
+    batch_max_samples_ = max_samples;
+    batch_max_age_ = max_age;
+}
+
+bool RabbitMQSender::flushBatches(bool force) {
+    auto now = std::chrono::steady_clock::now();
+    bool ok = true;
+
+    if (!hw_batch_.samples.empty() && (force || now - hw_batch_.opened_at >= batch_max_age_)) {
+        ok = flushBatch(hw_batch_, hw_queue_name_) && ok;
+    }
+    if (!sw_batch_.samples.empty() && (force || now - sw_batch_.opened_at >= batch_max_age_)) {
+        ok = flushBatch(sw_batch_, sw_queue_name_) && ok;
+    }
+    return ok;
+}
+
+void RabbitMQSender::setConfirmWindow(size_t max_in_flight, std::chrono::milliseconds timeout, int max_attempts) {
+    max_in_flight_ = std::max<size_t>(1, max_in_flight);
+    confirm_timeout_ = timeout;
+    max_publish_attempts_ = std::max(1, max_attempts);
+}
+
+RabbitMQSender::BatchStats RabbitMQSender::getBatchStats() const {
+    return batch_stats_;
+}
+
+RabbitMQSender::SendResult RabbitMQSender::enqueueSample(PendingBatch& batch, const std::string& queue_name,
+                                                         std::string sample, uint64_t sequence) {
+    if (batch.samples.empty()) {
+        batch.opened_at = std::chrono::steady_clock::now();
+        batch.samples.reserve(batch_max_samples_);
+    }
+    uint64_t previous_sequence = batch.last_sequence;
+    batch.samples.push_back(std::move(sample));
+    batch.last_sequence = std::max(batch.last_sequence, sequence);
+
+    if (batch.samples.size() < batch_max_samples_ &&
+        std::chrono::steady_clock::now() - batch.opened_at < batch_max_age_) {
+        return SendResult::Buffered;
+    }
+    if (flushBatch(batch, queue_name)) {
+        return SendResult::Sent;
+    }
+    // The batch is kept for the next flush. This sample is left to the caller
+    // (hardware ones are still in the MetricStore), so an outage cannot grow it
+    batch.samples.pop_back();
+    batch.last_sequence = previous_sequence;
+    return SendResult::Failed;
+}
+
+bool RabbitMQSender::flushBatch(PendingBatch& batch, const std::string& queue_name) {
+    std::string envelope;
+    const char* content_type = kJsonBatchContentType;
+    if (wire_format_ == WireFormat::Protobuf) {
+        // MetricsBatch: hardware samples are field 2, software samples field 3
+        envelope = buildProtobufEnvelope(batch, queue_name == hw_queue_name_ ? 2 : 3);
+        content_type = kProtobufBatchContentType;
+    } else {
+        envelope = buildJsonEnvelope(batch);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = sendMessage(queue_name, envelope, content_type);
+    double latency_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    if (!ok) {
+        std::cerr << "Batch of " << batch.samples.size() << " sample(s) for " << queue_name
+                  << " could not be published or spooled, kept for the next flush" << std::endl;
+        return false;
+    }
+
+    double fill_ratio = static_cast<double>(batch.samples.size()) / static_cast<double>(batch_max_samples_);
+    batch_stats_.flushes++;
+    batch_stats_.samples += batch.samples.size();
+    batch_stats_.fill_ratio_sum += fill_ratio;
+    batch_stats_.flush_latency_ms_sum += latency_ms;
+    batch_stats_.flush_latency_ms_max = std::max(batch_stats_.flush_latency_ms_max, latency_ms);
+
+    std::cout << "Flushed batch of " << batch.samples.size() << " sample(s) to " << queue_name
+              << " (fill " << static_cast<int>(fill_ratio * 100) << "%, " << latency_ms << " ms)" << std::endl;
+
+    if (&batch == &hw_batch_) {
+        hw_durable_sequence_ = std::max(hw_durable_sequence_, batch.last_sequence);
+    }
+    batch.samples.clear();
+    batch.last_sequence = 0;
+    return true;
+}
+
+std::string RabbitMQSender::buildJsonEnvelope(const PendingBatch& batch) const {
+    // Versioned envelope; samples are already serialized so they are spliced in as-is
+    size_t payload_size = 0;
+    for (const auto& sample : batch.samples) payload_size += sample.size() + 1;
+
+    std::string envelope;
+    envelope.reserve(payload_size + 96);
+    envelope += "{\"envelope_version\":" + std::to_string(kBatchEnvelopeVersion);
+    envelope += ",\"count\":" + std::to_string(batch.samples.size());
+    envelope += ",\"samples\":[";
+    for (size_t i = 0; i < batch.samples.size(); ++i) {
+        if (i > 0) envelope += ',';
+        envelope += batch.samples[i];
+    }
+    envelope += "]}";
+    return envelope;
+}
+
+std::string RabbitMQSender::buildProtobufEnvelope(const PendingBatch& batch, uint32_t field_number) const {
+    // A repeated message field is a sequence of (tag, length, bytes), so the
+    // serialized samples are spliced in without parsing them again
+    size_t payload_size = 0;
+    for (const auto& sample : batch.samples) payload_size += sample.size() + 6;
+
+    std::string envelope;
+    envelope.reserve(payload_size + 4);
+    appendVarint(envelope, (1 << 3) | 0);               // envelope_version, varint
+    appendVarint(envelope, kBatchEnvelopeVersion);
+    for (const auto& sample : batch.samples) {
+        appendVarint(envelope, (field_number << 3) | 2); // length-delimited
+        appendVarint(envelope, sample.size());
+        envelope += sample;
+    }
+    return envelope;
+}
+
+bool RabbitMQSender::sendMessage(const std::string& queue_name, const std::string& message,
+                                 const char* content_type) {
+    InFlightMessage pending;
+    pending.queue_name = queue_name;
+    pending.body = message;
+    pending.content_type = content_type;
+
+    // Keep ordering: while older messages wait in the spool, new ones queue behind them
+    if (spool_ && !spool_->empty()) {
+        drainSpool();
+        if (!spool_->empty()) {
+            return spoolMessage(pending);
+        }
+    }
+
+    if (!ensureConnected()) {
+        return spoolMessage(pending);
+    }
+
+    // Bounded window: wait for the broker before exceeding max_in_flight_
+    if (in_flight_.size() >= max_in_flight_) {
+        waitForConfirms(confirm_timeout_, max_in_flight_ - 1);
+        if (in_flight_.size() >= max_in_flight_) {
+            std::cerr << "Publisher confirm window full (" << in_flight_.size()
+                      << " in flight), cannot publish to " << queue_name << std::endl;
+            return spoolMessage(pending);
+        }
+    }
+
+    if (!publish(std::move(pending))) {
+        return spoolMessage(pending);
+    }
+
+    // Handle whatever acks/nacks already arrived, without blocking
+    pollConfirms();
+    return true;
+}
+
+void RabbitMQSender::enableSpool(const MessageSpool::Options& options) {
+    spool_ = std::make_unique<MessageSpool>(options);
+}
+
+size_t RabbitMQSender::drainSpool() {
+    if (!spool_ || spool_->empty() || !ensureConnected()) {
+        return 0;
+    }
+
+    size_t drained = spool_->drain([this](const MessageSpool::Message& spooled) {
+        // Leave room in the confirm window for fresh samples
+        if (in_flight_.size() >= max_in_flight_) {
             return false;
         }
+        InFlightMessage message;
+        message.queue_name = spooled.queue_name;
+        message.content_type = spooled.content_type;
+        message.body = spooled.body;
+        return publish(std::move(message));
+    });
+
+    if (drained > 0) {
+        auto stats = spool_->getStats();
+        std::cout << "Drained " << drained << " spooled message(s), " << stats.depth_messages
+                  << " left (" << stats.drain_throughput << " msg/s)" << std::endl;
     }
+    return drained;
+}
 
-    std::string message = serializeHardwareMetrics(metrics);
-    return sendMessage(hw_queue_name_, message);
+MessageSpool::Stats RabbitMQSender::getSpoolStats() const {
+    return spool_ ? spool_->getStats() : MessageSpool::Stats{};
+}
+
+bool RabbitMQSender::spoolMessage(const InFlightMessage& message) {
+    if (!spool_) {
+        return false;
+    }
+    MessageSpool::Message spooled{message.queue_name, message.content_type, message.body};
+    return spool_->push(spooled);
 }
 
-bool RabbitMQSender::sendSoftwareMetrics(const MetricsCollector::SoftwareMetrics& metrics) {
-    if (!connected_ && !connect()) {
+bool RabbitMQSender::ensureConnected() {
+    if (connected_) {
+        return true;
+    }
+
+    // Do not hammer an unreachable broker with a blocking connect on every sample
+    auto now = std::chrono::steady_clock::now();
+    if (last_connect_attempt_.time_since_epoch().count() != 0 &&
+        now - last_connect_attempt_ < reconnect_interval_) {
+        return false;
+    }
+    last_connect_attempt_ = now;
+
+    if (!connect()) {
         std::cerr << "Reconnect failed" << std::endl;
         return false;
     }
-    
-    std::string message = serializeSoftwareMetrics(metrics);
-    return sendMessage(sw_queue_name_, message);
+    return true;
 }
 
-bool RabbitMQSender::sendMessage(const std::string& queue_name, const std::string& message) {
+bool RabbitMQSender::publish(InFlightMessage&& message) {
+    if (!connected_) {
+        return false;
+    }
+
     amqp_basic_properties_t props;
     props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG | AMQP_BASIC_DELIVERY_MODE_FLAG;
-    props.content_type = amqp_cstring_bytes("application/json");
+    props.content_type = amqp_cstring_bytes(message.content_type.c_str());
     props.delivery_mode = 2; // persistent delivery
-    
-    // Publish message
+
+    // Compressed per attempt, so in-flight and spooled messages stay plain
+    std::string compressed;
+    amqp_table_entry_t headers[2];
+    const std::string* payload = &message.body;
+    if (compressor_.enabled() && message.body.size() >= compression_min_size_ &&
+        compressor_.compress(message.body, compressed)) {
+        headers[0].key = amqp_cstring_bytes(kCompressionHeader);
+        headers[0].value.kind = AMQP_FIELD_KIND_UTF8;
+        headers[0].value.value.bytes = amqp_cstring_bytes(PayloadCompressor::kAlgorithm);
+        headers[1].key = amqp_cstring_bytes(kDictionaryIdHeader);
+        headers[1].value.kind = AMQP_FIELD_KIND_I64;
+        headers[1].value.value.i64 = compressor_.dictionaryId();
+        props._flags |= AMQP_BASIC_HEADERS_FLAG;
+        props.headers.num_entries = 2;
+        props.headers.entries = headers;
+
+        compression_stats_.messages++;
+        compression_stats_.raw_bytes += message.body.size();
+        compression_stats_.wire_bytes += compressed.size();
+        payload = &compressed;
+    }
+
+    amqp_bytes_t body;
+    body.len = payload->size();
+    body.bytes = const_cast<char*>(payload->data());
+
+    // Publish message; the outcome arrives later as a basic.ack/basic.nack
     int status = amqp_basic_publish(conn_, channel_,
                                   amqp_cstring_bytes(""), // exchange
-                                  amqp_cstring_bytes(queue_name.c_str()), // routing key
+                                  amqp_cstring_bytes(message.queue_name.c_str()), // routing key
                                   0, // mandatory
                                   0, // immediate
                                   &props,
-                                  amqp_cstring_bytes(message.c_str()));
-    amqp_rpc_reply_t reply = amqp_get_rpc_reply(conn_);
-    if (!checkAMQPResponse(reply, "Publishing message")) {
-        return false;
-    }
-
-    
+                                  body);
     if (status != AMQP_STATUS_OK) {
-        std::cerr << "Failed to publish message to " << queue_name << ": " << status << std::endl;
+        std::cerr << "Failed to publish message to " << message.queue_name << ": "
+                  << amqp_error_string2(status) << std::endl;
+        connected_ = false;
         return false;
     }
-    
+
+    message.attempts++;
+    message.sent_at = std::chrono::steady_clock::now();
+    in_flight_.emplace(next_delivery_tag_++, std::move(message));
     return true;
 }
 
+size_t RabbitMQSender::pollConfirms() {
+    return processConfirmFrames(std::chrono::milliseconds(0), in_flight_.size());
+}
+
+bool RabbitMQSender::waitForConfirms(std::chrono::milliseconds timeout, size_t max_in_flight) {
+    processConfirmFrames(timeout, max_in_flight);
+    return in_flight_.size() <= max_in_flight;
+}
+
+size_t RabbitMQSender::processConfirmFrames(std::chrono::milliseconds timeout, size_t target_in_flight) {
+    size_t confirmed = 0;
+    std::vector<InFlightMessage> to_retry;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (connected_ && !in_flight_.empty()) {
+        auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - std::chrono::steady_clock::now());
+        // Non-blocking poll once the waiting target is reached or the time is up
+        if (in_flight_.size() <= target_in_flight || remaining.count() < 0) {
+            remaining = std::chrono::microseconds(0);
+        }
+        struct timeval tv;
+        tv.tv_sec = static_cast<long>(remaining.count() / 1000000);
+        tv.tv_usec = static_cast<long>(remaining.count() % 1000000);
+
+        amqp_frame_t frame;
+        int status = amqp_simple_wait_frame_noblock(conn_, &frame, &tv);
+        if (status == AMQP_STATUS_TIMEOUT) {
+            break;
+        }
+        if (status != AMQP_STATUS_OK) {
+            std::cerr << "Failed to read publisher confirms: " << amqp_error_string2(status) << std::endl;
+            connected_ = false;
+            break;
+        }
+        if (frame.frame_type != AMQP_FRAME_METHOD) {
+            continue;
+        }
+
+        switch (frame.payload.method.id) {
+            case AMQP_BASIC_ACK_METHOD: {
+                auto* ack = static_cast<amqp_basic_ack_t*>(frame.payload.method.decoded);
+                auto end = ack->multiple ? in_flight_.upper_bound(ack->delivery_tag)
+                                         : in_flight_.find(ack->delivery_tag);
+                if (!ack->multiple && end != in_flight_.end()) {
+                    in_flight_.erase(end);
+                    confirmed++;
+                } else if (ack->multiple) {
+                    confirmed += std::distance(in_flight_.begin(), end);
+                    in_flight_.erase(in_flight_.begin(), end);
+                }
+                break;
+            }
+            case AMQP_BASIC_NACK_METHOD: {
+                auto* nack = static_cast<amqp_basic_nack_t*>(frame.payload.method.decoded);
+                auto first = nack->multiple ? in_flight_.begin() : in_flight_.find(nack->delivery_tag);
+                auto last = nack->multiple ? in_flight_.upper_bound(nack->delivery_tag)
+                                           : (first == in_flight_.end() ? first : std::next(first));
+                for (auto it = first; it != last; ++it) {
+                    confirm_stats_.nacked++;
+                    to_retry.push_back(std::move(it->second));
+                }
+                in_flight_.erase(first, last);
+                break;
+            }
+            case AMQP_CHANNEL_CLOSE_METHOD:
+            case AMQP_CONNECTION_CLOSE_METHOD:
+                std::cerr << "Broker closed the publishing channel" << std::endl;
+                connected_ = false;
+                break;
+            default:
+                break;
+        }
+    }
+    confirm_stats_.confirmed += confirmed;
+
+    // Messages the broker did not confirm in time are treated like nacks
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = in_flight_.begin(); it != in_flight_.end();) {
+        if (now - it->second.sent_at >= confirm_timeout_) {
+            confirm_stats_.timed_out++;
+            to_retry.push_back(std::move(it->second));
+            it = in_flight_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Only nacked or timed-out messages are published again
+    for (auto& message : to_retry) {
+        if (message.attempts >= max_publish_attempts_) {
+            // Give up on the live connection, keep it on disk if a spool is configured
+            if (spoolMessage(message)) {
+                continue;
+            }
+            confirm_stats_.dropped++;
+            std::cerr << "Dropping message to " << message.queue_name << " after "
+                      << message.attempts << " unconfirmed attempt(s)" << std::endl;
+            continue;
+        }
+        confirm_stats_.retried++;
+        if (!publish(std::move(message)) && !spoolMessage(message)) {
+            std::cerr << "Retry of message to " << message.queue_name << " failed" << std::endl;
+        }
+    }
+    return confirmed;
+}
+
+RabbitMQSender::ConfirmStats RabbitMQSender::getConfirmStats() const {
+    ConfirmStats stats = confirm_stats_;
+    stats.in_flight = in_flight_.size();
+    return stats;
+}
+
 std::string RabbitMQSender::serializeHardwareMetrics(const MetricsCollector::HardwareMetrics& metrics) {
+    if (wire_format_ == WireFormat::Protobuf) {
+        monitoring::HardwareMetrics message;
+        message.set_device_id(metrics.device_id);
+        message.set_readable_date(metrics.readable_date);
+        message.set_cpu_usage(metrics.cpu_usage);
+        message.set_memory_usage(metrics.memory_usage);
+        message.set_disk_usage_root(metrics.disk_usage_root);
+        if (!metrics.replayed) {
+            message.set_usb_devices(metrics.usb_data);
+        }
+        message.set_gpio_state(metrics.gpio_state);
+        message.set_kernel_version(metrics.kernel_version);
+        message.set_hardware_model(metrics.hardware_model);
+        message.set_firmware_version(metrics.firmware_version);
+        addSampling(metrics.sampling, message);
+        if (metrics.cpu_window.samples > 0) {
+            setWindow(metrics.cpu_window, *message.mutable_cpu_window());
+        }
+        if (metrics.memory_window.samples > 0) {
+            setWindow(metrics.memory_window, *message.mutable_memory_window());
+        }
+        addProcesses(metrics.top_cpu, *message.mutable_top_cpu());
+        addProcesses(metrics.top_memory, *message.mutable_top_memory());
+        if (metrics.agent.window_seconds > 0) {
+            setAgentUsage(metrics.agent, *message.mutable_agent());
+        }
+        message.set_replayed(metrics.replayed);
+        return message.SerializeAsString();
+    }
+
     nlohmann::json json;
     json["device_id"] = metrics.device_id;
     json["readable_date"] = metrics.readable_date;
     json["cpu_usage"] = metrics.cpu_usage;
     json["memory_usage"] = metrics.memory_usage;
     json["disk_usage"] = metrics.disk_usage_root;
-    json["usb_state"] = metrics.usb_data;
+    if (!metrics.replayed) {
+        json["usb_state"] = metrics.usb_data;
+    }
     json["gpio_state"] = metrics.gpio_state;
     json["kernel_version"] = metrics.kernel_version;
     json["hardware_model"] = metrics.hardware_model;
     json["firmware_version"] = metrics.firmware_version;
+    if (!metrics.sampling.empty()) {
+        json["sampling"] = samplingToJson(metrics.sampling);
+    }
+    if (metrics.cpu_window.samples > 0) {
+        json["cpu_window"] = windowToJson(metrics.cpu_window);
+    }
+    if (metrics.memory_window.samples > 0) {
+        json["memory_window"] = windowToJson(metrics.memory_window);
+    }
+    if (!metrics.top_cpu.empty()) {
+        json["top_cpu"] = processesToJson(metrics.top_cpu);
+    }
+    if (!metrics.top_memory.empty()) {
+        json["top_memory"] = processesToJson(metrics.top_memory);
+    }
+    if (metrics.agent.window_seconds > 0) {
+        json["agent"] = agentUsageToJson(metrics.agent);
+    }
+    if (metrics.replayed) {
+        json["replayed"] = true;
+    }
     return json.dump();
 }
 
-std::string RabbitMQSender::serializeSoftwareMetrics(const MetricsCollector::SoftwareMetrics& metrics) {
+std::string RabbitMQSender::serializeSoftwareMetrics(const MetricsCollector::SoftwareMetrics& metrics,
+                                                     const InventoryTracker::Update& inventory) {
+    if (wire_format_ == WireFormat::Protobuf) {
+        monitoring::SoftwareMetrics message;
+        message.set_device_id(metrics.device_id);
+        message.set_readable_date(metrics.readable_date);
+        message.set_ip_address(metrics.ip_address);
+        message.set_uptime(metrics.uptime);
+        message.set_network_status(metrics.network_status);
+        message.set_os_version(metrics.os_version);
+        message.set_inventory_kind(inventory.snapshot ? monitoring::SoftwareMetrics::SNAPSHOT
+                                                      : monitoring::SoftwareMetrics::DELTA);
+        message.set_inventory_sequence(inventory.sequence);
+        for (const auto& [name, version] : inventory.applications) {
+            auto* app = message.add_applications();
+            app->set_name(name);
+            app->set_version(version);
+        }
+        message.mutable_services()->insert(inventory.services.begin(), inventory.services.end());
+        for (const auto& name : inventory.removed_services) {
+            message.add_removed_services(name);
+        }
+        for (const auto& name : inventory.removed_applications) {
+            message.add_removed_applications(name);
+        }
+        addSampling(metrics.sampling, message);
+        return message.SerializeAsString();
+    }
+
     nlohmann::json json;
     json["device_id"] = metrics.device_id;
     json["readable_date"] = metrics.readable_date;
@@ -160,18 +764,27 @@ std::string RabbitMQSender::serializeSoftwareMetrics(const MetricsCollector::Sof
     json["uptime"] = metrics.uptime;
     json["network_status"] = metrics.network_status;
     json["os_version"] = metrics.os_version;
+    json["inventory_kind"] = inventory.snapshot ? "snapshot" : "delta";
+    json["inventory_sequence"] = inventory.sequence;
     // Serialize applications
     nlohmann::json apps = nlohmann::json::array();
-    for (const auto& [name, version] : metrics.applications) {
+    for (const auto& [name, version] : inventory.applications) {
         apps.push_back({{"name", name}, {"version", version}});
     }
     json["applications"] = apps;
     // Serialize services
-    nlohmann::json services;
-    for (const auto& [name, status] : metrics.services) {
+    nlohmann::json services = nlohmann::json::object();
+    for (const auto& [name, status] : inventory.services) {
         services[name] = status;
     }
     json["services"] = services;
+    if (!inventory.snapshot) {
+        json["removed_services"] = inventory.removed_services;
+        json["removed_applications"] = inventory.removed_applications;
+    }
+    if (!metrics.sampling.empty()) {
+        json["sampling"] = samplingToJson(metrics.sampling);
+    }
     return json.dump();
 }
 
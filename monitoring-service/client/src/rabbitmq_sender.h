@@ -1,8 +1,17 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <cstdint>
 #include <amqp.h>
 #include <nlohmann/json.hpp>
 #include "metrics_collector.h"
+#include "message_spool.h"
+#include "inventory_tracker.h"
+#include "payload_compressor.h"
+#include "monitoring.pb.h"
 
 class RabbitMQSender {
 public:
@@ -14,13 +23,139 @@ public:
     bool connect();
     void disconnect();
 
-    bool sendHardwareMetrics(const MetricsCollector::HardwareMetrics& metrics);
-    bool sendSoftwareMetrics(const MetricsCollector::SoftwareMetrics& metrics);
+    // Sent: published, or written to the spool. Buffered: only held in memory
+    // in a batch, lost if the agent stops before it is flushed
+    enum class SendResult { Failed, Buffered, Sent };
+
+    SendResult sendHardwareMetrics(const MetricsCollector::HardwareMetrics& metrics);
+    SendResult sendSoftwareMetrics(const MetricsCollector::SoftwareMetrics& metrics);
+
+    // MetricStore sequence of the newest hardware sample published or spooled;
+    // the store may be committed up to it
+    uint64_t durableHardwareSequence() const { return hw_durable_sequence_; }
+
+    // Newest hardware sample handed over so far, including those still in a batch
+    uint64_t bufferedHardwareSequence() const;
+
+    // Batching mode: samples are grouped per queue and published as one
+    // envelope when max_samples is reached or the oldest sample is max_age old.
+    // max_samples <= 1 disables batching.
+    void enableBatching(size_t max_samples, std::chrono::milliseconds max_age);
+
+    // Publish batches whose age limit has expired (force = publish all).
+    // A batch that can be neither published nor spooled is kept for the next try
+    bool flushBatches(bool force = false);
+
+    struct BatchStats {
+        uint64_t flushes = 0;
+        uint64_t samples = 0;
+        double fill_ratio_sum = 0.0;     // samples / max_samples per flush
+        double flush_latency_ms_sum = 0.0;
+        double flush_latency_ms_max = 0.0;
+
+        double averageFillRatio() const { return flushes ? fill_ratio_sum / flushes : 0.0; }
+        double averageFlushLatencyMs() const { return flushes ? flush_latency_ms_sum / flushes : 0.0; }
+    };
+    BatchStats getBatchStats() const;
+
+    // Publisher confirms: up to max_in_flight messages may await a broker ack;
+    // nacked or unconfirmed-after-timeout messages are republished up to max_attempts times
+    void setConfirmWindow(size_t max_in_flight, std::chrono::milliseconds timeout, int max_attempts);
+
+    // Process acks/nacks received so far without blocking, returns the number confirmed
+    size_t pollConfirms();
+
+    // Block until at most max_in_flight messages are unconfirmed or timeout expires
+    bool waitForConfirms(std::chrono::milliseconds timeout, size_t max_in_flight = 0);
+
+    struct ConfirmStats {
+        uint64_t confirmed = 0;
+        uint64_t nacked = 0;
+        uint64_t timed_out = 0;
+        uint64_t retried = 0;
+        uint64_t dropped = 0;
+        size_t in_flight = 0;
+    };
+    ConfirmStats getConfirmStats() const;
+
+    // Store-and-forward: messages that cannot be published are written to a
+    // disk spool and drained in order, at the spool's rate, once the broker is back
+    void enableSpool(const MessageSpool::Options& options);
+    size_t drainSpool();
+    MessageSpool::Stats getSpoolStats() const;
+
+    // Software inventory is sent as deltas between periodic full snapshots;
+    // requestInventorySnapshot() forces one with the next sample (e.g. on a
+    // server resync request, from any thread)
+    void setInventorySnapshotInterval(std::chrono::seconds interval);
+    void requestInventorySnapshot();
+
+    // zstd compression with a trained dictionary; the x-compression and
+    // x-dict-id headers tell the consumer how to decompress. Messages smaller
+    // than min_size, or that would not shrink, are sent as-is.
+    bool enableCompression(const std::string& dictionary_path, int level = 3, size_t min_size = 32);
+
+    struct CompressionStats {
+        uint64_t messages = 0;          // compressed messages
+        uint64_t raw_bytes = 0;         // before compression
+        uint64_t wire_bytes = 0;        // after compression
+
+        double ratio() const { return wire_bytes ? static_cast<double>(raw_bytes) / wire_bytes : 0.0; }
+    };
+    CompressionStats getCompressionStats() const;
+
+    // Payload encoding, announced to the consumer through the AMQP content type.
+    // Protobuf uses the HardwareMetrics/SoftwareMetrics messages of monitoring.proto.
+    // Set it before the first send: pending batches are not re-encoded.
+    enum class WireFormat { Json, Protobuf };
+    void setWireFormat(WireFormat format);
+
+    // Version of the batch envelope understood by RabbitMQConsumer
+    static constexpr int kBatchEnvelopeVersion = 1;
+
+    static constexpr const char* kCompressionHeader = "x-compression";
+    static constexpr const char* kDictionaryIdHeader = "x-dict-id";
+
+    static constexpr const char* kJsonContentType = "application/json";
+    static constexpr const char* kProtobufContentType = "application/x-protobuf";
+    static constexpr const char* kJsonBatchContentType = "application/vnd.iotshadow.batch+json";
+    static constexpr const char* kProtobufBatchContentType = "application/vnd.iotshadow.batch+protobuf";
 
 private:
-    bool sendMessage(const std::string& queue_name, const std::string& message);
+    struct PendingBatch {
+        std::vector<std::string> samples;   // serialized samples
+        std::chrono::steady_clock::time_point opened_at;
+        uint64_t last_sequence = 0;         // newest MetricStore sequence, 0 when none is stored
+    };
+
+    struct InFlightMessage {
+        std::string queue_name;
+        std::string body;
+        std::string content_type;
+        std::chrono::steady_clock::time_point sent_at;
+        int attempts = 0;
+    };
+
+    // Publish and track the message under the next delivery tag
+    // (message is left untouched when publishing fails)
+    bool publish(InFlightMessage&& message);
+    bool spoolMessage(const InFlightMessage& message);
+
+    // Reconnect if needed, at most once per reconnect_interval_
+    bool ensureConnected();
+    size_t processConfirmFrames(std::chrono::milliseconds timeout, size_t target_in_flight);
+
+    SendResult enqueueSample(PendingBatch& batch, const std::string& queue_name, std::string sample,
+                             uint64_t sequence = 0);
+    bool flushBatch(PendingBatch& batch, const std::string& queue_name);
+    std::string buildJsonEnvelope(const PendingBatch& batch) const;
+    std::string buildProtobufEnvelope(const PendingBatch& batch, uint32_t field_number) const;
+    bool sendMessage(const std::string& queue_name, const std::string& message,
+                     const char* content_type);
     std::string serializeHardwareMetrics(const MetricsCollector::HardwareMetrics& metrics);
-    std::string serializeSoftwareMetrics(const MetricsCollector::SoftwareMetrics& metrics);
+    std::string serializeSoftwareMetrics(const MetricsCollector::SoftwareMetrics& metrics,
+                                         const InventoryTracker::Update& inventory);
+    const char* sampleContentType() const;
     bool checkAMQPResponse(amqp_rpc_reply_t x, const char* context);
 
     std::string hostname_, username_, password_;
@@ -29,4 +164,30 @@ private:
     amqp_connection_state_t conn_;
     int channel_;
     bool connected_;
+    WireFormat wire_format_;
+
+    size_t batch_max_samples_;
+    std::chrono::milliseconds batch_max_age_;
+    PendingBatch hw_batch_;
+    PendingBatch sw_batch_;
+    BatchStats batch_stats_;
+    uint64_t hw_durable_sequence_;
+
+    // Publisher confirm window, keyed by delivery tag
+    std::map<uint64_t, InFlightMessage> in_flight_;
+    uint64_t next_delivery_tag_;
+    size_t max_in_flight_;
+    std::chrono::milliseconds confirm_timeout_;
+    int max_publish_attempts_;
+    ConfirmStats confirm_stats_;
+
+    InventoryTracker inventory_;
+
+    PayloadCompressor compressor_;
+    size_t compression_min_size_;
+    CompressionStats compression_stats_;
+
+    std::unique_ptr<MessageSpool> spool_;
+    std::chrono::steady_clock::time_point last_connect_attempt_;
+    std::chrono::seconds reconnect_interval_;
 };
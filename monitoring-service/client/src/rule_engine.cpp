@@ -0,0 +1,153 @@
+#include "rule_engine.h"
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <limits>
+
+namespace {
+
+double windowValue(const WindowSampler::Stats& window, const std::string& statistic, const std::string& instant) {
+    if (window.samples == 0 || statistic.empty() || statistic == "instant") {
+        return SamplingScheduler::parsePercent(instant);
+    }
+    if (statistic == "min") return window.min;
+    if (statistic == "max") return window.max;
+    if (statistic == "mean") return window.mean;
+    if (statistic == "p95") return window.p95;
+    return SamplingScheduler::parsePercent(instant);
+}
+
+int usbDeviceCount(const std::string& usb_data) {
+    if (usb_data.empty() || usb_data == "none") return 0;
+    int count = 1;
+    for (size_t pos = usb_data.find(" | "); pos != std::string::npos; pos = usb_data.find(" | ", pos + 3)) {
+        ++count;
+    }
+    return count;
+}
+
+} // namespace
+
+bool RuleEngine::update(const monitoring::RuleSet& rules) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (rules.version() < rules_.version()) {
+        return false;
+    }
+    rules_ = rules;
+
+    // Keep the cooldowns of rules that are still there
+    for (auto it = last_fired_.begin(); it != last_fired_.end();) {
+        bool kept = false;
+        for (const auto& rule : rules_.rules()) {
+            if (rule.rule_id() == it->first) {
+                kept = true;
+                break;
+            }
+        }
+        it = kept ? std::next(it) : last_fired_.erase(it);
+    }
+    return true;
+}
+
+uint64_t RuleEngine::version() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rules_.version();
+}
+
+size_t RuleEngine::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<size_t>(rules_.rules_size());
+}
+
+double RuleEngine::threshold(const std::string& metric, monitoring::Alert::Severity severity) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    double lowest = std::numeric_limits<double>::quiet_NaN();
+    for (const auto& rule : rules_.rules()) {
+        if (rule.metric() == metric && rule.severity() == severity &&
+            rule.comparison() == monitoring::Rule::AT_LEAST && !(rule.threshold() >= lowest)) {
+            lowest = rule.threshold();
+        }
+    }
+    return lowest;
+}
+
+std::vector<monitoring::Alert> RuleEngine::evaluate(const MetricsCollector::HardwareMetrics& metrics) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Most severe matching rule per metric, so a critical rule hides the warning one
+    std::map<std::string, std::pair<const monitoring::Rule*, double>> matched;
+    for (const auto& rule : rules_.rules()) {
+        double value = metricValue(rule, metrics);
+        if (std::isnan(value)) continue;
+
+        bool match = rule.comparison() == monitoring::Rule::BELOW ? value < rule.threshold()
+                                                                   : value >= rule.threshold();
+        if (!match) continue;
+
+        auto it = matched.find(rule.metric());
+        if (it == matched.end() || rule.severity() > it->second.first->severity()) {
+            matched[rule.metric()] = {&rule, value};
+        }
+    }
+
+    std::vector<monitoring::Alert> alerts;
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& [metric, match] : matched) {
+        const monitoring::Rule& rule = *match.first;
+        auto fired = last_fired_.find(rule.rule_id());
+        if (fired != last_fired_.end() && now - fired->second < std::chrono::seconds(rule.cooldown_seconds())) {
+            continue;
+        }
+        last_fired_[rule.rule_id()] = now;
+
+        char value[32];
+        if (metric == "gpio" || metric == "usb") {
+            std::snprintf(value, sizeof(value), "%.0f", match.second);
+        } else {
+            std::snprintf(value, sizeof(value), "%.1f%%", match.second);
+        }
+
+        monitoring::Alert alert;
+        alert.set_device_id(metrics.device_id);
+        alert.set_severity(rule.severity());
+        alert.set_timestamp(std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count()));
+        alert.set_alert_type(rule.alert_type());
+        alert.set_description(rule.description() + ": " + value);
+        alert.set_recommended_action(rule.recommended_action());
+        alert.set_corrective_command(rule.corrective_command());
+        alert.set_rule_id(rule.rule_id());
+        // What was using the cpu or memory when the sample was taken
+        if (metric == "cpu" || metric == "memory") {
+            for (const auto& process : metric == "cpu" ? metrics.top_cpu : metrics.top_memory) {
+                auto* usage = alert.add_processes();
+                usage->set_pid(process.pid);
+                usage->set_name(process.name);
+                usage->set_cpu_percent(process.cpu_percent);
+                usage->set_rss_kb(process.rss_kb);
+            }
+        }
+        alerts.push_back(std::move(alert));
+    }
+    return alerts;
+}
+
+double RuleEngine::metricValue(const monitoring::Rule& rule, const MetricsCollector::HardwareMetrics& metrics) {
+    const std::string& metric = rule.metric();
+    if (metric == "cpu") {
+        return windowValue(metrics.cpu_window, rule.statistic(), metrics.cpu_usage);
+    }
+    if (metric == "memory") {
+        return windowValue(metrics.memory_window, rule.statistic(), metrics.memory_usage);
+    }
+    if (metric == "disk") {
+        return SamplingScheduler::parsePercent(metrics.disk_usage_root);
+    }
+    if (metric == "gpio") {
+        return metrics.gpio_state;
+    }
+    if (metric == "usb") {
+        return usbDeviceCount(metrics.usb_data);
+    }
+    return std::numeric_limits<double>::quiet_NaN();
+}
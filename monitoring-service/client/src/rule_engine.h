@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "metrics_collector.h"
+#include "monitoring.pb.h"
+
+// Threshold rules evaluated on the device.
+//
+// The server pushes a RuleSet on the alert stream (alert_type "RULES_UPDATE")
+// to agents that register with evaluates_rules. Every hardware sample is
+// checked against it right after it is taken, so the device can act on an
+// alert without the RabbitMQ -> analyzer -> gRPC round trip; the fired alerts
+// are then reported to the server on the device Session.
+class RuleEngine {
+public:
+    // Replace the current rules, false when the set is older than the active one
+    bool update(const monitoring::RuleSet& rules);
+
+    uint64_t version() const;
+    size_t size() const;
+
+    // Lowest "at least" threshold the rules set for metric at severity, NaN without one
+    double threshold(const std::string& metric, monitoring::Alert::Severity severity) const;
+
+    // Alerts raised by the sample: at most one per metric (the most severe
+    // matching rule), and none for a rule still in its cooldown
+    std::vector<monitoring::Alert> evaluate(const MetricsCollector::HardwareMetrics& metrics);
+
+private:
+    mutable std::mutex mutex_;
+    monitoring::RuleSet rules_;
+    std::map<std::string, std::chrono::steady_clock::time_point> last_fired_;   // by rule_id
+
+    // Value the rule applies to, NaN when the sample does not have it
+    static double metricValue(const monitoring::Rule& rule, const MetricsCollector::HardwareMetrics& metrics);
+};
@@ -0,0 +1,171 @@
+#include "sampling_scheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+SamplingScheduler::SamplingScheduler() : SamplingScheduler(Options{}) {
+}
+
+SamplingScheduler::SamplingScheduler(const Options& options) : options_(options) {
+    // Everything is due at once on start, at the base interval
+    for (auto& state : states_) {
+        state.interval = options_.base_interval;
+    }
+}
+
+bool SamplingScheduler::due(MetricClass metric_class, Clock::time_point now) const {
+    return now >= states_[static_cast<size_t>(metric_class)].next_due;
+}
+
+std::vector<SamplingScheduler::MetricClass> SamplingScheduler::due(std::initializer_list<MetricClass> classes,
+                                                                   Clock::time_point now) const {
+    std::vector<MetricClass> due_classes;
+    for (MetricClass metric_class : classes) {
+        if (due(metric_class, now)) {
+            due_classes.push_back(metric_class);
+        }
+    }
+    return due_classes;
+}
+
+SamplingScheduler::Clock::time_point SamplingScheduler::nextDue() const {
+    Clock::time_point next = Clock::time_point::max();
+    for (const auto& state : states_) {
+        next = std::min(next, state.next_due);
+    }
+    return next;
+}
+
+SamplingScheduler::Decision SamplingScheduler::current(MetricClass metric_class) const {
+    const ClassState& state = states_[static_cast<size_t>(metric_class)];
+    Decision decision;
+    decision.metric_class = metric_class;
+    decision.interval_seconds = static_cast<uint32_t>(state.interval.count()) * state.stretch;
+    decision.reason = state.reason;
+    decision.stretch = state.stretch;
+    return decision;
+}
+
+void SamplingScheduler::observe(MetricClass metric_class, double value, Clock::time_point now) {
+    ClassState& state = states_[static_cast<size_t>(metric_class)];
+
+    if (std::isnan(value)) {
+        // Nothing to compare against next time, retry at the base interval
+        state.has_value = false;
+        schedule(state, options_.base_interval, Reason::NoReading, now);
+        return;
+    }
+
+    const Thresholds& thresholds = thresholdsFor(metric_class);
+    bool first = !state.has_value;
+    double delta = first ? 0.0 : std::fabs(value - state.last_value);
+    state.last_value = value;
+    state.has_value = true;
+
+    if (value >= thresholds.critical) {
+        schedule(state, options_.min_interval, Reason::AboveCritical, now);
+    } else if (value >= thresholds.warning) {
+        schedule(state, std::min(options_.min_interval * 2, options_.base_interval), Reason::AboveWarning, now);
+    } else if (value >= thresholds.warning - options_.near_margin) {
+        schedule(state, std::max(options_.base_interval / 4, options_.min_interval), Reason::NearWarning, now);
+    } else if (first) {
+        schedule(state, options_.base_interval, Reason::Initial, now);
+    } else if (delta < options_.stable_delta) {
+        schedule(state, backoff(state), Reason::Stable, now);
+    } else {
+        schedule(state, options_.base_interval, Reason::Changed, now);
+    }
+}
+
+void SamplingScheduler::observeChange(MetricClass metric_class, bool changed, Clock::time_point now) {
+    ClassState& state = states_[static_cast<size_t>(metric_class)];
+    bool first = !state.has_value;
+    state.has_value = true;
+
+    if (first) {
+        schedule(state, options_.base_interval, Reason::Initial, now);
+    } else if (changed) {
+        schedule(state, options_.base_interval, Reason::Changed, now);
+    } else {
+        schedule(state, backoff(state), Reason::Stable, now);
+    }
+}
+
+void SamplingScheduler::setThresholds(MetricClass metric_class, const Thresholds& thresholds) {
+    switch (metric_class) {
+        case MetricClass::Cpu: options_.cpu = thresholds; break;
+        case MetricClass::Memory: options_.memory = thresholds; break;
+        case MetricClass::Disk: options_.disk = thresholds; break;
+        case MetricClass::Software: break;
+    }
+}
+
+void SamplingScheduler::setStretch(uint32_t factor) {
+    stretch_ = std::max<uint32_t>(factor, 1);
+}
+
+const char* SamplingScheduler::className(MetricClass metric_class) {
+    switch (metric_class) {
+        case MetricClass::Cpu: return "cpu";
+        case MetricClass::Memory: return "memory";
+        case MetricClass::Disk: return "disk";
+        case MetricClass::Software: return "software";
+    }
+    return "";
+}
+
+const char* SamplingScheduler::reasonName(Reason reason) {
+    switch (reason) {
+        case Reason::None: return "none";
+        case Reason::Initial: return "initial";
+        case Reason::NoReading: return "no_reading";
+        case Reason::Stable: return "stable";
+        case Reason::Changed: return "changed";
+        case Reason::NearWarning: return "near_warning";
+        case Reason::AboveWarning: return "above_warning";
+        case Reason::AboveCritical: return "above_critical";
+        case Reason::OverBudget: return "over_budget";
+    }
+    return "";
+}
+
+double SamplingScheduler::parsePercent(const std::string& value) {
+    if (value.empty()) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    char* end = nullptr;
+    double parsed = std::strtod(value.c_str(), &end);
+    if (end == value.c_str()) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return parsed;
+}
+
+const SamplingScheduler::Thresholds& SamplingScheduler::thresholdsFor(MetricClass metric_class) const {
+    switch (metric_class) {
+        case MetricClass::Memory: return options_.memory;
+        case MetricClass::Disk: return options_.disk;
+        default: return options_.cpu;
+    }
+}
+
+void SamplingScheduler::schedule(ClassState& state, std::chrono::seconds interval, Reason reason,
+                                 Clock::time_point now) {
+    state.interval = std::clamp(interval, options_.min_interval, options_.max_interval);
+    state.reason = reason;
+    // A device past its thresholds is watched as closely as ever. The stretch
+    // is kept apart from the interval so backoff() does not compound it
+    bool alerting = reason == Reason::AboveWarning || reason == Reason::AboveCritical;
+    state.stretch = alerting ? 1 : stretch_;
+    state.next_due = now + state.interval * state.stretch;
+}
+
+std::chrono::seconds SamplingScheduler::backoff(const ClassState& state) const {
+    // Coming down from a short (alert) interval restarts at the base interval,
+    // otherwise double it on every stable sample
+    if (state.interval < options_.base_interval) {
+        return options_.base_interval;
+    }
+    return std::min(state.interval * 2, options_.max_interval);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// Per metric class sampling intervals.
+//
+// A class is sampled more often as its value approaches the server's warning
+// and critical thresholds, and backs off exponentially (up to max_interval)
+// while the value stays stable. Each decision carries the reason for the
+// interval so the server can tell a quiet device from a slow one.
+class SamplingScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class MetricClass : uint8_t { Cpu = 0, Memory = 1, Disk = 2, Software = 3 };
+    static constexpr size_t kClassCount = 4;
+
+    // Stored as a byte in MetricStore records, append new values at the end
+    enum class Reason : uint8_t {
+        None = 0,           // not scheduled (older records, script mode)
+        Initial,
+        NoReading,
+        Stable,
+        Changed,
+        NearWarning,
+        AboveWarning,
+        AboveCritical,
+        OverBudget          // stretched by an older agent, the stretch is now a field of its own
+    };
+
+    // Interval that led to a sample and why it was chosen
+    struct Decision {
+        MetricClass metric_class = MetricClass::Cpu;
+        uint32_t interval_seconds = 0;  // stretch included
+        Reason reason = Reason::None;
+        uint32_t stretch = 1;           // budget multiplier applied to the interval
+    };
+
+    struct Thresholds {
+        double warning;
+        double critical;
+    };
+
+    struct Options {
+        std::chrono::seconds base_interval{60};
+        std::chrono::seconds min_interval{5};
+        std::chrono::seconds max_interval{600};
+        double near_margin = 10.0;     // points below warning counted as approaching it
+        double stable_delta = 2.0;     // change (points) below which a value is stable
+        // MetricsAnalyzer's defaults, until the server's rules replace them
+        Thresholds cpu{75.0, 90.0};
+        Thresholds memory{80.0, 95.0};
+        Thresholds disk{85.0, 95.0};
+    };
+
+    SamplingScheduler();
+    explicit SamplingScheduler(const Options& options);
+
+    bool due(MetricClass metric_class, Clock::time_point now) const;
+
+    // Those of classes that are due, in the order given
+    std::vector<MetricClass> due(std::initializer_list<MetricClass> classes, Clock::time_point now) const;
+
+    // Earliest time any class is due
+    Clock::time_point nextDue() const;
+
+    // Interval and reason in effect for the next sample of the class
+    Decision current(MetricClass metric_class) const;
+
+    // Record a numeric sample (percent, NaN when it could not be read)
+    // and choose the next interval from it
+    void observe(MetricClass metric_class, double value, Clock::time_point now);
+
+    // Record a sample of a non-numeric class (software inventory)
+    void observeChange(MetricClass metric_class, bool changed, Clock::time_point now);
+
+    // Thresholds of a numeric class from now on, e.g. the server's rules
+    void setThresholds(MetricClass metric_class, const Thresholds& thresholds);
+
+    // Multiply the intervals chosen from now on (1 = none). Intervals above
+    // the warning or critical threshold are never stretched
+    void setStretch(uint32_t factor);
+    uint32_t stretch() const { return stretch_; }
+
+    static const char* className(MetricClass metric_class);
+    static const char* reasonName(Reason reason);
+
+    // "12.5%" -> 12.5, NaN for an empty or malformed value
+    static double parsePercent(const std::string& value);
+
+private:
+    struct ClassState {
+        std::chrono::seconds interval{0};      // chosen from the readings, before the stretch
+        uint32_t stretch = 1;
+        Reason reason = Reason::Initial;
+        double last_value = 0.0;
+        bool has_value = false;
+        Clock::time_point next_due{};
+    };
+
+    Options options_;
+    std::array<ClassState, kClassCount> states_;
+    uint32_t stretch_ = 1;
+
+    const Thresholds& thresholdsFor(MetricClass metric_class) const;
+    void schedule(ClassState& state, std::chrono::seconds interval, Reason reason, Clock::time_point now);
+    std::chrono::seconds backoff(const ClassState& state) const;
+};
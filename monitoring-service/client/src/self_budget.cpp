@@ -0,0 +1,84 @@
+#include "self_budget.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+#include "proc_stats.h"
+
+SelfBudget::SelfBudget() : SelfBudget(Options{}) {
+}
+
+SelfBudget::SelfBudget(const Options& options) : options_(options) {
+    options_.max_stretch = std::max<uint32_t>(options_.max_stretch, 1);
+    uint64_t read_bytes = 0, write_bytes = 0;
+    readIo(read_bytes, write_bytes);
+    readings_.push_back({Clock::now(), cpuMicros(), read_bytes + write_bytes});
+    last_change_ = readings_.front().time;
+}
+
+SelfBudget::Usage SelfBudget::update(Clock::time_point now) {
+    Usage usage;
+    usage.cpu_budget_percent = options_.cpu_percent;
+    uint64_t cpu_us = cpuMicros();
+    readIo(usage.read_bytes_total, usage.write_bytes_total);
+    usage.cpu_ms_total = cpu_us / 1000;
+    readings_.push_back({now, cpu_us, usage.read_bytes_total + usage.write_bytes_total});
+
+    // Keep the newest reading at or before the window start as the baseline
+    while (readings_.size() > 2 && now - readings_[1].time >= options_.window) {
+        readings_.pop_front();
+    }
+    const Reading& first = readings_.front();
+    const Reading& last = readings_.back();
+    double seconds = std::chrono::duration<double>(last.time - first.time).count();
+    if (seconds > 0.0) {
+        usage.cpu_percent = static_cast<double>(last.cpu_us - first.cpu_us) / 1e4 / seconds;
+        usage.io_bytes_per_second = static_cast<double>(last.io_bytes - first.io_bytes) / seconds;
+        usage.window_seconds = static_cast<uint32_t>(seconds);
+    }
+
+    bool over = usage.cpu_percent > options_.cpu_percent ||
+                (options_.io_bytes_per_second > 0 &&
+                 usage.io_bytes_per_second > static_cast<double>(options_.io_bytes_per_second));
+    bool well_under = usage.cpu_percent < options_.cpu_percent / 2 &&
+                      (options_.io_bytes_per_second == 0 ||
+                       usage.io_bytes_per_second < static_cast<double>(options_.io_bytes_per_second) / 2);
+
+    // Startup costs (connections, first inventory) are not held against the
+    // budget until a fifth of the window has been measured
+    auto settle = options_.window / 5;
+    if (now - first.time >= settle && now - last_change_ >= settle) {
+        if (over && stretch_ < options_.max_stretch) {
+            stretch_ = std::min(stretch_ * 2, options_.max_stretch);
+            last_change_ = now;
+        } else if (well_under && stretch_ > 1) {
+            stretch_ /= 2;
+            last_change_ = now;
+        }
+    }
+    usage.over_budget = over;
+    usage.stretch = stretch_;
+    return usage;
+}
+
+uint64_t SelfBudget::cpuMicros() {
+    struct rusage usage{};
+    if (::getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    auto micros = [](const struct timeval& tv) {
+        return static_cast<uint64_t>(tv.tv_sec) * 1000000 + static_cast<uint64_t>(tv.tv_usec);
+    };
+    return micros(usage.ru_utime) + micros(usage.ru_stime);
+}
+
+bool SelfBudget::readIo(uint64_t& read_bytes, uint64_t& write_bytes) {
+    // read_bytes / write_bytes are what reached the storage layer; rchar and
+    // wchar would also count the sockets to the broker and the server
+    char buf[512];
+    if (proc_stats::readFile("/proc/self/io", buf, sizeof(buf)) <= 0) return false;
+    const char* read_field = std::strstr(buf, "\nread_bytes:");
+    const char* write_field = std::strstr(buf, "\nwrite_bytes:");
+    if (!read_field || !write_field) return false;
+    read_bytes = std::strtoull(read_field + std::strlen("\nread_bytes:"), nullptr, 10);
+    write_bytes = std::strtoull(write_field + std::strlen("\nwrite_bytes:"), nullptr, 10);
+    return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+// The agent's own CPU and I/O cost, held to a budget.
+//
+// Read once per collection cycle from getrusage (all threads) and
+// /proc/self/io, averaged over a sliding window. Over budget the sampling
+// intervals are stretched (doubled, up to max_stretch) and the optional
+// collectors deferred; below half the budget the stretch is halved again.
+// The stretch changes at most once per fifth of the window, so a single
+// expensive cycle does not swing it.
+class SelfBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        double cpu_percent = 1.0;               // of one CPU, averaged over the window
+        uint64_t io_bytes_per_second = 0;       // storage reads + writes, 0 = no I/O budget
+        std::chrono::seconds window{300};
+        uint32_t max_stretch = 8;
+    };
+
+    // Published with every hardware sample
+    struct Usage {
+        double cpu_percent = 0.0;               // over window_seconds
+        double cpu_budget_percent = 0.0;
+        double io_bytes_per_second = 0.0;
+        uint64_t cpu_ms_total = 0;              // since the agent started
+        uint64_t read_bytes_total = 0;
+        uint64_t write_bytes_total = 0;
+        uint32_t window_seconds = 0;            // 0 until a first interval was measured
+        uint32_t stretch = 1;                   // sampling interval multiplier in effect
+        bool over_budget = false;
+    };
+
+    SelfBudget();
+    explicit SelfBudget(const Options& options);
+
+    // Take a reading and adjust the stretch
+    Usage update(Clock::time_point now);
+
+    uint32_t stretch() const { return stretch_; }
+    const Options& options() const { return options_; }
+
+private:
+    struct Reading {
+        Clock::time_point time;
+        uint64_t cpu_us;
+        uint64_t io_bytes;
+    };
+
+    Options options_;
+    std::deque<Reading> readings_;          // oldest is the window's baseline
+    uint32_t stretch_ = 1;
+    Clock::time_point last_change_{};
+
+    static uint64_t cpuMicros();
+    static bool readIo(uint64_t& read_bytes, uint64_t& write_bytes);
+};
@@ -0,0 +1,313 @@
+#include "session_client.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+// Messages the server acks and that are resent on the next session
+bool needsAck(const monitoring::DeviceMessage& message) {
+    return message.has_alert() || message.has_command_result() || message.has_event();
+}
+
+} // namespace
+
+SessionClient::SessionClient(std::shared_ptr<grpc::Channel> channel, const monitoring::DeviceInfo& hello)
+    : SessionClient(std::move(channel), hello, Options{}) {
+}
+
+SessionClient::SessionClient(std::shared_ptr<grpc::Channel> channel, const monitoring::DeviceInfo& hello,
+                             const Options& options)
+    : stub_(monitoring::MonitoringService::NewStub(channel)), hello_(hello), options_(options),
+      backoff_(options.initial_backoff), rng_(std::random_device{}()) {
+}
+
+SessionClient::~SessionClient() {
+    stop();
+}
+
+void SessionClient::start(MessageHandler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (started_) return;
+    started_ = true;
+    handler_ = std::move(handler);
+    cq_thread_ = std::thread(&SessionClient::run, this);
+    connect();
+    scheduleHeartbeat();
+}
+
+void SessionClient::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_.exchange(true)) return;
+        if (!started_) {
+            // Nothing was ever queued on the completion queue
+            cq_.Shutdown();
+            void* tag;
+            bool ok;
+            while (cq_.Next(&tag, &ok)) {
+            }
+            return;
+        }
+        if (reconnect_armed_) reconnect_alarm_.Cancel();
+        if (heartbeat_armed_) heartbeat_alarm_.Cancel();
+        if (call_) {
+            // The stream ends, Finish completes and the queue is shut down from there
+            call_->context.TryCancel();
+        } else {
+            state_ = State::Stopped;
+            cq_.Shutdown();
+        }
+    }
+    if (cq_thread_.joinable()) {
+        cq_thread_.join();
+    }
+}
+
+bool SessionClient::send(monitoring::DeviceMessage message) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) return false;
+    bool queued = enqueue(std::move(message), false);
+    startWrite();
+    return queued;
+}
+
+void SessionClient::setStatus(const std::string& status) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    status_ = status;
+}
+
+SessionClient::Stats SessionClient::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.state = state_;
+    stats.queued = outbound_.size();
+    stats.unacked = unacked_.size();
+    if (state_ == State::Connected && call_) {
+        stats.connected_for = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - call_->connected_at);
+    }
+    return stats;
+}
+
+const char* SessionClient::stateName(State state) {
+    switch (state) {
+        case State::Idle: return "idle";
+        case State::Connecting: return "connecting";
+        case State::Connected: return "connected";
+        case State::Backoff: return "backoff";
+        case State::Stopped: return "stopped";
+    }
+    return "";
+}
+
+void SessionClient::run() {
+    void* raw_tag;
+    bool ok;
+    while (cq_.Next(&raw_tag, &ok)) {
+        Tag* tag = static_cast<Tag*>(raw_tag);
+        Call* call = tag->call;
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        switch (tag->kind) {
+            case TagKind::Start: {
+                if (!ok || stopping_) {
+                    finishCall(call);
+                    break;
+                }
+                state_ = State::Connected;
+                stats_.sessions++;
+                call->connected_at = std::chrono::steady_clock::now();
+                sequence_ = 0;
+
+                // Acks and heartbeats of the previous session are meaningless to
+                // this one; what the server never acked goes first, after the hello
+                std::deque<monitoring::DeviceMessage> pending;
+                for (auto& [sequence, message] : unacked_) {
+                    pending.push_back(std::move(message));
+                }
+                unacked_.clear();
+                for (auto& message : outbound_) {
+                    if (needsAck(message)) pending.push_back(std::move(message));
+                }
+                outbound_ = std::move(pending);
+                monitoring::DeviceMessage hello;
+                *hello.mutable_hello() = hello_;
+                outbound_.push_front(std::move(hello));
+
+                call->read_pending = true;
+                call->stream->Read(&call->incoming, &call->read_tag);
+                startWrite();
+                std::cout << "Device session connected" << std::endl;
+                break;
+            }
+            case TagKind::Read: {
+                call->read_pending = false;
+                if (!ok) {
+                    // Stream ended: server gone, connection lost or cancelled
+                    finishCall(call);
+                    break;
+                }
+                stats_.messages_received++;
+                monitoring::ServerMessage message = std::move(call->incoming);
+                if (message.has_ack()) {
+                    unacked_.erase(message.ack().sequence());
+                }
+                if (message.has_alert() && message.alert().alert_id() != 0) {
+                    // Ack on receipt, before the handler acts on it
+                    monitoring::DeviceMessage ack;
+                    ack.mutable_ack()->set_alert_id(message.alert().alert_id());
+                    enqueue(std::move(ack), false);
+                    startWrite();
+                }
+                if (!stopping_) {
+                    call->read_pending = true;
+                    call->stream->Read(&call->incoming, &call->read_tag);
+                } else {
+                    releaseCall(call);
+                }
+
+                MessageHandler handler = handler_;
+                lock.unlock();
+                if (handler) {
+                    handler(message);
+                }
+                break;
+            }
+            case TagKind::Write: {
+                call->write_pending = false;
+                if (!ok) {
+                    // The read fails as well and ends the call; keep what must reach the server
+                    if (needsAck(in_flight_)) {
+                        enqueue(std::move(in_flight_), true);
+                    }
+                    releaseCall(call);
+                    break;
+                }
+                stats_.messages_sent++;
+                last_write_ = std::chrono::steady_clock::now();
+                if (needsAck(in_flight_)) {
+                    unacked_[in_flight_.sequence()] = std::move(in_flight_);
+                }
+                startWrite();
+                // Finish may have completed while this write was pending
+                releaseCall(call);
+                break;
+            }
+            case TagKind::Finish: {
+                call->finish_pending = false;
+                call->finished = true;
+                if (!call->status.ok()) {
+                    stats_.last_error = call->status.error_message();
+                }
+                if (call == call_) {
+                    call_ = nullptr;
+                    if (state_ == State::Connected) {
+                        stats_.disconnects++;
+                        if (!stopping_) {
+                            std::cerr << "Device session lost: " << call->status.error_message() << std::endl;
+                        }
+                        if (std::chrono::steady_clock::now() - call->connected_at >= options_.stable_after) {
+                            backoff_ = options_.initial_backoff;
+                        }
+                    }
+                    if (stopping_) {
+                        state_ = State::Stopped;
+                    } else {
+                        scheduleReconnect();
+                    }
+                }
+                releaseCall(call);
+                if (stopping_ && !call_) {
+                    cq_.Shutdown();
+                }
+                break;
+            }
+            case TagKind::Reconnect:
+                reconnect_armed_ = false;
+                if (ok && !stopping_) {
+                    connect();
+                }
+                break;
+            case TagKind::Heartbeat:
+                heartbeat_armed_ = false;
+                if (!ok || stopping_) break;
+                if (state_ == State::Connected &&
+                    std::chrono::steady_clock::now() - last_write_ >= options_.heartbeat_interval) {
+                    monitoring::DeviceMessage heartbeat;
+                    heartbeat.mutable_heartbeat()->set_status(status_);
+                    enqueue(std::move(heartbeat), false);
+                    startWrite();
+                }
+                scheduleHeartbeat();
+                break;
+        }
+    }
+}
+
+void SessionClient::connect() {
+    state_ = State::Connecting;
+    stats_.connect_attempts++;
+    call_ = new Call();
+    call_->stream = stub_->PrepareAsyncSession(&call_->context, &cq_);
+    call_->stream->StartCall(&call_->start_tag);
+}
+
+void SessionClient::scheduleReconnect() {
+    state_ = State::Backoff;
+    std::uniform_real_distribution<double> jitter(1.0 - options_.jitter, 1.0 + options_.jitter);
+    auto delay = std::chrono::milliseconds(static_cast<int64_t>(backoff_.count() * jitter(rng_)));
+    stats_.next_backoff = delay;
+    backoff_ = std::min(options_.max_backoff, std::chrono::milliseconds(
+        static_cast<int64_t>(backoff_.count() * options_.backoff_multiplier)));
+
+    reconnect_armed_ = true;
+    reconnect_alarm_.Set(&cq_, std::chrono::system_clock::now() + delay, &reconnect_tag_);
+}
+
+void SessionClient::scheduleHeartbeat() {
+    // Checked a few times per interval so an idle session is never silent much longer
+    heartbeat_armed_ = true;
+    heartbeat_alarm_.Set(&cq_, std::chrono::system_clock::now() + options_.heartbeat_interval / 3,
+                         &heartbeat_tag_);
+}
+
+void SessionClient::startWrite() {
+    if (!call_ || state_ != State::Connected || call_->write_pending || call_->finish_pending ||
+        outbound_.empty()) {
+        return;
+    }
+    in_flight_ = std::move(outbound_.front());
+    outbound_.pop_front();
+    in_flight_.set_device_id(hello_.device_id());
+    in_flight_.set_sequence(++sequence_);
+    call_->write_pending = true;
+    call_->stream->Write(in_flight_, &call_->write_tag);
+}
+
+void SessionClient::finishCall(Call* call) {
+    if (call->finish_pending || call->finished) return;
+    call->finish_pending = true;
+    call->stream->Finish(&call->status, &call->finish_tag);
+}
+
+void SessionClient::releaseCall(Call* call) {
+    if (call->finished && !call->read_pending && !call->write_pending) {
+        delete call;
+    }
+}
+
+bool SessionClient::enqueue(monitoring::DeviceMessage message, bool front) {
+    bool full = outbound_.size() >= options_.max_queued;
+    if (full) {
+        // Oldest first, the newest state matters most
+        outbound_.pop_front();
+        stats_.dropped++;
+    }
+    if (front) {
+        outbound_.push_front(std::move(message));
+    } else {
+        outbound_.push_back(std::move(message));
+    }
+    return !full;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <grpcpp/alarm.h>
+#include <grpcpp/grpcpp.h>
+#include "monitoring.grpc.pb.h"
+
+// Device session over the gRPC async API.
+//
+// One completion-queue thread drives the Session stream (connect, reads,
+// queued writes, heartbeats) and reconnects with jittered exponential backoff
+// whenever the stream ends, so a server restart no longer leaves the device
+// deaf to alerts. Other threads only queue messages with send().
+class SessionClient {
+public:
+    enum class State { Idle, Connecting, Connected, Backoff, Stopped };
+
+    struct Options {
+        std::chrono::milliseconds initial_backoff{1000};
+        std::chrono::milliseconds max_backoff{60000};
+        double backoff_multiplier = 2.0;
+        double jitter = 0.2;                               // +/- fraction of the delay
+        std::chrono::seconds stable_after{30};             // connected this long resets the backoff
+        std::chrono::seconds heartbeat_interval{45};       // idle time before a heartbeat; the server idle timeout assumes it
+        size_t max_queued = 1000;                          // outbound messages kept while disconnected
+    };
+
+    // Stream-state metrics
+    struct Stats {
+        State state = State::Idle;
+        uint64_t connect_attempts = 0;
+        uint64_t sessions = 0;                 // streams that reached Connected
+        uint64_t disconnects = 0;
+        uint64_t messages_sent = 0;
+        uint64_t messages_received = 0;
+        uint64_t dropped = 0;                  // outbound queue overflow
+        size_t queued = 0;
+        size_t unacked = 0;
+        std::chrono::milliseconds next_backoff{0};
+        std::chrono::seconds connected_for{0}; // current session, 0 when not connected
+        std::string last_error;
+    };
+
+    // Called on the completion-queue thread for every server message
+    // (alerts are acknowledged before the handler runs)
+    using MessageHandler = std::function<void(const monitoring::ServerMessage&)>;
+
+    SessionClient(std::shared_ptr<grpc::Channel> channel, const monitoring::DeviceInfo& hello);
+    SessionClient(std::shared_ptr<grpc::Channel> channel, const monitoring::DeviceInfo& hello,
+                  const Options& options);
+    ~SessionClient();
+
+    SessionClient(const SessionClient&) = delete;
+    SessionClient& operator=(const SessionClient&) = delete;
+
+    void start(MessageHandler handler);
+    void stop();
+
+    // Queue a message for the session (sent once connected). Alerts, device
+    // events and command results are kept until the server acks them and
+    // resent on the next session otherwise. False when the queue was full and its
+    // oldest message was dropped.
+    bool send(monitoring::DeviceMessage message);
+
+    // Status carried by the heartbeats
+    void setStatus(const std::string& status);
+
+    Stats getStats() const;
+
+    static const char* stateName(State state);
+
+private:
+    enum class TagKind { Start, Read, Write, Finish, Reconnect, Heartbeat };
+
+    struct Call;
+    struct Tag {
+        TagKind kind;
+        Call* call;
+    };
+
+    // One Session stream; freed once every operation on it completed
+    struct Call {
+        grpc::ClientContext context;
+        std::unique_ptr<grpc::ClientAsyncReaderWriter<monitoring::DeviceMessage, monitoring::ServerMessage>> stream;
+        monitoring::ServerMessage incoming;
+        grpc::Status status;
+        Tag start_tag{TagKind::Start, this};
+        Tag read_tag{TagKind::Read, this};
+        Tag write_tag{TagKind::Write, this};
+        Tag finish_tag{TagKind::Finish, this};
+        bool read_pending = false;
+        bool write_pending = false;
+        bool finish_pending = false;
+        bool finished = false;
+        std::chrono::steady_clock::time_point connected_at;
+    };
+
+    std::unique_ptr<monitoring::MonitoringService::Stub> stub_;
+    monitoring::DeviceInfo hello_;
+    Options options_;
+    MessageHandler handler_;
+
+    grpc::CompletionQueue cq_;
+    std::thread cq_thread_;
+    grpc::Alarm reconnect_alarm_;
+    grpc::Alarm heartbeat_alarm_;
+    bool reconnect_armed_ = false;
+    bool heartbeat_armed_ = false;
+    Tag reconnect_tag_{TagKind::Reconnect, nullptr};
+    Tag heartbeat_tag_{TagKind::Heartbeat, nullptr};
+
+    mutable std::mutex mutex_;
+    std::atomic<bool> stopping_{false};
+    bool started_ = false;
+    State state_ = State::Idle;
+    Call* call_ = nullptr;                 // current stream, if any
+    std::deque<monitoring::DeviceMessage> outbound_;
+    monitoring::DeviceMessage in_flight_;  // write in progress
+    std::map<uint64_t, monitoring::DeviceMessage> unacked_;   // by session sequence
+    uint64_t sequence_ = 0;
+    std::string status_ = "running";
+    std::chrono::milliseconds backoff_;
+    std::chrono::steady_clock::time_point last_write_;
+    Stats stats_;
+    std::mt19937 rng_;
+
+    void run();
+    void connect();                                   // lock held
+    void scheduleReconnect();                         // lock held
+    void startWrite();                                // lock held
+    void finishCall(Call* call);                      // lock held
+    void releaseCall(Call* call);                     // lock held
+    void scheduleHeartbeat();                         // lock held
+    bool enqueue(monitoring::DeviceMessage message, bool front);   // lock held, false if one was dropped
+};
@@ -0,0 +1,121 @@
+#include "window_sampler.h"
+#include <algorithm>
+#include <cmath>
+#include "proc_stats.h"
+
+namespace {
+
+int64_t steadyMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+WindowSampler::WindowSampler() : WindowSampler(Options{}) {
+}
+
+WindowSampler::WindowSampler(const Options& options)
+    : options_(options), ring_(std::max<size_t>(options.capacity, 1)) {
+    scratch_.reserve(ring_.size());
+}
+
+WindowSampler::~WindowSampler() {
+    stop();
+}
+
+void WindowSampler::start() {
+    if (running_.exchange(true)) return;
+    thread_ = std::thread(&WindowSampler::run, this);
+}
+
+void WindowSampler::stop() {
+    if (!running_.exchange(false)) return;
+    wakeup_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void WindowSampler::run() {
+    proc_stats::CpuTicks last_ticks;
+    bool have_ticks = proc_stats::readCpuTicks(last_ticks);
+    auto next = std::chrono::steady_clock::now() + options_.period;
+
+    while (running_) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wakeup_.wait_until(lock, next, [this] { return !running_; });
+        }
+        if (!running_) break;
+        next += options_.period;
+
+        Reading reading{steadyMillis(), std::nanf(""), std::nanf("")};
+        proc_stats::CpuTicks ticks;
+        if (proc_stats::readCpuTicks(ticks)) {
+            if (have_ticks && ticks.total > last_ticks.total) {
+                reading.cpu = static_cast<float>(proc_stats::cpuUsagePercent(last_ticks, ticks));
+            }
+            last_ticks = ticks;
+            have_ticks = true;
+        }
+        proc_stats::MemInfo mem;
+        if (proc_stats::readMemInfo(mem)) {
+            reading.memory = static_cast<float>(proc_stats::memoryUsagePercent(mem));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        ring_[head_] = reading;
+        head_ = (head_ + 1) % ring_.size();
+        window_count_ = std::min(window_count_ + 1, ring_.size());
+    }
+}
+
+bool WindowSampler::takeWindow(Stats& cpu, Stats& memory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = window_count_;
+    window_count_ = 0;
+    if (count == 0) {
+        cpu = Stats{};
+        memory = Stats{};
+        return false;
+    }
+
+    size_t first = (head_ + ring_.size() - count) % ring_.size();
+    const Reading& oldest = ring_[first];
+    const Reading& newest = ring_[(head_ + ring_.size() - 1) % ring_.size()];
+    // Each reading covers the period before it
+    int64_t span_ms = newest.timestamp_ms - oldest.timestamp_ms + options_.period.count();
+    uint32_t window_seconds = static_cast<uint32_t>((span_ms + 500) / 1000);
+
+    cpu = summarize(&Reading::cpu, first, count, window_seconds);
+    memory = summarize(&Reading::memory, first, count, window_seconds);
+    return true;
+}
+
+WindowSampler::Stats WindowSampler::summarize(float Reading::*field, size_t first, size_t count,
+                                              uint32_t window_seconds) {
+    scratch_.clear();
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        float value = ring_[(first + i) % ring_.size()].*field;
+        if (std::isnan(value)) continue;
+        scratch_.push_back(value);
+        sum += value;
+    }
+
+    Stats stats;
+    if (scratch_.empty()) return stats;
+
+    stats.samples = static_cast<uint32_t>(scratch_.size());
+    stats.window_seconds = window_seconds;
+    auto [min_it, max_it] = std::minmax_element(scratch_.begin(), scratch_.end());
+    stats.min = *min_it;
+    stats.max = *max_it;
+    stats.mean = static_cast<float>(sum / scratch_.size());
+    // Nearest-rank 95th percentile
+    size_t rank = static_cast<size_t>(std::ceil(0.95 * scratch_.size())) - 1;
+    std::nth_element(scratch_.begin(), scratch_.begin() + rank, scratch_.end());
+    stats.p95 = scratch_[rank];
+    return stats;
+}
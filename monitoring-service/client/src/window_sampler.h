@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// High-rate CPU and memory sampling between published samples.
+//
+// A background thread reads /proc/stat and /proc/meminfo every period into a
+// fixed-size ring buffer (no allocation after start). Each published hardware
+// sample takes the min/max/mean/p95 of the readings since the previous one,
+// so spikes between two samples are no longer lost.
+class WindowSampler {
+public:
+    struct Options {
+        std::chrono::milliseconds period{1000};
+        size_t capacity = 600;          // readings kept, ten minutes at 1 Hz
+    };
+
+    // Summary of one window, samples == 0 when there is none
+    struct Stats {
+        uint32_t samples = 0;
+        uint32_t window_seconds = 0;
+        float min = 0.0f;
+        float max = 0.0f;
+        float mean = 0.0f;
+        float p95 = 0.0f;
+    };
+
+    WindowSampler();
+    explicit WindowSampler(const Options& options);
+    ~WindowSampler();
+
+    WindowSampler(const WindowSampler&) = delete;
+    WindowSampler& operator=(const WindowSampler&) = delete;
+
+    void start();
+    void stop();
+
+    // Summaries of the readings since the previous call (at most capacity),
+    // then start a new window. False when no reading was taken.
+    bool takeWindow(Stats& cpu, Stats& memory);
+
+private:
+    struct Reading {
+        int64_t timestamp_ms;   // steady clock
+        float cpu;              // percent, NaN when /proc/stat could not be read
+        float memory;           // percent, NaN when /proc/meminfo could not be read
+    };
+
+    Options options_;
+    std::vector<Reading> ring_;
+    size_t head_ = 0;               // next slot to write
+    size_t window_count_ = 0;       // readings in the current window
+    std::vector<float> scratch_;    // reused for the percentile
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+
+    void run();
+    Stats summarize(float Reading::*field, size_t first, size_t count, uint32_t window_seconds);
+};
@@ -0,0 +1,308 @@
+#include "alert_mailbox.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// length, checksum, kind, expires_ms
+constexpr size_t kRecordHeaderSize = 17;
+
+// The log is rewritten once past this size and four times the live alerts
+constexpr uint64_t kCompactMinBytes = 1024 * 1024;
+
+uint32_t checksum(const uint8_t* data, size_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+} // namespace
+
+AlertMailbox::AlertMailbox(const Options& options) : options_(options) {
+    options_.max_per_device = std::max<size_t>(options_.max_per_device, 1);
+    if (options_.path.empty()) {
+        return;
+    }
+    load();
+    // Starts the log over without the torn tail, the taken and the expired alerts
+    compact();
+}
+
+AlertMailbox::~AlertMailbox() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void AlertMailbox::put(const monitoring::Alert& alert) {
+    int64_t expires_ms = nowMs() + std::chrono::duration_cast<std::chrono::milliseconds>(options_.ttl).count();
+    if (!insert(alert, expires_ms)) {
+        return;
+    }
+    append(kPut, expires_ms, alert.SerializeAsString());
+}
+
+std::vector<monitoring::Alert> AlertMailbox::take(const std::string& device_id) {
+    auto device = devices_.find(device_id);
+    if (device == devices_.end()) {
+        return {};
+    }
+
+    int64_t now = nowMs();
+    std::vector<Pending*> pending;
+    for (auto& [alert_type, entry] : device->second) {
+        order_.erase(entry.sequence);
+        bytes_ -= entry.bytes;
+        if (entry.expires_ms > now) {
+            pending.push_back(&entry);
+        }
+    }
+    std::sort(pending.begin(), pending.end(),
+              [](const Pending* a, const Pending* b) { return a->sequence < b->sequence; });
+
+    std::vector<monitoring::Alert> alerts;
+    alerts.reserve(pending.size());
+    for (Pending* entry : pending) {
+        alerts.push_back(std::move(entry->alert));
+    }
+    devices_.erase(device);
+    append(kTake, 0, device_id);
+    return alerts;
+}
+
+size_t AlertMailbox::expire() {
+    int64_t now = nowMs();
+    std::vector<std::pair<std::string, std::string>> expired;
+    for (const auto& [device_id, alerts] : devices_) {
+        for (const auto& [alert_type, entry] : alerts) {
+            if (entry.expires_ms <= now) {
+                expired.emplace_back(device_id, alert_type);
+            }
+        }
+    }
+    // Not logged: the expiry time is in the put record
+    for (const auto& [device_id, alert_type] : expired) {
+        erase(device_id, alert_type);
+    }
+    return expired.size();
+}
+
+bool AlertMailbox::insert(const monitoring::Alert& alert, int64_t expires_ms) {
+    size_t size = alert.ByteSizeLong();
+    if (size > options_.max_bytes) {
+        std::cerr << "Alert " << alert.alert_type() << " for device " << alert.device_id()
+                  << " is larger than the mailbox" << std::endl;
+        return false;
+    }
+
+    // Latest alert of a type only
+    erase(alert.device_id(), alert.alert_type());
+
+    Pending entry;
+    entry.alert = alert;
+    entry.expires_ms = expires_ms;
+    entry.sequence = ++next_sequence_;
+    entry.bytes = size;
+    order_[entry.sequence] = {alert.device_id(), alert.alert_type()};
+    bytes_ += size;
+    devices_[alert.device_id()][alert.alert_type()] = std::move(entry);
+
+    enforceLimits(alert.device_id());
+    return true;
+}
+
+void AlertMailbox::erase(const std::string& device_id, const std::string& alert_type) {
+    auto device = devices_.find(device_id);
+    if (device == devices_.end()) {
+        return;
+    }
+    auto entry = device->second.find(alert_type);
+    if (entry == device->second.end()) {
+        return;
+    }
+    bytes_ -= entry->second.bytes;
+    order_.erase(entry->second.sequence);
+    device->second.erase(entry);
+    if (device->second.empty()) {
+        devices_.erase(device);
+    }
+}
+
+void AlertMailbox::enforceLimits(const std::string& device_id) {
+    // Not logged: replaying the log under the same limits drops the same alerts
+    size_t dropped = 0;
+    auto device = devices_.find(device_id);
+    while (device != devices_.end() && device->second.size() > options_.max_per_device) {
+        auto oldest = std::min_element(device->second.begin(), device->second.end(),
+                                       [](const auto& a, const auto& b) {
+                                           return a.second.sequence < b.second.sequence;
+                                       });
+        std::string alert_type = oldest->first;
+        erase(device_id, alert_type);
+        device = devices_.find(device_id);
+        ++dropped;
+    }
+    while (bytes_ > options_.max_bytes && !order_.empty()) {
+        auto [oldest_device, alert_type] = order_.begin()->second;
+        erase(oldest_device, alert_type);
+        ++dropped;
+    }
+    if (dropped > 0) {
+        std::cerr << "Alert mailbox full, dropped the " << dropped << " oldest alert(s)" << std::endl;
+    }
+}
+
+void AlertMailbox::load() {
+    std::ifstream file(options_.path, std::ios::binary);
+    if (!file) {
+        return;
+    }
+    std::string log((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    size_t offset = 0;
+    size_t records = 0;
+    while (log.size() - offset >= kRecordHeaderSize) {
+        const char* record = log.data() + offset;
+        uint32_t length = 0;
+        uint32_t sum = 0;
+        int64_t expires_ms = 0;
+        std::memcpy(&length, record, sizeof(length));
+        std::memcpy(&sum, record + 4, sizeof(sum));
+        std::memcpy(&expires_ms, record + 9, sizeof(expires_ms));
+        auto kind = static_cast<uint8_t>(record[8]);
+        if (length < kRecordHeaderSize || length > log.size() - offset ||
+            checksum(reinterpret_cast<const uint8_t*>(record) + 8, length - 8) != sum) {
+            break;
+        }
+
+        std::string payload(record + kRecordHeaderSize, length - kRecordHeaderSize);
+        if (kind == kPut) {
+            monitoring::Alert alert;
+            if (!alert.ParseFromString(payload)) break;
+            insert(alert, expires_ms);
+        } else if (kind == kTake) {
+            auto device = devices_.find(payload);
+            if (device != devices_.end()) {
+                for (const auto& [alert_type, entry] : device->second) {
+                    order_.erase(entry.sequence);
+                    bytes_ -= entry.bytes;
+                }
+                devices_.erase(device);
+            }
+        } else {
+            break;
+        }
+        offset += length;
+        ++records;
+    }
+    if (offset < log.size()) {
+        std::cerr << "Alert mailbox " << options_.path << ": dropped " << (log.size() - offset)
+                  << " byte(s) of torn records after " << records << " record(s)" << std::endl;
+    }
+
+    expire();
+    if (!order_.empty()) {
+        std::cout << "Alert mailbox " << options_.path << " holds " << order_.size()
+                  << " undelivered alert(s) for " << devices_.size() << " device(s)" << std::endl;
+    }
+}
+
+void AlertMailbox::compact() {
+    std::error_code ec;
+    fs::create_directories(fs::path(options_.path).parent_path(), ec);
+
+    // Written next to the log and renamed over it, a crash leaves one or the other
+    std::string temporary = options_.path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0;
+    uint64_t written = 0;
+    for (auto it = order_.begin(); ok && it != order_.end(); ++it) {
+        const Pending& entry = devices_[it->second.first][it->second.second];
+        std::string record = encode(kPut, entry.expires_ms, entry.alert.SerializeAsString());
+        ok = writeAll(fd, record);
+        written += record.size();
+    }
+    ok = ok && ::fdatasync(fd) == 0;
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (!ok || ::rename(temporary.c_str(), options_.path.c_str()) != 0) {
+        std::cerr << "Failed to rewrite alert mailbox " << options_.path << ": " << std::strerror(errno) << std::endl;
+        ::unlink(temporary.c_str());
+        if (fd_ >= 0) {
+            return;                             // keep appending to the current log
+        }
+    } else {
+        log_bytes_ = written;
+    }
+
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = ::open(options_.path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        std::cerr << "Failed to open alert mailbox " << options_.path << ": " << std::strerror(errno)
+                  << ", alerts for offline devices are kept in memory only" << std::endl;
+    }
+}
+
+void AlertMailbox::append(RecordKind kind, int64_t expires_ms, const std::string& payload) {
+    if (fd_ < 0) {
+        return;
+    }
+    std::string record = encode(kind, expires_ms, payload);
+    if (!writeAll(fd_, record) || (options_.sync && ::fdatasync(fd_) != 0)) {
+        std::cerr << "Failed to append to alert mailbox " << options_.path << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+    log_bytes_ += record.size();
+
+    uint64_t live_bytes = bytes_ + order_.size() * kRecordHeaderSize;
+    if (log_bytes_ > kCompactMinBytes && log_bytes_ > 4 * live_bytes) {
+        compact();
+    }
+}
+
+std::string AlertMailbox::encode(RecordKind kind, int64_t expires_ms, const std::string& payload) {
+    std::string record(kRecordHeaderSize + payload.size(), '\0');
+    auto length = static_cast<uint32_t>(record.size());
+    std::memcpy(&record[0], &length, sizeof(length));
+    record[8] = static_cast<char>(kind);
+    std::memcpy(&record[9], &expires_ms, sizeof(expires_ms));
+    std::memcpy(&record[kRecordHeaderSize], payload.data(), payload.size());
+    // Covers everything after itself
+    uint32_t sum = checksum(reinterpret_cast<const uint8_t*>(record.data()) + 8, record.size() - 8);
+    std::memcpy(&record[4], &sum, sizeof(sum));
+    return record;
+}
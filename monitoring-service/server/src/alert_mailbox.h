@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "monitoring.pb.h"
+
+// Alerts raised while their device was not connected, replayed when it
+// registers again.
+//
+// Only the latest alert of each alert_type is kept per device, until its TTL
+// runs out. A device keeps at most max_per_device alerts and the whole fleet
+// max_bytes of them; past either limit the oldest ones are dropped first.
+//
+// Every put and take is appended to a log file, which is replayed (and
+// rewritten without the stale records) at startup. The log is also rewritten
+// whenever stale records make up most of it. Not thread-safe: AlertManager
+// calls it with devices_mutex_ held.
+class AlertMailbox {
+public:
+    struct Options {
+        std::string path;                                   // empty: memory only
+        std::chrono::seconds ttl{24 * 60 * 60};
+        size_t max_per_device = 32;
+        size_t max_bytes = 32 * 1024 * 1024;                // serialized alerts, fleet-wide
+        bool sync = false;                                  // fdatasync each record, for power loss
+    };
+
+    explicit AlertMailbox(const Options& options);
+    ~AlertMailbox();
+
+    AlertMailbox(const AlertMailbox&) = delete;
+    AlertMailbox& operator=(const AlertMailbox&) = delete;
+
+    // Keep an alert for its device, replacing a pending one of the same type
+    void put(const monitoring::Alert& alert);
+
+    // The device's unexpired alerts, oldest first, removed from the mailbox
+    std::vector<monitoring::Alert> take(const std::string& device_id);
+
+    // Drop the alerts past their TTL; returns how many
+    size_t expire();
+
+    size_t size() const { return order_.size(); }
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct Pending {
+        monitoring::Alert alert;
+        int64_t expires_ms = 0;         // system_clock, survives restarts
+        uint64_t sequence = 0;          // mailbox order
+        size_t bytes = 0;
+    };
+
+    enum RecordKind : uint8_t {
+        kPut = 1,                       // payload: the serialized Alert
+        kTake = 2                       // payload: the device_id
+    };
+
+    Options options_;
+    int fd_ = -1;
+    uint64_t log_bytes_ = 0;
+
+    std::map<std::string, std::map<std::string, Pending>> devices_;     // device_id, alert_type
+    std::map<uint64_t, std::pair<std::string, std::string>> order_;     // sequence: device_id, alert_type
+    uint64_t next_sequence_ = 0;
+    size_t bytes_ = 0;
+
+    // Applies a put without logging it; false if it was dropped at once
+    bool insert(const monitoring::Alert& alert, int64_t expires_ms);
+    void erase(const std::string& device_id, const std::string& alert_type);
+    void enforceLimits(const std::string& device_id);
+
+    void load();
+    void compact();
+    void append(RecordKind kind, int64_t expires_ms, const std::string& payload);
+    static std::string encode(RecordKind kind, int64_t expires_ms, const std::string& payload);
+};
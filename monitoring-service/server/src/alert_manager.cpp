@@ -1,16 +1,23 @@
 #include "alert_manager.h"
+#include "alert_stream_reactor.h"
+#include "session_reactor.h"
+#include <algorithm>
 #include <iostream>
 #include <chrono>
 #include <sstream> // For std::to_string
 
-AlertManager::AlertManager() {}
+AlertManager::AlertManager() : mailbox_(AlertMailbox::Options()) {}
+
+AlertManager::AlertManager(const OutboundOptions& outbound, const AlertMailbox::Options& mailbox)
+    : outbound_(outbound), mailbox_(mailbox) {}
 
 void AlertManager::sendAlert(const std::string& device_id,
                              AlertSeverity severity,
                              const std::string& alert_type,
                              const std::string& description,
                              const std::string& recommended_action,
-                             const std::string& corrective_command) {
+                             const std::string& corrective_command,
+                             const std::vector<monitoring::ProcessUsage>& processes) {
     monitoring::Alert alert;
     alert.set_device_id(device_id);
     alert.set_severity(convertSeverity(severity));
@@ -20,6 +27,9 @@ void AlertManager::sendAlert(const std::string& device_id,
     if (!corrective_command.empty()) {
         alert.set_corrective_command(corrective_command);
     }
+    for (const auto& process : processes) {
+        *alert.add_processes() = process;
+    }
 
     // Set timestamp as string
     auto now = std::chrono::system_clock::now();
@@ -29,24 +39,29 @@ void AlertManager::sendAlert(const std::string& device_id,
 
     std::lock_guard<std::mutex> lock(devices_mutex_);
 
+    auto rules = local_alert_types_.find(device_id);
+    if (rules != local_alert_types_.end() && rules->second.count(alert_type)) {
+        // The agent raises this one itself and reports it, offline ones included
+        std::cout << "Alert " << alert_type << " for device " << device_id
+                  << " is evaluated on the device, not sent" << std::endl;
+        return;
+    }
+    alert.set_alert_id(++next_alert_id_);
+    addToHistory(alert);
     auto it = devices_.find(device_id);
-    if (it != devices_.end()) {
-        try {
-            if (it->second.stream) {
-                if (!it->second.stream->Write(alert)) {
-                    std::cerr << "Failed to send alert to device: " << device_id << std::endl;
-                    devices_.erase(it);
-                }
-            }
-        } catch (const std::exception& e) {
-            std::cerr << "Exception sending alert to device " << device_id
-                      << ": " << e.what() << std::endl;
-            devices_.erase(it);
-        }
-    } else {
+    if (it == devices_.end()) {
+        mailbox_.put(alert);
         std::cout << "Alert generated for non-connected device " << device_id
                   << " - Type: " << alert_type
-                  << " - Severity: " << static_cast<int>(severity) << std::endl;
+                  << " - Severity: " << static_cast<int>(severity)
+                  << " - Kept until it registers" << std::endl;
+        return;
+    }
+    if (!writeAlert(it->second, alert)) {
+        std::cerr << "Failed to send alert to device: " << device_id << ", kept until it registers" << std::endl;
+        keepUndelivered(device_id, it->second);
+        mailbox_.put(alert);
+        devices_.erase(it);
         return;
     }
 
@@ -56,16 +71,25 @@ void AlertManager::sendAlert(const std::string& device_id,
               << " - Description: " << description << std::endl;
 }
 
-void AlertManager::registerDevice(const std::string& device_id, 
-                                 grpc::ServerWriter<monitoring::Alert>* stream) {
+uint64_t AlertManager::registerDevice(const std::string& device_id, AlertStreamReactor* stream,
+                                      bool evaluates_rules) {
     std::lock_guard<std::mutex> lock(devices_mutex_);
     
-    DeviceConnection connection{
-        stream,
-        std::chrono::system_clock::now()
-    };
+    if (!evaluates_rules) {
+        local_alert_types_.erase(device_id);
+    }
+    auto it = devices_.find(device_id);
+    if (it != devices_.end()) {
+        // Reconnected before the old stream was cancelled, or moved off a session
+        closeConnection(device_id, it->second);
+    }
+    
+    DeviceConnection connection;
+    connection.stream = stream;
+    connection.generation = ++next_generation_;
+    connection.last_update = std::chrono::system_clock::now();
     
-    devices_[device_id] = connection;
+    DeviceConnection& registered = devices_[device_id] = connection;
     
     std::cout << "Device registered: " << device_id << std::endl;
     
@@ -82,25 +106,210 @@ void AlertManager::registerDevice(const std::string& device_id,
     welcome_alert.set_timestamp(std::to_string(now_ms)); // Convert long int to string
     
     try {
-        if (stream) {
-            stream->Write(welcome_alert);
-        }
+        writeAlert(registered, welcome_alert);
     } catch (const std::exception& e) {
         std::cerr << "Exception sending welcome alert to device " << device_id 
                   << ": " << e.what() << std::endl;
     }
+    replayMailbox(device_id, registered);
+    return registered.generation;
 }
 
-void AlertManager::unregisterDevice(const std::string& device_id) {
+uint64_t AlertManager::registerSession(const std::string& device_id, SessionReactor* session,
+                                       bool evaluates_rules) {
     std::lock_guard<std::mutex> lock(devices_mutex_);
     
+    if (!evaluates_rules) {
+        local_alert_types_.erase(device_id);
+    }
     auto it = devices_.find(device_id);
     if (it != devices_.end()) {
+        // Reconnected before the old session timed out, or upgraded from RegisterDevice
+        closeConnection(device_id, it->second);
+    }
+    
+    DeviceConnection connection;
+    connection.session = session;
+    connection.generation = ++next_generation_;
+    connection.last_update = std::chrono::system_clock::now();
+    DeviceConnection& registered = devices_[device_id] = connection;
+    
+    std::cout << "Device session opened: " << device_id << std::endl;
+    replayMailbox(device_id, registered);
+    return registered.generation;
+}
+
+void AlertManager::unregisterDevice(const std::string& device_id, uint64_t generation) {
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    
+    auto it = devices_.find(device_id);
+    if (it != devices_.end() && it->second.generation == generation) {
+        keepUndelivered(device_id, it->second);
         devices_.erase(it);
         std::cout << "Device unregistered: " << device_id << std::endl;
     }
 }
 
+void AlertManager::touch(const std::string& device_id) {
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    
+    auto it = devices_.find(device_id);
+    if (it != devices_.end()) {
+        it->second.last_update = std::chrono::system_clock::now();
+    }
+}
+
+void AlertManager::acknowledgeAlert(const std::string& device_id, uint64_t alert_id) {
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    
+    auto it = devices_.find(device_id);
+    if (it == devices_.end()) return;
+    auto pending = it->second.unacked_alerts.find(alert_id);
+    if (pending == it->second.unacked_alerts.end()) return;
+    
+    auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - pending->second.sent);
+    it->second.unacked_alerts.erase(pending);
+    std::cout << "Alert " << alert_id << " delivered to device " << device_id
+              << " in " << latency.count() << " ms" << std::endl;
+}
+
+void AlertManager::sendAck(const std::string& device_id, uint64_t sequence) {
+    monitoring::ServerMessage message;
+    message.mutable_ack()->set_sequence(sequence);
+    
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    
+    auto it = devices_.find(device_id);
+    if (it != devices_.end() && it->second.session) {
+        it->second.session->write(message);
+    }
+}
+
+void AlertManager::recordCommandResult(const std::string& device_id, const monitoring::CommandResult& result) {
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    
+    RemediationStats& stats = remediation_stats_[device_id];
+    stats.commands++;
+    if (result.exit_code() != 0) stats.failures++;
+    if (result.timed_out()) stats.timeouts++;
+    stats.total_latency_ms += result.latency_ms();
+    stats.max_latency_ms = std::max<int64_t>(stats.max_latency_ms, result.latency_ms());
+    
+    std::cout << "Command result from device " << device_id
+              << " - Alert: " << result.alert_id()
+              << " - Rule: " << result.rule_id()
+              << " - Command: " << result.command()
+              << " - Exit code: " << result.exit_code();
+    if (result.signal() != 0) {
+        std::cout << " - Signal: " << result.signal() << (result.timed_out() ? " (timed out)" : "");
+    }
+    if (!result.error().empty()) {
+        std::cout << " - Error: " << result.error();
+    }
+    std::cout << " - Duration: " << result.duration_ms() << " ms"
+              << " - Remediation latency: " << result.latency_ms() << " ms"
+              << " (avg " << stats.total_latency_ms / static_cast<int64_t>(stats.commands)
+              << " ms, max " << stats.max_latency_ms << " ms over " << stats.commands << " command(s), "
+              << stats.failures << " failed, " << stats.timeouts << " timed out)" << std::endl;
+    if (!result.output().empty()) {
+        std::cout << "Output" << (result.output_truncated() ? " (truncated)" : "") << ":\n"
+                  << result.output() << std::endl;
+    }
+}
+
+size_t AlertManager::closeIdleSessions(std::chrono::seconds timeout) {
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    
+    // The reactor unregisters the device once the session is finished
+    auto now = std::chrono::system_clock::now();
+    size_t closed = 0;
+    for (auto& [device_id, connection] : devices_) {
+        if (connection.session && now - connection.last_update > timeout &&
+            connection.session->close(grpc::Status(grpc::StatusCode::CANCELLED, "session idle"))) {
+            std::cout << "Closing idle session of device " << device_id << std::endl;
+            ++closed;
+        }
+    }
+    return closed;
+}
+
+void AlertManager::sendRules(const std::string& device_id, const monitoring::RuleSet& rules) {
+    monitoring::Alert update;
+    update.set_device_id(device_id);
+    update.set_severity(monitoring::Alert::INFO);
+    update.set_alert_type("RULES_UPDATE");
+    update.set_description("Local alert rules");
+    *update.mutable_rules() = rules;
+    
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    
+    auto it = devices_.find(device_id);
+    if (it == devices_.end()) {
+        return;
+    }
+    if (!writeAlert(it->second, update)) {
+        std::cerr << "Failed to send rules to device: " << device_id << std::endl;
+        keepUndelivered(device_id, it->second);
+        devices_.erase(it);
+        return;
+    }
+    std::set<std::string>& local_types = local_alert_types_[device_id];
+    local_types.clear();
+    for (const auto& rule : rules.rules()) {
+        local_types.insert(rule.alert_type());
+    }
+    std::cout << "Sent " << rules.rules_size() << " rule(s) (version " << rules.version()
+              << ") to device " << device_id << std::endl;
+}
+
+void AlertManager::recordDeviceAlert(const monitoring::Alert& alert) {
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    addToHistory(alert);
+    
+    std::cout << "Alert raised on device " << alert.device_id()
+              << " - Rule: " << alert.rule_id()
+              << " - Type: " << alert.alert_type()
+              << " - Severity: " << monitoring::Alert::Severity_Name(alert.severity())
+              << " - Description: " << alert.description() << std::endl;
+}
+
+size_t AlertManager::expireMailbox() {
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    return mailbox_.expire();
+}
+
+std::vector<monitoring::Alert> AlertManager::getAlertHistory(const std::string& device_id) {
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    
+    auto it = alert_history_.find(device_id);
+    if (it == alert_history_.end()) {
+        return {};
+    }
+    return std::vector<monitoring::Alert>(it->second.begin(), it->second.end());
+}
+
+void AlertManager::addToHistory(const monitoring::Alert& alert) {
+    auto& history = alert_history_[alert.device_id()];
+    history.push_back(alert);
+    if (history.size() > kAlertHistorySize) {
+        history.pop_front();
+    }
+}
+
+void AlertManager::replayMailbox(const std::string& device_id, DeviceConnection& connection) {
+    std::vector<monitoring::Alert> pending = mailbox_.take(device_id);
+    if (pending.empty()) {
+        return;
+    }
+    std::cout << "Replaying " << pending.size() << " alert(s) kept for device " << device_id << std::endl;
+    for (auto& alert : pending) {
+        // A new id: ids restart with the server, and acks are matched on them
+        alert.set_alert_id(++next_alert_id_);
+        writeAlert(connection, alert);
+    }
+}
+
 bool AlertManager::isDeviceConnected(const std::string& device_id) {
     std::lock_guard<std::mutex> lock(devices_mutex_);
     return devices_.find(device_id) != devices_.end();
@@ -119,6 +328,66 @@ std::vector<std::string> AlertManager::getConnectedDevices() {
     return connected_devices;
 }
 
+bool AlertManager::writeAlert(DeviceConnection& connection, const monitoring::Alert& alert) {
+    if (connection.session) {
+        monitoring::ServerMessage message;
+        *message.mutable_alert() = alert;
+        if (!connection.session->write(std::move(message), alert.alert_type())) {
+            return false;
+        }
+        if (alert.alert_id() != 0) {
+            connection.unacked_alerts[alert.alert_id()] = {alert, std::chrono::steady_clock::now()};
+            if (connection.unacked_alerts.size() > kAlertHistorySize) {
+                connection.unacked_alerts.erase(connection.unacked_alerts.begin());
+            }
+        }
+        return true;
+    }
+    if (connection.stream) {
+        // Queued, the reactor writes it from the gRPC callback threads
+        return connection.stream->write(alert, alert.alert_type());
+    }
+    return true;
+}
+
+void AlertManager::closeConnection(const std::string& device_id, DeviceConnection& connection) {
+    // Its reactor unregisters itself with a generation that is no longer
+    // current; what it did not deliver is replayed on the new connection
+    if (connection.stream) {
+        connection.stream->close(grpc::Status::OK);
+    }
+    if (connection.session) {
+        connection.session->close(grpc::Status::CANCELLED);
+    }
+    keepUndelivered(device_id, connection);
+}
+
+void AlertManager::keepUndelivered(const std::string& device_id, DeviceConnection& connection) {
+    // A session's alerts stay in unacked_alerts until acked, the queued ones
+    // included; a RegisterDevice stream has no acks, only its queue is known
+    std::vector<monitoring::Alert> undelivered;
+    for (auto& [alert_id, sent] : connection.unacked_alerts) {
+        undelivered.push_back(std::move(sent.alert));
+    }
+    connection.unacked_alerts.clear();
+    if (connection.stream) {
+        for (auto& alert : connection.stream->takeUnsent()) {
+            // The welcome alert and rule updates have no id and are sent again on registering
+            if (alert.alert_id() != 0) {
+                undelivered.push_back(std::move(alert));
+            }
+        }
+    }
+    if (undelivered.empty()) {
+        return;
+    }
+    for (const auto& alert : undelivered) {
+        mailbox_.put(alert);
+    }
+    std::cout << undelivered.size() << " alert(s) not delivered to device " << device_id
+              << ", kept until it registers" << std::endl;
+}
+
 monitoring::Alert::Severity AlertManager::convertSeverity(AlertSeverity severity) {
     switch (severity) {
         case AlertSeverity::INFO:
@@ -1,15 +1,33 @@
 #pragma once
 
 #include <string>
+#include <deque>
 #include <map>
+#include <set>
 #include <vector>
 #include <mutex>
 #include <chrono>
+#include <cstdint>
 #include <monitoring.grpc.pb.h>
+#include "alert_mailbox.h"
+#include "outbound_queue.h"
+
+class AlertStreamReactor;
+class SessionReactor;
 
 class AlertManager {
 public:
+    // Outbound queue of every RegisterDevice stream and Session
+    struct OutboundOptions {
+        size_t queue_size = 64;
+        OverflowPolicy overflow = OverflowPolicy::Coalesce;
+    };
+    
+    // Memory-only mailbox
     AlertManager();
+    AlertManager(const OutboundOptions& outbound, const AlertMailbox::Options& mailbox);
+    
+    const OutboundOptions& outboundOptions() const { return outbound_; }
     
     enum AlertSeverity {
         INFO,
@@ -17,31 +35,106 @@ public:
         CRITICAL
     };
     
+    // Queued on the device's connection, never waits for the network. Kept in
+    // the device's mailbox while it is not connected. Types the device
+    // evaluates itself (sendRules) are not sent, connected or not
     void sendAlert(const std::string& device_id, 
                   AlertSeverity severity,
                   const std::string& alert_type,
                   const std::string& description,
                   const std::string& recommended_action,
-                  const std::string& corrective_command = "");
+                  const std::string& corrective_command = "",
+                  const std::vector<monitoring::ProcessUsage>& processes = {});
+    
+    // Legacy RegisterDevice stream; the stream or session the device had before is closed.
+    // The alerts kept in its mailbox follow the welcome alert. A device that
+    // no longer evaluates rules gets every alert type again.
+    // Returns the connection generation to pass back to unregisterDevice
+    uint64_t registerDevice(const std::string& device_id, AlertStreamReactor* stream, bool evaluates_rules);
+    
+    // Session stream; the session or RegisterDevice stream the device had
+    // before is closed, then the alerts kept in its mailbox are sent
+    uint64_t registerSession(const std::string& device_id, SessionReactor* session, bool evaluates_rules);
+    
+    // Only unregisters the connection of that generation, a device that
+    // reconnected in the meantime stays registered. The alerts it did not
+    // deliver go to the device's mailbox
+    void unregisterDevice(const std::string& device_id, uint64_t generation);
+    
+    // Any message received on the device's session
+    void touch(const std::string& device_id);
+    
+    // Agent acknowledged an alert it received on its session
+    void acknowledgeAlert(const std::string& device_id, uint64_t alert_id);
     
-    // Change to raw pointer
-    void registerDevice(const std::string& device_id, 
-                       grpc::ServerWriter<monitoring::Alert>* stream);
+    // Acknowledge a DeviceMessage (local alert, command result) on the session
+    void sendAck(const std::string& device_id, uint64_t sequence);
     
-    void unregisterDevice(const std::string& device_id);
+    // Logs the outcome and the device's remediation latency (alert to command done)
+    void recordCommandResult(const std::string& device_id, const monitoring::CommandResult& result);
+    
+    // Close sessions without any message for longer than timeout
+    size_t closeIdleSessions(std::chrono::seconds timeout);
+    
+    // Push the rules the agent evaluates locally; alerts of these types are
+    // no longer streamed to it nor kept for it while it is offline, the agent
+    // reports them (ReportAlert or Session)
+    void sendRules(const std::string& device_id, const monitoring::RuleSet& rules);
+    
+    // Alert raised and handled on the device
+    void recordDeviceAlert(const monitoring::Alert& alert);
+    
+    // Drop mailbox alerts past their TTL; returns how many
+    size_t expireMailbox();
+    
+    // Latest alerts of a device (sent by the server or reported by the agent), oldest first
+    std::vector<monitoring::Alert> getAlertHistory(const std::string& device_id);
     
     bool isDeviceConnected(const std::string& device_id);
     
     std::vector<std::string> getConnectedDevices();
 
 private:
+    struct SentAlert {
+        monitoring::Alert alert;
+        std::chrono::steady_clock::time_point sent;
+    };
+    
     struct DeviceConnection {
-        grpc::ServerWriter<monitoring::Alert>* stream; // Raw pointer
-        std::chrono::system_clock::time_point last_update;
+        AlertStreamReactor* stream = nullptr;                    // RegisterDevice, until unregistered
+        SessionReactor* session = nullptr;                       // Session, until unregistered
+        uint64_t generation = 0;
+        std::chrono::system_clock::time_point last_update;       // last message on the session
+        std::map<uint64_t, SentAlert> unacked_alerts;            // Session only, by alert_id
     };
     
     std::map<std::string, DeviceConnection> devices_;
+    std::map<std::string, std::set<std::string>> local_alert_types_;     // evaluated by the agent's rules, across reconnects
+    std::map<std::string, std::deque<monitoring::Alert>> alert_history_;   // guarded by devices_mutex_
+    struct RemediationStats {
+        uint64_t commands = 0;
+        uint64_t failures = 0;
+        uint64_t timeouts = 0;
+        int64_t total_latency_ms = 0;
+        int64_t max_latency_ms = 0;
+    };
+    std::map<std::string, RemediationStats> remediation_stats_;            // guarded by devices_mutex_
+    static constexpr size_t kAlertHistorySize = 100;
+    uint64_t next_generation_ = 0;
+    uint64_t next_alert_id_ = 0;
     std::mutex devices_mutex_;
+    OutboundOptions outbound_;
+    AlertMailbox mailbox_;                                                 // guarded by devices_mutex_
     
     monitoring::Alert::Severity convertSeverity(AlertSeverity severity);
+    void addToHistory(const monitoring::Alert& alert);
+    // Send what the device's mailbox holds on its new connection (lock held)
+    void replayMailbox(const std::string& device_id, DeviceConnection& connection);
+    // Queue on whichever stream the device is connected with (lock held)
+    bool writeAlert(DeviceConnection& connection, const monitoring::Alert& alert);
+    // Finish a connection that is being replaced (lock held)
+    void closeConnection(const std::string& device_id, DeviceConnection& connection);
+    // Put the alerts the connection queued or sent without an ack back in the
+    // device's mailbox, oldest first (lock held)
+    void keepUndelivered(const std::string& device_id, DeviceConnection& connection);
 };
\ No newline at end of file
@@ -0,0 +1,20 @@
+#include "alert_stream_reactor.h"
+#include "alert_manager.h"
+#include <iostream>
+
+AlertStreamReactor::AlertStreamReactor(AlertManager* alert_manager, const std::string& device_id,
+                                       bool evaluates_rules)
+    : OutboundStream(alert_manager->outboundOptions().queue_size, alert_manager->outboundOptions().overflow),
+      alert_manager_(alert_manager), device_id_(device_id) {
+    generation_ = alert_manager_->registerDevice(device_id_, this, evaluates_rules);
+}
+
+void AlertStreamReactor::OnDone() {
+    // The manager stops handing out this pointer before it goes away
+    alert_manager_->unregisterDevice(device_id_, generation_);
+    if (dropped() || coalesced()) {
+        std::cout << "Alert stream of device " << device_id_ << " ended with " << dropped()
+                  << " alert(s) dropped and " << coalesced() << " coalesced" << std::endl;
+    }
+    delete this;
+}
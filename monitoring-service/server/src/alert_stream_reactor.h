@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <grpcpp/grpcpp.h>
+#include <monitoring.grpc.pb.h>
+#include "outbound_stream.h"
+
+class AlertManager;
+
+// One device's RegisterDevice alert stream, on the gRPC callback API.
+//
+// Alerts go through the stream's bounded OutboundQueue and are written one at
+// a time from the reactions, which run on gRPC's small callback thread pool:
+// an idle stream holds no thread and never wakes up. A dropped connection or
+// a cancelled call arrives as OnCancel; the reactor unregisters and deletes
+// itself in OnDone.
+class AlertStreamReactor : public OutboundStream<grpc::ServerWriteReactor<monitoring::Alert>, monitoring::Alert> {
+public:
+    // Registers the stream with alert_manager, which sends the welcome alert
+    AlertStreamReactor(AlertManager* alert_manager, const std::string& device_id, bool evaluates_rules);
+
+    void OnDone() override;
+
+private:
+    AlertManager* alert_manager_;
+    std::string device_id_;
+    uint64_t generation_ = 0;
+};
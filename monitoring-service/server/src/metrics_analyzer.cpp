@@ -4,7 +4,31 @@
 #include <iostream>
 #include <sstream>
 #include <cmath>
+#include <cstdio>
+#include <ctime>
 
+namespace {
+
+// "; top: stress (812) 48.2%, ..." for the alert description, empty without processes
+std::string describeProcesses(const MetricsAnalyzer::ProcessList& processes, bool by_cpu) {
+    std::string text;
+    char entry[96];
+    for (int i = 0; i < processes.size() && i < 3; ++i) {
+        const auto& process = processes.Get(i);
+        if (by_cpu) {
+            std::snprintf(entry, sizeof(entry), "%s (%d) %.1f%%", process.name().c_str(), process.pid(),
+                          process.cpu_percent());
+        } else {
+            std::snprintf(entry, sizeof(entry), "%s (%d) %llu MB", process.name().c_str(), process.pid(),
+                          static_cast<unsigned long long>(process.rss_kb() / 1024));
+        }
+        text += (i == 0 ? "; top: " : ", ");
+        text += entry;
+    }
+    return text;
+}
+
+} // namespace
 
 MetricsAnalyzer::MetricsAnalyzer(AlertManager* alert_manager, const std::string& thresholds_path)
     : alert_manager_(alert_manager) {
@@ -14,9 +38,35 @@ MetricsAnalyzer::MetricsAnalyzer(AlertManager* alert_manager, const std::string&
         {"memory", {{"warning", 80.0}, {"critical", 95.0}}},
         {"disk", {{"warning", 85.0}, {"critical", 95.0}}}
     };
+    // Statistic of the agent's sampling window the thresholds apply to:
+    // "instant" (the point sample), "min", "max", "mean" or "p95".
+    // Samples without a window always use the point value.
+    thresholds_["cpu"]["statistic"] = "p95";
+    thresholds_["memory"]["statistic"] = "p95";
+    
+    // Overrides from the thresholds file, per metric and key
+    std::ifstream file(thresholds_path);
+    if (file && file.peek() != std::ifstream::traits_type::eof()) {
+        try {
+            nlohmann::json overrides = nlohmann::json::parse(file);
+            for (const auto& [metric, values] : overrides.items()) {
+                for (const auto& [key, value] : values.items()) {
+                    thresholds_[metric][key] = value;
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Ignoring invalid thresholds file " << thresholds_path << ": " << e.what() << std::endl;
+        }
+    }
 }
 
-void MetricsAnalyzer::processHardwareMetrics(const std::string& device_id, const nlohmann::json& metrics) {
+void MetricsAnalyzer::processHardwareMetrics(const std::string& device_id, const monitoring::HardwareMetrics& metrics) {
+    // Stored, not analyzed: the agent checked it when it was taken, and its
+    // alerts and commands would be stale by now
+    if (metrics.replayed()) {
+        return;
+    }
+    
     std::lock_guard<std::mutex> lock(devices_mutex_);
     
     // Check if device exists in our map, if not, initialize it
@@ -39,34 +89,37 @@ void MetricsAnalyzer::processHardwareMetrics(const std::string& device_id, const
     
     // Update device state with new hardware metrics
     try {
-        if (metrics.contains("cpu_usage")) {
-            state.cpu_usage = metrics["cpu_usage"].get<std::string>();
-            analyzeCpuUsage(device_id, state.cpu_usage);
+        if (!metrics.cpu_usage().empty()) {
+            state.cpu_usage = metrics.cpu_usage();
+            analyzeCpuUsage(device_id, selectStatistic("cpu", metrics.cpu_usage(),
+                                                       metrics.has_cpu_window() ? &metrics.cpu_window() : nullptr),
+                            metrics.top_cpu());
         }
         
-        if (metrics.contains("memory_usage")) {
-            state.memory_usage = metrics["memory_usage"].get<std::string>();
-            analyzeMemoryUsage(device_id, state.memory_usage);
+        if (!metrics.memory_usage().empty()) {
+            state.memory_usage = metrics.memory_usage();
+            analyzeMemoryUsage(device_id, selectStatistic("memory", metrics.memory_usage(),
+                                                          metrics.has_memory_window() ? &metrics.memory_window() : nullptr),
+                               metrics.top_memory());
         }
         
-        if (metrics.contains("disk_usage")) {
-            state.disk_usage = metrics["disk_usage"].get<std::string>();
+        if (!metrics.disk_usage_root().empty()) {
+            state.disk_usage = metrics.disk_usage_root();
             analyzeDiskUsage(device_id, state.disk_usage);
         }
         
-        if (metrics.contains("usb_state")) {
-            state.usb_state = metrics["usb_state"].get<std::string>();
+        if (metrics.usb_info_case() == monitoring::HardwareMetrics::kUsbDevices) {
+            state.usb_state = metrics.usb_devices();
             analyzeUsbState(device_id, state.usb_state);
         }
         
-        if (metrics.contains("gpio_state")) {
-                state.gpio_state = metrics["gpio_state"].get<int>();  // Expecting an integer for GPIO count or status
-                analyzeGpioState(device_id, state.gpio_state, previous_gpio_state); // Make sure previous_gpio_state is passed correctly
-            }
+        // Always present in the payload (proto3 scalar)
+        state.gpio_state = metrics.gpio_state();  // GPIO count or status
+        analyzeGpioState(device_id, state.gpio_state, previous_gpio_state);
         
         // Update timestamp
-        if (metrics.contains("timestamp")) {
-            state.last_hw_update = metrics["timestamp"].get<std::string>();
+        if (!metrics.readable_date().empty()) {
+            state.last_hw_update = metrics.readable_date();
         } else {
             // Generate timestamp if not provided
             auto now = std::chrono::system_clock::now();
@@ -81,7 +134,30 @@ void MetricsAnalyzer::processHardwareMetrics(const std::string& device_id, const
     }
 }
 
-void MetricsAnalyzer::processSoftwareMetrics(const std::string& device_id, const nlohmann::json& metrics) {
+void MetricsAnalyzer::processDeviceEvent(const std::string& device_id, const monitoring::DeviceEvent& event) {
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    DeviceState& state = device_states_[device_id];
+    
+    switch (event.kind()) {
+        case monitoring::DeviceEvent::USB_ADDED:
+            std::cout << "USB device added on " << device_id << ": " << event.usb_device() << std::endl;
+            analyzeUsbState(device_id, event.usb_device());
+            break;
+        case monitoring::DeviceEvent::USB_REMOVED:
+            std::cout << "USB device removed on " << device_id << ": " << event.usb_device() << std::endl;
+            break;
+        case monitoring::DeviceEvent::GPIO_CHANGED:
+            std::cout << "GPIO " << event.gpio_chip() << " line " << event.gpio_line() << " "
+                      << event.gpio_change() << " on " << device_id << std::endl;
+            analyzeGpioState(device_id, event.gpio_state(), state.gpio_state);
+            state.gpio_state = event.gpio_state();
+            break;
+        default:
+            break;
+    }
+}
+
+void MetricsAnalyzer::processSoftwareMetrics(const std::string& device_id, const monitoring::SoftwareMetrics& metrics) {
     std::lock_guard<std::mutex> lock(devices_mutex_);
     
     // Check if device exists in our map, if not, initialize it
@@ -94,31 +170,23 @@ void MetricsAnalyzer::processSoftwareMetrics(const std::string& device_id, const
     
     // Update device state with new software metrics
     try {
-        if (metrics.contains("ip_address")) {
-            state.ip_address = metrics["ip_address"].get<std::string>();
+        if (!metrics.ip_address().empty()) {
+            state.ip_address = metrics.ip_address();
         }
         
-        if (metrics.contains("network_status")) {
-            state.network_status = metrics["network_status"].get<std::string>();
+        if (!metrics.network_status().empty()) {
+            state.network_status = metrics.network_status();
             analyzeNetworkStatus(device_id, state.network_status);
         }
         
-        if (metrics.contains("services")) {
-            // Clear previous services state
-            state.services.clear();
-            
-            // Update with new services state
-            auto services = metrics["services"];
-            for (auto& [service, status] : services.items()) {
-                state.services[service] = status.get<std::string>();
-            }
-            
+        // Services are only analyzed against a complete inventory
+        if (applyInventory(device_id, state, metrics)) {
             analyzeServices(device_id, state.services);
         }
         
         // Update timestamp
-        if (metrics.contains("timestamp")) {
-            state.last_sw_update = metrics["timestamp"].get<std::string>();
+        if (!metrics.readable_date().empty()) {
+            state.last_sw_update = metrics.readable_date();
         } else {
             // Generate timestamp if not provided
             auto now = std::chrono::system_clock::now();
@@ -157,7 +225,76 @@ std::vector<std::string> MetricsAnalyzer::getAllDeviceIds() {
     return device_ids;
 }
 
-void MetricsAnalyzer::analyzeCpuUsage(const std::string& device_id, const std::string& cpu_usage) {
+bool MetricsAnalyzer::applyInventory(const std::string& device_id, DeviceState& state,
+                                     const monitoring::SoftwareMetrics& metrics) {
+    uint64_t sequence = metrics.inventory_sequence();
+    
+    if (metrics.inventory_kind() == monitoring::SoftwareMetrics::SNAPSHOT) {
+        // Full inventory (always the case for agents without delta encoding, sequence 0)
+        state.services.clear();
+        state.services.insert(metrics.services().begin(), metrics.services().end());
+        state.applications.clear();
+        for (const auto& app : metrics.applications()) {
+            state.applications[app.name()] = app.version();
+        }
+        state.inventory_sequence = sequence;
+        state.inventory_synced = true;
+        return true;
+    }
+    
+    // Late or duplicated delta (e.g. republished after a nack), already covered
+    if (state.inventory_synced && sequence <= state.inventory_sequence) {
+        return false;
+    }
+    
+    // A delta only applies on top of the sample right before it
+    if (!state.inventory_synced || sequence != state.inventory_sequence + 1) {
+        if (state.inventory_synced) {
+            std::cerr << "Inventory sequence gap for device " << device_id << ": expected "
+                      << state.inventory_sequence + 1 << ", got " << sequence << std::endl;
+        }
+        state.inventory_synced = false;
+        requestInventoryResync(device_id, state);
+        return false;
+    }
+    
+    for (const auto& name : metrics.removed_services()) {
+        state.services.erase(name);
+    }
+    for (const auto& [name, status] : metrics.services()) {
+        state.services[name] = status;
+    }
+    for (const auto& name : metrics.removed_applications()) {
+        state.applications.erase(name);
+    }
+    for (const auto& app : metrics.applications()) {
+        state.applications[app.name()] = app.version();
+    }
+    state.inventory_sequence = sequence;
+    return true;
+}
+
+void MetricsAnalyzer::requestInventoryResync(const std::string& device_id, DeviceState& state) {
+    // One request per minute is enough, the agent answers with its next sample
+    auto now = std::chrono::steady_clock::now();
+    if (state.last_resync_request.time_since_epoch().count() != 0 &&
+        now - state.last_resync_request < std::chrono::seconds(60)) {
+        return;
+    }
+    state.last_resync_request = now;
+    
+    std::cout << "Requesting inventory resync from device " << device_id << std::endl;
+    alert_manager_->sendAlert(
+        device_id,
+        AlertManager::AlertSeverity::INFO,
+        "INVENTORY_RESYNC",
+        "Software inventory out of sync",
+        "Send a full inventory snapshot"
+    );
+}
+
+void MetricsAnalyzer::analyzeCpuUsage(const std::string& device_id, const std::string& cpu_usage,
+                                      const ProcessList& processes) {
     float usage = extractPercentage(cpu_usage);
 
     if (std::isnan(usage)) {
@@ -167,15 +304,18 @@ void MetricsAnalyzer::analyzeCpuUsage(const std::string& device_id, const std::s
     float warning_threshold = thresholds_["cpu"]["warning"].get<float>();
     float critical_threshold = thresholds_["cpu"]["critical"].get<float>();
 
+    std::vector<monitoring::ProcessUsage> top(processes.begin(), processes.end());
     if (usage >= critical_threshold) {
-        // Send critical alert with a single simple corrective command
+        // The sample already names the busiest processes; agents that do not
+        // send them still get "top" as the corrective command
         alert_manager_->sendAlert(
             device_id,
             AlertManager::AlertSeverity::CRITICAL,
             "HIGH_CPU_USAGE",
-            "CPU usage is critically high: " + cpu_usage,
+            "CPU usage is critically high: " + cpu_usage + describeProcesses(processes, true),
             "Check for runaway processes or resource leaks",
-            "top -b -n 1 | head -20"
+            top.empty() ? "top -b -n 1" : "",
+            top
         );
     } else if (usage >= warning_threshold) {
         // Send warning alert (no corrective command)
@@ -183,14 +323,16 @@ void MetricsAnalyzer::analyzeCpuUsage(const std::string& device_id, const std::s
             device_id,
             AlertManager::AlertSeverity::WARNING,
             "ELEVATED_CPU_USAGE",
-            "CPU usage is elevated: " + cpu_usage,
-            "Monitor system performance and check active processes"
-            // No corrective command
+            "CPU usage is elevated: " + cpu_usage + describeProcesses(processes, true),
+            "Monitor system performance and check active processes",
+            "",
+            top
         );
     }
 }
 
-void MetricsAnalyzer::analyzeMemoryUsage(const std::string& device_id, const std::string& memory_usage) {
+void MetricsAnalyzer::analyzeMemoryUsage(const std::string& device_id, const std::string& memory_usage,
+                                         const ProcessList& processes) {
     float usage = extractPercentage(memory_usage);
 
     if (std::isnan(usage)) {
@@ -200,15 +342,17 @@ void MetricsAnalyzer::analyzeMemoryUsage(const std::string& device_id, const std
     float warning_threshold = thresholds_["memory"]["warning"].get<float>();
     float critical_threshold = thresholds_["memory"]["critical"].get<float>();
 
+    std::vector<monitoring::ProcessUsage> top(processes.begin(), processes.end());
     if (usage >= critical_threshold) {
         // Send critical alert with a single simple corrective command
         alert_manager_->sendAlert(
             device_id,
             AlertManager::AlertSeverity::CRITICAL,
             "HIGH_MEMORY_USAGE",
-            "Memory usage is critically high: " + memory_usage,
+            "Memory usage is critically high: " + memory_usage + describeProcesses(processes, false),
             "Check for memory leaks or increase available memory",
-            "free -m"
+            "free -m",
+            top
         );
     } else if (usage >= warning_threshold) {
         // Send warning alert (no corrective command)
@@ -216,9 +360,10 @@ void MetricsAnalyzer::analyzeMemoryUsage(const std::string& device_id, const std
             device_id,
             AlertManager::AlertSeverity::WARNING,
             "ELEVATED_MEMORY_USAGE",
-            "Memory usage is elevated: " + memory_usage,
-            "Monitor memory consumption and identify memory-intensive processes"
-            // No corrective command
+            "Memory usage is elevated: " + memory_usage + describeProcesses(processes, false),
+            "Monitor memory consumption and identify memory-intensive processes",
+            "",
+            top
         );
     }
 }
@@ -250,8 +395,8 @@ void MetricsAnalyzer::analyzeDiskUsage(const std::string& device_id, const std::
             AlertManager::AlertSeverity::WARNING,
             "ELEVATED_DISK_USAGE",
             "Disk usage is elevated: " + disk_usage,
-            "Cleanup unnecessary files or plan for storage expansion"
-            // No corrective command
+            "Cleanup unnecessary files or plan for storage expansion",
+            ""                  // No corrective command
         );
     }
 }
@@ -334,6 +479,82 @@ void MetricsAnalyzer::analyzeNetworkStatus(const std::string& device_id, const s
                                     
 
 
+monitoring::RuleSet MetricsAnalyzer::buildDeviceRules() {
+    struct RuleTemplate {
+        const char* metric;
+        const char* level;
+        monitoring::Alert::Severity severity;
+        const char* alert_type;
+        const char* description;
+        const char* recommended_action;
+        const char* corrective_command;
+    };
+    static const RuleTemplate templates[] = {
+        // Rule-evaluating agents attach their top processes to the alert instead of running top
+        {"cpu", "critical", monitoring::Alert::CRITICAL, "HIGH_CPU_USAGE", "CPU usage is critically high",
+         "Check for runaway processes or resource leaks", ""},
+        {"cpu", "warning", monitoring::Alert::WARNING, "ELEVATED_CPU_USAGE", "CPU usage is elevated",
+         "Monitor system performance and check active processes", ""},
+        {"memory", "critical", monitoring::Alert::CRITICAL, "HIGH_MEMORY_USAGE", "Memory usage is critically high",
+         "Check for memory leaks or increase available memory", "free -m"},
+        {"memory", "warning", monitoring::Alert::WARNING, "ELEVATED_MEMORY_USAGE", "Memory usage is elevated",
+         "Monitor memory consumption and identify memory-intensive processes", ""},
+        {"disk", "critical", monitoring::Alert::CRITICAL, "HIGH_DISK_USAGE", "Disk usage is critically high",
+         "Free up disk space immediately or expand storage", "df -h"},
+        {"disk", "warning", monitoring::Alert::WARNING, "ELEVATED_DISK_USAGE", "Disk usage is elevated",
+         "Cleanup unnecessary files or plan for storage expansion", ""},
+    };
+    
+    monitoring::RuleSet rules;
+    // Thresholds only change on restart, the server start time orders the versions
+    static const uint64_t version = static_cast<uint64_t>(std::time(nullptr));
+    rules.set_version(version);
+    for (const auto& entry : templates) {
+        const nlohmann::json& metric = thresholds_[entry.metric];
+        auto* rule = rules.add_rules();
+        rule->set_rule_id(std::string(entry.metric) + "_" + entry.level);
+        rule->set_metric(entry.metric);
+        rule->set_statistic(metric.value("statistic", ""));
+        rule->set_comparison(monitoring::Rule::AT_LEAST);
+        rule->set_threshold(metric[entry.level].get<double>());
+        rule->set_severity(entry.severity);
+        rule->set_alert_type(entry.alert_type);
+        rule->set_description(entry.description);
+        rule->set_recommended_action(entry.recommended_action);
+        rule->set_corrective_command(entry.corrective_command);
+        rule->set_cooldown_seconds(300);
+    }
+    return rules;
+}
+
+std::string MetricsAnalyzer::selectStatistic(const std::string& metric, const std::string& instant,
+                                             const monitoring::WindowStats* window) {
+    std::string statistic = thresholds_[metric].value("statistic", "instant");
+    if (!window || window->samples() == 0 || statistic == "instant") {
+        return instant;
+    }
+    
+    float value;
+    if (statistic == "min") {
+        value = window->min();
+    } else if (statistic == "max") {
+        value = window->max();
+    } else if (statistic == "mean") {
+        value = window->mean();
+    } else if (statistic == "p95") {
+        value = window->p95();
+    } else {
+        std::cerr << "Unknown statistic '" << statistic << "' for " << metric << ", using the point value" << std::endl;
+        return instant;
+    }
+    
+    // Still parsed by extractPercentage, the suffix ends up in the alert description
+    char buf[96];
+    std::snprintf(buf, sizeof(buf), "%.1f%% (%s of %u readings over %u s)", value, statistic.c_str(),
+                  window->samples(), window->window_seconds());
+    return buf;
+}
+
 float MetricsAnalyzer::extractPercentage(const std::string& percentage_str) {
     try {
         // Remove '%' character if present
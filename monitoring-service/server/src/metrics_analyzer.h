@@ -4,7 +4,9 @@
 #include <map>
 #include <vector>
 #include <mutex>
+#include <chrono>
 #include <nlohmann/json.hpp>
+#include "monitoring.pb.h"
 
 // Forward declaration
 class AlertManager;
@@ -24,26 +26,44 @@ public:
         std::string ip_address;
         std::string network_status;
         std::map<std::string, std::string> services;
+        std::map<std::string, std::string> applications;   // name -> version
+        
+        // Inventory delta tracking; services/applications are rebuilt from
+        // the last snapshot plus the deltas that followed it
+        uint64_t inventory_sequence = 0;
+        bool inventory_synced = false;
+        std::chrono::steady_clock::time_point last_resync_request;
         
         // Timestamps
         std::string last_hw_update;
         std::string last_sw_update;
     };
     
+    // Top processes attached to a hardware sample
+    using ProcessList = google::protobuf::RepeatedPtrField<monitoring::ProcessUsage>;
+    
     // Constructor
     MetricsAnalyzer(AlertManager* alert_manager, const std::string& thresholds_path);
     
     // Process hardware metrics from a device
-    void processHardwareMetrics(const std::string& device_id, const nlohmann::json& metrics);
+    void processHardwareMetrics(const std::string& device_id, const monitoring::HardwareMetrics& metrics);
     
     // Process software metrics from a device
-    void processSoftwareMetrics(const std::string& device_id, const nlohmann::json& metrics);
+    void processSoftwareMetrics(const std::string& device_id, const monitoring::SoftwareMetrics& metrics);
+    
+    // USB or GPIO change reported by the agent as it happened; same policies
+    // as the corresponding hardware sample fields
+    void processDeviceEvent(const std::string& device_id, const monitoring::DeviceEvent& event);
     
     // Get the current state of a device
     DeviceState getDeviceState(const std::string& device_id);
     
     // Get all known device IDs
     std::vector<std::string> getAllDeviceIds();
+    
+    // cpu/memory/disk thresholds as rules for agents that evaluate them locally,
+    // same alert types, descriptions and corrective commands as the analyzer
+    monitoring::RuleSet buildDeviceRules();
 
 private:
     AlertManager* alert_manager_;
@@ -53,11 +73,13 @@ private:
     std::map<std::string, DeviceState> device_states_;
     std::mutex devices_mutex_;
     
-    // Analyze CPU usage
-    void analyzeCpuUsage(const std::string& device_id, const std::string& cpu_usage);
+    // Analyze CPU usage; processes are the sample's top CPU users, if any
+    void analyzeCpuUsage(const std::string& device_id, const std::string& cpu_usage,
+                         const ProcessList& processes);
     
-    // Analyze memory usage
-    void analyzeMemoryUsage(const std::string& device_id, const std::string& memory_usage);
+    // Analyze memory usage; processes are the sample's top RSS users, if any
+    void analyzeMemoryUsage(const std::string& device_id, const std::string& memory_usage,
+                            const ProcessList& processes);
     
     // Analyze disk usage
     void analyzeDiskUsage(const std::string& device_id, const std::string& disk_usage);
@@ -71,9 +93,22 @@ private:
     // Analyze network status
     void analyzeNetworkStatus(const std::string& device_id, const std::string& status);  // <- this line
     
+    // Apply a software sample's inventory snapshot or delta to the device state.
+    // Returns false when the inventory could not be applied (sequence gap).
+    bool applyInventory(const std::string& device_id, DeviceState& state,
+                        const monitoring::SoftwareMetrics& metrics);
+    
+    // Ask the agent for a full inventory snapshot (throttled per device)
+    void requestInventoryResync(const std::string& device_id, DeviceState& state);
+    
     // Analyze services
     void analyzeServices(const std::string& device_id, const std::map<std::string, std::string>& services);
     
+    // Value the cpu/memory thresholds apply to: the configured statistic of
+    // the sample's window, or the point value when there is no window
+    std::string selectStatistic(const std::string& metric, const std::string& instant,
+                                const monitoring::WindowStats* window);
+    
     // Helper to extract percentage value from string
     float extractPercentage(const std::string& percentage_str);
 };
\ No newline at end of file
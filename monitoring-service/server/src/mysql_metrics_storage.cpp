@@ -1,7 +1,31 @@
 #include "mysql_metrics_storage.h"
 #include <mysql/mysql.h>
+#include <mysql/errmsg.h>
+#include <algorithm>
+#include <cstdio>
+#include <map>
 #include <iostream>
 
+namespace {
+
+// "pid:name:cpu%:rss_kb" entries separated by ';', empty when the sample has none
+std::string formatProcesses(const google::protobuf::RepeatedPtrField<monitoring::ProcessUsage>& processes) {
+    std::string text;
+    char entry[64];
+    for (const auto& process : processes) {
+        // comm is chosen by the process, keep it out of the SQL quoting
+        std::string name = process.name();
+        std::replace_if(name.begin(), name.end(), [](char c) { return c == '\'' || c == '\\' || c == ';'; }, '_');
+        std::snprintf(entry, sizeof(entry), "%d:%s:%.1f:%llu", process.pid(), name.c_str(), process.cpu_percent(),
+                      static_cast<unsigned long long>(process.rss_kb()));
+        if (!text.empty()) text += ";";
+        text += entry;
+    }
+    return text;
+}
+
+} // namespace
+
 MySQLMetricsStorage::MySQLMetricsStorage() {
     conn_ = mysql_init(nullptr);
     
@@ -22,8 +46,7 @@ MySQLMetricsStorage::~MySQLMetricsStorage() {
 }
 
 bool MySQLMetricsStorage::reconnect() {
-    std::lock_guard<std::mutex> lock(mysql_mutex_);
-    
+    // Only called from executeQuery(), which already holds mysql_mutex_
     if (conn_) {
         mysql_close(static_cast<MYSQL*>(conn_));
     }
@@ -74,6 +97,12 @@ bool MySQLMetricsStorage::initDatabase() {
         "kernel_version VARCHAR(64),"
         "hardware_model VARCHAR(128),"
         "firmware_version VARCHAR(128),"
+        "top_cpu TEXT,"
+        "top_memory TEXT,"
+        "agent_cpu_percent FLOAT,"
+        "agent_io_bytes_per_second FLOAT,"
+        "agent_stretch INT,"
+        "replayed BOOLEAN DEFAULT FALSE,"
         "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP"
         ")";
 
@@ -82,6 +111,23 @@ bool MySQLMetricsStorage::initDatabase() {
         return false;
     }
 
+    // Tables created before the process lists, agent usage and replay flag lack these columns
+    const char* hw_migrations[] = {
+        "ALTER TABLE hardware_info ADD COLUMN top_cpu TEXT",
+        "ALTER TABLE hardware_info ADD COLUMN top_memory TEXT",
+        "ALTER TABLE hardware_info ADD COLUMN agent_cpu_percent FLOAT",
+        "ALTER TABLE hardware_info ADD COLUMN agent_io_bytes_per_second FLOAT",
+        "ALTER TABLE hardware_info ADD COLUMN agent_stretch INT",
+        "ALTER TABLE hardware_info ADD COLUMN replayed BOOLEAN DEFAULT FALSE",
+    };
+    for (const char* migration : hw_migrations) {
+        // 1060 = ER_DUP_FIELDNAME, the column already exists
+        if (mysql_query(static_cast<MYSQL*>(conn_), migration) && mysql_errno(static_cast<MYSQL*>(conn_)) != 1060) {
+            std::cerr << "Failed to migrate hardware_info table: " << mysql_error(static_cast<MYSQL*>(conn_)) << std::endl;
+            return false;
+        }
+    }
+
     const char* create_sw_table =
         "CREATE TABLE IF NOT EXISTS software_info ("
         "id INT AUTO_INCREMENT PRIMARY KEY,"
@@ -93,6 +139,9 @@ bool MySQLMetricsStorage::initDatabase() {
         "os_version VARCHAR(128),"
         "applications TEXT,"
         "services TEXT,"
+        "inventory_kind VARCHAR(8) DEFAULT 'snapshot',"
+        "inventory_sequence BIGINT UNSIGNED DEFAULT 0,"
+        "removed_entries TEXT,"
         "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP"
         ")";
 
@@ -100,6 +149,20 @@ bool MySQLMetricsStorage::initDatabase() {
         std::cerr << "Failed to create software_info table: " << mysql_error(static_cast<MYSQL*>(conn_)) << std::endl;
         return false;
     }
+
+    // Tables created before inventory delta encoding lack these columns
+    const char* sw_migrations[] = {
+        "ALTER TABLE software_info ADD COLUMN inventory_kind VARCHAR(8) DEFAULT 'snapshot'",
+        "ALTER TABLE software_info ADD COLUMN inventory_sequence BIGINT UNSIGNED DEFAULT 0",
+        "ALTER TABLE software_info ADD COLUMN removed_entries TEXT",
+    };
+    for (const char* migration : sw_migrations) {
+        // 1060 = ER_DUP_FIELDNAME, the column already exists
+        if (mysql_query(static_cast<MYSQL*>(conn_), migration) && mysql_errno(static_cast<MYSQL*>(conn_)) != 1060) {
+            std::cerr << "Failed to migrate software_info table: " << mysql_error(static_cast<MYSQL*>(conn_)) << std::endl;
+            return false;
+        }
+    }
     return true;
 }
 
@@ -129,64 +192,86 @@ bool MySQLMetricsStorage::executeQuery(const std::string& query) {
     return true;
 }
 
-bool MySQLMetricsStorage::insertHardwareInfo(const nlohmann::json& m) {
+bool MySQLMetricsStorage::insertHardwareInfo(const monitoring::HardwareMetrics& m) {
     if (!conn_) {
         std::cerr << "No MySQL connection available" << std::endl;
         return false;
     }
 
-    // Log the full JSON for debugging
-    std::cout << "Inserting hardware metrics: " << m.dump(2) << std::endl;
+    // Log the full sample for debugging
+    std::cout << "Inserting hardware metrics: " << m.ShortDebugString() << std::endl;
     
     std::string query =
-        "INSERT INTO hardware_info (device_id, readable_date, cpu_usage, memory_usage, disk_usage, usb_state, gpio_state, kernel_version, hardware_model, firmware_version) VALUES ('" +
-        m.value("device_id", "unknown") + "','" +  // Add default "unknown"
-        m.value("readable_date", "") + "','" +
-        m.value("cpu_usage", "") + "','" +
-        m.value("memory_usage", "") + "','" +
-        m.value("disk_usage", "") + "','" +
-        m.value("usb_state", "") + "'," +
-        std::to_string(m.value("gpio_state", 0)) + ",'" +
-        m.value("kernel_version", "") + "','" +
-        m.value("hardware_model", "") + "','" +
-        m.value("firmware_version", "") + "')";
+        "INSERT INTO hardware_info (device_id, readable_date, cpu_usage, memory_usage, disk_usage, usb_state, gpio_state, kernel_version, hardware_model, firmware_version, top_cpu, top_memory, agent_cpu_percent, agent_io_bytes_per_second, agent_stretch, replayed) VALUES ('" +
+        (m.device_id().empty() ? std::string("unknown") : m.device_id()) + "','" +  // Add default "unknown"
+        m.readable_date() + "','" +
+        m.cpu_usage() + "','" +
+        m.memory_usage() + "','" +
+        m.disk_usage_root() + "'," +
+        // NULL on replayed samples, which do not know the device's state at the time
+        (m.replayed() ? std::string("NULL,") + std::to_string(m.gpio_state()) + ",NULL,NULL,NULL,'"
+                      : "'" + m.usb_devices() + "'," +
+                        std::to_string(m.gpio_state()) + ",'" +
+                        m.kernel_version() + "','" +
+                        m.hardware_model() + "','" +
+                        m.firmware_version() + "','") +
+        formatProcesses(m.top_cpu()) + "','" +
+        formatProcesses(m.top_memory()) + "'," +
+        // NULL for agents that do not measure themselves
+        (m.has_agent() ? std::to_string(m.agent().cpu_percent()) + "," +
+                         std::to_string(m.agent().io_bytes_per_second()) + "," +
+                         std::to_string(m.agent().stretch())
+                       : std::string("NULL,NULL,NULL")) + "," +
+        (m.replayed() ? "TRUE" : "FALSE") + ")";
     std::cout << "Executing hardware query: " << query << std::endl;
     return executeQuery(query);
 }
 
-bool MySQLMetricsStorage::insertSoftwareInfo(const nlohmann::json& m) {
+bool MySQLMetricsStorage::insertSoftwareInfo(const monitoring::SoftwareMetrics& m) {
     if (!conn_) {
         std::cerr << "No MySQL connection available" << std::endl;
         return false;
     }
 
-    // Log the full JSON for debugging
-    std::cout << "Inserting software metrics: " << m.dump(2) << std::endl;
+    // Log the full sample for debugging
+    std::cout << "Inserting software metrics: " << m.ShortDebugString() << std::endl;
     
     std::string apps;
-    if (m.contains("applications")) {
-        for (const auto& app : m["applications"]) {
-            if (!apps.empty()) apps += ";";
-            apps += app.value("name", "") + ":" + app.value("version", "");
-        }
+    for (const auto& app : m.applications()) {
+        if (!apps.empty()) apps += ";";
+        apps += app.name() + ":" + app.version();
     }
+    // Sorted by name, as the JSON objects used to be
+    std::map<std::string, std::string> sorted_services(m.services().begin(), m.services().end());
     std::string services;
-    if (m.contains("services")) {
-        for (auto& [k, v] : m["services"].items()) {
-            if (!services.empty()) services += ";";
-            services += k + ":" + v.get<std::string>();
-        }
+    for (const auto& [k, v] : sorted_services) {
+        if (!services.empty()) services += ";";
+        services += k + ":" + v;
+    }
+    // Delta rows only hold what changed since the previous row of the device
+    bool delta = m.inventory_kind() == monitoring::SoftwareMetrics::DELTA;
+    std::string removed;
+    for (const auto& name : m.removed_services()) {
+        if (!removed.empty()) removed += ";";
+        removed += "service:" + name;
+    }
+    for (const auto& name : m.removed_applications()) {
+        if (!removed.empty()) removed += ";";
+        removed += "application:" + name;
     }
     std::string query =
-        "INSERT INTO software_info (device_id, readable_date, ip_address, uptime, network_status, os_version, applications, services) VALUES ('" +
-        m.value("device_id", "unknown") + "','" +  // Add default "unknown"
-        m.value("readable_date", "") + "','" +
-        m.value("ip_address", "") + "','" +
-        m.value("uptime", "") + "','" +
-        m.value("network_status", "") + "','" +
-        m.value("os_version", "") + "','" +
+        "INSERT INTO software_info (device_id, readable_date, ip_address, uptime, network_status, os_version, applications, services, inventory_kind, inventory_sequence, removed_entries) VALUES ('" +
+        (m.device_id().empty() ? std::string("unknown") : m.device_id()) + "','" +  // Add default "unknown"
+        m.readable_date() + "','" +
+        m.ip_address() + "','" +
+        m.uptime() + "','" +
+        m.network_status() + "','" +
+        m.os_version() + "','" +
         apps + "','" +
-        services + "')";
+        services + "','" +
+        (delta ? "delta" : "snapshot") + "'," +
+        std::to_string(m.inventory_sequence()) + ",'" +
+        removed + "')";
     std::cout << "Executing software query: " << query << std::endl;
     return executeQuery(query);
 }
@@ -1,16 +1,22 @@
 #pragma once
-#include <nlohmann/json.hpp>
 #include <string>
 #include <mutex>
+#include "monitoring.pb.h"
 
 class MySQLMetricsStorage {
 public:
     MySQLMetricsStorage();
     ~MySQLMetricsStorage();
 
-    bool insertHardwareInfo(const nlohmann::json& metrics);
-    bool insertSoftwareInfo(const nlohmann::json& metrics);
+    bool insertHardwareInfo(const monitoring::HardwareMetrics& metrics);
+    bool insertSoftwareInfo(const monitoring::SoftwareMetrics& metrics);
 
 private:
     void* conn_; // Use MYSQL* if you include <mysql/mysql.h>
+    std::mutex mysql_mutex_;
+
+    // Caller holds mysql_mutex_
+    bool reconnect();
+    bool initDatabase();
+    bool executeQuery(const std::string& query);
 };
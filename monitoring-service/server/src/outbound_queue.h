@@ -0,0 +1,186 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// What a full outbound queue gives up to take a new message
+enum class OverflowPolicy {
+    DropOldest,     // the oldest queued message
+    Coalesce        // an older message of the same alert_type first, then the oldest
+};
+
+// Bounded lock-free queue of the messages waiting to be written to one device
+// (Vyukov's bounded MPMC ring). push never blocks and never fails: a full
+// queue makes room according to its OverflowPolicy.
+//
+// With Coalesce, a message pushed with a coalesce key (the alert_type)
+// supersedes the queued ones with the same key: pop skips them, and a full
+// queue discards them first and moves the latest of each key to the back
+// rather than dropping it. Messages without a key are never coalesced.
+template <typename T>
+class OutboundQueue {
+public:
+    OutboundQueue(size_t capacity, OverflowPolicy policy)
+        : cells_(roundUp(capacity)), mask_(cells_.size() - 1), policy_(policy) {
+        for (size_t i = 0; i < cells_.size(); ++i) {
+            cells_[i].turn.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    void push(T message, const std::string& coalesce_key = "") {
+        Entry entry;
+        entry.message = std::make_unique<T>(std::move(message));
+        entry.sequence = next_sequence_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (policy_ == OverflowPolicy::Coalesce && !coalesce_key.empty()) {
+            entry.key = markLatest(coalesce_key, entry.sequence);
+        }
+
+        size_t requeued = 0;
+        while (!tryPush(entry)) {
+            Entry oldest;
+            if (!tryPop(oldest)) {
+                continue;                       // drained in the meantime
+            }
+            if (isSuperseded(oldest)) {
+                coalesced_.fetch_add(1, std::memory_order_relaxed);
+            } else if (oldest.key != 0 && ++requeued < cells_.size() && tryPush(oldest)) {
+                // Latest of its alert_type: kept, behind the others
+            } else {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Oldest message not superseded by a newer one; nullptr when empty
+    std::unique_ptr<T> pop() {
+        Entry entry;
+        while (tryPop(entry)) {
+            if (!isSuperseded(entry)) {
+                return std::move(entry.message);
+            }
+            coalesced_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return nullptr;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return cells_.size(); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    uint64_t coalesced() const { return coalesced_.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        std::unique_ptr<T> message;     // 8 bytes a cell, the message is only allocated when queued
+        uint64_t key = 0;               // 0: not coalesced
+        uint64_t sequence = 0;
+    };
+
+    struct Cell {
+        std::atomic<size_t> turn{0};
+        Entry entry;
+    };
+
+    // Latest sequence pushed per coalesce key. Keys are never removed; past
+    // kKeySlots distinct alert types the new ones are not coalesced
+    struct KeySlot {
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint64_t> latest{0};
+    };
+    static constexpr size_t kKeySlots = 32;
+
+    std::vector<Cell> cells_;
+    const size_t mask_;
+    const OverflowPolicy policy_;
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::atomic<size_t> head_{0};
+    std::atomic<uint64_t> next_sequence_{0};
+    std::array<KeySlot, kKeySlots> keys_;
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> coalesced_{0};
+
+    static size_t roundUp(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        return size;
+    }
+
+    bool tryPush(Entry& entry) {
+        size_t position = tail_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[position & mask_];
+            size_t turn = cell->turn.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(turn) - static_cast<std::ptrdiff_t>(position);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;                   // full
+            } else {
+                position = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->entry = std::move(entry);
+        cell->turn.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(Entry& entry) {
+        size_t position = head_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[position & mask_];
+            size_t turn = cell->turn.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(turn) - static_cast<std::ptrdiff_t>(position + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;                   // empty
+            } else {
+                position = head_.load(std::memory_order_relaxed);
+            }
+        }
+        entry = std::move(cell->entry);
+        cell->turn.store(position + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    KeySlot* findSlot(uint64_t key, bool insert) {
+        for (size_t i = 0; i < kKeySlots; ++i) {
+            KeySlot& slot = keys_[(key + i) % kKeySlots];
+            uint64_t current = slot.key.load(std::memory_order_acquire);
+            if (current == 0 && insert) {
+                slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel);
+                if (current == 0) return &slot;
+            }
+            if (current == key) return &slot;
+            if (current == 0) return nullptr;
+        }
+        return nullptr;
+    }
+
+    // Returns the entry's key, 0 if the table is full
+    uint64_t markLatest(const std::string& coalesce_key, uint64_t sequence) {
+        uint64_t key = std::hash<std::string>{}(coalesce_key) | 1;
+        KeySlot* slot = findSlot(key, true);
+        if (!slot) return 0;
+        uint64_t latest = slot->latest.load(std::memory_order_relaxed);
+        while (latest < sequence &&
+               !slot->latest.compare_exchange_weak(latest, sequence, std::memory_order_acq_rel)) {}
+        return key;
+    }
+
+    bool isSuperseded(const Entry& entry) {
+        if (entry.key == 0) return false;
+        KeySlot* slot = findSlot(entry.key, false);
+        return slot && slot->latest.load(std::memory_order_acquire) > entry.sequence;
+    }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+#include "outbound_queue.h"
+
+// Write side of a callback-API reactor (ServerWriteReactor or
+// ServerBidiReactor) fed from an OutboundQueue.
+//
+// write() is O(1) and never waits for the network: the message is queued and
+// whichever thread finds the writer idle starts the next StartWrite, the
+// following ones run from OnWriteDone. Ownership of the writer is a single
+// atomic flag, taken by exchange; Finish is called by its owner, once no
+// write is in flight, and the writer is never released afterwards.
+template <typename Reactor, typename Message>
+class OutboundStream : public Reactor {
+public:
+    OutboundStream(size_t queue_size, OverflowPolicy overflow) : queue_(queue_size, overflow) {}
+
+    // Queue a message; false once the stream is finishing
+    bool write(Message message, const std::string& coalesce_key = "") {
+        if (closing_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        queue_.push(std::move(message), coalesce_key);
+        drain();
+        return true;
+    }
+
+    // Finish the stream with status, dropping what is not written yet.
+    // Returns false if it was already finishing
+    bool close(const grpc::Status& status) {
+        bool expected = false;
+        if (!closing_.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+            return false;
+        }
+        status_ = status;
+        finishing_.store(true, std::memory_order_release);
+        drain();
+        return true;
+    }
+
+    void OnWriteDone(bool ok) override {
+        in_flight_.reset();
+        if (!ok) {
+            close(grpc::Status(grpc::StatusCode::UNAVAILABLE, "stream broken"));
+        }
+        if (startNext()) {
+            return;
+        }
+        writing_.store(false, std::memory_order_release);
+        drain();
+    }
+
+    void OnCancel() override {
+        close(grpc::Status::CANCELLED);
+    }
+
+    // What was queued and will not be written, oldest first; once closed
+    std::vector<Message> takeUnsent() {
+        std::vector<Message> unsent;
+        if (!finishing_.load(std::memory_order_acquire)) {
+            return unsent;
+        }
+        while (auto message = queue_.pop()) {
+            unsent.push_back(std::move(*message));
+        }
+        return unsent;
+    }
+
+protected:
+    uint64_t dropped() const { return queue_.dropped(); }
+    uint64_t coalesced() const { return queue_.coalesced(); }
+
+private:
+    OutboundQueue<Message> queue_;
+    std::unique_ptr<Message> in_flight_;            // owned by the writer
+    std::atomic<bool> writing_{false};              // a write (or Finish) is started
+    std::atomic<bool> closing_{false};              // status_ is being set
+    std::atomic<bool> finishing_{false};            // status_ is set
+    grpc::Status status_;
+
+    // Take the writer if idle and start what is pending; loops because work
+    // can arrive between the owner finding nothing and releasing the writer
+    void drain() {
+        while (!writing_.exchange(true, std::memory_order_acq_rel)) {
+            if (startNext()) {
+                return;
+            }
+            writing_.store(false, std::memory_order_release);
+            if (!finishing_.load(std::memory_order_acquire) && queue_.empty()) {
+                return;
+            }
+        }
+    }
+
+    // Writer owner only. Nothing may touch this object after Finish: OnDone
+    // can delete it right away
+    bool startNext() {
+        if (finishing_.load(std::memory_order_acquire)) {
+            Reactor::Finish(status_);
+            return true;
+        }
+        in_flight_ = queue_.pop();
+        if (!in_flight_) {
+            return false;
+        }
+        Reactor::StartWrite(in_flight_.get());
+        return true;
+    }
+};
@@ -0,0 +1,105 @@
+#include "payload_decompressor.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Metric messages are a few kB at most, refuse anything claiming to be huge
+constexpr unsigned long long kMaxDecompressedSize = 16 * 1024 * 1024;
+
+} // namespace
+
+PayloadDecompressor::PayloadDecompressor() {
+}
+
+PayloadDecompressor::~PayloadDecompressor() {
+#ifdef HAVE_ZSTD
+    for (auto& [id, ddict] : dictionaries_) {
+        ZSTD_freeDDict(static_cast<ZSTD_DDict*>(ddict));
+    }
+#endif
+}
+
+size_t PayloadDecompressor::loadDirectory(const std::string& directory) {
+#ifdef HAVE_ZSTD
+    size_t loaded = 0;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        if (entry.path().extension() != ".zdict") continue;
+
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::string dictionary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        unsigned dict_id = ZSTD_getDictID_fromDict(dictionary.data(), dictionary.size());
+        if (dict_id == 0) {
+            std::cerr << "Skipping compression dictionary without id: " << entry.path() << std::endl;
+            continue;
+        }
+        if (dictionaries_.count(dict_id)) {
+            std::cerr << "Duplicate compression dictionary id " << dict_id << ": " << entry.path() << std::endl;
+            continue;
+        }
+
+        ZSTD_DDict* ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+        if (!ddict) {
+            std::cerr << "Failed to load compression dictionary " << entry.path() << std::endl;
+            continue;
+        }
+        dictionaries_[dict_id] = ddict;
+        loaded++;
+        std::cout << "Loaded compression dictionary " << dict_id << " from " << entry.path() << std::endl;
+    }
+    if (ec) {
+        std::cerr << "Cannot read compression dictionaries from " << directory << ": " << ec.message() << std::endl;
+    }
+    return loaded;
+#else
+    std::cerr << "Built without zstd, compressed payloads will be rejected" << std::endl;
+    (void)directory;
+    return 0;
+#endif
+}
+
+std::string PayloadDecompressor::decompress(const std::string& algorithm, uint32_t dict_id,
+                                            const void* data, size_t size) const {
+#ifdef HAVE_ZSTD
+    if (algorithm != "zstd") {
+        throw std::runtime_error("Unsupported payload compression " + algorithm);
+    }
+    auto it = dictionaries_.find(dict_id);
+    if (it == dictionaries_.end()) {
+        throw std::runtime_error("Unknown compression dictionary " + std::to_string(dict_id));
+    }
+
+    unsigned long long content_size = ZSTD_getFrameContentSize(data, size);
+    if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN ||
+        content_size > kMaxDecompressedSize) {
+        throw std::runtime_error("Invalid compressed payload");
+    }
+
+    // One context per consumer thread, the dictionaries are shared read-only
+    thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+
+    std::string out(content_size, '\0');
+    size_t result = ZSTD_decompress_usingDDict(dctx.get(), &out[0], out.size(), data, size,
+                                               static_cast<const ZSTD_DDict*>(it->second));
+    if (ZSTD_isError(result) || result != content_size) {
+        throw std::runtime_error(std::string("Failed to decompress payload: ") +
+                                 (ZSTD_isError(result) ? ZSTD_getErrorName(result) : "size mismatch"));
+    }
+    return out;
+#else
+    (void)dict_id;
+    (void)data;
+    (void)size;
+    throw std::runtime_error("Built without zstd, cannot decompress " + algorithm + " payload");
+#endif
+}
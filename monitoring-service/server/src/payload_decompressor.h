@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Decompression of the zstd payloads published by agents with --compress.
+//
+// Every dictionary found in the dictionaries directory is loaded once and
+// indexed by its zstd dictionary id, which the agent sends in the x-dict-id
+// header; older dictionaries stay loaded so agents can be upgraded gradually.
+// Safe to use from several consumer threads once loaded.
+class PayloadDecompressor {
+public:
+    PayloadDecompressor();
+    ~PayloadDecompressor();
+
+    PayloadDecompressor(const PayloadDecompressor&) = delete;
+    PayloadDecompressor& operator=(const PayloadDecompressor&) = delete;
+
+    // Load every *.zdict file of the directory, returns the number loaded
+    size_t loadDirectory(const std::string& directory);
+
+    // Throws std::runtime_error on an unknown algorithm or dictionary, or corrupt data
+    std::string decompress(const std::string& algorithm, uint32_t dict_id,
+                           const void* data, size_t size) const;
+
+private:
+    std::map<uint32_t, void*> dictionaries_;    // dictionary id -> ZSTD_DDict*
+};
@@ -3,13 +3,12 @@
 #include <iostream>
 #include <amqp_framing.h>
 
-static MySQLMetricsStorage mysql_storage;
-
 RabbitMQConsumer::RabbitMQConsumer(const std::string& hostname, int port,
                                  const std::string& username, const std::string& password,
-                                 const std::string& hw_queue_name, const std::string& sw_queue_name)
+                                 const std::string& hw_queue_name, const std::string& sw_queue_name,
+                                 MySQLMetricsStorage* storage)
     : hostname_(hostname), port_(port), username_(username), password_(password),
-      hw_queue_name_(hw_queue_name), sw_queue_name_(sw_queue_name),
+      hw_queue_name_(hw_queue_name), sw_queue_name_(sw_queue_name), storage_(storage),
       hw_conn_(nullptr), sw_conn_(nullptr), hw_channel_(1), sw_channel_(1),
       running_(false) {
 }
@@ -95,19 +94,17 @@ void RabbitMQConsumer::consumeHardwareMetrics() {
         res = amqp_consume_message(hw_conn_, &envelope, &timeout, 0);
 
         if (res.reply_type == AMQP_RESPONSE_NORMAL) {
-            // Extract message
-            std::string message(static_cast<char*>(envelope.message.body.bytes), envelope.message.body.len);
+            std::string content_type = contentTypeOf(envelope);
 
             try {
-                // Parse JSON
-                nlohmann::json json = nlohmann::json::parse(message);
-
-                // Extract device ID
-                std::string device_id = json["device_id"];
-
-                // Call callback
-                hw_callback_(device_id, json);
-                mysql_storage.insertHardwareInfo(json);
+                // A message is either one sample or a batch envelope of samples
+                std::string decompressed;
+                amqp_bytes_t body = payloadOf(envelope, decompressed);
+                for (const auto& metrics : decodeHardwareMetrics(body, content_type)) {
+                    // Call callback
+                    hw_callback_(metrics.device_id(), metrics);
+                    storage_->insertHardwareInfo(metrics);
+                }
             } catch (const std::exception& e) {
                 std::cerr << "Error processing hardware metrics: " << e.what() << std::endl;
             }
@@ -159,19 +156,17 @@ void RabbitMQConsumer::consumeSoftwareMetrics() {
         res = amqp_consume_message(sw_conn_, &envelope, &timeout, 0);
 
         if (res.reply_type == AMQP_RESPONSE_NORMAL) {
-            // Extract message
-            std::string message(static_cast<char*>(envelope.message.body.bytes), envelope.message.body.len);
+            std::string content_type = contentTypeOf(envelope);
 
             try {
-                // Parse JSON
-                nlohmann::json json = nlohmann::json::parse(message);
-
-                // Extract device ID
-                std::string device_id = json["device_id"];
-
-                // Call callback
-                sw_callback_(device_id, json);
-                mysql_storage.insertSoftwareInfo(json);
+                // A message is either one sample or a batch envelope of samples
+                std::string decompressed;
+                amqp_bytes_t body = payloadOf(envelope, decompressed);
+                for (const auto& metrics : decodeSoftwareMetrics(body, content_type)) {
+                    // Call callback
+                    sw_callback_(metrics.device_id(), metrics);
+                    storage_->insertSoftwareInfo(metrics);
+                }
             } catch (const std::exception& e) {
                 std::cerr << "Error processing software metrics: " << e.what() << std::endl;
             }
@@ -194,6 +189,283 @@ void RabbitMQConsumer::consumeSoftwareMetrics() {
     std::cout << "Software metrics consumer stopped" << std::endl;
 }
 
+std::string RabbitMQConsumer::contentTypeOf(const amqp_envelope_t& envelope) {
+    const amqp_basic_properties_t& props = envelope.message.properties;
+    if (!(props._flags & AMQP_BASIC_CONTENT_TYPE_FLAG)) {
+        return "application/json";
+    }
+    return std::string(static_cast<char*>(props.content_type.bytes), props.content_type.len);
+}
+
+size_t RabbitMQConsumer::loadCompressionDictionaries(const std::string& directory) {
+    return decompressor_.loadDirectory(directory);
+}
+
+amqp_bytes_t RabbitMQConsumer::payloadOf(const amqp_envelope_t& envelope, std::string& storage) const {
+    const amqp_basic_properties_t& props = envelope.message.properties;
+    if (!(props._flags & AMQP_BASIC_HEADERS_FLAG)) {
+        return envelope.message.body;
+    }
+
+    // x-compression / x-dict-id, as set by RabbitMQSender
+    std::string algorithm;
+    int64_t dict_id = -1;
+    for (int i = 0; i < props.headers.num_entries; ++i) {
+        const amqp_table_entry_t& entry = props.headers.entries[i];
+        std::string key(static_cast<char*>(entry.key.bytes), entry.key.len);
+        const amqp_field_value_t& value = entry.value;
+        if (key == "x-compression" &&
+            (value.kind == AMQP_FIELD_KIND_UTF8 || value.kind == AMQP_FIELD_KIND_BYTES)) {
+            algorithm.assign(static_cast<char*>(value.value.bytes.bytes), value.value.bytes.len);
+        } else if (key == "x-dict-id") {
+            switch (value.kind) {
+                case AMQP_FIELD_KIND_I8: dict_id = value.value.i8; break;
+                case AMQP_FIELD_KIND_U8: dict_id = value.value.u8; break;
+                case AMQP_FIELD_KIND_I16: dict_id = value.value.i16; break;
+                case AMQP_FIELD_KIND_U16: dict_id = value.value.u16; break;
+                case AMQP_FIELD_KIND_I32: dict_id = value.value.i32; break;
+                case AMQP_FIELD_KIND_U32: dict_id = value.value.u32; break;
+                case AMQP_FIELD_KIND_I64: dict_id = value.value.i64; break;
+                default: break;
+            }
+        }
+    }
+
+    if (algorithm.empty()) {
+        return envelope.message.body;
+    }
+    if (dict_id < 0 || dict_id > UINT32_MAX) {
+        throw std::runtime_error("Compressed payload without a valid x-dict-id header");
+    }
+
+    storage = decompressor_.decompress(algorithm, static_cast<uint32_t>(dict_id),
+                                       envelope.message.body.bytes, envelope.message.body.len);
+    amqp_bytes_t body;
+    body.len = storage.size();
+    body.bytes = &storage[0];
+    return body;
+}
+
+std::vector<monitoring::HardwareMetrics> RabbitMQConsumer::decodeHardwareMetrics(const amqp_bytes_t& body,
+                                                                                const std::string& content_type) {
+    std::vector<monitoring::HardwareMetrics> samples;
+    const void* data = body.bytes;
+    int size = static_cast<int>(body.len);
+
+    if (content_type.rfind(kProtobufBatchContentType, 0) == 0) {
+        monitoring::MetricsBatch batch;
+        if (!batch.ParseFromArray(data, size)) {
+            throw std::runtime_error("Malformed protobuf batch envelope");
+        }
+        if (batch.envelope_version() < 1 || batch.envelope_version() > kMaxBatchEnvelopeVersion) {
+            throw std::runtime_error("Unsupported batch envelope version " +
+                                     std::to_string(batch.envelope_version()));
+        }
+        samples.reserve(batch.hardware_size());
+        for (auto& sample : *batch.mutable_hardware()) {
+            samples.push_back(std::move(sample));
+        }
+    } else if (content_type.rfind(kProtobufContentType, 0) == 0) {
+        samples.emplace_back();
+        if (!samples.back().ParseFromArray(data, size)) {
+            throw std::runtime_error("Malformed protobuf hardware metrics");
+        }
+    } else {
+        for (const auto& json : unpackJsonMessage(body, content_type)) {
+            samples.push_back(hardwareFromJson(json));
+        }
+    }
+
+    for (const auto& sample : samples) {
+        if (sample.device_id().empty()) {
+            throw std::runtime_error("Hardware metrics without device_id");
+        }
+    }
+    return samples;
+}
+
+std::vector<monitoring::SoftwareMetrics> RabbitMQConsumer::decodeSoftwareMetrics(const amqp_bytes_t& body,
+                                                                                const std::string& content_type) {
+    std::vector<monitoring::SoftwareMetrics> samples;
+    const void* data = body.bytes;
+    int size = static_cast<int>(body.len);
+
+    if (content_type.rfind(kProtobufBatchContentType, 0) == 0) {
+        monitoring::MetricsBatch batch;
+        if (!batch.ParseFromArray(data, size)) {
+            throw std::runtime_error("Malformed protobuf batch envelope");
+        }
+        if (batch.envelope_version() < 1 || batch.envelope_version() > kMaxBatchEnvelopeVersion) {
+            throw std::runtime_error("Unsupported batch envelope version " +
+                                     std::to_string(batch.envelope_version()));
+        }
+        samples.reserve(batch.software_size());
+        for (auto& sample : *batch.mutable_software()) {
+            samples.push_back(std::move(sample));
+        }
+    } else if (content_type.rfind(kProtobufContentType, 0) == 0) {
+        samples.emplace_back();
+        if (!samples.back().ParseFromArray(data, size)) {
+            throw std::runtime_error("Malformed protobuf software metrics");
+        }
+    } else {
+        for (const auto& json : unpackJsonMessage(body, content_type)) {
+            samples.push_back(softwareFromJson(json));
+        }
+    }
+
+    for (const auto& sample : samples) {
+        if (sample.device_id().empty()) {
+            throw std::runtime_error("Software metrics without device_id");
+        }
+    }
+    return samples;
+}
+
+std::vector<nlohmann::json> RabbitMQConsumer::unpackJsonMessage(const amqp_bytes_t& body,
+                                                                const std::string& content_type) {
+    const char* begin = static_cast<const char*>(body.bytes);
+    nlohmann::json json = nlohmann::json::parse(begin, begin + body.len);
+
+    // Older agents publish a bare sample without envelope
+    if (content_type != kJsonBatchContentType && !json.contains("envelope_version")) {
+        return {std::move(json)};
+    }
+
+    int version = json.value("envelope_version", 0);
+    if (version < 1 || version > kMaxBatchEnvelopeVersion) {
+        throw std::runtime_error("Unsupported batch envelope version " + std::to_string(version));
+    }
+
+    std::vector<nlohmann::json> samples;
+    auto& batch = json["samples"];
+    if (!batch.is_array()) {
+        throw std::runtime_error("Batch envelope without samples array");
+    }
+    samples.reserve(batch.size());
+    for (auto& sample : batch) {
+        samples.push_back(std::move(sample));
+    }
+    return samples;
+}
+
+monitoring::HardwareMetrics RabbitMQConsumer::hardwareFromJson(const nlohmann::json& json) {
+    // Field names as written by RabbitMQSender in JSON mode
+    monitoring::HardwareMetrics metrics;
+    metrics.set_device_id(json.at("device_id").get<std::string>());
+    metrics.set_readable_date(json.value("readable_date", ""));
+    metrics.set_cpu_usage(json.value("cpu_usage", ""));
+    metrics.set_memory_usage(json.value("memory_usage", ""));
+    metrics.set_disk_usage_root(json.value("disk_usage", ""));
+    if (json.contains("usb_state")) {
+        metrics.set_usb_devices(json["usb_state"].get<std::string>());
+    }
+    metrics.set_gpio_state(json.value("gpio_state", 0));
+    metrics.set_kernel_version(json.value("kernel_version", ""));
+    metrics.set_hardware_model(json.value("hardware_model", ""));
+    metrics.set_firmware_version(json.value("firmware_version", ""));
+    samplingFromJson(json, *metrics.mutable_sampling());
+    if (json.contains("cpu_window")) {
+        windowFromJson(json["cpu_window"], *metrics.mutable_cpu_window());
+    }
+    if (json.contains("memory_window")) {
+        windowFromJson(json["memory_window"], *metrics.mutable_memory_window());
+    }
+    if (json.contains("agent")) {
+        agentUsageFromJson(json["agent"], *metrics.mutable_agent());
+    }
+    if (json.contains("top_cpu")) {
+        processesFromJson(json["top_cpu"], *metrics.mutable_top_cpu());
+    }
+    if (json.contains("top_memory")) {
+        processesFromJson(json["top_memory"], *metrics.mutable_top_memory());
+    }
+    metrics.set_replayed(json.value("replayed", false));
+    return metrics;
+}
+
+void RabbitMQConsumer::windowFromJson(const nlohmann::json& json, monitoring::WindowStats& window) {
+    window.set_samples(json.value("samples", 0u));
+    window.set_window_seconds(json.value("window_seconds", 0u));
+    window.set_min(json.value("min", 0.0f));
+    window.set_max(json.value("max", 0.0f));
+    window.set_mean(json.value("mean", 0.0f));
+    window.set_p95(json.value("p95", 0.0f));
+}
+
+void RabbitMQConsumer::agentUsageFromJson(const nlohmann::json& json, monitoring::AgentUsage& usage) {
+    usage.set_cpu_percent(json.value("cpu_percent", 0.0f));
+    usage.set_cpu_budget_percent(json.value("cpu_budget_percent", 0.0f));
+    usage.set_io_bytes_per_second(json.value("io_bytes_per_second", 0.0f));
+    usage.set_cpu_ms_total(json.value("cpu_ms_total", uint64_t{0}));
+    usage.set_read_bytes_total(json.value("read_bytes_total", uint64_t{0}));
+    usage.set_write_bytes_total(json.value("write_bytes_total", uint64_t{0}));
+    usage.set_window_seconds(json.value("window_seconds", 0u));
+    usage.set_stretch(json.value("stretch", 1u));
+    usage.set_over_budget(json.value("over_budget", false));
+}
+
+void RabbitMQConsumer::processesFromJson(const nlohmann::json& json,
+                                         google::protobuf::RepeatedPtrField<monitoring::ProcessUsage>& processes) {
+    if (!json.is_array()) return;
+    for (const auto& entry : json) {
+        auto* process = processes.Add();
+        process->set_pid(entry.value("pid", 0));
+        process->set_name(entry.value("name", ""));
+        process->set_cpu_percent(entry.value("cpu_percent", 0.0f));
+        process->set_rss_kb(entry.value("rss_kb", uint64_t{0}));
+    }
+}
+
+monitoring::SoftwareMetrics RabbitMQConsumer::softwareFromJson(const nlohmann::json& json) {
+    monitoring::SoftwareMetrics metrics;
+    metrics.set_device_id(json.at("device_id").get<std::string>());
+    metrics.set_readable_date(json.value("readable_date", ""));
+    metrics.set_ip_address(json.value("ip_address", ""));
+    metrics.set_uptime(json.value("uptime", ""));
+    metrics.set_network_status(json.value("network_status", ""));
+    metrics.set_os_version(json.value("os_version", ""));
+    if (json.contains("applications") && json["applications"].is_array()) {
+        for (const auto& app : json["applications"]) {
+            auto* application = metrics.add_applications();
+            application->set_name(app.value("name", ""));
+            application->set_version(app.value("version", ""));
+        }
+    }
+    if (json.contains("services") && json["services"].is_object()) {
+        auto& services = *metrics.mutable_services();
+        for (const auto& [name, status] : json["services"].items()) {
+            services[name] = status.get<std::string>();
+        }
+    }
+    // Inventory delta fields, absent from older agents (full snapshot, sequence 0)
+    if (json.value("inventory_kind", "snapshot") == "delta") {
+        metrics.set_inventory_kind(monitoring::SoftwareMetrics::DELTA);
+    }
+    metrics.set_inventory_sequence(json.value("inventory_sequence", uint64_t{0}));
+    for (const auto& name : json.value("removed_services", std::vector<std::string>{})) {
+        metrics.add_removed_services(name);
+    }
+    for (const auto& name : json.value("removed_applications", std::vector<std::string>{})) {
+        metrics.add_removed_applications(name);
+    }
+    samplingFromJson(json, *metrics.mutable_sampling());
+    return metrics;
+}
+
+void RabbitMQConsumer::samplingFromJson(const nlohmann::json& json,
+                                        google::protobuf::RepeatedPtrField<monitoring::SamplingInfo>& sampling) {
+    // Absent from agents without adaptive sampling (fixed 60 s interval)
+    if (!json.contains("sampling") || !json["sampling"].is_array()) return;
+    for (const auto& entry : json["sampling"]) {
+        auto* info = sampling.Add();
+        info->set_metric_class(entry.value("metric_class", ""));
+        info->set_interval_seconds(entry.value("interval_seconds", 0u));
+        info->set_reason(entry.value("reason", ""));
+        info->set_stretch(entry.value("stretch", 1u));
+    }
+}
+
 amqp_connection_state_t RabbitMQConsumer::connectToRabbitMQ(const std::string& queue_name, int& channel) {
     // Create connection
     amqp_connection_state_t conn = amqp_new_connection();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <memory>
 #include <functional>
 #include <thread>
@@ -8,20 +9,26 @@
 #include <amqp.h>
 #include <amqp_tcp_socket.h>
 #include <nlohmann/json.hpp>
+#include "monitoring.pb.h"
+#include "payload_decompressor.h"
+
+class MySQLMetricsStorage;
 
 class RabbitMQConsumer {
 public:
     // Callback for when hardware metrics are received
     using HardwareMetricsCallback = std::function<void(const std::string& device_id,
-                                                     const nlohmann::json& metrics)>;
+                                                     const monitoring::HardwareMetrics& metrics)>;
     
     // Callback for when software metrics are received
     using SoftwareMetricsCallback = std::function<void(const std::string& device_id,
-                                                     const nlohmann::json& metrics)>;
+                                                     const monitoring::SoftwareMetrics& metrics)>;
     
+    // Every sample received is stored in storage, shared with the device sessions
     RabbitMQConsumer(const std::string& hostname, int port,
                     const std::string& username, const std::string& password,
-                    const std::string& hw_queue_name, const std::string& sw_queue_name);
+                    const std::string& hw_queue_name, const std::string& sw_queue_name,
+                    MySQLMetricsStorage* storage);
     ~RabbitMQConsumer();
     
     // Initialize connection and start consumers
@@ -30,6 +37,9 @@ public:
     // Stop consumers and close connection
     void stop();
     
+    // Dictionaries for payloads compressed by the agents (call before start())
+    size_t loadCompressionDictionaries(const std::string& directory);
+    
 private:
     std::string hostname_;
     int port_;
@@ -37,6 +47,7 @@ private:
     std::string password_;
     std::string hw_queue_name_;
     std::string sw_queue_name_;
+    MySQLMetricsStorage* storage_;
     
     // Callback functions
     HardwareMetricsCallback hw_callback_;
@@ -48,6 +59,8 @@ private:
     int hw_channel_;
     int sw_channel_;
     
+    PayloadDecompressor decompressor_;
+    
     // Consumer threads
     std::thread hw_thread_;
     std::thread sw_thread_;
@@ -62,4 +75,35 @@ private:
     
     // Connect to RabbitMQ
     amqp_connection_state_t connectToRabbitMQ(const std::string& queue_name, int& channel);
+
+    // Content types published by RabbitMQSender; anything else is treated as JSON
+    static constexpr const char* kProtobufContentType = "application/x-protobuf";
+    static constexpr const char* kJsonBatchContentType = "application/vnd.iotshadow.batch+json";
+    static constexpr const char* kProtobufBatchContentType = "application/vnd.iotshadow.batch+protobuf";
+    static constexpr int kMaxBatchEnvelopeVersion = 1;
+
+    static std::string contentTypeOf(const amqp_envelope_t& envelope);
+
+    // Message body, decompressed into storage when the x-compression header is set
+    amqp_bytes_t payloadOf(const amqp_envelope_t& envelope, std::string& storage) const;
+
+    // Decode a message body into its samples (one for plain messages, N for a
+    // batch envelope). Protobuf bodies are parsed straight into the proto
+    // messages; JSON bodies from older agents are converted field by field.
+    static std::vector<monitoring::HardwareMetrics> decodeHardwareMetrics(const amqp_bytes_t& body,
+                                                                          const std::string& content_type);
+    static std::vector<monitoring::SoftwareMetrics> decodeSoftwareMetrics(const amqp_bytes_t& body,
+                                                                          const std::string& content_type);
+
+    // Split a JSON message into its samples
+    static std::vector<nlohmann::json> unpackJsonMessage(const amqp_bytes_t& body,
+                                                         const std::string& content_type);
+    static monitoring::HardwareMetrics hardwareFromJson(const nlohmann::json& json);
+    static monitoring::SoftwareMetrics softwareFromJson(const nlohmann::json& json);
+    static void windowFromJson(const nlohmann::json& json, monitoring::WindowStats& window);
+    static void agentUsageFromJson(const nlohmann::json& json, monitoring::AgentUsage& usage);
+    static void processesFromJson(const nlohmann::json& json,
+                                  google::protobuf::RepeatedPtrField<monitoring::ProcessUsage>& processes);
+    static void samplingFromJson(const nlohmann::json& json,
+                                 google::protobuf::RepeatedPtrField<monitoring::SamplingInfo>& sampling);
 };
\ No newline at end of file
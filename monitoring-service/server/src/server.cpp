@@ -1,41 +1,61 @@
 #include <grpcpp/grpcpp.h>
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include <string>
+#include <atomic>
+#include <thread>
 
 #include "monitoring.grpc.pb.h"
 #include "rabbitmq_consumer.h"
 #include "metrics_analyzer.h"
 #include "alert_manager.h"
+#include "alert_stream_reactor.h"
+#include "session_reactor.h"
+#include "mysql_metrics_storage.h"
+#include "session_metrics_worker.h"
 
 using grpc::Server;
 using grpc::ServerBuilder;
 using grpc::ServerContext;
-using grpc::ServerWriter;
 using grpc::Status;
 
-class MonitoringServiceImpl final : public monitoring::MonitoringService::Service {
-public:
-    explicit MonitoringServiceImpl(AlertManager* alert_manager)
-        : alert_manager_(alert_manager) {}
+// SessionClient::Options::heartbeat_interval: an agent heartbeats after this
+// long without any other message on its session
+constexpr std::chrono::seconds kAgentHeartbeatInterval{45};
+// Four heartbeats missed in a row close the session
+constexpr std::chrono::seconds kSessionIdleTimeout = 4 * kAgentHeartbeatInterval;
 
-    Status RegisterDevice(ServerContext* context,
-                         const monitoring::DeviceInfo* request,
-                         ServerWriter<monitoring::Alert>* writer) override {
+// The streams on the callback API, the unary methods on the synchronous one
+class MonitoringServiceImpl final
+    : public monitoring::MonitoringService::WithCallbackMethod_RegisterDevice<
+          monitoring::MonitoringService::WithCallbackMethod_Session<monitoring::MonitoringService::Service>> {
+public:
+    MonitoringServiceImpl(AlertManager* alert_manager, MetricsAnalyzer* metrics_analyzer,
+                          SessionMetricsWorker* metrics_worker)
+        : alert_manager_(alert_manager), metrics_analyzer_(metrics_analyzer), metrics_worker_(metrics_worker) {}
+
+    // No thread per device: the stream is a reactor driven by gRPC's callback
+    // threads, and its cancellation an event (AlertStreamReactor::OnCancel)
+    grpc::ServerWriteReactor<monitoring::Alert>* RegisterDevice(grpc::CallbackServerContext* context,
+                                                              const monitoring::DeviceInfo* request) override {
         std::string device_id = request->device_id();
         std::cout << "Registering device: " << device_id << std::endl;
 
-        // Register the device with AlertManager using raw pointer
-        alert_manager_->registerDevice(device_id, writer);
+        auto* reactor = new AlertStreamReactor(alert_manager_, device_id, request->evaluates_rules());
 
-        // Keep the stream open until client disconnects or context is cancelled
-        while (!context->IsCancelled()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        // Agents with a rule engine check the thresholds on each sample themselves
+        if (request->evaluates_rules()) {
+            alert_manager_->sendRules(device_id, metrics_analyzer_->buildDeviceRules());
         }
+        return reactor;
+    }
 
-        // Unregister device when stream is closed
-        alert_manager_->unregisterDevice(device_id);
-        return Status::OK;
+    // Device messages are handled on the callback threads as they arrive;
+    // what goes down is queued, no Write blocks a caller
+    grpc::ServerBidiReactor<monitoring::DeviceMessage, monitoring::ServerMessage>* Session(
+        grpc::CallbackServerContext* context) override {
+        return new SessionReactor(alert_manager_, metrics_analyzer_, metrics_worker_);
     }
 
     Status SendStatusUpdate(ServerContext* context,
@@ -52,44 +72,85 @@ public:
         return Status::OK;
     }
 
+    Status ReportAlert(ServerContext* context,
+                       const monitoring::Alert* request,
+                       monitoring::StatusResponse* response) override {
+        alert_manager_->recordDeviceAlert(*request);
+
+        response->set_success(true);
+        response->set_message("Alert recorded");
+
+        return Status::OK;
+    }
+
 private:
     AlertManager* alert_manager_;
+    MetricsAnalyzer* metrics_analyzer_;
+    SessionMetricsWorker* metrics_worker_;
 };
 
 void RunServer(const std::string& rabbitmq_host, int rabbitmq_port,
                const std::string& rabbitmq_username, const std::string& rabbitmq_password,
                const std::string& hw_queue, const std::string& sw_queue,
-               const std::string& thresholds_path, const std::string& grpc_address) {
-    AlertManager alert_manager;
+               const std::string& thresholds_path, const std::string& dictionaries_path,
+               const std::string& grpc_address, const AlertManager::OutboundOptions& outbound,
+               const AlertMailbox::Options& mailbox) {
+    AlertManager alert_manager(outbound, mailbox);
     MetricsAnalyzer metrics_analyzer(&alert_manager, thresholds_path);
+    // Samples from RabbitMQ and from device sessions, one connection for both
+    MySQLMetricsStorage storage;
     RabbitMQConsumer rabbitmq_consumer(
         rabbitmq_host, rabbitmq_port,
         rabbitmq_username, rabbitmq_password,
-        hw_queue, sw_queue
+        hw_queue, sw_queue, &storage
     );
 
-    auto hw_callback = [&metrics_analyzer](const std::string& device_id, const nlohmann::json& metrics) {
+    auto hw_callback = [&metrics_analyzer](const std::string& device_id, const monitoring::HardwareMetrics& metrics) {
         metrics_analyzer.processHardwareMetrics(device_id, metrics);
     };
 
-    auto sw_callback = [&metrics_analyzer](const std::string& device_id, const nlohmann::json& metrics) {
+    auto sw_callback = [&metrics_analyzer](const std::string& device_id, const monitoring::SoftwareMetrics& metrics) {
         metrics_analyzer.processSoftwareMetrics(device_id, metrics);
     };
 
+    // Agents started with --compress use the dictionaries shipped in dictionaries/
+    rabbitmq_consumer.loadCompressionDictionaries(dictionaries_path);
+
     if (!rabbitmq_consumer.start(hw_callback, sw_callback)) {
         std::cerr << "Failed to start RabbitMQ consumer" << std::endl;
         return;
     }
 
-    MonitoringServiceImpl service(&alert_manager);
+    // Samples received on device sessions
+    SessionMetricsWorker session_metrics(&alert_manager, &metrics_analyzer, &storage);
+    MonitoringServiceImpl service(&alert_manager, &metrics_analyzer, &session_metrics);
     ServerBuilder builder;
     builder.AddListeningPort(grpc_address, grpc::InsecureServerCredentials());
     builder.RegisterService(&service);
+    // Agents heartbeat on an idle session (kAgentHeartbeatInterval); keepalive
+    // pings only catch connections that died without a FIN
+    builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_TIME_MS, 5 * 60 * 1000);
+    builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, 20 * 1000);
+    builder.AddChannelArgument(GRPC_ARG_HTTP2_MIN_RECV_PING_INTERVAL_WITHOUT_DATA_MS, 30 * 1000);
 
     std::unique_ptr<Server> server(builder.BuildAndStart());
     std::cout << "Server listening on " << grpc_address << std::endl;
 
+    // Sessions silent for kSessionIdleTimeout are closed, and mailbox alerts
+    // past their TTL dropped
+    std::atomic<bool> running{true};
+    std::thread idle_sessions([&alert_manager, &running]() {
+        while (running) {
+            std::this_thread::sleep_for(std::chrono::seconds(30));
+            alert_manager.closeIdleSessions(kSessionIdleTimeout);
+            alert_manager.expireMailbox();
+        }
+    });
+
     server->Wait();
+    running = false;
+    idle_sessions.join();
+    session_metrics.stop();
 
     rabbitmq_consumer.stop();
 }
@@ -102,10 +163,43 @@ int main(int argc, char** argv) {
     std::string hw_queue = "hardware_metrics";
     std::string sw_queue = "software_metrics";
     std::string thresholds_path = "thresholds.json";
+    std::string dictionaries_path = "../../dictionaries";
     std::string grpc_address = "0.0.0.0:50051";
+    AlertManager::OutboundOptions outbound;
+    AlertMailbox::Options mailbox;
+    mailbox.path = "alert_mailbox.log";
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--outbound-queue" && i + 1 < argc) {
+            // Messages waiting per device connection
+            outbound.queue_size = std::max(std::stoul(argv[++i]), 2UL);
+        } else if (arg == "--overflow" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            if (policy == "drop-oldest") {
+                outbound.overflow = OverflowPolicy::DropOldest;
+            } else if (policy == "coalesce") {
+                outbound.overflow = OverflowPolicy::Coalesce;
+            } else {
+                std::cerr << "--overflow must be drop-oldest or coalesce" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--mailbox" && i + 1 < argc) {
+            // Log of the alerts kept for offline devices, "" for memory only
+            mailbox.path = argv[++i];
+        } else if (arg == "--mailbox-ttl" && i + 1 < argc) {
+            mailbox.ttl = std::chrono::seconds(std::stol(argv[++i]));
+        } else if (arg == "--mailbox-mb" && i + 1 < argc) {
+            mailbox.max_bytes = std::stoul(argv[++i]) * 1024 * 1024;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--outbound-queue N] [--overflow drop-oldest|coalesce]\n"
+                      << "       [--mailbox PATH] [--mailbox-ttl SECONDS] [--mailbox-mb MB]" << std::endl;
+            return 1;
+        }
+    }
 
     RunServer(rabbitmq_host, rabbitmq_port, rabbitmq_username, rabbitmq_password,
-              hw_queue, sw_queue, thresholds_path, grpc_address);
+              hw_queue, sw_queue, thresholds_path, dictionaries_path, grpc_address, outbound, mailbox);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include "session_metrics_worker.h"
+#include "alert_manager.h"
+#include "metrics_analyzer.h"
+#include "mysql_metrics_storage.h"
+#include <iostream>
+
+SessionMetricsWorker::SessionMetricsWorker(AlertManager* alert_manager, MetricsAnalyzer* metrics_analyzer,
+                                           MySQLMetricsStorage* storage, size_t max_queued)
+    : alert_manager_(alert_manager), metrics_analyzer_(metrics_analyzer), storage_(storage),
+      max_queued_(max_queued), thread_(&SessionMetricsWorker::run, this) {
+}
+
+SessionMetricsWorker::~SessionMetricsWorker() {
+    stop();
+}
+
+bool SessionMetricsWorker::submit(const std::string& device_id, uint64_t sequence,
+                                  monitoring::HardwareMetrics metrics) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || queue_.size() >= max_queued_) {
+            // Logged once per 100 so a stalled database does not flood the log
+            if (dropped_++ % 100 == 0) {
+                std::cerr << "Session sample queue full, dropped " << dropped_ << " sample(s) so far" << std::endl;
+            }
+            return false;
+        }
+        queue_.push_back({device_id, sequence, std::move(metrics)});
+    }
+    wakeup_.notify_one();
+    return true;
+}
+
+void SessionMetricsWorker::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeup_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void SessionMetricsWorker::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wakeup_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        Sample sample = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+
+        // Same analysis and storage as the samples arriving over RabbitMQ,
+        // under the device that opened the session
+        sample.metrics.set_device_id(sample.device_id);
+        metrics_analyzer_->processHardwareMetrics(sample.device_id, sample.metrics);
+        if (storage_->insertHardwareInfo(sample.metrics)) {
+            alert_manager_->sendAck(sample.device_id, sample.sequence);
+        }
+
+        lock.lock();
+    }
+}
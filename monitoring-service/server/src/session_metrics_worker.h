@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "monitoring.pb.h"
+
+class AlertManager;
+class MetricsAnalyzer;
+class MySQLMetricsStorage;
+
+// Hardware samples received on device sessions, analyzed and stored on a
+// thread of its own like the samples consumed from RabbitMQ, so no gRPC
+// callback waits for MySQL. A sample is acked on its session once stored.
+class SessionMetricsWorker {
+public:
+    SessionMetricsWorker(AlertManager* alert_manager, MetricsAnalyzer* metrics_analyzer,
+                         MySQLMetricsStorage* storage, size_t max_queued = 1024);
+    ~SessionMetricsWorker();
+
+    SessionMetricsWorker(const SessionMetricsWorker&) = delete;
+    SessionMetricsWorker& operator=(const SessionMetricsWorker&) = delete;
+
+    // Queue a sample, never waits. False when the queue is full: the sample
+    // is dropped and never acked
+    bool submit(const std::string& device_id, uint64_t sequence, monitoring::HardwareMetrics metrics);
+
+    // Process what is queued, then stop the thread
+    void stop();
+
+private:
+    struct Sample {
+        std::string device_id;
+        uint64_t sequence = 0;
+        monitoring::HardwareMetrics metrics;
+    };
+
+    AlertManager* alert_manager_;
+    MetricsAnalyzer* metrics_analyzer_;
+    MySQLMetricsStorage* storage_;
+    const size_t max_queued_;
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::deque<Sample> queue_;              // guarded by mutex_
+    bool stopping_ = false;                 // guarded by mutex_
+    uint64_t dropped_ = 0;                  // guarded by mutex_
+    std::thread thread_;
+
+    void run();
+};
@@ -0,0 +1,80 @@
+#include "session_reactor.h"
+#include "alert_manager.h"
+#include "metrics_analyzer.h"
+#include "session_metrics_worker.h"
+#include <iostream>
+
+SessionReactor::SessionReactor(AlertManager* alert_manager, MetricsAnalyzer* metrics_analyzer,
+                               SessionMetricsWorker* metrics_worker)
+    : OutboundStream(alert_manager->outboundOptions().queue_size, alert_manager->outboundOptions().overflow),
+      alert_manager_(alert_manager), metrics_analyzer_(metrics_analyzer), metrics_worker_(metrics_worker) {
+    StartRead(&message_);
+}
+
+void SessionReactor::OnReadDone(bool ok) {
+    if (!ok) {
+        // The device closed the stream or the connection dropped
+        close(grpc::Status::OK);
+        return;
+    }
+    if (generation_ == 0) {
+        if (!message_.has_hello()) {
+            close(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Session must start with a hello"));
+            return;
+        }
+        handleHello();
+    } else {
+        handleMessage();
+    }
+    StartRead(&message_);
+}
+
+void SessionReactor::OnDone() {
+    if (generation_ != 0) {
+        alert_manager_->unregisterDevice(device_id_, generation_);
+    }
+    if (dropped() || coalesced()) {
+        std::cout << "Session of device " << device_id_ << " ended with " << dropped()
+                  << " message(s) dropped and " << coalesced() << " coalesced" << std::endl;
+    }
+    delete this;
+}
+
+void SessionReactor::handleHello() {
+    device_id_ = message_.hello().device_id();
+    std::cout << "Registering device: " << device_id_ << " (session)" << std::endl;
+
+    generation_ = alert_manager_->registerSession(device_id_, this, message_.hello().evaluates_rules());
+    if (message_.hello().evaluates_rules()) {
+        alert_manager_->sendRules(device_id_, metrics_analyzer_->buildDeviceRules());
+    }
+}
+
+void SessionReactor::handleMessage() {
+    alert_manager_->touch(device_id_);
+    switch (message_.payload_case()) {
+        case monitoring::DeviceMessage::kAck:
+            alert_manager_->acknowledgeAlert(device_id_, message_.ack().alert_id());
+            break;
+        case monitoring::DeviceMessage::kCommandResult:
+            alert_manager_->recordCommandResult(device_id_, message_.command_result());
+            alert_manager_->sendAck(device_id_, message_.sequence());
+            break;
+        case monitoring::DeviceMessage::kAlert:
+            alert_manager_->recordDeviceAlert(message_.alert());
+            alert_manager_->sendAck(device_id_, message_.sequence());
+            break;
+        case monitoring::DeviceMessage::kMetrics:
+            // Analyzed and stored off the callback thread, acked once stored
+            metrics_worker_->submit(device_id_, message_.sequence(), std::move(*message_.mutable_metrics()));
+            break;
+        case monitoring::DeviceMessage::kEvent:
+            // Hotplug and GPIO changes, without waiting for the next sample
+            metrics_analyzer_->processDeviceEvent(device_id_, message_.event());
+            alert_manager_->sendAck(device_id_, message_.sequence());
+            break;
+        default:
+            // Heartbeat: the activity itself is the liveness signal
+            break;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <grpcpp/grpcpp.h>
+#include <monitoring.grpc.pb.h>
+#include "outbound_stream.h"
+
+class AlertManager;
+class MetricsAnalyzer;
+class SessionMetricsWorker;
+
+// One device's bidirectional Session, on the gRPC callback API.
+//
+// Device messages are handled in OnReadDone as they arrive, the first one
+// must be the hello. Alerts and acks go through the session's bounded
+// OutboundQueue, like the RegisterDevice stream. The session ends when the
+// device closes it, the connection drops or it is closed for inactivity.
+class SessionReactor
+    : public OutboundStream<grpc::ServerBidiReactor<monitoring::DeviceMessage, monitoring::ServerMessage>,
+                            monitoring::ServerMessage> {
+public:
+    SessionReactor(AlertManager* alert_manager, MetricsAnalyzer* metrics_analyzer,
+                   SessionMetricsWorker* metrics_worker);
+
+    void OnReadDone(bool ok) override;
+    void OnDone() override;
+
+private:
+    AlertManager* alert_manager_;
+    MetricsAnalyzer* metrics_analyzer_;
+    SessionMetricsWorker* metrics_worker_;
+    monitoring::DeviceMessage message_;
+    std::string device_id_;
+    uint64_t generation_ = 0;           // 0 until the hello
+
+    void handleHello();
+    void handleMessage();
+};
@@ -0,0 +1,105 @@
+// Compression ratio and per-message CPU of the agent-side PayloadCompressor
+// and the server-side PayloadDecompressor.
+//
+//   compression_bench [--dictionary FILE] [--messages N] [--level L]
+//
+// Payloads are synthetic (see sample_payloads.h) and generated with a different
+// seed than the one used for training, so the dictionary never saw them.
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <zstd.h>
+#include "payload_compressor.h"
+#include "payload_decompressor.h"
+#include "sample_payloads.h"
+
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv) {
+    std::string dictionary_path = "../dictionaries/metrics-v1.zdict";
+    size_t message_count = 20000;
+    int level = 3;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dictionary" && i + 1 < argc) {
+            dictionary_path = argv[++i];
+        } else if (arg == "--messages" && i + 1 < argc) {
+            message_count = std::stoul(argv[++i]);
+        } else if (arg == "--level" && i + 1 < argc) {
+            level = std::stoi(argv[++i]);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    PayloadCompressor compressor;
+    PayloadDecompressor decompressor;
+    if (!compressor.load(dictionary_path, level) ||
+        decompressor.loadDirectory(fs::path(dictionary_path).parent_path().string()) == 0) {
+        return 1;
+    }
+
+    using Kind = SamplePayloads::Kind;
+    using Format = SamplePayloads::Format;
+    using Clock = std::chrono::steady_clock;
+
+    std::printf("%-18s %-9s %9s %9s %9s %8s %8s %12s %12s\n", "payload", "format", "raw B", "zstd B",
+                "dict B", "ratio", "no-dict", "compress", "decompress");
+
+    for (Kind kind : {Kind::Hardware, Kind::SoftwareSnapshot, Kind::SoftwareDelta}) {
+        for (Format format : {Format::Json, Format::Protobuf}) {
+            SamplePayloads payloads(2);
+            std::vector<std::string> messages;
+            messages.reserve(message_count);
+            for (size_t i = 0; i < message_count; ++i) {
+                messages.push_back(payloads.next(kind, format));
+            }
+
+            // Reference: plain zstd at the same level, no dictionary
+            size_t raw_bytes = 0;
+            size_t plain_bytes = 0;
+            std::string plain(ZSTD_compressBound(64 * 1024), '\0');
+            for (const auto& message : messages) {
+                raw_bytes += message.size();
+                plain_bytes += ZSTD_compress(&plain[0], plain.size(), message.data(), message.size(), level);
+            }
+
+            std::vector<std::string> compressed(messages.size());
+            auto start = Clock::now();
+            for (size_t i = 0; i < messages.size(); ++i) {
+                if (!compressor.compress(messages[i], compressed[i])) {
+                    compressed[i].clear();  // would not shrink, sent as-is by the agent
+                }
+            }
+            double compress_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+            size_t dict_bytes = 0;
+            size_t decompressed_bytes = 0;
+            start = Clock::now();
+            for (size_t i = 0; i < messages.size(); ++i) {
+                if (compressed[i].empty()) {
+                    dict_bytes += messages[i].size();
+                    continue;
+                }
+                dict_bytes += compressed[i].size();
+                decompressed_bytes += decompressor.decompress(PayloadCompressor::kAlgorithm, compressor.dictionaryId(),
+                                                              compressed[i].data(), compressed[i].size()).size();
+            }
+            double decompress_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            (void)decompressed_bytes;
+
+            double n = static_cast<double>(messages.size());
+            std::printf("%-18s %-9s %9.1f %9.1f %9.1f %7.2fx %7.2fx %9.0f ns %9.0f ns\n",
+                        SamplePayloads::kindName(kind), SamplePayloads::formatName(format),
+                        raw_bytes / n, plain_bytes / n, dict_bytes / n,
+                        static_cast<double>(raw_bytes) / dict_bytes, static_cast<double>(raw_bytes) / plain_bytes,
+                        compress_ns / n, decompress_ns / n);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,819 @@
+// Virtual device fleet, to size the monitoring server.
+//
+//   fleet_loadgen [--devices N] [--server HOST:PORT] [--amqp HOST[:PORT]]
+//                 [--hw-interval S] [--sw-interval S] [--cpu DIST] [--memory DIST] [--disk DIST]
+//                 [--noise PCT] [--publishers N] [--grpc-threads N] [--devices-per-channel N]
+//                 [--prefix ID] [--duration S] [--report S] [--no-sessions]
+//
+// Every virtual device publishes hardware samples and software inventory
+// (a snapshot, then deltas) to the hardware_metrics / software_metrics queues
+// exactly like RabbitMQSender in protobuf mode, and keeps a device Session
+// open to receive the alerts the server raises from those samples.
+//
+// DIST is uniform:LOW:HIGH, normal:MEAN:STDDEV or const:VALUE, in percent. It
+// sets each device's baseline; every sample is the baseline plus +/- --noise,
+// so a fleet with cpu normal:50:20 has a stable share of hot devices.
+//
+// Against the local stack: `docker compose up -d rabbitmq mysql` from the repo
+// root, start monitoring_service, then run this tool with the defaults.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <amqp.h>
+#include <amqp_tcp_socket.h>
+#include <grpcpp/alarm.h>
+#include <grpcpp/grpcpp.h>
+#include "monitoring.grpc.pb.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::atomic<bool> g_stop{false};
+
+void onSignal(int) {
+    g_stop = true;
+}
+
+int64_t wallMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+struct Distribution {
+    enum class Kind { Uniform, Normal, Constant };
+    Kind kind = Kind::Uniform;
+    double a = 0;
+    double b = 100;
+
+    // uniform:LOW:HIGH, normal:MEAN:STDDEV, const:VALUE
+    static bool parse(const std::string& text, Distribution& out) {
+        std::vector<std::string> parts;
+        std::stringstream ss(text);
+        std::string part;
+        while (std::getline(ss, part, ':')) {
+            parts.push_back(part);
+        }
+        try {
+            if (parts.size() == 3 && parts[0] == "uniform") {
+                out = Distribution{Kind::Uniform, std::stod(parts[1]), std::stod(parts[2])};
+            } else if (parts.size() == 3 && parts[0] == "normal") {
+                out = Distribution{Kind::Normal, std::stod(parts[1]), std::stod(parts[2])};
+            } else if (parts.size() == 2 && parts[0] == "const") {
+                out = Distribution{Kind::Constant, std::stod(parts[1]), 0};
+            } else {
+                return false;
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+
+    double sample(std::mt19937& rng) const {
+        double value = a;
+        if (kind == Kind::Uniform) {
+            value = std::uniform_real_distribution<double>(a, b)(rng);
+        } else if (kind == Kind::Normal) {
+            value = std::normal_distribution<double>(a, b)(rng);
+        }
+        return std::clamp(value, 0.0, 100.0);
+    }
+};
+
+struct Config {
+    size_t devices = 100;
+    std::string server = "localhost:50051";
+    std::string amqp_host = "localhost";
+    int amqp_port = 5672;
+    std::string hw_queue = "hardware_metrics";
+    std::string sw_queue = "software_metrics";
+    std::chrono::seconds hw_interval{60};
+    std::chrono::seconds sw_interval{300};
+    Distribution cpu{Distribution::Kind::Normal, 35, 20};
+    Distribution memory{Distribution::Kind::Normal, 55, 15};
+    Distribution disk{Distribution::Kind::Uniform, 20, 80};
+    double noise = 5;
+    size_t publishers = 2;
+    size_t grpc_threads = 2;
+    size_t devices_per_channel = 500;
+    std::string prefix = "loadgen-";
+    std::chrono::seconds duration{0};   // 0 = until interrupted
+    std::chrono::seconds report{10};
+    bool sessions = true;
+};
+
+// Per-interval latency samples, summarized and reset by take()
+class LatencyRecorder {
+public:
+    struct Summary {
+        size_t count = 0;
+        double p50 = 0, p95 = 0, p99 = 0, max = 0;
+    };
+
+    void add(double ms) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_.push_back(ms);
+    }
+
+    Summary take() {
+        std::vector<double> samples;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            samples.swap(samples_);
+        }
+        Summary summary;
+        summary.count = samples.size();
+        if (samples.empty()) return summary;
+        std::sort(samples.begin(), samples.end());
+        auto rank = [&](double q) { return samples[std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()))]; };
+        summary.p50 = rank(0.50);
+        summary.p95 = rank(0.95);
+        summary.p99 = rank(0.99);
+        summary.max = samples.back();
+        return summary;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<double> samples_;
+};
+
+struct Stats {
+    std::atomic<uint64_t> hardware_published{0};
+    std::atomic<uint64_t> software_published{0};
+    std::atomic<uint64_t> publish_errors{0};    // publish call failed or connection lost
+    std::atomic<uint64_t> confirmed{0};
+    std::atomic<uint64_t> nacked{0};
+    std::atomic<uint64_t> sessions_open{0};
+    std::atomic<uint64_t> session_attempts{0};
+    std::atomic<uint64_t> alerts{0};
+    std::mutex errors_mutex;
+    std::map<std::string, uint64_t> session_errors;   // by gRPC status code
+    LatencyRecorder fanout;       // server alert timestamp -> received
+    LatencyRecorder end_to_end;   // last hardware publish -> alert received
+
+    void sessionError(grpc::StatusCode code) {
+        static const char* names[] = {"OK", "CANCELLED", "UNKNOWN", "INVALID_ARGUMENT", "DEADLINE_EXCEEDED",
+                                      "NOT_FOUND", "ALREADY_EXISTS", "PERMISSION_DENIED", "RESOURCE_EXHAUSTED",
+                                      "FAILED_PRECONDITION", "ABORTED", "OUT_OF_RANGE", "UNIMPLEMENTED",
+                                      "INTERNAL", "UNAVAILABLE", "DATA_LOSS", "UNAUTHENTICATED"};
+        std::string name = code >= 0 && code <= 16 ? names[code] : std::to_string(code);
+        std::lock_guard<std::mutex> lock(errors_mutex);
+        session_errors[name]++;
+    }
+};
+
+struct Device {
+    std::string id;
+    double cpu_base = 0, memory_base = 0, disk_base = 0;
+    std::string model;
+    int gpio = 0;
+    uint64_t inventory_sequence = 0;
+    std::atomic<int64_t> last_hardware_ms{0};
+};
+
+const char* const kModels[] = {
+    "Raspberry Pi 4 Model B Rev 1.4", "Raspberry Pi 4 Model B Rev 1.5",
+    "Raspberry Pi 3 Model B Plus Rev 1.3", "Raspberry Pi Zero 2 W Rev 1.0",
+};
+
+std::string percent(double value) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%.1f%%", value);
+    return buf;
+}
+
+std::string readableDate() {
+    std::time_t now = std::time(nullptr);
+    std::tm tm_now;
+    localtime_r(&now, &tm_now);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d_%H-%M-%S", &tm_now);
+    return buf;
+}
+
+// One AMQP connection publishing for a slice of the fleet, with publisher confirms
+class Publisher {
+public:
+    Publisher(const Config& config, std::vector<Device>& devices, size_t begin, size_t end, Stats& stats, uint32_t seed)
+        : config_(config), devices_(devices), begin_(begin), end_(end), stats_(stats), rng_(seed) {
+    }
+
+    ~Publisher() {
+        disconnect();
+    }
+
+    void run() {
+        // Random phase, so the fleet does not publish in lockstep
+        auto now = Clock::now();
+        for (size_t i = begin_; i < end_; ++i) {
+            schedule_.push({now + randomPhase(config_.hw_interval), i, false});
+            schedule_.push({now + randomPhase(config_.sw_interval), i, true});
+        }
+
+        while (!g_stop) {
+            if (!conn_ && !connect()) {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                continue;
+            }
+            now = Clock::now();
+            while (!schedule_.empty() && schedule_.top().due <= now && conn_) {
+                Entry entry = schedule_.top();
+                schedule_.pop();
+                publish(devices_[entry.device], entry.software);
+                entry.due += entry.software ? config_.sw_interval : config_.hw_interval;
+                schedule_.push(entry);
+            }
+            pollConfirms();
+            auto next = schedule_.empty() ? now + std::chrono::milliseconds(50) : schedule_.top().due;
+            std::this_thread::sleep_until(std::min(next, Clock::now() + std::chrono::milliseconds(50)));
+        }
+    }
+
+private:
+    struct Entry {
+        Clock::time_point due;
+        size_t device;
+        bool software;
+        bool operator>(const Entry& other) const { return due > other.due; }
+    };
+
+    const Config& config_;
+    std::vector<Device>& devices_;
+    size_t begin_, end_;
+    Stats& stats_;
+    std::mt19937 rng_;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> schedule_;
+    amqp_connection_state_t conn_ = nullptr;
+    static constexpr amqp_channel_t kChannel = 1;
+    uint64_t next_delivery_tag_ = 1;
+    std::set<uint64_t> in_flight_;
+
+    Clock::duration randomPhase(std::chrono::seconds interval) {
+        auto range = std::chrono::duration_cast<std::chrono::milliseconds>(interval).count();
+        return std::chrono::milliseconds(std::uniform_int_distribution<int64_t>(0, std::max<int64_t>(range, 1))(rng_));
+    }
+
+    bool connect() {
+        conn_ = amqp_new_connection();
+        amqp_socket_t* socket = amqp_tcp_socket_new(conn_);
+        if (!socket || amqp_socket_open(socket, config_.amqp_host.c_str(), config_.amqp_port) != AMQP_STATUS_OK) {
+            std::cerr << "Cannot reach RabbitMQ at " << config_.amqp_host << ":" << config_.amqp_port << std::endl;
+            return fail();
+        }
+        if (amqp_login(conn_, "/", 0, 131072, 0, AMQP_SASL_METHOD_PLAIN, "guest", "guest").reply_type !=
+            AMQP_RESPONSE_NORMAL) {
+            std::cerr << "RabbitMQ login failed" << std::endl;
+            return fail();
+        }
+        amqp_channel_open(conn_, kChannel);
+        if (amqp_get_rpc_reply(conn_).reply_type != AMQP_RESPONSE_NORMAL) return fail();
+        amqp_confirm_select(conn_, kChannel);
+        if (amqp_get_rpc_reply(conn_).reply_type != AMQP_RESPONSE_NORMAL) return fail();
+        // Same declaration as RabbitMQSender, a mismatch would close the channel
+        for (const std::string* queue : {&config_.hw_queue, &config_.sw_queue}) {
+            amqp_queue_declare(conn_, kChannel, amqp_cstring_bytes(queue->c_str()), 0, 1, 0, 0, amqp_empty_table);
+            if (amqp_get_rpc_reply(conn_).reply_type != AMQP_RESPONSE_NORMAL) return fail();
+        }
+        next_delivery_tag_ = 1;
+        in_flight_.clear();
+        return true;
+    }
+
+    bool fail() {
+        stats_.publish_errors++;
+        disconnect();
+        return false;
+    }
+
+    void disconnect() {
+        if (!conn_) return;
+        amqp_connection_close(conn_, AMQP_REPLY_SUCCESS);
+        amqp_destroy_connection(conn_);
+        conn_ = nullptr;
+    }
+
+    double jitter(double base) {
+        return std::clamp(base + std::uniform_real_distribution<double>(-config_.noise, config_.noise)(rng_), 0.0, 100.0);
+    }
+
+    void publish(Device& device, bool software) {
+        std::string body;
+        const std::string* queue = &config_.hw_queue;
+        if (software) {
+            // Snapshot first, then deltas that rarely change anything
+            monitoring::SoftwareMetrics message;
+            message.set_device_id(device.id);
+            message.set_readable_date(readableDate());
+            message.set_ip_address("10.0." + std::to_string((&device - devices_.data()) / 250 % 256) + "." +
+                                   std::to_string((&device - devices_.data()) % 250 + 2));
+            message.set_uptime("up 3 days, 4 hours");
+            message.set_network_status("reachable");
+            message.set_os_version("\"Debian GNU/Linux 12 (bookworm)\"");
+            bool snapshot = device.inventory_sequence == 0;
+            message.set_inventory_kind(snapshot ? monitoring::SoftwareMetrics::SNAPSHOT
+                                                : monitoring::SoftwareMetrics::DELTA);
+            message.set_inventory_sequence(++device.inventory_sequence);
+            if (snapshot) {
+                (*message.mutable_services())["ssh"] = "active";
+                (*message.mutable_services())["cron"] = "active";
+                auto* app = message.add_applications();
+                app->set_name("shadow-agent");
+                app->set_version("latest");
+            }
+            body = message.SerializeAsString();
+            queue = &config_.sw_queue;
+        } else {
+            monitoring::HardwareMetrics message;
+            message.set_device_id(device.id);
+            message.set_readable_date(readableDate());
+            message.set_cpu_usage(percent(jitter(device.cpu_base)));
+            message.set_memory_usage(percent(jitter(device.memory_base)));
+            message.set_disk_usage_root(percent(jitter(device.disk_base)));
+            message.set_usb_devices("Bus 001 Device 001: ID 1d6b:0002 Linux Foundation 2.0 root hub");
+            message.set_gpio_state(device.gpio);
+            message.set_kernel_version("6.1.0-rpi7-rpi-v8");
+            message.set_hardware_model(device.model);
+            message.set_firmware_version("unknown");
+            body = message.SerializeAsString();
+        }
+
+        amqp_basic_properties_t props;
+        props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG | AMQP_BASIC_DELIVERY_MODE_FLAG;
+        props.content_type = amqp_cstring_bytes("application/x-protobuf");
+        props.delivery_mode = 2;
+        amqp_bytes_t bytes;
+        bytes.len = body.size();
+        bytes.bytes = const_cast<char*>(body.data());
+        int status = amqp_basic_publish(conn_, kChannel, amqp_empty_bytes, amqp_cstring_bytes(queue->c_str()),
+                                        0, 0, &props, bytes);
+        if (status != AMQP_STATUS_OK) {
+            std::cerr << "Publish failed: " << amqp_error_string2(status) << std::endl;
+            fail();
+            return;
+        }
+        in_flight_.insert(next_delivery_tag_++);
+        if (software) {
+            stats_.software_published++;
+        } else {
+            stats_.hardware_published++;
+            device.last_hardware_ms = wallMillis();
+        }
+    }
+
+    void pollConfirms() {
+        while (conn_ && !in_flight_.empty()) {
+            struct timeval tv = {0, 0};
+            amqp_frame_t frame;
+            int status = amqp_simple_wait_frame_noblock(conn_, &frame, &tv);
+            if (status == AMQP_STATUS_TIMEOUT) return;
+            if (status != AMQP_STATUS_OK) {
+                std::cerr << "Lost RabbitMQ connection: " << amqp_error_string2(status) << std::endl;
+                fail();
+                return;
+            }
+            if (frame.frame_type != AMQP_FRAME_METHOD) continue;
+
+            bool ack = frame.payload.method.id == AMQP_BASIC_ACK_METHOD;
+            if (ack || frame.payload.method.id == AMQP_BASIC_NACK_METHOD) {
+                uint64_t tag = ack ? static_cast<amqp_basic_ack_t*>(frame.payload.method.decoded)->delivery_tag
+                                   : static_cast<amqp_basic_nack_t*>(frame.payload.method.decoded)->delivery_tag;
+                bool multiple = ack ? static_cast<amqp_basic_ack_t*>(frame.payload.method.decoded)->multiple
+                                    : static_cast<amqp_basic_nack_t*>(frame.payload.method.decoded)->multiple;
+                auto first = multiple ? in_flight_.begin() : in_flight_.find(tag);
+                auto last = multiple ? in_flight_.upper_bound(tag)
+                                     : (first == in_flight_.end() ? first : std::next(first));
+                uint64_t count = std::distance(first, last);
+                in_flight_.erase(first, last);
+                (ack ? stats_.confirmed : stats_.nacked) += count;
+            } else if (frame.payload.method.id == AMQP_CHANNEL_CLOSE_METHOD ||
+                       frame.payload.method.id == AMQP_CONNECTION_CLOSE_METHOD) {
+                std::cerr << "Broker closed the publishing channel" << std::endl;
+                fail();
+                return;
+            }
+        }
+    }
+};
+
+// Device Sessions of a slice of the fleet, all driven by one completion queue
+class SessionDriver {
+public:
+    SessionDriver(const Config& config, std::vector<Device>& devices,
+                  const std::vector<std::unique_ptr<monitoring::MonitoringService::Stub>>& stubs,
+                  size_t begin, size_t end, Stats& stats)
+        : config_(config), devices_(devices), stats_(stats) {
+        for (size_t i = begin; i < end; ++i) {
+            auto stream = std::make_unique<Stream>();
+            stream->device = i;
+            stream->stub = stubs[i / config.devices_per_channel].get();
+            streams_.push_back(std::move(stream));
+        }
+    }
+
+    void run() {
+        for (auto& stream : streams_) {
+            connect(*stream);
+        }
+        stop_alarm_.Set(&cq_, std::chrono::system_clock::now() + std::chrono::milliseconds(200), &stop_tag_);
+
+        void* raw_tag;
+        bool ok;
+        while (cq_.Next(&raw_tag, &ok)) {
+            Tag* tag = static_cast<Tag*>(raw_tag);
+            if (tag->op == Op::StopCheck) {
+                checkStop();
+                continue;
+            }
+            handle(*tag->stream, tag->op, ok);
+        }
+    }
+
+private:
+    enum class Op { Start, Read, Write, Finish, Retry, StopCheck };
+
+    struct Stream;
+    struct Tag {
+        Op op;
+        Stream* stream;
+    };
+
+    struct Stream {
+        size_t device = 0;
+        monitoring::MonitoringService::Stub* stub = nullptr;
+        std::unique_ptr<grpc::ClientContext> context;
+        std::unique_ptr<grpc::ClientAsyncReaderWriter<monitoring::DeviceMessage, monitoring::ServerMessage>> rw;
+        monitoring::ServerMessage incoming;
+        monitoring::DeviceMessage outgoing;
+        std::deque<uint64_t> pending_acks;
+        uint64_t sequence = 0;
+        grpc::Status status;
+        grpc::Alarm retry;
+        bool connected = false;
+        bool writing = false;
+        bool finished = false;
+        bool retry_pending = false;
+        bool done = false;
+        Tag start_tag{Op::Start, this};
+        Tag read_tag{Op::Read, this};
+        Tag write_tag{Op::Write, this};
+        Tag finish_tag{Op::Finish, this};
+        Tag retry_tag{Op::Retry, this};
+    };
+
+    const Config& config_;
+    std::vector<Device>& devices_;
+    Stats& stats_;
+    grpc::CompletionQueue cq_;
+    std::vector<std::unique_ptr<Stream>> streams_;
+    grpc::Alarm stop_alarm_;
+    Tag stop_tag_{Op::StopCheck, nullptr};
+    bool stopping_ = false;
+    size_t done_ = 0;
+
+    void connect(Stream& stream) {
+        stats_.session_attempts++;
+        // The old stream lives in the old call's arena, release it first
+        stream.rw.reset();
+        stream.context = std::make_unique<grpc::ClientContext>();
+        stream.rw = stream.stub->PrepareAsyncSession(stream.context.get(), &cq_);
+        stream.sequence = 0;
+        stream.finished = false;
+        stream.pending_acks.clear();
+        stream.rw->StartCall(&stream.start_tag);
+    }
+
+    void write(Stream& stream) {
+        if (stream.writing || stream.finished || stream.pending_acks.empty()) return;
+        stream.outgoing.Clear();
+        stream.outgoing.set_device_id(devices_[stream.device].id);
+        stream.outgoing.set_sequence(++stream.sequence);
+        stream.outgoing.mutable_ack()->set_alert_id(stream.pending_acks.front());
+        stream.pending_acks.pop_front();
+        stream.writing = true;
+        stream.rw->Write(stream.outgoing, &stream.write_tag);
+    }
+
+    void handle(Stream& stream, Op op, bool ok) {
+        switch (op) {
+            case Op::Start:
+                if (!ok) {
+                    stream.rw->Finish(&stream.status, &stream.finish_tag);
+                    break;
+                }
+                stream.connected = true;
+                stats_.sessions_open++;
+                // Server-side evaluation, so the server streams the alerts itself
+                stream.outgoing.Clear();
+                stream.outgoing.set_device_id(devices_[stream.device].id);
+                stream.outgoing.set_sequence(++stream.sequence);
+                stream.outgoing.mutable_hello()->set_device_id(devices_[stream.device].id);
+                stream.writing = true;
+                stream.rw->Write(stream.outgoing, &stream.write_tag);
+                stream.rw->Read(&stream.incoming, &stream.read_tag);
+                break;
+            case Op::Read:
+                if (!ok) {
+                    stream.rw->Finish(&stream.status, &stream.finish_tag);
+                    break;
+                }
+                if (stream.incoming.has_alert()) {
+                    const auto& alert = stream.incoming.alert();
+                    int64_t now = wallMillis();
+                    stats_.alerts++;
+                    if (!alert.timestamp().empty()) {
+                        stats_.fanout.add(static_cast<double>(now - std::stoll(alert.timestamp())));
+                    }
+                    int64_t published = devices_[stream.device].last_hardware_ms;
+                    if (published > 0) {
+                        stats_.end_to_end.add(static_cast<double>(now - published));
+                    }
+                    if (alert.alert_id() != 0) {
+                        stream.pending_acks.push_back(alert.alert_id());
+                        write(stream);
+                    }
+                }
+                stream.rw->Read(&stream.incoming, &stream.read_tag);
+                break;
+            case Op::Write:
+                stream.writing = false;
+                if (stream.finished) {
+                    retryOrDone(stream);
+                } else if (ok) {
+                    write(stream);
+                }
+                break;
+            case Op::Finish:
+                stream.finished = true;
+                if (stream.connected) {
+                    stats_.sessions_open--;
+                    stream.connected = false;
+                }
+                if (!stopping_ && !stream.status.ok()) {
+                    stats_.sessionError(stream.status.error_code());
+                }
+                if (!stream.writing) {
+                    retryOrDone(stream);
+                }
+                break;
+            case Op::Retry:
+                stream.retry_pending = false;
+                if (ok && !stopping_) {
+                    connect(stream);
+                } else {
+                    markDone(stream);
+                }
+                break;
+            case Op::StopCheck:
+                break;
+        }
+    }
+
+    // The call is over and nothing is pending on it any more
+    void retryOrDone(Stream& stream) {
+        if (stopping_) {
+            markDone(stream);
+            return;
+        }
+        auto delay = std::chrono::milliseconds(2000 + std::uniform_int_distribution<int>(0, 3000)(rng()));
+        stream.retry_pending = true;
+        stream.retry.Set(&cq_, std::chrono::system_clock::now() + delay, &stream.retry_tag);
+    }
+
+    void markDone(Stream& stream) {
+        if (stream.done) return;
+        stream.done = true;
+        if (++done_ == streams_.size()) {
+            cq_.Shutdown();
+        }
+    }
+
+    void checkStop() {
+        if (!g_stop) {
+            stop_alarm_.Set(&cq_, std::chrono::system_clock::now() + std::chrono::milliseconds(200), &stop_tag_);
+            return;
+        }
+        stopping_ = true;
+        for (auto& stream : streams_) {
+            if (stream->retry_pending) {
+                stream->retry.Cancel();
+            } else if (!stream->finished) {
+                stream->context->TryCancel();
+            } else if (!stream->writing) {
+                markDone(*stream);
+            }
+        }
+        if (streams_.empty()) {
+            cq_.Shutdown();
+        }
+    }
+
+    static std::mt19937& rng() {
+        thread_local std::mt19937 generator(std::random_device{}());
+        return generator;
+    }
+};
+
+void printUsage() {
+    std::cerr << "Usage: fleet_loadgen [--devices N] [--server HOST:PORT] [--amqp HOST[:PORT]]\n"
+                 "                     [--hw-interval S] [--sw-interval S] [--cpu DIST] [--memory DIST] [--disk DIST]\n"
+                 "                     [--noise PCT] [--publishers N] [--grpc-threads N] [--devices-per-channel N]\n"
+                 "                     [--prefix ID] [--duration S] [--report S] [--no-sessions]\n"
+                 "DIST: uniform:LOW:HIGH | normal:MEAN:STDDEV | const:VALUE" << std::endl;
+}
+
+void printLatency(const char* name, const LatencyRecorder::Summary& summary) {
+    if (summary.count == 0) return;
+    std::printf("  %-22s n=%zu p50=%.0f p95=%.0f p99=%.0f max=%.0f ms\n", name, summary.count, summary.p50,
+                summary.p95, summary.p99, summary.max);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto distribution = [&](Distribution& out) {
+            if (!Distribution::parse(argv[++i], out)) {
+                std::cerr << "Bad distribution for " << arg << ": " << argv[i] << std::endl;
+                std::exit(1);
+            }
+        };
+        if (arg == "--devices" && i + 1 < argc) {
+            config.devices = std::stoul(argv[++i]);
+        } else if (arg == "--server" && i + 1 < argc) {
+            config.server = argv[++i];
+        } else if (arg == "--amqp" && i + 1 < argc) {
+            std::string address = argv[++i];
+            auto colon = address.find(':');
+            config.amqp_host = address.substr(0, colon);
+            if (colon != std::string::npos) config.amqp_port = std::stoi(address.substr(colon + 1));
+        } else if (arg == "--hw-interval" && i + 1 < argc) {
+            config.hw_interval = std::chrono::seconds(std::stol(argv[++i]));
+        } else if (arg == "--sw-interval" && i + 1 < argc) {
+            config.sw_interval = std::chrono::seconds(std::stol(argv[++i]));
+        } else if (arg == "--cpu" && i + 1 < argc) {
+            distribution(config.cpu);
+        } else if (arg == "--memory" && i + 1 < argc) {
+            distribution(config.memory);
+        } else if (arg == "--disk" && i + 1 < argc) {
+            distribution(config.disk);
+        } else if (arg == "--noise" && i + 1 < argc) {
+            config.noise = std::stod(argv[++i]);
+        } else if (arg == "--publishers" && i + 1 < argc) {
+            config.publishers = std::max<size_t>(std::stoul(argv[++i]), 1);
+        } else if (arg == "--grpc-threads" && i + 1 < argc) {
+            config.grpc_threads = std::max<size_t>(std::stoul(argv[++i]), 1);
+        } else if (arg == "--devices-per-channel" && i + 1 < argc) {
+            config.devices_per_channel = std::max<size_t>(std::stoul(argv[++i]), 1);
+        } else if (arg == "--prefix" && i + 1 < argc) {
+            config.prefix = argv[++i];
+        } else if (arg == "--duration" && i + 1 < argc) {
+            config.duration = std::chrono::seconds(std::stol(argv[++i]));
+        } else if (arg == "--report" && i + 1 < argc) {
+            config.report = std::chrono::seconds(std::max(std::stol(argv[++i]), 1L));
+        } else if (arg == "--no-sessions") {
+            config.sessions = false;
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (config.hw_interval.count() <= 0 || config.sw_interval.count() <= 0) {
+        std::cerr << "Intervals must be at least one second" << std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    std::mt19937 rng(42);
+    std::vector<Device> devices(config.devices);
+    for (size_t i = 0; i < devices.size(); ++i) {
+        devices[i].id = config.prefix + std::to_string(i);
+        devices[i].cpu_base = config.cpu.sample(rng);
+        devices[i].memory_base = config.memory.sample(rng);
+        devices[i].disk_base = config.disk.sample(rng);
+        devices[i].model = kModels[i % (sizeof(kModels) / sizeof(kModels[0]))];
+        devices[i].gpio = static_cast<int>(i % 7);
+    }
+
+    Stats stats;
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Publisher>> publishers;
+    size_t per_publisher = (devices.size() + config.publishers - 1) / config.publishers;
+    for (size_t begin = 0, p = 0; begin < devices.size(); begin += per_publisher, ++p) {
+        publishers.push_back(std::make_unique<Publisher>(config, devices, begin,
+                                                         std::min(devices.size(), begin + per_publisher), stats,
+                                                         static_cast<uint32_t>(p + 1)));
+        threads.emplace_back(&Publisher::run, publishers.back().get());
+    }
+
+    // Each channel is its own HTTP/2 connection, so no single connection
+    // carries more than --devices-per-channel streams
+    std::vector<std::unique_ptr<monitoring::MonitoringService::Stub>> stubs;
+    std::vector<std::unique_ptr<SessionDriver>> drivers;
+    if (config.sessions) {
+        for (size_t begin = 0; begin < devices.size(); begin += config.devices_per_channel) {
+            grpc::ChannelArguments args;
+            args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+            args.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS, 60000);
+            stubs.push_back(monitoring::MonitoringService::NewStub(
+                grpc::CreateCustomChannel(config.server, grpc::InsecureChannelCredentials(), args)));
+        }
+        size_t per_driver = (devices.size() + config.grpc_threads - 1) / config.grpc_threads;
+        for (size_t begin = 0; begin < devices.size(); begin += per_driver) {
+            drivers.push_back(std::make_unique<SessionDriver>(config, devices, stubs, begin,
+                                                              std::min(devices.size(), begin + per_driver), stats));
+            threads.emplace_back(&SessionDriver::run, drivers.back().get());
+        }
+    }
+
+    std::cout << "Simulating " << devices.size() << " device(s): hardware every " << config.hw_interval.count()
+              << " s, software every " << config.sw_interval.count() << " s, " << publishers.size()
+              << " publisher(s), " << drivers.size() << " session thread(s), " << stubs.size() << " channel(s)"
+              << std::endl;
+
+    auto start = Clock::now();
+    auto last = start;
+    uint64_t last_published = 0, last_alerts = 0, last_errors = 0, last_nacked = 0;
+    uint64_t total_errors = 0;
+    while (!g_stop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        auto now = Clock::now();
+        if (config.duration.count() > 0 && now - start >= config.duration) {
+            g_stop = true;
+        }
+        if (now - last < config.report && !g_stop) continue;
+
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+        uint64_t published = stats.hardware_published + stats.software_published;
+        uint64_t alerts = stats.alerts;
+        uint64_t errors = stats.publish_errors;
+        uint64_t nacked = stats.nacked;
+        std::map<std::string, uint64_t> session_errors;
+        {
+            std::lock_guard<std::mutex> lock(stats.errors_mutex);
+            session_errors.swap(stats.session_errors);
+        }
+        uint64_t session_failures = 0;
+        for (const auto& [code, count] : session_errors) session_failures += count;
+        total_errors += session_failures;
+
+        std::printf("[%5.0f s] publish %.1f msg/s (%llu total, %llu confirmed, %llu nacked, %llu errors) | "
+                    "sessions %llu/%zu open, %.1f session errors/s | alerts %.1f/s\n",
+                    std::chrono::duration<double>(now - start).count(), (published - last_published) / seconds,
+                    static_cast<unsigned long long>(published), static_cast<unsigned long long>(stats.confirmed.load()),
+                    static_cast<unsigned long long>(nacked), static_cast<unsigned long long>(errors),
+                    static_cast<unsigned long long>(stats.sessions_open.load()),
+                    config.sessions ? devices.size() : 0, session_failures / seconds,
+                    (alerts - last_alerts) / seconds);
+        printLatency("alert fan-out", stats.fanout.take());
+        printLatency("sample -> alert", stats.end_to_end.take());
+        for (const auto& [code, count] : session_errors) {
+            std::printf("  session error %-18s %llu\n", code.c_str(), static_cast<unsigned long long>(count));
+        }
+        if (errors > last_errors || nacked > last_nacked) {
+            std::printf("  broker: %llu publish error(s), %llu nack(s) this interval\n",
+                        static_cast<unsigned long long>(errors - last_errors),
+                        static_cast<unsigned long long>(nacked - last_nacked));
+        }
+        std::fflush(stdout);
+        last_published = published;
+        last_alerts = alerts;
+        last_errors = errors;
+        last_nacked = nacked;
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::printf("Done: %llu hardware + %llu software message(s), %llu confirmed, %llu nacked, "
+                "%llu publish error(s), %llu alert(s), %llu session attempt(s), %llu session error(s)\n",
+                static_cast<unsigned long long>(stats.hardware_published.load()),
+                static_cast<unsigned long long>(stats.software_published.load()),
+                static_cast<unsigned long long>(stats.confirmed.load()),
+                static_cast<unsigned long long>(stats.nacked.load()),
+                static_cast<unsigned long long>(stats.publish_errors.load()),
+                static_cast<unsigned long long>(stats.alerts.load()),
+                static_cast<unsigned long long>(stats.session_attempts.load()),
+                static_cast<unsigned long long>(total_errors));
+    return 0;
+}
@@ -0,0 +1,222 @@
+// Script-mode JSON parsing: the previous std::ifstream >> nlohmann::json path
+// against the mmap + JsonCursor reader now used by MetricsCollector.
+//
+//   json_reader_bench [--logs DIR] [--iterations N]
+//
+// Both paths extract the same fields into the same kind of structs. The files
+// collect_metrics.sh writes may hold raw control characters in strings
+// (a hostname with its newline), which nlohmann::json rejects: such files
+// are benchmarked through an escaped copy, and reported.
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "json_file_reader.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Hardware {
+    std::string readable_date, cpu_usage, memory_usage, disk_usage, usb_data;
+    std::string kernel_version, hardware_model, firmware_version;
+    int gpio_state = 0;
+};
+
+struct Software {
+    std::string readable_date, ip_address, uptime, network_status, os_version;
+    std::vector<std::pair<std::string, std::string>> applications;
+    std::map<std::string, std::string> services;
+};
+
+// Same extraction as the former MetricsCollector::parse*Metrics
+Hardware streamHardware(const std::string& path) {
+    std::ifstream file(path);
+    nlohmann::json json;
+    file >> json;
+    Hardware metrics;
+    metrics.readable_date = json["readable_date"];
+    metrics.cpu_usage = json["cpu_usage"];
+    metrics.memory_usage = json["memory_usage"];
+    metrics.disk_usage = json["disk_usage"];
+    metrics.usb_data = json.contains("usb_state") ? json["usb_state"].get<std::string>() : "none";
+    metrics.gpio_state = json["gpio_state"];
+    metrics.kernel_version = json.value("kernel_version", "");
+    metrics.hardware_model = json.value("hardware_model", "");
+    metrics.firmware_version = json.value("firmware_version", "");
+    return metrics;
+}
+
+Software streamSoftware(const std::string& path) {
+    std::ifstream file(path);
+    nlohmann::json json;
+    file >> json;
+    Software metrics;
+    metrics.readable_date = json["readable_date"];
+    metrics.ip_address = json["ip_address"];
+    metrics.uptime = json["uptime"];
+    metrics.network_status = json["network_status"];
+    metrics.os_version = json.value("os_version", "");
+    if (json.contains("applications") && json["applications"].is_array()) {
+        for (const auto& app : json["applications"]) {
+            metrics.applications.push_back({app["name"].get<std::string>(), app["version"].get<std::string>()});
+        }
+    }
+    for (auto& [service, status] : json["services"].items()) {
+        metrics.services[service] = status;
+    }
+    return metrics;
+}
+
+Hardware mappedHardware(const std::string& path) {
+    MappedFile file(path);
+    JsonCursor json(file.data());
+    Hardware metrics;
+    metrics.usb_data = "none";
+    json.forEachMember([&](std::string_view key) {
+        if (key == "readable_date") json.readString(metrics.readable_date);
+        else if (key == "cpu_usage") json.readString(metrics.cpu_usage);
+        else if (key == "memory_usage") json.readString(metrics.memory_usage);
+        else if (key == "disk_usage") json.readString(metrics.disk_usage);
+        else if (key == "gpio_state") metrics.gpio_state = static_cast<int>(json.readInt());
+        else if (key == "usb_state") json.readString(metrics.usb_data);
+        else if (key == "kernel_version") json.readString(metrics.kernel_version);
+        else if (key == "hardware_model") json.readString(metrics.hardware_model);
+        else if (key == "firmware_version") json.readString(metrics.firmware_version);
+    });
+    json.expectEnd();
+    return metrics;
+}
+
+Software mappedSoftware(const std::string& path) {
+    MappedFile file(path);
+    JsonCursor json(file.data());
+    Software metrics;
+    std::string name, value;
+    json.forEachMember([&](std::string_view key) {
+        if (key == "readable_date") json.readString(metrics.readable_date);
+        else if (key == "ip_address") json.readString(metrics.ip_address);
+        else if (key == "uptime") json.readString(metrics.uptime);
+        else if (key == "network_status") json.readString(metrics.network_status);
+        else if (key == "os_version") json.readString(metrics.os_version);
+        else if (key == "applications" && json.peek() == JsonCursor::Type::Array) {
+            json.forEachElement([&]() {
+                name.clear();
+                value.clear();
+                json.forEachMember([&](std::string_view field) {
+                    if (field == "name") json.readString(name);
+                    else if (field == "version") json.readString(value);
+                });
+                metrics.applications.emplace_back(name, value);
+            });
+        } else if (key == "services") {
+            json.forEachMember([&](std::string_view service) {
+                json.readString(value);
+                metrics.services[std::string(service)] = value;
+            });
+        }
+    });
+    json.expectEnd();
+    return metrics;
+}
+
+// Copy with control characters inside strings escaped, empty if none were found
+std::string escapedCopy(const std::string& path, const fs::path& scratch) {
+    std::ifstream in(path, std::ios::binary);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::string out;
+    bool in_string = false;
+    bool changed = false;
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (in_string && c == '\\' && i + 1 < text.size()) {
+            out += c;
+            out += text[++i];
+            continue;
+        }
+        if (c == '"') in_string = !in_string;
+        if (in_string && static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+            changed = true;
+            continue;
+        }
+        out += c;
+    }
+    if (!changed) return "";
+    fs::create_directories(scratch);
+    fs::path copy = scratch / fs::path(path).filename();
+    std::ofstream(copy, std::ios::binary) << out;
+    return copy.string();
+}
+
+template <typename Parse>
+double nanosPerParse(const std::vector<std::string>& files, size_t iterations, Parse parse) {
+    size_t sink = 0;
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        for (const auto& file : files) {
+            sink += parse(file).readable_date.size();
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    if (sink == 0) std::cerr << "(no data)" << std::endl;
+    return ns / static_cast<double>(iterations * files.size());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string logs = "../client/logs";
+    size_t iterations = 20000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--logs" && i + 1 < argc) {
+            logs = argv[++i];
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> hardware, software;
+    fs::path scratch = fs::temp_directory_path() / "json_reader_bench";
+    for (const auto& entry : fs::directory_iterator(logs)) {
+        std::string name = entry.path().filename().string();
+        if (entry.path().extension() != ".json") continue;
+        std::string path = entry.path().string();
+        std::string copy = escapedCopy(path, scratch);
+        if (!copy.empty()) {
+            std::cout << name << ": raw control characters in strings, rejected by nlohmann::json; using an escaped copy"
+                      << std::endl;
+            path = copy;
+        }
+        if (name.rfind("hardware_metrics_", 0) == 0) hardware.push_back(path);
+        else if (name.rfind("software_metrics_", 0) == 0) software.push_back(path);
+    }
+    if (hardware.empty() || software.empty()) {
+        std::cerr << "No hardware_metrics_*.json / software_metrics_*.json in " << logs << std::endl;
+        return 1;
+    }
+
+    std::printf("%-9s %6s %16s %16s %8s\n", "file", "count", "ifstream+json", "mmap+cursor", "speedup");
+    double stream_ns = nanosPerParse(hardware, iterations, streamHardware);
+    double mapped_ns = nanosPerParse(hardware, iterations, mappedHardware);
+    std::printf("%-9s %6zu %13.0f ns %13.0f ns %7.1fx\n", "hardware", hardware.size(), stream_ns, mapped_ns,
+                stream_ns / mapped_ns);
+    stream_ns = nanosPerParse(software, iterations, streamSoftware);
+    mapped_ns = nanosPerParse(software, iterations, mappedSoftware);
+    std::printf("%-9s %6zu %13.0f ns %13.0f ns %7.1fx\n", "software", software.size(), stream_ns, mapped_ns,
+                stream_ns / mapped_ns);
+    return 0;
+}
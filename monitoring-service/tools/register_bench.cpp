@@ -0,0 +1,299 @@
+// Thread count and idle CPU of the monitoring server per connected device,
+// for the RegisterDevice alert streams.
+//
+//   register_bench [--connections N[,N...]] [--mode callback|sync|both]
+//                  [--channels N] [--idle S] [--ready-timeout S] [--port P]
+//
+// Each run forks a server process serving RegisterDevice on 127.0.0.1:
+//   callback  AlertStreamReactor, as in monitoring_service
+//   sync      the previous handler: one synchronous gRPC thread per stream,
+//             polling IsCancelled() every 100 ms
+// and a client process that opens the streams with callback-API readers
+// spread over --channels connections and waits for every welcome alert.
+// Once they are all established, this process samples the server's
+// /proc/PID/stat and status over --idle seconds: threads, RSS and CPU (100%
+// = one core). It never uses gRPC itself, so forking stays safe.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <grpcpp/grpcpp.h>
+#include "alert_manager.h"
+#include "alert_stream_reactor.h"
+#include "monitoring.grpc.pb.h"
+
+namespace {
+
+struct Config {
+    std::vector<size_t> connections{1000, 10000, 50000};
+    std::vector<std::string> modes{"callback", "sync"};
+    size_t channels = 64;
+    std::chrono::seconds idle{30};
+    std::chrono::seconds ready_timeout{180};
+    int port = 50151;
+};
+
+class CallbackService final
+    : public monitoring::MonitoringService::WithCallbackMethod_RegisterDevice<monitoring::MonitoringService::Service> {
+public:
+    explicit CallbackService(AlertManager* alert_manager) : alert_manager_(alert_manager) {}
+
+    grpc::ServerWriteReactor<monitoring::Alert>* RegisterDevice(grpc::CallbackServerContext*,
+                                                              const monitoring::DeviceInfo* request) override {
+        return new AlertStreamReactor(alert_manager_, request->device_id());
+    }
+
+private:
+    AlertManager* alert_manager_;
+};
+
+// RegisterDevice as monitoring_service implemented it before AlertStreamReactor
+class SyncService final : public monitoring::MonitoringService::Service {
+public:
+    grpc::Status RegisterDevice(grpc::ServerContext* context, const monitoring::DeviceInfo* request,
+                                grpc::ServerWriter<monitoring::Alert>* writer) override {
+        monitoring::Alert welcome;
+        welcome.set_device_id(request->device_id());
+        welcome.set_alert_type("CONNECTION_ESTABLISHED");
+        writer->Write(welcome);
+        while (!context->IsCancelled()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        return grpc::Status::OK;
+    }
+};
+
+[[noreturn]] void runServer(const std::string& mode, int port, int ready_fd) {
+    // AlertManager logs every registration; keep the measurement quiet
+    std::cout.setstate(std::ios::failbit);
+    AlertManager alert_manager;
+    CallbackService callback_service(&alert_manager);
+    SyncService sync_service;
+
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort("127.0.0.1:" + std::to_string(port), grpc::InsecureServerCredentials());
+    if (mode == "callback") {
+        builder.RegisterService(&callback_service);
+    } else {
+        builder.RegisterService(&sync_service);
+    }
+    // Same keepalive settings as monitoring_service
+    builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_TIME_MS, 5 * 60 * 1000);
+    builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, 20 * 1000);
+    builder.AddChannelArgument(GRPC_ARG_HTTP2_MIN_RECV_PING_INTERVAL_WITHOUT_DATA_MS, 30 * 1000);
+    std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+    char ready = server ? 1 : 0;
+    if (::write(ready_fd, &ready, 1) != 1 || !server) {
+        std::_Exit(1);
+    }
+    server->Wait();
+    std::_Exit(0);
+}
+
+// Holds one stream open and counts its welcome alert
+class StreamReader : public grpc::ClientReadReactor<monitoring::Alert> {
+public:
+    StreamReader(monitoring::MonitoringService::Stub* stub, const std::string& device_id,
+                 std::atomic<size_t>& welcomed, std::atomic<size_t>& failed)
+        : welcomed_(welcomed), failed_(failed) {
+        request_.set_device_id(device_id);
+        stub->async()->RegisterDevice(&context_, &request_, this);
+        StartRead(&alert_);
+        StartCall();
+    }
+
+    void OnReadDone(bool ok) override {
+        if (!ok) return;                        // OnDone follows
+        if (!welcomed_once_) {
+            welcomed_once_ = true;
+            ++welcomed_;
+        }
+        StartRead(&alert_);
+    }
+
+    void OnDone(const grpc::Status&) override {
+        ++failed_;
+    }
+
+private:
+    grpc::ClientContext context_;
+    monitoring::DeviceInfo request_;
+    monitoring::Alert alert_;
+    bool welcomed_once_ = false;
+    std::atomic<size_t>& welcomed_;
+    std::atomic<size_t>& failed_;
+};
+
+[[noreturn]] void runClients(const Config& config, size_t connections, int report_fd) {
+    std::vector<std::unique_ptr<monitoring::MonitoringService::Stub>> stubs;
+    for (size_t i = 0; i < config.channels; ++i) {
+        // A local subchannel pool gives every channel its own TCP connection
+        grpc::ChannelArguments args;
+        args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+        stubs.push_back(monitoring::MonitoringService::NewStub(grpc::CreateCustomChannel(
+            "127.0.0.1:" + std::to_string(config.port), grpc::InsecureChannelCredentials(), args)));
+    }
+
+    std::atomic<size_t> welcomed{0};
+    std::atomic<size_t> failed{0};
+    std::vector<std::unique_ptr<StreamReader>> readers;
+    readers.reserve(connections);
+    for (size_t i = 0; i < connections; ++i) {
+        readers.push_back(std::make_unique<StreamReader>(stubs[i % stubs.size()].get(),
+                                                         "bench-" + std::to_string(i), welcomed, failed));
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + config.ready_timeout;
+    while (welcomed + failed < connections && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    size_t established = welcomed;
+    if (::write(report_fd, &established, sizeof(established)) != sizeof(established)) {
+        std::_Exit(1);
+    }
+    // Streams stay open until the parent kills this process
+    while (true) {
+        ::pause();
+    }
+}
+
+struct ProcessSample {
+    uint64_t cpu_ticks = 0;
+    long threads = 0;
+    long rss_kb = 0;
+};
+
+bool sampleProcess(pid_t pid, ProcessSample& out) {
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (!std::getline(stat, line)) return false;
+    // Fields after "(comm)": 14 utime, 15 stime
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    uint64_t utime = 0, stime = 0;
+    for (int index = 3; fields >> field && index <= 15; ++index) {
+        if (index == 14) utime = std::stoull(field);
+        if (index == 15) stime = std::stoull(field);
+    }
+    out.cpu_ticks = utime + stime;
+
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    while (std::getline(status, line)) {
+        if (line.rfind("Threads:", 0) == 0) out.threads = std::stol(line.substr(8));
+        if (line.rfind("VmRSS:", 0) == 0) out.rss_kb = std::stol(line.substr(6));
+    }
+    return true;
+}
+
+void runOnce(const Config& config, const std::string& mode, size_t connections) {
+    int ready_pipe[2], report_pipe[2];
+    if (::pipe(ready_pipe) != 0 || ::pipe(report_pipe) != 0) {
+        std::perror("pipe");
+        return;
+    }
+
+    pid_t server = ::fork();
+    if (server == 0) {
+        runServer(mode, config.port, ready_pipe[1]);
+    }
+    char ready = 0;
+    if (::read(ready_pipe[0], &ready, 1) != 1 || ready != 1) {
+        std::fprintf(stderr, "%s: server did not start\n", mode.c_str());
+        ::kill(server, SIGKILL);
+        ::waitpid(server, nullptr, 0);
+        return;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    pid_t clients = ::fork();
+    if (clients == 0) {
+        runClients(config, connections, report_pipe[1]);
+    }
+    size_t established = 0;
+    if (::read(report_pipe[0], &established, sizeof(established)) != sizeof(established)) {
+        established = 0;
+    }
+    double ramp = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    ProcessSample before, after;
+    sampleProcess(server, before);
+    std::this_thread::sleep_for(config.idle);
+    sampleProcess(server, after);
+    double cpu_percent = static_cast<double>(after.cpu_ticks - before.cpu_ticks) * 100.0 /
+                         static_cast<double>(::sysconf(_SC_CLK_TCK)) / static_cast<double>(config.idle.count());
+
+    std::printf("%-9s %11zu %11zu %8.1f %8ld %9.1f %12.2f\n", mode.c_str(), connections, established, ramp,
+                after.threads, static_cast<double>(after.rss_kb) / 1024.0, cpu_percent);
+    std::fflush(stdout);
+
+    ::kill(clients, SIGKILL);
+    ::kill(server, SIGKILL);
+    ::waitpid(clients, nullptr, 0);
+    ::waitpid(server, nullptr, 0);
+    for (int fd : {ready_pipe[0], ready_pipe[1], report_pipe[0], report_pipe[1]}) {
+        ::close(fd);
+    }
+}
+
+void printUsage() {
+    std::cerr << "usage: register_bench [--connections N[,N...]] [--mode callback|sync|both]\n"
+                 "                      [--channels N] [--idle S] [--ready-timeout S] [--port P]" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--connections" && i + 1 < argc) {
+            config.connections.clear();
+            std::stringstream list(argv[++i]);
+            std::string count;
+            while (std::getline(list, count, ',')) {
+                config.connections.push_back(std::stoul(count));
+            }
+        } else if (arg == "--mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "both") {
+                config.modes = {"callback", "sync"};
+            } else if (mode == "callback" || mode == "sync") {
+                config.modes = {mode};
+            } else {
+                printUsage();
+                return 1;
+            }
+        } else if (arg == "--channels" && i + 1 < argc) {
+            config.channels = std::max<size_t>(std::stoul(argv[++i]), 1);
+        } else if (arg == "--idle" && i + 1 < argc) {
+            config.idle = std::chrono::seconds(std::max(std::stol(argv[++i]), 1L));
+        } else if (arg == "--ready-timeout" && i + 1 < argc) {
+            config.ready_timeout = std::chrono::seconds(std::stol(argv[++i]));
+        } else if (arg == "--port" && i + 1 < argc) {
+            config.port = std::stoi(argv[++i]);
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::printf("%-9s %11s %11s %8s %8s %9s %12s\n", "mode", "connections", "established", "ramp s",
+                "threads", "RSS MB", "idle CPU %");
+    for (const auto& mode : config.modes) {
+        for (size_t connections : config.connections) {
+            runOnce(config, mode, connections);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,191 @@
+#include "sample_payloads.h"
+#include <cstdio>
+#include <map>
+#include <nlohmann/json.hpp>
+#include "monitoring.pb.h"
+
+namespace {
+
+const std::vector<std::string> kKernels = {
+    "6.1.0-rpi7-rpi-v8", "6.1.21-v8+", "6.6.20+rpt-rpi-v8", "5.15.84-v7l+",
+};
+const std::vector<std::string> kModels = {
+    "Raspberry Pi 4 Model B Rev 1.4", "Raspberry Pi 4 Model B Rev 1.5",
+    "Raspberry Pi 3 Model B Plus Rev 1.3", "Raspberry Pi Zero 2 W Rev 1.0",
+};
+const std::vector<std::string> kOsVersions = {
+    "\"Debian GNU/Linux 12 (bookworm)\"", "\"Raspbian GNU/Linux 11 (bullseye)\"",
+};
+const std::vector<std::string> kUsbStates = {
+    "none",
+    "Bus 001 Device 001: ID 1d6b:0002 Linux Foundation 2.0 root hub",
+    "Bus 001 Device 001: ID 1d6b:0002 Linux Foundation 2.0 root hub | "
+    "Bus 001 Device 002: ID 2109:3431 VIA Labs, Inc. Hub",
+    "Bus 001 Device 001: ID 1d6b:0002 Linux Foundation 2.0 root hub | "
+    "Bus 001 Device 003: ID 0781:5567 SanDisk Corp. Cruzer Blade",
+};
+const std::vector<std::string> kServices = {"ssh", "cron", "mosquitto"};
+const std::vector<std::pair<std::string, std::string>> kApplications = {
+    {"node-red", "3.1.0"}, {"grafana-agent", "0.39.1"}, {"telegraf", "1.29.2"},
+    {"shadow-agent", "latest"}, {"ota-client", "1.2.0"}, {"modbus-bridge", "0.4.2"},
+};
+
+} // namespace
+
+SamplePayloads::SamplePayloads(uint32_t seed)
+    : rng_(seed), inventory_sequence_(0) {
+}
+
+template <typename T>
+const T& SamplePayloads::pick(const std::vector<T>& values) {
+    return values[std::uniform_int_distribution<size_t>(0, values.size() - 1)(rng_)];
+}
+
+std::string SamplePayloads::deviceId() {
+    return "rpi-" + std::to_string(std::uniform_int_distribution<int>(1000, 60000)(rng_));
+}
+
+std::string SamplePayloads::percent(double low, double high) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%.1f%%", std::uniform_real_distribution<double>(low, high)(rng_));
+    return buf;
+}
+
+std::string SamplePayloads::readableDate() {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "2025-%02d-%02d_%02d-%02d-%02d",
+                  std::uniform_int_distribution<int>(1, 12)(rng_), std::uniform_int_distribution<int>(1, 28)(rng_),
+                  std::uniform_int_distribution<int>(0, 23)(rng_), std::uniform_int_distribution<int>(0, 59)(rng_),
+                  std::uniform_int_distribution<int>(0, 59)(rng_));
+    return buf;
+}
+
+std::string SamplePayloads::next(Kind kind, Format format) {
+    std::string device_id = deviceId();
+    std::string date = readableDate();
+
+    if (kind == Kind::Hardware) {
+        std::string cpu = percent(1, 99);
+        std::string memory = percent(10, 95);
+        std::string disk = percent(5, 90);
+        const std::string& usb = pick(kUsbStates);
+        int gpio = std::uniform_int_distribution<int>(0, 6)(rng_);
+        const std::string& kernel = pick(kKernels);
+        const std::string& model = pick(kModels);
+
+        if (format == Format::Protobuf) {
+            monitoring::HardwareMetrics message;
+            message.set_device_id(device_id);
+            message.set_readable_date(date);
+            message.set_cpu_usage(cpu);
+            message.set_memory_usage(memory);
+            message.set_disk_usage_root(disk);
+            message.set_usb_devices(usb);
+            message.set_gpio_state(gpio);
+            message.set_kernel_version(kernel);
+            message.set_hardware_model(model);
+            message.set_firmware_version("unknown");
+            return message.SerializeAsString();
+        }
+        nlohmann::json json;
+        json["device_id"] = device_id;
+        json["readable_date"] = date;
+        json["cpu_usage"] = cpu;
+        json["memory_usage"] = memory;
+        json["disk_usage"] = disk;
+        json["usb_state"] = usb;
+        json["gpio_state"] = gpio;
+        json["kernel_version"] = kernel;
+        json["hardware_model"] = model;
+        json["firmware_version"] = "unknown";
+        return json.dump();
+    }
+
+    bool snapshot = kind == Kind::SoftwareSnapshot;
+    std::string ip = "192.168." + std::to_string(std::uniform_int_distribution<int>(0, 10)(rng_)) + "." +
+                     std::to_string(std::uniform_int_distribution<int>(2, 254)(rng_));
+    std::string uptime = "up " + std::to_string(std::uniform_int_distribution<int>(1, 6)(rng_)) + " days, " +
+                         std::to_string(std::uniform_int_distribution<int>(1, 23)(rng_)) + " hours, " +
+                         std::to_string(std::uniform_int_distribution<int>(1, 59)(rng_)) + " minutes";
+    const char* network = std::uniform_int_distribution<int>(0, 9)(rng_) ? "reachable" : "unreachable";
+    const std::string& os = pick(kOsVersions);
+    uint64_t sequence = ++inventory_sequence_;
+
+    // Snapshots carry the whole inventory, deltas usually nothing or one change
+    std::map<std::string, std::string> services;
+    std::vector<std::pair<std::string, std::string>> applications;
+    if (snapshot) {
+        for (const auto& service : kServices) {
+            services[service] = std::uniform_int_distribution<int>(0, 7)(rng_) ? "active" : "inactive";
+        }
+        size_t count = std::uniform_int_distribution<size_t>(2, kApplications.size())(rng_);
+        applications.assign(kApplications.begin(), kApplications.begin() + count);
+    } else if (std::uniform_int_distribution<int>(0, 4)(rng_) == 0) {
+        services[pick(kServices)] = "inactive";
+    }
+
+    if (format == Format::Protobuf) {
+        monitoring::SoftwareMetrics message;
+        message.set_device_id(device_id);
+        message.set_readable_date(date);
+        message.set_ip_address(ip);
+        message.set_uptime(uptime);
+        message.set_network_status(network);
+        message.set_os_version(os);
+        message.set_inventory_kind(snapshot ? monitoring::SoftwareMetrics::SNAPSHOT
+                                            : monitoring::SoftwareMetrics::DELTA);
+        message.set_inventory_sequence(sequence);
+        for (const auto& [name, version] : applications) {
+            auto* app = message.add_applications();
+            app->set_name(name);
+            app->set_version(version);
+        }
+        message.mutable_services()->insert(services.begin(), services.end());
+        return message.SerializeAsString();
+    }
+    nlohmann::json json;
+    json["device_id"] = device_id;
+    json["readable_date"] = date;
+    json["ip_address"] = ip;
+    json["uptime"] = uptime;
+    json["network_status"] = network;
+    json["os_version"] = os;
+    json["inventory_kind"] = snapshot ? "snapshot" : "delta";
+    json["inventory_sequence"] = sequence;
+    nlohmann::json apps = nlohmann::json::array();
+    for (const auto& [name, version] : applications) {
+        apps.push_back({{"name", name}, {"version", version}});
+    }
+    json["applications"] = apps;
+    json["services"] = nlohmann::json(services);
+    if (!snapshot) {
+        json["removed_services"] = nlohmann::json::array();
+        json["removed_applications"] = nlohmann::json::array();
+    }
+    return json.dump();
+}
+
+std::vector<std::string> SamplePayloads::generate(size_t count) {
+    static const Kind kinds[] = {Kind::Hardware, Kind::SoftwareSnapshot, Kind::SoftwareDelta};
+    static const Format formats[] = {Format::Json, Format::Protobuf};
+
+    std::vector<std::string> samples;
+    samples.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        samples.push_back(next(kinds[i % 3], formats[(i / 3) % 2]));
+    }
+    return samples;
+}
+
+const char* SamplePayloads::kindName(Kind kind) {
+    switch (kind) {
+        case Kind::Hardware: return "hardware";
+        case Kind::SoftwareSnapshot: return "software snapshot";
+        case Kind::SoftwareDelta: return "software delta";
+    }
+    return "";
+}
+
+const char* SamplePayloads::formatName(Format format) {
+    return format == Format::Json ? "json" : "protobuf";
+}
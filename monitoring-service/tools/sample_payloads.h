@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Synthetic metric payloads shaped like the ones RabbitMQSender publishes
+// (same JSON keys, same protobuf messages), for dictionary training and
+// benchmarks when no captured traffic is at hand.
+class SamplePayloads {
+public:
+    enum class Kind { Hardware, SoftwareSnapshot, SoftwareDelta };
+    enum class Format { Json, Protobuf };
+
+    explicit SamplePayloads(uint32_t seed);
+
+    std::string next(Kind kind, Format format);
+
+    // Mixed set covering every kind and format
+    std::vector<std::string> generate(size_t count);
+
+    static const char* kindName(Kind kind);
+    static const char* formatName(Format format);
+
+private:
+    std::mt19937 rng_;
+    uint64_t inventory_sequence_;
+
+    std::string deviceId();
+    std::string percent(double low, double high);
+    std::string readableDate();
+    template <typename T>
+    const T& pick(const std::vector<T>& values);
+};
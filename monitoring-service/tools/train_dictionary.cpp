@@ -0,0 +1,92 @@
+// Train the zstd dictionary used by RabbitMQSender --compress.
+//
+//   train_dictionary --dict-id 1 --out ../dictionaries/metrics-v1.zdict [--from DIR] [--samples N] [--size BYTES]
+//
+// Samples come from --from (one captured message body per file) or, by
+// default, from synthetic payloads shaped like the agent's. The dictionary id
+// is the version the agents announce in x-dict-id: bump it for every new
+// dictionary and keep the old files on the server until no agent uses them.
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+// fastCover parameters (dictionary id) are only in the static-linking API
+#define ZDICT_STATIC_LINKING_ONLY
+#include <zdict.h>
+#include "sample_payloads.h"
+
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv) {
+    unsigned dict_id = 0;
+    std::string out_path;
+    std::string from_dir;
+    size_t sample_count = 30000;
+    size_t dict_size = 4096;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dict-id" && i + 1 < argc) {
+            dict_id = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--out" && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (arg == "--from" && i + 1 < argc) {
+            from_dir = argv[++i];
+        } else if (arg == "--samples" && i + 1 < argc) {
+            sample_count = std::stoul(argv[++i]);
+        } else if (arg == "--size" && i + 1 < argc) {
+            dict_size = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (dict_id == 0 || out_path.empty()) {
+        std::cerr << "Usage: train_dictionary --dict-id N --out FILE [--from DIR] [--samples N] [--size BYTES]" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> samples;
+    if (!from_dir.empty()) {
+        for (const auto& entry : fs::directory_iterator(from_dir)) {
+            if (!entry.is_regular_file()) continue;
+            std::ifstream file(entry.path(), std::ios::binary);
+            samples.emplace_back((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        }
+    } else {
+        samples = SamplePayloads(1).generate(sample_count);
+    }
+
+    std::string buffer;
+    std::vector<size_t> sizes;
+    for (const auto& sample : samples) {
+        buffer += sample;
+        sizes.push_back(sample.size());
+    }
+
+    ZDICT_fastCover_params_t params = {};
+    params.d = 8;
+    params.steps = 4;
+    params.zParams.compressionLevel = 3;
+    params.zParams.dictID = dict_id;
+
+    std::vector<char> dictionary(dict_size);
+    size_t size = ZDICT_optimizeTrainFromBuffer_fastCover(dictionary.data(), dictionary.size(), buffer.data(),
+                                                          sizes.data(), static_cast<unsigned>(sizes.size()), &params);
+    if (ZDICT_isError(size)) {
+        std::cerr << "Training failed: " << ZDICT_getErrorName(size) << std::endl;
+        return 1;
+    }
+
+    std::ofstream out(out_path, std::ios::binary);
+    out.write(dictionary.data(), static_cast<std::streamsize>(size));
+    if (!out) {
+        std::cerr << "Failed to write " << out_path << std::endl;
+        return 1;
+    }
+    std::cout << "Trained dictionary " << dict_id << " (" << size << " bytes) on " << samples.size()
+              << " samples: " << out_path << std::endl;
+    return 0;
+}
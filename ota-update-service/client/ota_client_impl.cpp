@@ -8,8 +8,11 @@
 #include <chrono>
 #include <openssl/sha.h>
 
-SimpleOTAClient::SimpleOTAClient(const std::string& server_address, int32_t user_device_id) {
-    auto channel = grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials());
+SimpleOTAClient::SimpleOTAClient(const std::string& server_address, int32_t user_device_id)
+    : SimpleOTAClient(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()), user_device_id) {
+}
+
+SimpleOTAClient::SimpleOTAClient(std::shared_ptr<grpc::Channel> channel, int32_t user_device_id) {
     stub = ota::OTAUpdateService::NewStub(channel);
     device_id = user_device_id;
     std::cout << "OTA Client initialized with device_id: " << device_id << std::endl;
@@ -9,6 +9,8 @@
 class SimpleOTAClient {
 public:
     SimpleOTAClient(const std::string& server_address, int32_t user_device_id);
+    // On a channel shared with other clients (device agent)
+    SimpleOTAClient(std::shared_ptr<grpc::Channel> channel, int32_t user_device_id);
     void CheckAndApplyUpdates();
 
 private:
@@ -6,6 +6,7 @@ class ConfigManager {
 public:
     static bool saveDeviceInfo(const std::string& hostname, const std::string& device_id);
     static bool loadDeviceInfo(std::string& hostname, std::string& device_id);
+    static void setConfigPath(const std::string& path);
     
 private:
     static std::string config_path;
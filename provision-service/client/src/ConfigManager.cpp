@@ -45,6 +45,10 @@ bool ConfigManager::loadDeviceInfo(std::string& hostname, std::string& device_id
     }
 }
 
+void ConfigManager::setConfigPath(const std::string& path) {
+    config_path = path;
+}
+
 void ConfigManager::ensureConfigDirExists() {
     std::filesystem::path dir = std::filesystem::path(config_path).parent_path();
     if (!std::filesystem::exists(dir)) {